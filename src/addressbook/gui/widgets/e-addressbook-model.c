@@ -43,6 +43,7 @@ struct _EAddressbookModelPrivate {
 
 	/* Query Results */
 	GPtrArray *contacts;
+	GHashTable *uid_to_index; /* const gchar *uid ~> index into 'contacts' */
 
 	/* Signal Handler IDs */
 	gulong create_contact_id;
@@ -81,6 +82,11 @@ enum {
 
 static guint signals[LAST_SIGNAL];
 
+/* When the removed contacts form more than this many separate ranges,
+ * the listeners are notified about all of them at once, to not make them
+ * update their views once for each range. */
+#define MAX_REMOVED_RANGES 8
+
 G_DEFINE_TYPE (EAddressbookModel, e_addressbook_model, G_TYPE_OBJECT)
 
 static void
@@ -88,11 +94,40 @@ free_data (EAddressbookModel *model)
 {
 	GPtrArray *array;
 
+	g_hash_table_remove_all (model->priv->uid_to_index);
+
 	array = model->priv->contacts;
 	g_ptr_array_foreach (array, (GFunc) g_object_unref, NULL);
 	g_ptr_array_set_size (array, 0);
 }
 
+static gint
+find_contact_index (EAddressbookModel *model,
+                    const gchar *uid)
+{
+	gpointer value = NULL;
+
+	if (!uid || !g_hash_table_lookup_extended (model->priv->uid_to_index, uid, NULL, &value))
+		return -1;
+
+	return GPOINTER_TO_INT (value);
+}
+
+static void
+set_contact_index (EAddressbookModel *model,
+                   EContact *contact,
+                   gint index)
+{
+	const gchar *uid;
+
+	uid = e_contact_get_const (contact, E_CONTACT_UID);
+
+	/* The key is owned by the contact, which is
+	 * kept in the 'contacts' array at the index. */
+	if (uid)
+		g_hash_table_replace (model->priv->uid_to_index, (gpointer) uid, GINT_TO_POINTER (index));
+}
+
 static void
 remove_book_view (EAddressbookModel *model)
 {
@@ -187,6 +222,7 @@ view_create_contact_cb (EBookClientView *client_view,
 		EContact *contact = contact_list->data;
 
 		g_ptr_array_add (array, g_object_ref (contact));
+		set_contact_index (model, contact, array->len - 1);
 		contact_list = contact_list->next;
 	}
 
@@ -204,58 +240,145 @@ sort_descending (gconstpointer ca,
 	return (a == b) ? 0 : (a < b) ? 1 : -1;
 }
 
+/* Removes all the contacts at the 'indices' in one pass. */
+static void
+compact_contacts (EAddressbookModel *model,
+                  GArray *indices)
+{
+	GPtrArray *array;
+	guint ii, jj;
+
+	array = model->priv->contacts;
+
+	for (ii = 0; ii < indices->len; ii++) {
+		gint index = g_array_index (indices, gint, ii);
+
+		g_object_unref (array->pdata[index]);
+		array->pdata[index] = NULL;
+	}
+
+	for (ii = 0, jj = 0; ii < array->len; ii++) {
+		EContact *contact = array->pdata[ii];
+
+		if (!contact)
+			continue;
+
+		if (ii != jj) {
+			array->pdata[jj] = contact;
+			set_contact_index (model, contact, jj);
+		}
+
+		jj++;
+	}
+
+	g_ptr_array_set_size (array, jj);
+}
+
+/* Removes the contacts of one continuous range, which
+ * is sorted in descending order, and notifies about it. */
+static void
+remove_contacts_range (EAddressbookModel *model,
+                       GArray *range)
+{
+	GPtrArray *array;
+	guint ii, first;
+
+	array = model->priv->contacts;
+	first = g_array_index (range, gint, range->len - 1);
+
+	for (ii = first; ii < first + range->len; ii++)
+		g_object_unref (array->pdata[ii]);
+
+	g_ptr_array_remove_range (array, first, range->len);
+
+	for (ii = first; ii < array->len; ii++)
+		set_contact_index (model, array->pdata[ii], ii);
+
+	g_signal_emit (model, signals[CONTACTS_REMOVED], 0, range);
+}
+
+/* The 'indices' are sorted in descending order. The removed contacts
+ * stay in place until their own range is removed, thus the listeners
+ * never see an index without a contact. */
+static void
+remove_contacts (EAddressbookModel *model,
+                 GArray *indices)
+{
+	GArray *range;
+	guint ii, n_ranges = 1;
+
+	for (ii = 1; ii < indices->len; ii++) {
+		if (g_array_index (indices, gint, ii) + 1 != g_array_index (indices, gint, ii - 1))
+			n_ranges++;
+	}
+
+	/* Too many ranges, compact the array at once and tell about
+	 * all the removed contacts with a single signal, like before. */
+	if (n_ranges > MAX_REMOVED_RANGES) {
+		compact_contacts (model, indices);
+		g_signal_emit (model, signals[CONTACTS_REMOVED], 0, indices);
+		return;
+	}
+
+	/* Remove and notify about each continuous range separately,
+	 * starting with the highest, thus the listeners see the row
+	 * count matching the notifications they received so far. */
+	range = g_array_new (FALSE, FALSE, sizeof (gint));
+
+	for (ii = 0; ii < indices->len; ii++) {
+		gint index = g_array_index (indices, gint, ii);
+
+		if (range->len > 0 && index + 1 != g_array_index (range, gint, range->len - 1)) {
+			remove_contacts_range (model, range);
+			g_array_set_size (range, 0);
+		}
+
+		g_array_append_val (range, index);
+	}
+
+	if (range->len > 0)
+		remove_contacts_range (model, range);
+
+	g_array_free (range, TRUE);
+}
+
 static void
 view_remove_contact_cb (EBookClientView *client_view,
                         const GSList *ids,
                         EAddressbookModel *model)
 {
-	/* XXX we should keep a hash around instead of this O(n*m) loop */
 	const GSList *iter;
 	GArray *indices;
 	GPtrArray *array;
-	gint ii;
 
 	array = model->priv->contacts;
 	indices = g_array_new (FALSE, FALSE, sizeof (gint));
 
 	for (iter = ids; iter != NULL; iter = iter->next) {
 		const gchar *target_uid = iter->data;
+		gint index;
 
-		for (ii = 0; ii < array->len; ii++) {
-			EContact *contact;
-			const gchar *uid;
-
-			contact = array->pdata[ii];
-			/* check if already removed */
-			if (!contact)
-				continue;
+		index = find_contact_index (model, target_uid);
+		if (index < 0 || index >= array->len)
+			continue;
 
-			uid = e_contact_get_const (contact, E_CONTACT_UID);
-			g_return_if_fail (uid != NULL);
+		/* The contact stays in the array until it is removed
+		 * with its range; without the UID it is not found
+		 * again when the 'ids' list it twice. */
+		g_hash_table_remove (model->priv->uid_to_index, target_uid);
+		g_array_append_val (indices, index);
+	}
 
-			if (strcmp (uid, target_uid) == 0) {
-				g_object_unref (contact);
-				g_array_append_val (indices, ii);
-				array->pdata[ii] = NULL;
-				break;
-			}
-		}
+	if (indices->len == 0) {
+		g_array_free (indices, TRUE);
+		return;
 	}
 
-	/* Sort the 'indices' array in descending order, since
-	 * g_ptr_array_remove_index() shifts subsequent elements
-	 * down one position to fill the gap. */
+	/* Listeners expect the indices in descending order. */
 	g_array_sort (indices, sort_descending);
 
-	for (ii = 0; ii < indices->len; ii++) {
-		gint index;
-
-		index = g_array_index (indices, gint, ii);
-		g_ptr_array_remove_index (array, index);
-	}
-
-	g_signal_emit (model, signals[CONTACTS_REMOVED], 0, indices);
-	g_array_free (indices, FALSE);
+	remove_contacts (model, indices);
+	g_array_free (indices, TRUE);
 
 	update_folder_bar_message (model);
 }
@@ -271,40 +394,35 @@ view_modify_contact_cb (EBookClientView *client_view,
 
 	while (contact_list != NULL) {
 		EContact *new_contact = contact_list->data;
+		EContact *old_contact;
 		const gchar *target_uid;
-		gint ii;
+		gint index;
 
 		target_uid = e_contact_get_const (new_contact, E_CONTACT_UID);
 		g_warn_if_fail (target_uid != NULL);
 
+		contact_list = contact_list->next;
+
 		/* skip contacts without UID */
-		if (!target_uid) {
-			contact_list = contact_list->next;
+		if (!target_uid)
 			continue;
-		}
-
-		for (ii = 0; ii < array->len; ii++) {
-			EContact *old_contact;
-			const gchar *uid;
 
-			old_contact = array->pdata[ii];
-			g_return_if_fail (old_contact != NULL);
-
-			uid = e_contact_get_const (old_contact, E_CONTACT_UID);
-			g_return_if_fail (uid != NULL);
+		index = find_contact_index (model, target_uid);
+		if (index < 0 || index >= array->len)
+			continue;
 
-			if (strcmp (uid, target_uid) != 0)
-				continue;
+		old_contact = array->pdata[index];
+		g_return_if_fail (old_contact != NULL);
 
-			g_object_unref (old_contact);
-			array->pdata[ii] = e_contact_duplicate (new_contact);
+		/* The key is owned by the old contact */
+		g_hash_table_remove (model->priv->uid_to_index, target_uid);
+		g_object_unref (old_contact);
 
-			g_signal_emit (
-				model, signals[CONTACT_CHANGED], 0, ii);
-			break;
-		}
+		array->pdata[index] = e_contact_duplicate (new_contact);
+		set_contact_index (model, array->pdata[index], index);
 
-		contact_list = contact_list->next;
+		g_signal_emit (
+			model, signals[CONTACT_CHANGED], 0, index);
 	}
 }
 
@@ -576,6 +694,7 @@ addressbook_model_finalize (GObject *object)
 
 	priv = E_ADDRESSBOOK_MODEL_GET_PRIVATE (object);
 
+	g_hash_table_destroy (priv->uid_to_index);
 	g_ptr_array_free (priv->contacts, TRUE);
 
 	/* Chain up to parent's finalize() method. */
@@ -768,6 +887,7 @@ e_addressbook_model_init (EAddressbookModel *model)
 {
 	model->priv = E_ADDRESSBOOK_MODEL_GET_PRIVATE (model);
 	model->priv->contacts = g_ptr_array_new ();
+	model->priv->uid_to_index = g_hash_table_new (g_str_hash, g_str_equal);
 	model->priv->first_get_view = TRUE;
 }
 
@@ -874,6 +994,16 @@ e_addressbook_model_find (EAddressbookModel *model,
 	g_return_val_if_fail (E_IS_CONTACT (contact), -1);
 
 	array = model->priv->contacts;
+
+	if (e_contact_get_const (contact, E_CONTACT_UID)) {
+		ii = find_contact_index (model, e_contact_get_const (contact, E_CONTACT_UID));
+
+		if (ii >= 0 && ii < array->len && array->pdata[ii] == contact)
+			return ii;
+
+		return -1;
+	}
+
 	for (ii = 0; ii < array->len; ii++) {
 		EContact *candidate = array->pdata[ii];
 
@@ -37,6 +37,9 @@ struct _EAddressbookReflowAdapterPrivate {
 
 	gboolean loading;
 
+	/* Reused to measure the minicards */
+	PangoLayout *height_layout;
+
 	gulong create_contact_id, remove_contact_id, modify_contact_id, model_changed_id;
 	gulong search_started_id, search_result_id;
 	gulong notify_client_id;
@@ -132,6 +135,8 @@ addressbook_dispose (GObject *object)
 	EAddressbookReflowAdapter *adapter = E_ADDRESSBOOK_REFLOW_ADAPTER (object);
 
 	unlink_model (adapter);
+
+	g_clear_object (&adapter->priv->height_layout);
 }
 
 static void
@@ -162,11 +167,25 @@ addressbook_height (EReflowModel *erm,
 	gint count = 0;
 	gchar *string;
 	EContact *contact = (EContact *) e_addressbook_model_contact_at (priv->model, i);
+	GtkWidget *widget;
 	PangoLayout *layout;
 	gint height;
 
-	layout = gtk_widget_create_pango_layout (
-		GTK_WIDGET (GNOME_CANVAS_ITEM (parent)->canvas), "");
+	widget = GTK_WIDGET (GNOME_CANVAS_ITEM (parent)->canvas);
+
+	/* Creating a layout for each contact is expensive,
+	 * thus reuse one as long as the widget's context. */
+	if (priv->height_layout == NULL ||
+	    pango_layout_get_context (priv->height_layout) !=
+	    gtk_widget_get_pango_context (widget)) {
+		g_clear_object (&priv->height_layout);
+		priv->height_layout = gtk_widget_create_pango_layout (widget, "");
+	} else {
+		/* The font could change meanwhile. */
+		pango_layout_context_changed (priv->height_layout);
+	}
+
+	layout = priv->height_layout;
 
 	string = e_contact_get (contact, E_CONTACT_FILE_AS);
 	height = text_height (layout, string ? string : "") + 10.0;
@@ -198,8 +217,6 @@ addressbook_height (EReflowModel *erm,
 	}
 	height += 2;
 
-	g_object_unref (layout);
-
 	return height;
 }
 
@@ -372,15 +389,23 @@ remove_contacts (EAddressbookModel *model,
                 EAddressbookReflowAdapter *adapter)
 {
 	GArray *indices = (GArray *) data;
-	gint count = indices->len;
+	guint ii, first = 0;
+
+	/* The indices are sorted in descending order; notify about
+	 * each continuous range of them, the highest first, thus
+	 * the lower indices stay valid for the view. */
+	for (ii = 1; ii <= indices->len; ii++) {
+		if (ii < indices->len &&
+		    g_array_index (indices, gint, ii) + 1 == g_array_index (indices, gint, ii - 1))
+			continue;
 
-	if (count == 1)
-		e_reflow_model_item_removed (
+		e_reflow_model_items_removed (
 			E_REFLOW_MODEL (adapter),
-			g_array_index (indices, gint, 0));
-	else
-		e_reflow_model_changed (E_REFLOW_MODEL (adapter));
+			g_array_index (indices, gint, ii - 1),
+			ii - first);
 
+		first = ii;
+	}
 }
 
 static void
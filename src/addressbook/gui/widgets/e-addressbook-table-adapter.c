@@ -406,15 +406,25 @@ remove_contacts (EAddressbookModel *model,
 {
 	GArray *indices = (GArray *) data;
 	gint count = indices->len;
+	gint first, last;
 
 	/* clear whole cache */
 	g_hash_table_remove_all (adapter->priv->emails);
 
 	e_table_model_pre_change (E_TABLE_MODEL (adapter));
-	if (count == 1)
+
+	if (count == 0) {
+		e_table_model_no_change (E_TABLE_MODEL (adapter));
+		return;
+	}
+
+	/* The indices are sorted in descending order */
+	last = g_array_index (indices, gint, 0);
+	first = g_array_index (indices, gint, count - 1);
+
+	if (last - first + 1 == count)
 		e_table_model_rows_deleted (
-			E_TABLE_MODEL (adapter),
-			g_array_index (indices, gint, 0), 1);
+			E_TABLE_MODEL (adapter), first, count);
 	else
 		e_table_model_changed (E_TABLE_MODEL (adapter));
 }
@@ -77,8 +77,32 @@ typedef struct {
 	 * table.  Thus a CQA exists <=> it has queued alarms.
 	 */
 	GHashTable *uid_alarms_hash;
+
+	/* Hash table of component key -> TriggerState, for all the components
+	 * seen in the view, whether they have queued alarms or not. */
+	GHashTable *trigger_states;
+
+	/* Timeout ID for saving the trigger states */
+	guint save_states_id;
 } ClientAlarms;
 
+/* What was already generated for a component, thus alarms are generated
+ * again only when it changes, or for the part of the window not covered
+ * yet.  It is saved together with the queued alarms of the component,
+ * thus these need not be generated again after a restart either.
+ */
+typedef struct {
+	/* Checksum of the component at the time of generating its alarms */
+	gchar *revision;
+
+	/* Alarms were generated up to this time */
+	time_t covered_until;
+
+	/* ECalComponentAlarmInstance-s read from the cache, until the view
+	 * reports the component */
+	GSList *cached_instances;
+} TriggerState;
+
 /* Pair of a ECalComponentAlarms and the mapping from queued alarm IDs to the
  * actual alarm instance structures.
  */
@@ -118,9 +142,18 @@ typedef struct {
 	guint snooze : 1;
 } QueuedAlarm;
 
-/* Alarm ID for the midnight refresh function */
-static gpointer midnight_refresh_id = NULL;
-static time_t midnight = 0;
+/* Alarms are loaded for a window of this many days, which is moved
+ * forward once half of it passed. */
+#define ALARM_HORIZON_DAYS 8
+
+/* Alarm ID for the horizon refresh function */
+static gpointer horizon_refresh_id = NULL;
+
+/* End of the window alarms are loaded for */
+static time_t horizon = 0;
+
+/* When the window is moved forward */
+static time_t horizon_refresh = 0;
 
 static void	remove_client_alarms		(ClientAlarms *ca);
 static void	display_notification		(time_t trigger,
@@ -160,8 +193,8 @@ static void	on_dialog_objs_removed_cb	(ECalClientView *view,
 
 /* Alarm queue engine */
 
-static void	load_alarms_for_today		(ClientAlarms *ca);
-static void	midnight_refresh_cb		(gpointer alarm_id,
+static void	load_alarms_in_horizon		(ClientAlarms *ca);
+static void	horizon_refresh_cb		(gpointer alarm_id,
 						 time_t trigger,
 						 gpointer data);
 
@@ -229,27 +262,37 @@ e_ctime (const time_t *timep)
 	return ret;
 }
 
-/* Queues an alarm trigger for midnight so that we can load the next
- * day's worth of alarms. */
+/* Moves the window alarms are loaded for and queues an alarm trigger
+ * to move it again once half of it passed. */
 static void
-queue_midnight_refresh (void)
+queue_horizon_refresh (void)
 {
 	icaltimezone *zone;
+	time_t now;
 
-	if (midnight_refresh_id != NULL) {
-		alarm_remove (midnight_refresh_id);
-		midnight_refresh_id = NULL;
+	if (horizon_refresh_id != NULL) {
+		alarm_remove (horizon_refresh_id);
+		horizon_refresh_id = NULL;
 	}
 
 	zone = config_data_get_timezone ();
-	midnight = time_day_end_with_zone (time (NULL), zone);
-
-	debug (("Refresh at %s", e_ctime (&midnight)));
+	now = time (NULL);
 
-	midnight_refresh_id = alarm_add (
-		midnight, midnight_refresh_cb, NULL, NULL);
-	if (!midnight_refresh_id) {
-		debug (("Could not setup the midnight refresh alarm"));
+	/* Add one hour after midnight, just to cover the delay in 30 minutes
+	 * refresh checking. */
+	horizon = time_day_end_with_zone (
+		time_add_day_with_zone (now, ALARM_HORIZON_DAYS - 1, zone),
+		zone) + (60 * 60);
+	horizon_refresh = time_day_end_with_zone (
+		time_add_day_with_zone (now, ALARM_HORIZON_DAYS / 2 - 1, zone),
+		zone);
+
+	debug (("Loading up to %s, refresh at %s", e_ctime (&horizon), e_ctime (&horizon_refresh)));
+
+	horizon_refresh_id = alarm_add (
+		horizon_refresh, horizon_refresh_cb, NULL, NULL);
+	if (!horizon_refresh_id) {
+		debug (("Could not setup the horizon refresh alarm"));
 		/* FIXME: what to do? */
 	}
 }
@@ -264,47 +307,334 @@ add_client_alarms_cb (gpointer key,
 
 	debug (("Adding %p", ca));
 
-	load_alarms_for_today (ca);
+	load_alarms_in_horizon (ca);
 }
 
-struct _midnight_refresh_msg {
+struct _horizon_refresh_msg {
 	Message header;
-	gboolean remove;
 };
 
-/* Loads the alarms for the new day every midnight */
+/* Moves the window forward.  The views report all their components
+ * again, but only the alarms past the previous window are generated
+ * for those which did not change. */
 static void
-midnight_refresh_async (struct _midnight_refresh_msg *msg)
+horizon_refresh_async (struct _horizon_refresh_msg *msg)
 {
 	debug (("..."));
 
+	/* Re-schedule the horizon update */
+	queue_horizon_refresh ();
+
 	/* Re-load the alarms for all clients */
 	g_hash_table_foreach (client_alarms_hash, add_client_alarms_cb, NULL);
 
-	/* Re-schedule the midnight update */
-	if (msg->remove && midnight_refresh_id != NULL) {
-		debug (("Reschedule the midnight update"));
-		alarm_remove (midnight_refresh_id);
-		midnight_refresh_id = NULL;
+	g_slice_free (struct _horizon_refresh_msg, msg);
+}
+
+static void
+horizon_refresh_cb (gpointer alarm_id,
+                    time_t trigger,
+                    gpointer data)
+{
+	struct _horizon_refresh_msg *msg;
+
+	/* The alarm is freed after this callback returns. */
+	horizon_refresh_id = NULL;
+
+	msg = g_slice_new0 (struct _horizon_refresh_msg);
+	msg->header.func = (MessageFunc) horizon_refresh_async;
+
+	message_push ((Message *) msg);
+}
+
+static void
+trigger_state_clear_cached (TriggerState *state)
+{
+	GSList *link;
+
+	for (link = state->cached_instances; link; link = g_slist_next (link)) {
+		ECalComponentAlarmInstance *instance = link->data;
+
+		if (instance) {
+			g_free ((gchar *) instance->auid);
+			g_free (instance);
+		}
+	}
+
+	g_slist_free (state->cached_instances);
+	state->cached_instances = NULL;
+}
+
+static void
+trigger_state_free (TriggerState *state)
+{
+	trigger_state_clear_cached (state);
+	g_free (state->revision);
+	g_free (state);
+}
+
+static gchar *
+trigger_state_key (const ECalComponentId *id)
+{
+	return g_strconcat (id->uid, "\n", id->rid ? id->rid : "", NULL);
+}
+
+/* The generated alarms depend on the component and the timezone */
+static gchar *
+trigger_state_revision (ECalComponent *comp)
+{
+	icaltimezone *zone;
+	GChecksum *checksum;
+	gchar *revision;
+	gchar *str;
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA1);
+
+	str = e_cal_component_get_as_string (comp);
+	if (str)
+		g_checksum_update (checksum, (const guchar *) str, -1);
+	g_free (str);
+
+	zone = config_data_get_timezone ();
+	if (zone && icaltimezone_get_location (zone))
+		g_checksum_update (checksum, (const guchar *) icaltimezone_get_location (zone), -1);
+
+	revision = g_strdup (g_checksum_get_string (checksum));
+	g_checksum_free (checksum);
+
+	return revision;
+}
+
+static gchar *
+trigger_states_filename (ClientAlarms *ca)
+{
+	ESource *source;
+
+	source = e_client_get_source (E_CLIENT (ca->cal_client));
+
+	return g_build_filename (
+		e_get_user_cache_dir (), "alarm-notify",
+		e_source_get_uid (source), NULL);
+}
+
+/* Reads the trigger states saved by save_trigger_states().  Each line
+ * is either "S key revision covered-until" for a component, or
+ * "I auid trigger occur-start occur-end" for its queued alarms. */
+static void
+load_trigger_states (ClientAlarms *ca)
+{
+	TriggerState *state = NULL;
+	gchar *filename;
+	gchar *contents = NULL;
+	gchar **lines;
+	guint ii;
+
+	filename = trigger_states_filename (ca);
+
+	if (!g_file_get_contents (filename, &contents, NULL, NULL)) {
+		g_free (filename);
+		return;
+	}
+
+	lines = g_strsplit (contents, "\n", -1);
+
+	for (ii = 0; lines[ii]; ii++) {
+		gchar **fields;
+		guint n_fields;
+
+		fields = g_strsplit (lines[ii], "\t", -1);
+		n_fields = g_strv_length (fields);
+
+		if (n_fields == 4 && g_str_equal (fields[0], "S")) {
+			state = g_new0 (TriggerState, 1);
+			state->revision = g_strdup (fields[2]);
+			state->covered_until = (time_t) g_ascii_strtoll (fields[3], NULL, 10);
+
+			g_hash_table_insert (
+				ca->trigger_states,
+				g_strcompress (fields[1]), state);
+		} else if (n_fields == 5 && g_str_equal (fields[0], "I") && state) {
+			ECalComponentAlarmInstance *instance;
+
+			instance = g_new0 (ECalComponentAlarmInstance, 1);
+			instance->auid = g_strcompress (fields[1]);
+			instance->trigger = (time_t) g_ascii_strtoll (fields[2], NULL, 10);
+			instance->occur_start = (time_t) g_ascii_strtoll (fields[3], NULL, 10);
+			instance->occur_end = (time_t) g_ascii_strtoll (fields[4], NULL, 10);
+
+			state->cached_instances = g_slist_prepend (
+				state->cached_instances, instance);
+		}
+
+		g_strfreev (fields);
 	}
 
-	queue_midnight_refresh ();
+	debug (("Read %d trigger states from %s", g_hash_table_size (ca->trigger_states), filename));
 
-	g_slice_free (struct _midnight_refresh_msg, msg);
+	g_strfreev (lines);
+	g_free (contents);
+	g_free (filename);
 }
 
 static void
-midnight_refresh_cb (gpointer alarm_id,
-                     time_t trigger,
-                     gpointer data)
+save_trigger_states (ClientAlarms *ca)
+{
+	GHashTable *cqa_by_key;
+	GHashTableIter iter;
+	gpointer key, value;
+	GString *contents;
+	gchar *filename;
+	gchar *dirname;
+	time_t now;
+	GError *error = NULL;
+
+	cqa_by_key = g_hash_table_new_full (
+		g_str_hash, g_str_equal, g_free, NULL);
+
+	g_hash_table_iter_init (&iter, ca->uid_alarms_hash);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		CompQueuedAlarms *cqa = value;
+
+		if (cqa->alarms != NULL)
+			g_hash_table_insert (
+				cqa_by_key, trigger_state_key (cqa->id), cqa);
+	}
+
+	contents = g_string_sized_new (1024);
+	now = time (NULL);
+
+	g_hash_table_iter_init (&iter, ca->trigger_states);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		TriggerState *state = value;
+		CompQueuedAlarms *cqa;
+		GSList *link;
+		gchar *escaped;
+
+		/* These would be generated again anyway. */
+		if (state->covered_until < now)
+			continue;
+
+		escaped = g_strescape (key, NULL);
+		g_string_append_printf (
+			contents, "S\t%s\t%s\t%" G_GINT64_FORMAT "\n",
+			escaped, state->revision, (gint64) state->covered_until);
+		g_free (escaped);
+
+		cqa = g_hash_table_lookup (cqa_by_key, key);
+		link = cqa ? cqa->queued_alarms : state->cached_instances;
+
+		for (; link; link = g_slist_next (link)) {
+			ECalComponentAlarmInstance *instance;
+
+			if (cqa) {
+				QueuedAlarm *qa = link->data;
+
+				/* Snoozed alarms are not restored on restart. */
+				if (qa->snooze)
+					continue;
+
+				instance = qa->instance;
+			} else {
+				instance = link->data;
+			}
+
+			if (!instance)
+				continue;
+
+			escaped = g_strescape (instance->auid, NULL);
+			g_string_append_printf (
+				contents, "I\t%s\t%" G_GINT64_FORMAT "\t%"
+				G_GINT64_FORMAT "\t%" G_GINT64_FORMAT "\n",
+				escaped, (gint64) instance->trigger,
+				(gint64) instance->occur_start,
+				(gint64) instance->occur_end);
+			g_free (escaped);
+		}
+	}
+
+	filename = trigger_states_filename (ca);
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+
+	if (!g_file_set_contents (filename, contents->str, contents->len, &error)) {
+		g_warning ("%s: Failed to save '%s': %s", G_STRFUNC, filename, error->message);
+		g_clear_error (&error);
+	}
+
+	g_hash_table_destroy (cqa_by_key);
+	g_string_free (contents, TRUE);
+	g_free (dirname);
+	g_free (filename);
+}
+
+struct _save_states_msg {
+	Message header;
+	ECalClient *cal_client;
+	guint source_id;
+};
+
+static ClientAlarms *lookup_client (ECalClient *cal_client);
+
+/* Runs with the other messages, thus the tables
+ * are not modified while they are being saved. */
+static void
+save_trigger_states_async (struct _save_states_msg *msg)
+{
+	ClientAlarms *ca = NULL;
+
+	if (alarm_queue_inited && client_alarms_hash != NULL)
+		ca = lookup_client (msg->cal_client);
+
+	/* The client could be removed meanwhile, or its states
+	 * saved and the save scheduled again. */
+	if (ca != NULL && ca->trigger_states != NULL &&
+	    ca->save_states_id == msg->source_id) {
+		ca->save_states_id = 0;
+		save_trigger_states (ca);
+	}
+
+	g_object_unref (msg->cal_client);
+	g_slice_free (struct _save_states_msg, msg);
+}
+
+static gboolean
+save_trigger_states_cb (gpointer user_data)
 {
-	struct _midnight_refresh_msg *msg;
+	struct _save_states_msg *msg;
 
-	msg = g_slice_new0 (struct _midnight_refresh_msg);
-	msg->header.func = (MessageFunc) midnight_refresh_async;
-	msg->remove = TRUE;
+	msg = g_slice_new0 (struct _save_states_msg);
+	msg->header.func = (MessageFunc) save_trigger_states_async;
+	msg->cal_client = g_object_ref (user_data);
+	msg->source_id = g_source_get_id (g_main_current_source ());
 
 	message_push ((Message *) msg);
+
+	return FALSE;
+}
+
+static void
+schedule_save_trigger_states (ClientAlarms *ca)
+{
+	if (ca->save_states_id == 0)
+		ca->save_states_id = e_named_timeout_add_seconds_full (
+			G_PRIORITY_DEFAULT, 30,
+			save_trigger_states_cb,
+			g_object_ref (ca->cal_client),
+			(GDestroyNotify) g_object_unref);
+}
+
+/* Saves pending changes and frees the trigger states of a client.
+ * A scheduled save is not removed here, it finds out it's stale. */
+static void
+finish_trigger_states (ClientAlarms *ca)
+{
+	if (ca->save_states_id != 0) {
+		ca->save_states_id = 0;
+		save_trigger_states (ca);
+	}
+
+	g_hash_table_destroy (ca->trigger_states);
+	ca->trigger_states = NULL;
 }
 
 /* Looks up a client in the client alarms hash table */
@@ -577,34 +907,17 @@ alarm_trigger_cb (gpointer alarm_id,
 	debug (("Notification sent: %d", action));
 }
 
-/* Adds the alarms in a ECalComponentAlarms structure to the alarms queued for a
- * particular client.  Also puts the triggers in the alarm timer queue.
+/* Puts the given alarm instances of a component, which are part of
+ * cqa->alarms, in the alarm timer queue.
  */
 static void
-add_component_alarms (ClientAlarms *ca,
-                      ECalComponentAlarms *alarms)
+queue_alarm_instances (CompQueuedAlarms *cqa,
+                       GSList *instances)
 {
-	ECalComponentId *id;
-	CompQueuedAlarms *cqa;
+	GSList *queued_alarms = NULL;
 	GSList *l;
 
-	/* No alarms? */
-	if (alarms == NULL || alarms->alarms == NULL) {
-		debug (("No alarms to add"));
-		if (alarms)
-			e_cal_component_alarms_free (alarms);
-		return;
-	}
-
-	cqa = g_new (CompQueuedAlarms, 1);
-	cqa->parent_client = ca;
-	cqa->alarms = alarms;
-	cqa->expecting_update = FALSE;
-
-	cqa->queued_alarms = NULL;
-	debug (("Creating CQA %p", cqa));
-
-	for (l = alarms->alarms; l; l = l->next) {
+	for (l = instances; l; l = l->next) {
 		ECalComponentAlarmInstance *instance;
 		gpointer alarm_id;
 		QueuedAlarm *qa;
@@ -625,9 +938,42 @@ add_component_alarms (ClientAlarms *ca,
 		qa->orig_trigger = instance->trigger;
 		qa->snooze = FALSE;
 
-		cqa->queued_alarms = g_slist_prepend (cqa->queued_alarms, qa);
+		queued_alarms = g_slist_prepend (queued_alarms, qa);
+		debug (("Adding %p to queue", qa));
 	}
 
+	cqa->queued_alarms = g_slist_concat (
+		cqa->queued_alarms, g_slist_reverse (queued_alarms));
+}
+
+/* Adds the alarms in a ECalComponentAlarms structure to the alarms queued for a
+ * particular client.  Also puts the triggers in the alarm timer queue.
+ */
+static void
+add_component_alarms (ClientAlarms *ca,
+                      ECalComponentAlarms *alarms)
+{
+	ECalComponentId *id;
+	CompQueuedAlarms *cqa;
+
+	/* No alarms? */
+	if (alarms == NULL || alarms->alarms == NULL) {
+		debug (("No alarms to add"));
+		if (alarms)
+			e_cal_component_alarms_free (alarms);
+		return;
+	}
+
+	cqa = g_new (CompQueuedAlarms, 1);
+	cqa->parent_client = ca;
+	cqa->alarms = alarms;
+	cqa->expecting_update = FALSE;
+
+	cqa->queued_alarms = NULL;
+	debug (("Creating CQA %p", cqa));
+
+	queue_alarm_instances (cqa, alarms->alarms);
+
 	id = e_cal_component_get_id (alarms->comp);
 
 	/* If we failed to add all the alarms, then we should get rid of the cqa */
@@ -639,7 +985,6 @@ add_component_alarms (ClientAlarms *ca,
 		return;
 	}
 
-	cqa->queued_alarms = g_slist_reverse (cqa->queued_alarms);
 	cqa->id = id;
 	debug (("Alarm added for %s", id->uid));
 	g_hash_table_insert (ca->uid_alarms_hash, cqa->id, cqa);
@@ -715,11 +1060,11 @@ load_alarms (ClientAlarms *ca,
 	g_free (str_query);
 }
 
-/* Loads today's remaining alarms for a client */
+/* Loads the remaining alarms in the window for a client */
 static void
-load_alarms_for_today (ClientAlarms *ca)
+load_alarms_in_horizon (ClientAlarms *ca)
 {
-	time_t now, from, day_end, day_start;
+	time_t now, from, day_start;
 	icaltimezone *zone;
 
 	now = time (NULL);
@@ -735,11 +1080,8 @@ load_alarms_for_today (ClientAlarms *ca)
 	if (from <= 0)
 		from = MAX (from, day_start);
 
-	/* Add one hour after midnight, just to cover the delay in 30 minutes
-	 * midnight checking. */
-	day_end = time_day_end_with_zone (now, zone) + (60 * 60);
-	debug (("From %s to %s", e_ctime (&from), e_ctime (&day_end)));
-	load_alarms (ca, from, day_end);
+	debug (("From %s to %s", e_ctime (&from), e_ctime (&horizon)));
+	load_alarms (ca, from, horizon);
 }
 
 /* Looks up a component's queued alarm structure in a client alarms structure */
@@ -843,53 +1185,61 @@ duplicate_ecal (const GSList *in_list)
 	return g_slist_reverse (out_list);
 }
 
-static gboolean
-get_alarms_for_object (ECalClient *cal_client,
-                       const ECalComponentId *id,
-                       time_t start,
-                       time_t end,
-                       ECalComponentAlarms **alarms)
+static ECalComponentAlarms *
+generate_alarms (ClientAlarms *ca,
+                 ECalComponent *comp,
+                 time_t start,
+                 time_t end)
 {
-	icalcomponent *icalcomp = NULL;
-	ECalComponent *comp;
 	ECalComponentAlarmAction omit[] = {-1};
 
-	g_return_val_if_fail (cal_client != NULL, FALSE);
-	g_return_val_if_fail (id != NULL, FALSE);
-	g_return_val_if_fail (alarms != NULL, FALSE);
-	g_return_val_if_fail (start >= 0 && end >= 0, FALSE);
-	g_return_val_if_fail (start <= end, FALSE);
+	if (start >= end)
+		return NULL;
 
-	e_cal_client_get_object_sync (
-		cal_client, id->uid, id->rid, &icalcomp, NULL, NULL);
+	return e_cal_util_generate_alarms_for_comp (
+		comp, start, end, omit, e_cal_client_resolve_tzid_cb,
+		ca->cal_client, config_data_get_timezone ());
+}
 
-	if (icalcomp == NULL)
-		return FALSE;
+/* Prepends the instances read from the cache, which are not
+ * in the past, to the generated alarms. */
+static ECalComponentAlarms *
+merge_cached_alarms (ECalComponent *comp,
+                     TriggerState *state,
+                     time_t from,
+                     ECalComponentAlarms *alarms)
+{
+	GSList *cached = NULL;
+	GSList *link;
 
-	comp = e_cal_component_new ();
-	if (!e_cal_component_set_icalcomponent (comp, icalcomp)) {
-		icalcomponent_free (icalcomp);
-		g_object_unref (comp);
-		return FALSE;
+	for (link = state->cached_instances; link; link = g_slist_next (link)) {
+		ECalComponentAlarmInstance *instance = link->data;
+
+		if (instance && instance->trigger >= from) {
+			cached = g_slist_prepend (cached, instance);
+			link->data = NULL;
+		}
 	}
 
-	*alarms = e_cal_util_generate_alarms_for_comp (
-		comp, start, end, omit, e_cal_client_resolve_tzid_cb,
-		cal_client, config_data_get_timezone ());
+	if (cached == NULL)
+		return alarms;
+
+	if (alarms == NULL) {
+		alarms = g_new0 (ECalComponentAlarms, 1);
+		alarms->comp = g_object_ref (comp);
+	}
 
-	g_object_unref (comp);
+	alarms->alarms = g_slist_concat (g_slist_reverse (cached), alarms->alarms);
 
-	return TRUE;
+	return alarms;
 }
 
 static void
 query_objects_changed_async (struct _query_msg *msg)
 {
 	ClientAlarms *ca;
-	time_t from, day_end;
+	time_t from;
 	ECalComponentAlarms *alarms;
-	gboolean found;
-	icaltimezone *zone;
 	CompQueuedAlarms *cqa;
 	GSList *l;
 	GSList *objects;
@@ -903,41 +1253,75 @@ query_objects_changed_async (struct _query_msg *msg)
 	else
 		from += 1; /* we add 1 to make sure the alarm is not displayed twice */
 
-	zone = config_data_get_timezone ();
-
-	day_end = time_day_end_with_zone (time (NULL), zone);
-
 	for (l = objects; l != NULL; l = l->next) {
 		ECalComponentId *id;
-		GSList *sl;
+		TriggerState *state;
+		gchar *key, *revision;
 		ECalComponent *comp = e_cal_component_new ();
 
 		e_cal_component_set_icalcomponent (comp, l->data);
 
 		id = e_cal_component_get_id (comp);
-		found = get_alarms_for_object (ca->cal_client, id, from, day_end, &alarms);
+		key = trigger_state_key (id);
+		revision = trigger_state_revision (comp);
+
+		cqa = lookup_comp_queued_alarms (ca, id);
+		state = g_hash_table_lookup (ca->trigger_states, key);
+
+		if (state != NULL && g_str_equal (state->revision, revision)) {
+			/* The component did not change, like when the window
+			 * moved forward, thus only the alarms past the part
+			 * of the window already covered are generated. */
+			alarms = generate_alarms (
+				ca, comp, MAX (state->covered_until, from), horizon);
+
+			if (cqa != NULL && cqa->alarms != NULL) {
+				if (alarms != NULL) {
+					GSList *instances = alarms->alarms;
+
+					debug (("Extending alarms of %s", id->uid));
+
+					cqa->alarms->alarms = g_slist_concat (
+						cqa->alarms->alarms, instances);
+					alarms->alarms = NULL;
+					e_cal_component_alarms_free (alarms);
+
+					queue_alarm_instances (cqa, instances);
+				}
+			} else {
+				alarms = merge_cached_alarms (comp, state, from, alarms);
+				add_component_alarms (ca, alarms);
+			}
+
+			trigger_state_clear_cached (state);
+			state->covered_until = MAX (state->covered_until, horizon);
 
-		if (!found) {
-			debug (("No Alarm found for client %p", ca->cal_client));
-			tray_list_remove_cqa (lookup_comp_queued_alarms (ca, id));
-			remove_comp (ca, id);
-			g_hash_table_remove (ca->uid_alarms_hash, id);
 			e_cal_component_free_id (id);
 			g_object_unref (comp);
-			comp = NULL;
+			g_free (revision);
+			g_free (key);
 			continue;
 		}
 
-		cqa = lookup_comp_queued_alarms (ca, id);
+		alarms = generate_alarms (ca, comp, from, horizon);
+
+		state = g_new0 (TriggerState, 1);
+		state->revision = revision;
+		state->covered_until = horizon;
+		g_hash_table_replace (ca->trigger_states, key, state);
+
 		if (!cqa) {
 			debug (("No currently queued alarms for %s", id->uid));
 			add_component_alarms (ca, alarms);
+			e_cal_component_free_id (id);
 			g_object_unref (comp);
 			comp = NULL;
 			continue;
 		}
 
 		debug (("Alarm Already Exist for %s", id->uid));
+		e_cal_component_free_id (id);
+
 		/* If the alarms or the alarms list is empty,
 		 * remove it after updating the cqa structure. */
 		if (alarms == NULL || alarms->alarms == NULL) {
@@ -957,35 +1341,15 @@ query_objects_changed_async (struct _query_msg *msg)
 		cqa->queued_alarms = NULL;
 
 		/* add the new alarms */
-		for (sl = cqa->alarms->alarms; sl; sl = sl->next) {
-			ECalComponentAlarmInstance *instance;
-			gpointer alarm_id;
-			QueuedAlarm *qa;
-
-			instance = sl->data;
+		queue_alarm_instances (cqa, cqa->alarms->alarms);
 
-			if (!has_known_notification (cqa->alarms->comp, instance->auid))
-				continue;
-
-			alarm_id = alarm_add (instance->trigger, alarm_trigger_cb, cqa, NULL);
-			if (!alarm_id)
-				continue;
-
-			qa = g_new0 (QueuedAlarm, 1);
-			qa->alarm_id = alarm_id;
-			qa->instance = instance;
-			qa->snooze = FALSE;
-			qa->orig_trigger = instance->trigger;
-			cqa->queued_alarms = g_slist_prepend (cqa->queued_alarms, qa);
-			debug (("Adding %p to queue", qa));
-		}
-
-		cqa->queued_alarms = g_slist_reverse (cqa->queued_alarms);
 		g_object_unref (comp);
 		comp = NULL;
 	}
 	g_slist_free (objects);
 
+	schedule_save_trigger_states (ca);
+
 	g_slice_free (struct _query_msg, msg);
 }
 
@@ -1020,6 +1384,12 @@ query_objects_removed_async (struct _query_msg *msg)
 	debug (("Removing %d objects", g_slist_length (objects)));
 
 	for (l = objects; l != NULL; l = l->next) {
+		gchar *key;
+
+		key = trigger_state_key (l->data);
+		g_hash_table_remove (ca->trigger_states, key);
+		g_free (key);
+
 		/* If the alarm is already triggered remove it. */
 		tray_list_remove_cqa (lookup_comp_queued_alarms (ca, l->data));
 		remove_comp (ca, l->data);
@@ -1029,6 +1399,8 @@ query_objects_removed_async (struct _query_msg *msg)
 
 	g_slist_free (objects);
 
+	schedule_save_trigger_states (ca);
+
 	g_slice_free (struct _query_msg, msg);
 }
 
@@ -2194,22 +2566,15 @@ procedure_notification (time_t trigger,
 }
 
 static gboolean
-check_midnight_refresh (gpointer user_data)
+check_horizon_refresh (gpointer user_data)
 {
-	time_t new_midnight;
-	icaltimezone *zone;
-
 	debug (("..."));
 
-	zone = config_data_get_timezone ();
-	new_midnight = time_day_end_with_zone (time (NULL), zone);
-
-	if (new_midnight > midnight) {
-		struct _midnight_refresh_msg *msg;
+	if (time (NULL) >= horizon_refresh) {
+		struct _horizon_refresh_msg *msg;
 
-		msg = g_slice_new0 (struct _midnight_refresh_msg);
-		msg->header.func = (MessageFunc) midnight_refresh_async;
-		msg->remove = FALSE;
+		msg = g_slice_new0 (struct _horizon_refresh_msg);
+		msg->header.func = (MessageFunc) horizon_refresh_async;
 
 		message_push ((Message *) msg);
 	}
@@ -2231,7 +2596,7 @@ check_wall_clock_time_changed (gpointer user_data)
 	if (wall_clock_time > ADD_SECONDS (expected_wall_clock_time, 1) ||
 	    wall_clock_time < ADD_SECONDS (expected_wall_clock_time, -1)) {
 		debug (("Current wall-clock time differs from expected, rescheduling alarms"));
-		check_midnight_refresh (NULL);
+		check_horizon_refresh (NULL);
 		alarm_reschedule_timeout ();
 	}
 
@@ -2257,7 +2622,7 @@ alarm_queue_init (gpointer data)
 	debug (("..."));
 
 	client_alarms_hash = g_hash_table_new (g_direct_hash, g_direct_equal);
-	queue_midnight_refresh ();
+	queue_horizon_refresh ();
 
 	if (config_data_get_last_notification_time (NULL) == -1) {
 		time_t tmval = time_day_begin (time (NULL));
@@ -2266,8 +2631,8 @@ alarm_queue_init (gpointer data)
 	}
 
 	/* Install timeout handler (every 30 mins) for not missing the
-	 * midnight refresh. */
-	e_named_timeout_add_seconds (1800, check_midnight_refresh, NULL);
+	 * horizon refresh. */
+	e_named_timeout_add_seconds (1800, check_horizon_refresh, NULL);
 
 	/* Monotonic time doesn't change during hibernation, while the
 	 * wall clock time does, thus check for wall clock time changes
@@ -2291,6 +2656,7 @@ free_client_alarms_cb (gpointer key,
 	debug (("ca=%p", ca));
 
 	if (ca) {
+		finish_trigger_states (ca);
 		remove_client_alarms (ca);
 		if (ca->cal_client) {
 			debug (("Disconnecting Client"));
@@ -2341,9 +2707,9 @@ alarm_queue_done (void)
 	g_hash_table_destroy (client_alarms_hash);
 	client_alarms_hash = NULL;
 
-	if (midnight_refresh_id != NULL) {
-		alarm_remove (midnight_refresh_id);
-		midnight_refresh_id = NULL;
+	if (horizon_refresh_id != NULL) {
+		alarm_remove (horizon_refresh_id);
+		horizon_refresh_id = NULL;
 	}
 
 	alarm_queue_inited = FALSE;
@@ -2405,13 +2771,19 @@ alarm_queue_add_async (struct _alarm_client_msg *msg)
 
 	ca->cal_client = cal_client;
 	ca->view = NULL;
+	ca->save_states_id = 0;
 
 	g_hash_table_insert (client_alarms_hash, cal_client, ca);
 
 	ca->uid_alarms_hash = g_hash_table_new (
 		(GHashFunc) hash_ids, (GEqualFunc) compare_ids);
 
-	load_alarms_for_today (ca);
+	ca->trigger_states = g_hash_table_new_full (
+		g_str_hash, g_str_equal, g_free,
+		(GDestroyNotify) trigger_state_free);
+
+	load_trigger_states (ca);
+	load_alarms_in_horizon (ca);
 
 	g_slice_free (struct _alarm_client_msg, msg);
 }
@@ -2509,6 +2881,7 @@ alarm_queue_remove_async (struct _alarm_client_msg *msg)
 	g_return_if_fail (ca != NULL);
 
 	debug (("..."));
+	finish_trigger_states (ca);
 	remove_client_alarms (ca);
 
 	/* Clean up */
@@ -2582,7 +2955,7 @@ update_cqa (CompQueuedAlarms *cqa,
 
 	zone = config_data_get_timezone ();
 	from = time_day_begin_with_zone (time (NULL), zone);
-	to = time_day_end_with_zone (time (NULL), zone);
+	to = MAX (horizon, time_day_end_with_zone (time (NULL), zone));
 
 	debug (("Generating alarms between %s and %s", e_ctime (&from), e_ctime (&to)));
 	alarms = e_cal_util_generate_alarms_for_comp (
@@ -36,8 +36,11 @@
 /* Our glib timeout */
 static guint timeout_id;
 
-/* The list of pending alarms */
-static GList *alarms = NULL;
+/* The pending alarms, as a binary min-heap ordered by the trigger time */
+static GPtrArray *alarms = NULL;
+
+/* The same alarms, as IDs passed to alarm_remove() may be stale */
+static GHashTable *alarm_ids = NULL;
 
 /* A queued alarm structure */
 typedef struct {
@@ -45,26 +48,102 @@ typedef struct {
 	AlarmFunction      alarm_fn;
 	gpointer           data;
 	AlarmDestroyNotify destroy_notify_fn;
+
+	/* Position in the heap, to remove the alarm without a lookup */
+	guint              heap_index;
 } AlarmRecord;
 
 static void setup_timeout (void);
 
+#define HEAP_RECORD(ii) ((AlarmRecord *) g_ptr_array_index (alarms, (ii)))
+#define HEAP_HEAD() (alarms && alarms->len > 0 ? HEAP_RECORD (0) : NULL)
+
+static void
+heap_set (guint index,
+          AlarmRecord *ar)
+{
+	alarms->pdata[index] = ar;
+	ar->heap_index = index;
+}
+
+static void
+heap_sift_up (guint index)
+{
+	AlarmRecord *ar = HEAP_RECORD (index);
+
+	while (index > 0) {
+		guint parent = (index - 1) / 2;
+
+		if (HEAP_RECORD (parent)->trigger <= ar->trigger)
+			break;
+
+		heap_set (index, HEAP_RECORD (parent));
+		index = parent;
+	}
+
+	heap_set (index, ar);
+}
+
+static void
+heap_sift_down (guint index)
+{
+	AlarmRecord *ar = HEAP_RECORD (index);
+
+	while (TRUE) {
+		guint child = 2 * index + 1;
+
+		if (child >= alarms->len)
+			break;
+
+		if (child + 1 < alarms->len &&
+		    HEAP_RECORD (child + 1)->trigger < HEAP_RECORD (child)->trigger)
+			child++;
+
+		if (ar->trigger <= HEAP_RECORD (child)->trigger)
+			break;
+
+		heap_set (index, HEAP_RECORD (child));
+		index = child;
+	}
+
+	heap_set (index, ar);
+}
+
+/* Takes the alarm out of the heap.  Does not free it. */
+static void
+heap_remove (AlarmRecord *ar)
+{
+	AlarmRecord *last;
+	guint index = ar->heap_index;
+
+	last = g_ptr_array_remove_index (alarms, alarms->len - 1);
+
+	if (last == ar)
+		return;
+
+	heap_set (index, last);
+
+	if (index > 0 && HEAP_RECORD ((index - 1) / 2)->trigger > last->trigger)
+		heap_sift_up (index);
+	else
+		heap_sift_down (index);
+}
+
 /* Removes the head alarm from the queue.  Does not touch the timeout_id. */
 static void
 pop_alarm (void)
 {
 	AlarmRecord *ar;
-	GList *l;
 
-	if (!alarms) {
+	ar = HEAP_HEAD ();
+
+	if (!ar) {
 		g_warning ("Nothing to pop from the alarm queue");
 		return;
 	}
 
-	ar = alarms->data;
-
-	l = alarms;
-	alarms = g_list_delete_link (alarms, l);
+	heap_remove (ar);
+	g_hash_table_remove (alarm_ids, ar);
 
 	g_free (ar);
 }
@@ -75,7 +154,7 @@ alarm_ready_cb (gpointer data)
 {
 	time_t now;
 
-	if (!alarms) {
+	if (!HEAP_HEAD ()) {
 		g_warning ("Alarm triggered, but no alarm present\n");
 		return FALSE;
 	}
@@ -85,11 +164,11 @@ alarm_ready_cb (gpointer data)
 	now = time (NULL);
 
 	debug (("Alarm callback!"));
-	while (alarms) {
+	while (HEAP_HEAD ()) {
 		AlarmRecord *notify_id, *ar;
 		AlarmRecord ar_copy;
 
-		ar = alarms->data;
+		ar = HEAP_HEAD ();
 
 		if (ar->trigger > now)
 			break;
@@ -114,7 +193,7 @@ alarm_ready_cb (gpointer data)
 	 * re-entered and added an alarm of its own, so the timer will
 	 * already be set up.
 	 */
-	if (alarms)
+	if (HEAP_HEAD ())
 		setup_timeout ();
 
 	return FALSE;
@@ -130,13 +209,13 @@ setup_timeout (void)
 	guint diff;
 	time_t now;
 
-	if (!alarms) {
+	ar = HEAP_HEAD ();
+
+	if (!ar) {
 		g_warning ("No alarm to setup\n");
 		return;
 	}
 
-	ar = alarms->data;
-
 	/* Remove the existing time out */
 	if (timeout_id != 0) {
 		g_source_remove (timeout_id);
@@ -157,35 +236,26 @@ setup_timeout (void)
 	timeout_id = e_named_timeout_add_seconds (diff, alarm_ready_cb, NULL);
 }
 
-/* Used from g_list_insert_sorted(); compares the
- * trigger times of two AlarmRecord structures. */
-static gint
-compare_alarm_by_time (gconstpointer a,
-                       gconstpointer b)
-{
-	const AlarmRecord *ara = a;
-	const AlarmRecord *arb = b;
-	time_t diff;
-
-	diff = ara->trigger - arb->trigger;
-	return (diff < 0) ? -1 : (diff > 0) ? 1 : 0;
-}
-
 /* Adds an alarm to the queue and sets up the timer */
 static void
 queue_alarm (AlarmRecord *ar)
 {
-	GList *old_head;
+	AlarmRecord *old_head;
+
+	if (!alarms) {
+		alarms = g_ptr_array_new ();
+		alarm_ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+	}
 
-	/* Track the current head of the list in case there are changes */
-	old_head = alarms;
+	/* Track the current head of the queue in case there are changes */
+	old_head = HEAP_HEAD ();
 
-	/* Insert the new alarm in order if the alarm's trigger time is
-	 * after the current time */
-	alarms = g_list_insert_sorted (alarms, ar, compare_alarm_by_time);
+	g_ptr_array_add (alarms, ar);
+	g_hash_table_add (alarm_ids, ar);
+	heap_sift_up (alarms->len - 1);
 
-	/* If there first item on the list didn't change, the time out is fine */
-	if (old_head == alarms)
+	/* If the first item in the queue didn't change, the time out is fine */
+	if (old_head == HEAP_HEAD ())
 		return;
 
 	/* Set the timer for removal upon activation */
@@ -240,37 +310,32 @@ alarm_remove (gpointer alarm)
 	AlarmRecord *notify_id, *ar;
 	AlarmRecord ar_copy;
 	AlarmRecord *old_head;
-	GList *l;
 
 	g_return_if_fail (alarm != NULL);
 
 	ar = alarm;
 
-	l = g_list_find (alarms, ar);
-	if (!l) {
+	if (!alarm_ids || !g_hash_table_contains (alarm_ids, ar)) {
 		g_warning (G_STRLOC ": Requested removal of nonexistent alarm!");
 		return;
 	}
 
-	old_head = alarms->data;
+	old_head = HEAP_HEAD ();
 
 	notify_id = ar;
 
-	if (old_head == ar) {
-		ar_copy = *ar;
-		ar = &ar_copy;
-
-		/* This will free the original AlarmRecord;
-		 * that's why we copy it. */
-		pop_alarm ();
-	} else {
-		alarms = g_list_delete_link (alarms, l);
-	}
+	ar_copy = *ar;
+	heap_remove (ar);
+	g_hash_table_remove (alarm_ids, ar);
+	g_free (ar);
+	ar = &ar_copy;
 
 	/* Reset the timeout */
-	if (!alarms) {
+	if (!HEAP_HEAD ()) {
 		g_source_remove (timeout_id);
 		timeout_id = 0;
+	} else if (old_head == notify_id) {
+		setup_timeout ();
 	}
 
 	/* Notify about destructiono of the alarm */
@@ -289,10 +354,10 @@ alarm_remove (gpointer alarm)
 void
 alarm_done (void)
 {
-	GList *l;
+	guint ii;
 
 	if (timeout_id == 0) {
-		if (alarms)
+		if (HEAP_HEAD ())
 			g_warning ("No timeout, but queue is not NULL\n");
 		return;
 	}
@@ -300,15 +365,15 @@ alarm_done (void)
 	g_source_remove (timeout_id);
 	timeout_id = 0;
 
-	if (!alarms) {
+	if (!HEAP_HEAD ()) {
 		g_warning ("timeout present, freed, but no alarms active\n");
 		return;
 	}
 
-	for (l = alarms; l; l = l->next) {
+	for (ii = 0; ii < alarms->len; ii++) {
 		AlarmRecord *ar;
 
-		ar = l->data;
+		ar = HEAP_RECORD (ii);
 
 		if (ar->destroy_notify_fn)
 			(* ar->destroy_notify_fn) (ar, ar->data);
@@ -316,8 +381,11 @@ alarm_done (void)
 		g_free (ar);
 	}
 
-	g_list_free (alarms);
+	g_ptr_array_free (alarms, TRUE);
 	alarms = NULL;
+
+	g_hash_table_destroy (alarm_ids);
+	alarm_ids = NULL;
 }
 
 /**
@@ -328,6 +396,6 @@ alarm_done (void)
 void
 alarm_reschedule_timeout (void)
 {
-	if (alarms)
+	if (HEAP_HEAD ())
 		setup_timeout ();
 }
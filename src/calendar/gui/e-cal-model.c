@@ -64,6 +64,20 @@ struct _ECalModelPrivate {
 	/* Array for storing the objects. Each element is of type ECalModelComponent */
 	GPtrArray *objects;
 
+	/* Objects by their UID, in the same order as in the 'objects' array */
+	GHashTable *uid_index; /* gchar *uid ~> GSList { ECalModelComponent * } */
+
+	/* Row of each object, as it was when stored; rows only move towards
+	 * the start, by at most 'rows_removed' since the index was rebuilt */
+	GHashTable *row_index; /* ECalModelComponent * ~> row */
+	guint rows_removed;
+
+	/* Changes done between subscriber's freeze and thaw are announced
+	 * to the ETableModel in one pre_change/changed pair on thaw */
+	guint subscriber_freeze;
+	gboolean pending_change;
+	GSList *pending_removed; /* ECalModelComponent *, already out of the 'objects' */
+
 	icalcomponent_kind kind;
 	icaltimezone *zone;
 
@@ -1211,6 +1225,10 @@ cal_model_finalize (GObject *object)
 
 	g_free (priv->default_category);
 
+	g_slist_free_full (priv->pending_removed, g_object_unref);
+	g_hash_table_destroy (priv->uid_index);
+	g_hash_table_destroy (priv->row_index);
+
 	for (ii = 0; ii < priv->objects->len; ii++) {
 		ECalModelComponent *comp_data;
 
@@ -1900,45 +1918,185 @@ cal_model_value_to_string (ETableModel *etm,
 	return g_strdup ("");
 }
 
+static void
+cal_model_index_add (ECalModelPrivate *priv,
+                     ECalModelComponent *comp_data,
+                     guint row)
+{
+	const gchar *uid;
+
+	g_hash_table_insert (priv->row_index, comp_data, GUINT_TO_POINTER (row));
+
+	uid = icalcomponent_get_uid (comp_data->icalcomp);
+	if (uid && *uid) {
+		GSList *list;
+
+		list = g_hash_table_lookup (priv->uid_index, uid);
+		if (list) {
+			/* Components with the same UID are rare and only a few */
+			list = g_slist_append (list, comp_data);
+		} else {
+			g_hash_table_insert (priv->uid_index, g_strdup (uid), g_slist_prepend (NULL, comp_data));
+		}
+	}
+}
+
+/* Removes the @comp_data from the UID index only; its row
+ * is forgotten when the object is removed from the array. */
+static void
+cal_model_index_remove (ECalModelPrivate *priv,
+                        ECalModelComponent *comp_data)
+{
+	const gchar *uid;
+	GSList *list;
+
+	uid = icalcomponent_get_uid (comp_data->icalcomp);
+	if (!uid || !*uid)
+		return;
+
+	list = g_hash_table_lookup (priv->uid_index, uid);
+	if (!list)
+		return;
+
+	if (list->data == comp_data && !list->next) {
+		g_hash_table_remove (priv->uid_index, uid);
+	} else if (list->data == comp_data) {
+		gpointer orig_key = NULL;
+
+		/* The head changes, thus replace it in the hash table,
+		 * without freeing the list by the value destroy function */
+		if (g_hash_table_lookup_extended (priv->uid_index, uid, &orig_key, NULL)) {
+			g_hash_table_steal (priv->uid_index, uid);
+			g_hash_table_insert (priv->uid_index, orig_key, g_slist_remove (list, comp_data));
+		}
+	} else {
+		list = g_slist_remove (list, comp_data);
+	}
+}
+
+/* Removes @count rows from the 'objects' array, starting at the @row,
+ * without unreffing them. */
+static void
+cal_model_remove_rows (ECalModelPrivate *priv,
+                       guint row,
+                       guint count)
+{
+	guint ii;
+
+	for (ii = row; ii < row + count; ii++)
+		g_hash_table_remove (priv->row_index, g_ptr_array_index (priv->objects, ii));
+
+	g_ptr_array_remove_range (priv->objects, row, count);
+
+	priv->rows_removed += count;
+}
+
+/* When more rows than this were removed since the row index was rebuilt,
+ * the index is rebuilt instead of searching for the moved rows. */
+#define MAX_REMOVED_ROWS 256
+
 static gint
-e_cal_model_get_component_index (ECalModel *model,
-				 ECalClient *client,
-				 const ECalComponentId *id)
+cal_model_get_row (ECalModelPrivate *priv,
+                   ECalModelComponent *comp_data)
 {
-	gint ii;
+	gpointer value = NULL;
+	guint row, stop;
 
-	for (ii = 0; ii < model->priv->objects->len; ii++) {
-		ECalModelComponent *comp_data = g_ptr_array_index (model->priv->objects, ii);
+	if (!g_hash_table_lookup_extended (priv->row_index, comp_data, NULL, &value))
+		return -1;
 
-		if (comp_data) {
-			const gchar *uid;
-			gchar *rid = NULL;
+	row = GPOINTER_TO_UINT (value);
+
+	if (row < priv->objects->len && g_ptr_array_index (priv->objects, row) == comp_data)
+		return row;
+
+	if (priv->rows_removed > MAX_REMOVED_ROWS) {
+		guint ii;
+
+		for (ii = 0; ii < priv->objects->len; ii++) {
+			g_hash_table_insert (priv->row_index,
+				g_ptr_array_index (priv->objects, ii),
+				GUINT_TO_POINTER (ii));
+		}
+
+		priv->rows_removed = 0;
+
+		if (!g_hash_table_lookup_extended (priv->row_index, comp_data, NULL, &value))
+			return -1;
+
+		return GPOINTER_TO_INT (value);
+	}
+
+	/* The row moved towards the start by the rows removed before it */
+	g_return_val_if_fail (priv->objects->len > 0, -1);
+
+	row = MIN (row, priv->objects->len - 1);
+	stop = row > priv->rows_removed ? row - priv->rows_removed : 0;
+
+	while (g_ptr_array_index (priv->objects, row) != comp_data) {
+		g_return_val_if_fail (row > stop, -1);
+		row--;
+	}
+
+	g_hash_table_insert (priv->row_index, comp_data, GUINT_TO_POINTER (row));
+
+	return row;
+}
+
+static ECalModelComponent *
+search_by_id_and_client (ECalModelPrivate *priv,
+                         ECalClient *client,
+                         const ECalComponentId *id)
+{
+	GSList *link;
+	gboolean has_rid;
+
+	if (!id || !id->uid || !*id->uid)
+		return NULL;
+
+	has_rid = (id->rid && *id->rid);
+
+	for (link = g_hash_table_lookup (priv->uid_index, id->uid); link; link = g_slist_next (link)) {
+		ECalModelComponent *comp_data = link->data;
+
+		if (client && comp_data->client != client)
+			continue;
+
+		if (has_rid) {
 			struct icaltimetype icalrid;
-			gboolean has_rid = (id->rid && *id->rid);
+			gchar *rid = NULL;
+			gboolean matches;
 
-			uid = icalcomponent_get_uid (comp_data->icalcomp);
 			icalrid = icalcomponent_get_recurrenceid (comp_data->icalcomp);
 			if (!icaltime_is_null_time (icalrid))
 				rid = icaltime_as_ical_string_r (icalrid);
 
-			if (uid && *uid) {
-				if ((!client || comp_data->client == client) && strcmp (id->uid, uid) == 0) {
-					if (has_rid) {
-						if (!(rid && *rid && strcmp (rid, id->rid) == 0)) {
-							g_free (rid);
-							continue;
-						}
-					}
-					g_free (rid);
-					return ii;
-				}
-			}
+			matches = rid && *rid && strcmp (rid, id->rid) == 0;
 
 			g_free (rid);
+
+			if (!matches)
+				continue;
 		}
+
+		return comp_data;
 	}
 
-	return -1;
+	return NULL;
+}
+
+static gint
+e_cal_model_get_component_index (ECalModel *model,
+				 ECalClient *client,
+				 const ECalComponentId *id)
+{
+	ECalModelComponent *comp_data;
+
+	comp_data = search_by_id_and_client (model->priv, client, id);
+	if (!comp_data)
+		return -1;
+
+	return cal_model_get_row (model->priv, comp_data);
 }
 
 /* We do this check since the calendar items are downloaded from the server
@@ -1967,6 +2125,19 @@ ensure_dates_are_in_default_zone (ECalModel *model,
 	}
 }
 
+/* While the subscriber is frozen, the table is told about the changes only
+ * once, with a single pre-change now and a single change on thaw. */
+static void
+cal_model_pre_change (ECalModel *model)
+{
+	if (!model->priv->subscriber_freeze) {
+		e_table_model_pre_change (E_TABLE_MODEL (model));
+	} else if (!model->priv->pending_change) {
+		model->priv->pending_change = TRUE;
+		e_table_model_pre_change (E_TABLE_MODEL (model));
+	}
+}
+
 static void
 cal_model_data_subscriber_component_added_or_modified (ECalDataModelSubscriber *subscriber,
 						       ECalClient *client,
@@ -1996,7 +2167,7 @@ cal_model_data_subscriber_component_added_or_modified (ECalDataModelSubscriber *
 	ensure_dates_are_in_default_zone (model, icalcomp);
 
 	if (index < 0) {
-		e_table_model_pre_change (table_model);
+		cal_model_pre_change (model);
 
 		comp_data = g_object_new (E_TYPE_CAL_MODEL_COMPONENT, NULL);
 		comp_data->is_new_component = FALSE;
@@ -2004,15 +2175,19 @@ cal_model_data_subscriber_component_added_or_modified (ECalDataModelSubscriber *
 		comp_data->icalcomp = icalcomp;
 		e_cal_model_set_instance_times (comp_data, model->priv->zone);
 		g_ptr_array_add (model->priv->objects, comp_data);
+		cal_model_index_add (model->priv, comp_data, model->priv->objects->len - 1);
 
-		e_table_model_row_inserted (table_model, model->priv->objects->len - 1);
+		/* Announced with the other changes on thaw */
+		if (!model->priv->subscriber_freeze)
+			e_table_model_row_inserted (table_model, model->priv->objects->len - 1);
 	} else {
-		e_table_model_pre_change (table_model);
+		cal_model_pre_change (model);
 
 		comp_data = g_ptr_array_index (model->priv->objects, index);
 		e_cal_model_component_set_icalcomponent (comp_data, model, icalcomp);
 
-		e_table_model_row_changed (table_model, index);
+		if (!model->priv->subscriber_freeze)
+			e_table_model_row_changed (table_model, index);
 	}
 }
 
@@ -2050,20 +2225,29 @@ e_cal_model_data_subscriber_component_removed (ECalDataModelSubscriber *subscrib
 	id.uid = (gchar *) uid;
 	id.rid = (gchar *) rid;
 
-	index = e_cal_model_get_component_index (model, client, &id);
+	comp_data = search_by_id_and_client (model->priv, client, &id);
 
-	if (index < 0)
+	if (!comp_data)
 		return;
 
-	table_model = E_TABLE_MODEL (model);
-	e_table_model_pre_change (table_model);
+	index = cal_model_get_row (model->priv, comp_data);
+	g_return_if_fail (index >= 0);
+
+	cal_model_index_remove (model->priv, comp_data);
+
+	cal_model_pre_change (model);
+	cal_model_remove_rows (model->priv, index, 1);
 
-	comp_data = g_ptr_array_remove_index (model->priv->objects, index);
-	if (!comp_data) {
-		e_table_model_no_change (table_model);
+	if (model->priv->subscriber_freeze) {
+		/* The comps-deleted is emitted on thaw, which
+		 * also releases the reference held by the array */
+		model->priv->pending_removed = g_slist_prepend (
+			model->priv->pending_removed, comp_data);
 		return;
 	}
 
+	table_model = E_TABLE_MODEL (model);
+
 	link = g_slist_append (NULL, comp_data);
 	g_signal_emit (model, signals[COMPS_DELETED], 0, link);
 
@@ -2074,21 +2258,44 @@ e_cal_model_data_subscriber_component_removed (ECalDataModelSubscriber *subscrib
 }
 
 static void
-e_cal_model_data_subscriber_freeze (ECalDataModelSubscriber *subscriber)
+cal_model_flush_pending_changes (ECalModel *model)
 {
-	/* No freeze/thaw, the ETableModel doesn't notify about changes when frozen */
+	ECalModelPrivate *priv = model->priv;
+
+	if (priv->pending_removed) {
+		GSList *removed = priv->pending_removed;
+
+		priv->pending_removed = NULL;
+
+		g_signal_emit (model, signals[COMPS_DELETED], 0, removed);
+		g_slist_free_full (removed, g_object_unref);
+	}
 
-	/* ETableModel *table_model = E_TABLE_MODEL (subscriber);
-	e_table_model_freeze (table_model); */
+	if (priv->pending_change) {
+		priv->pending_change = FALSE;
+		e_table_model_changed (E_TABLE_MODEL (model));
+	}
+}
+
+static void
+e_cal_model_data_subscriber_freeze (ECalDataModelSubscriber *subscriber)
+{
+	/* No freeze/thaw of the ETableModel, it doesn't notify about changes
+	 * when frozen; the changes are announced as one change on thaw. */
+	E_CAL_MODEL (subscriber)->priv->subscriber_freeze++;
 }
 
 static void
 e_cal_model_data_subscriber_thaw (ECalDataModelSubscriber *subscriber)
 {
-	/* No freeze/thaw, the ETableModel doesn't notify about changes when frozen */
+	ECalModel *model = E_CAL_MODEL (subscriber);
+
+	g_return_if_fail (model->priv->subscriber_freeze > 0);
 
-	/* ETableModel *table_model = E_TABLE_MODEL (subscriber);
-	e_table_model_thaw (table_model); */
+	model->priv->subscriber_freeze--;
+
+	if (!model->priv->subscriber_freeze)
+		cal_model_flush_pending_changes (model);
 }
 
 static void
@@ -2633,6 +2840,8 @@ e_cal_model_init (ECalModel *model)
 	model->priv->end = (time_t) -1;
 
 	model->priv->objects = g_ptr_array_new ();
+	model->priv->uid_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) g_slist_free);
+	model->priv->row_index = g_hash_table_new (g_direct_hash, g_direct_equal);
 	model->priv->kind = ICAL_NO_COMPONENT;
 
 	model->priv->use_24_hour_format = TRUE;
@@ -3619,73 +3828,43 @@ e_cal_model_set_default_source_uid (ECalModel *model,
 	g_object_notify (G_OBJECT (model), "default-source-uid");
 }
 
-static ECalModelComponent *
-search_by_id_and_client (ECalModelPrivate *priv,
-                         ECalClient *client,
-                         const ECalComponentId *id)
+void
+e_cal_model_remove_all_objects (ECalModel *model)
 {
-	gint i;
+	ETableModel *table_model;
+	GSList *removed = NULL;
+	gint index, count;
 
-	for (i = 0; i < priv->objects->len; i++) {
-		ECalModelComponent *comp_data = g_ptr_array_index (priv->objects, i);
+	table_model = E_TABLE_MODEL (model);
 
-		if (comp_data) {
-			const gchar *uid;
-			gchar *rid = NULL;
-			struct icaltimetype icalrid;
-			gboolean has_rid = (id->rid && *id->rid);
+	/* Everything is gone, including not yet announced changes */
+	cal_model_flush_pending_changes (model);
 
-			uid = icalcomponent_get_uid (comp_data->icalcomp);
-			icalrid = icalcomponent_get_recurrenceid (comp_data->icalcomp);
-			if (!icaltime_is_null_time (icalrid))
-				rid = icaltime_as_ical_string_r (icalrid);
+	count = model->priv->objects->len;
+	if (!count)
+		return;
 
-			if (uid && *uid) {
-				if ((!client || comp_data->client == client) && !strcmp (id->uid, uid)) {
-					if (has_rid) {
-						if (!(rid && *rid && !strcmp (rid, id->rid))) {
-							g_free (rid);
-							continue;
-						}
-					}
-					g_free (rid);
-					return comp_data;
-				}
-			}
+	for (index = count - 1; index >= 0; index--) {
+		ECalModelComponent *comp_data;
 
-			g_free (rid);
-		}
+		comp_data = g_ptr_array_index (model->priv->objects, index);
+		if (comp_data)
+			removed = g_slist_prepend (removed, comp_data);
 	}
 
-	return NULL;
-}
-
-void
-e_cal_model_remove_all_objects (ECalModel *model)
-{
-	ECalModelComponent *comp_data;
-	ETableModel *table_model;
-	GSList *link;
-	gint index;
+	e_table_model_pre_change (table_model);
 
-	table_model = E_TABLE_MODEL (model);
-	for (index = model->priv->objects->len - 1; index >= 0; index--) {
-		e_table_model_pre_change (table_model);
+	g_hash_table_remove_all (model->priv->uid_index);
+	g_hash_table_remove_all (model->priv->row_index);
+	model->priv->rows_removed = 0;
+	g_ptr_array_set_size (model->priv->objects, 0);
 
-		comp_data = g_ptr_array_remove_index (model->priv->objects, index);
-		if (!comp_data) {
-			e_table_model_no_change (table_model);
-			continue;
-		}
-
-		link = g_slist_append (NULL, comp_data);
-		g_signal_emit (model, signals[COMPS_DELETED], 0, link);
+	if (removed)
+		g_signal_emit (model, signals[COMPS_DELETED], 0, removed);
 
-		g_slist_free (link);
-		g_object_unref (comp_data);
+	g_slist_free_full (removed, g_object_unref);
 
-		e_table_model_row_deleted (table_model, index);
-	}
+	e_table_model_rows_deleted (table_model, 0, count);
 }
 
 void
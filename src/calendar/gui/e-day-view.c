@@ -170,6 +170,11 @@ struct _EDayViewPrivate {
 	GtkWidget *timezone_name_2_label; /* not referenced */
 
 	GdkDragContext *drag_context;
+
+	/* Component UID ~> number of its events in each day, with the long
+	 * events counted at E_DAY_VIEW_LONG_EVENT; lets lookups by UID skip
+	 * days and components which are not shown at all. */
+	GHashTable *uid_index;
 };
 
 typedef struct {
@@ -991,6 +996,11 @@ day_view_dispose (GObject *object)
 		day_view->long_events = NULL;
 	}
 
+	if (day_view->priv->uid_index) {
+		g_hash_table_destroy (day_view->priv->uid_index);
+		day_view->priv->uid_index = NULL;
+	}
+
 	for (day = 0; day < E_DAY_VIEW_MAX_DAYS; day++) {
 		if (day_view->events[day]) {
 			g_array_free (day_view->events[day], TRUE);
@@ -2054,6 +2064,8 @@ e_day_view_init (EDayView *day_view)
 	gulong handler_id;
 
 	day_view->priv = E_DAY_VIEW_GET_PRIVATE (day_view);
+	day_view->priv->uid_index = g_hash_table_new_full (
+		g_str_hash, g_str_equal, g_free, g_free);
 
 	gtk_widget_set_can_focus (GTK_WIDGET (day_view), TRUE);
 
@@ -2755,6 +2767,53 @@ model_rows_inserted_cb (ETableModel *etm,
 
 }
 
+/* Removes the events showing any of the components in one pass, stepping
+ * backwards through the arrays.  Returns a new list of the components
+ * which did not have an event of their own, these can still be shown by
+ * an event of another ECalModelComponent for the same component. */
+static GSList *
+day_view_remove_comps_events (EDayView *day_view,
+                              GSList *comps)
+{
+	GHashTable *pending;
+	GHashTableIter iter;
+	GSList *link, *not_found = NULL;
+	gpointer key;
+	gint day, event_num;
+
+	pending = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (link = comps; link; link = g_slist_next (link))
+		g_hash_table_add (pending, link->data);
+
+	for (day = 0; day <= E_DAY_VIEW_LONG_EVENT; day++) {
+		GArray *array;
+
+		if (day == E_DAY_VIEW_LONG_EVENT)
+			array = day_view->long_events;
+		else if (day < e_day_view_get_days_shown (day_view))
+			array = day_view->events[day];
+		else
+			continue;
+
+		for (event_num = array->len - 1; event_num >= 0; event_num--) {
+			EDayViewEvent *event;
+
+			event = &g_array_index (array, EDayViewEvent, event_num);
+
+			if (event->comp_data && g_hash_table_remove (pending, event->comp_data))
+				e_day_view_remove_event_cb (day_view, day, event_num, NULL);
+		}
+	}
+
+	g_hash_table_iter_init (&iter, pending);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		not_found = g_slist_prepend (not_found, key);
+
+	g_hash_table_destroy (pending);
+
+	return not_found;
+}
+
 static void
 model_comps_deleted_cb (ETableModel *etm,
                         gpointer data,
@@ -2771,6 +2830,11 @@ model_comps_deleted_cb (ETableModel *etm,
 
 	e_day_view_stop_editing_event (day_view);
 
+	/* Bulk removals, like when the model time range changes,
+	 * are done in one pass over the events. */
+	if (list && list->next)
+		list = day_view_remove_comps_events (day_view, list);
+
 	for (l = list; l != NULL; l = g_slist_next (l)) {
 		ECalModelComponent *comp_data = l->data;
 		gint day, event_num;
@@ -2792,6 +2856,9 @@ model_comps_deleted_cb (ETableModel *etm,
 		g_free (rid);
 	}
 
+	if (list != data)
+		g_slist_free (list);
+
 	gtk_widget_queue_draw (day_view->top_canvas);
 	gtk_widget_queue_draw (day_view->main_canvas);
 	e_day_view_queue_layout (day_view);
@@ -3120,6 +3187,49 @@ e_day_view_foreach_event (EDayView *day_view,
 	}
 }
 
+static void
+day_view_index_event (EDayView *day_view,
+                      const EDayViewEvent *event,
+                      gint day,
+                      gint delta)
+{
+	const gchar *uid;
+	guint *counts;
+
+	if (!day_view->priv->uid_index || !is_comp_data_valid (event))
+		return;
+
+	uid = icalcomponent_get_uid (event->comp_data->icalcomp);
+	if (!uid)
+		return;
+
+	counts = g_hash_table_lookup (day_view->priv->uid_index, uid);
+	if (!counts) {
+		if (delta < 0)
+			return;
+
+		counts = g_new0 (guint, E_DAY_VIEW_MAX_DAYS + 1);
+		g_hash_table_insert (day_view->priv->uid_index, g_strdup (uid), counts);
+	}
+
+	if (delta < 0 && counts[day] == 0)
+		return;
+
+	counts[day] += delta;
+}
+
+/* Returns per-day counts of events of the component, or NULL when
+ * there is none, in which case no event needs to be checked. */
+static const guint *
+day_view_lookup_uid (EDayView *day_view,
+                     const gchar *uid)
+{
+	if (!uid || !day_view->priv->uid_index)
+		return NULL;
+
+	return g_hash_table_lookup (day_view->priv->uid_index, uid);
+}
+
 /* This calls a given function for each event instance that matches the given
  * uid. If the callback returns FALSE the iteration is stopped.
  * Note that it is safe for the callback to remove the event (since we
@@ -3134,13 +3244,18 @@ e_day_view_foreach_event_with_uid (EDayView *day_view,
 	gint day, event_num;
 	gint days_shown;
 	const gchar *u;
+	const guint *counts;
 
-	if (!uid)
+	counts = day_view_lookup_uid (day_view, uid);
+	if (!counts)
 		return;
 
 	days_shown = e_day_view_get_days_shown (day_view);
 
 	for (day = 0; day < days_shown; day++) {
+		if (!counts[day])
+			continue;
+
 		for (event_num = day_view->events[day]->len - 1;
 		     event_num >= 0;
 		     event_num--) {
@@ -3158,6 +3273,9 @@ e_day_view_foreach_event_with_uid (EDayView *day_view,
 		}
 	}
 
+	if (!counts[E_DAY_VIEW_LONG_EVENT])
+		return;
+
 	for (event_num = day_view->long_events->len - 1;
 	     event_num >= 0;
 	     event_num--) {
@@ -3270,6 +3388,8 @@ e_day_view_remove_event_cb (EDayView *day_view,
 	if (event->canvas_item)
 		g_object_run_dispose (G_OBJECT (event->canvas_item));
 
+	day_view_index_event (day_view, event, day, -1);
+
 	if (is_comp_data_valid (event))
 		g_object_unref (event->comp_data);
 	event->comp_data = NULL;
@@ -3520,13 +3640,18 @@ e_day_view_find_event_from_uid (EDayView *day_view,
 	gint days_shown;
 	const gchar *u;
 	gchar *r = NULL;
+	const guint *counts;
 
-	if (!uid)
+	counts = day_view_lookup_uid (day_view, uid);
+	if (!counts)
 		return FALSE;
 
 	days_shown = e_day_view_get_days_shown (day_view);
 
 	for (day = 0; day < days_shown; day++) {
+		if (!counts[day])
+			continue;
+
 		for (event_num = 0; event_num < day_view->events[day]->len;
 		     event_num++) {
 			event = &g_array_index (day_view->events[day],
@@ -3558,6 +3683,9 @@ e_day_view_find_event_from_uid (EDayView *day_view,
 		}
 	}
 
+	if (!counts[E_DAY_VIEW_LONG_EVENT])
+		return FALSE;
+
 	for (event_num = 0; event_num < day_view->long_events->len;
 	     event_num++) {
 		event = &g_array_index (day_view->long_events,
@@ -5659,6 +5787,9 @@ e_day_view_free_events (EDayView *day_view)
 	for (day = 0; day < E_DAY_VIEW_MAX_DAYS; day++)
 		e_day_view_free_event_array (day_view, day_view->events[day]);
 
+	if (day_view->priv->uid_index)
+		g_hash_table_remove_all (day_view->priv->uid_index);
+
 	if (did_editing)
 		g_object_notify (G_OBJECT (day_view), "is-editing");
 }
@@ -5789,6 +5920,7 @@ e_day_view_add_event (ESourceRegistry *registry,
 			}
 
 			g_array_append_val (add_event_data->day_view->events[day], event);
+			day_view_index_event (add_event_data->day_view, &event, day, +1);
 			add_event_data->day_view->events_sorted[day] = FALSE;
 			add_event_data->day_view->need_layout[day] = TRUE;
 			return;
@@ -5798,6 +5930,7 @@ e_day_view_add_event (ESourceRegistry *registry,
 	/* The event wasn't within one day so it must be a long event,
 	 * i.e. shown in the top canvas. */
 	g_array_append_val (add_event_data->day_view->long_events, event);
+	day_view_index_event (add_event_data->day_view, &event, E_DAY_VIEW_LONG_EVENT, +1);
 	add_event_data->day_view->long_events_sorted = FALSE;
 	add_event_data->day_view->long_events_need_layout = TRUE;
 	return;
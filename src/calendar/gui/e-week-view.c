@@ -99,6 +99,10 @@ struct _EWeekViewPrivate {
 	gulong notify_week_start_day_id;
 
 	gboolean show_icons_month_view;
+
+	/* Number of events shown for each component UID, thus
+	 * the lookups can skip components which are not shown. */
+	GHashTable *uid_index;
 };
 
 typedef struct {
@@ -289,6 +293,42 @@ week_view_model_cell_changed_cb (EWeekView *week_view,
 	week_view_update_row (week_view, row);
 }
 
+/* Removes the events showing any of the components in one pass, stepping
+ * backwards through the array.  Returns a new list of the components
+ * which did not have an event of their own, these can still be shown by
+ * an event of another ECalModelComponent for the same component. */
+static GSList *
+week_view_remove_comps_events (EWeekView *week_view,
+                               GSList *comps)
+{
+	GHashTable *pending;
+	GHashTableIter iter;
+	GSList *link, *not_found = NULL;
+	gpointer key;
+	gint event_num;
+
+	pending = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (link = comps; link; link = g_slist_next (link))
+		g_hash_table_add (pending, link->data);
+
+	for (event_num = week_view->events->len - 1; event_num >= 0; event_num--) {
+		EWeekViewEvent *event;
+
+		event = &g_array_index (week_view->events, EWeekViewEvent, event_num);
+
+		if (event->comp_data && g_hash_table_remove (pending, event->comp_data))
+			e_week_view_remove_event_cb (week_view, event_num, NULL);
+	}
+
+	g_hash_table_iter_init (&iter, pending);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		not_found = g_slist_prepend (not_found, key);
+
+	g_hash_table_destroy (pending);
+
+	return not_found;
+}
+
 static void
 week_view_model_comps_deleted_cb (EWeekView *week_view,
                                   gpointer data)
@@ -302,6 +342,11 @@ week_view_model_comps_deleted_cb (EWeekView *week_view,
 		return;
 	}
 
+	/* Bulk removals, like when the model time range changes,
+	 * are done in one pass over the events. */
+	if (list && list->next)
+		list = week_view_remove_comps_events (week_view, list);
+
 	for (l = list; l != NULL; l = g_slist_next (l)) {
 		gint event_num;
 		const gchar *uid;
@@ -322,6 +367,9 @@ week_view_model_comps_deleted_cb (EWeekView *week_view,
 		g_free (rid);
 	}
 
+	if (list != data)
+		g_slist_free (list);
+
 	gtk_widget_queue_draw (week_view->main_canvas);
 	e_week_view_queue_layout (week_view);
 }
@@ -855,6 +903,11 @@ week_view_dispose (GObject *object)
 		week_view->events = NULL;
 	}
 
+	if (week_view->priv->uid_index) {
+		g_hash_table_destroy (week_view->priv->uid_index);
+		week_view->priv->uid_index = NULL;
+	}
+
 	if (week_view->small_font_desc) {
 		pango_font_description_free (week_view->small_font_desc);
 		week_view->small_font_desc = NULL;
@@ -1684,6 +1737,8 @@ e_week_view_init (EWeekView *week_view)
 	week_view->priv->show_event_end_times = TRUE;
 	week_view->priv->update_base_date = TRUE;
 	week_view->priv->display_start_day = G_DATE_MONDAY;
+	week_view->priv->uid_index = g_hash_table_new_full (
+		g_str_hash, g_str_equal, g_free, NULL);
 
 	gtk_widget_set_can_focus (GTK_WIDGET (week_view), TRUE);
 
@@ -2610,6 +2665,44 @@ set_style_from_attendee (EWeekViewEvent *event,
 	g_object_unref (comp);
 }
 
+static void
+week_view_index_event (EWeekView *week_view,
+                       const EWeekViewEvent *event,
+                       gint delta)
+{
+	const gchar *uid;
+	guint count;
+
+	if (!week_view->priv->uid_index || !is_comp_data_valid (event))
+		return;
+
+	uid = icalcomponent_get_uid (event->comp_data->icalcomp);
+	if (!uid)
+		return;
+
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (week_view->priv->uid_index, uid));
+	if (delta < 0 && count == 0)
+		return;
+
+	count += delta;
+
+	if (count > 0)
+		g_hash_table_insert (week_view->priv->uid_index, g_strdup (uid), GUINT_TO_POINTER (count));
+	else
+		g_hash_table_remove (week_view->priv->uid_index, uid);
+}
+
+/* Returns how many events show the component with the uid. */
+static guint
+week_view_lookup_uid (EWeekView *week_view,
+                      const gchar *uid)
+{
+	if (!uid || !week_view->priv->uid_index)
+		return 0;
+
+	return GPOINTER_TO_UINT (g_hash_table_lookup (week_view->priv->uid_index, uid));
+}
+
 /* This calls a given function for each event instance that matches the given
  * uid. Note that it is safe for the callback to remove the event (since we
  * step backwards through the arrays). */
@@ -2621,9 +2714,12 @@ e_week_view_foreach_event_with_uid (EWeekView *week_view,
 {
 	EWeekViewEvent *event;
 	gint event_num;
+	guint remaining;
+
+	remaining = week_view_lookup_uid (week_view, uid);
 
 	for (event_num = week_view->events->len - 1;
-	     event_num >= 0;
+	     event_num >= 0 && remaining > 0;
 	     event_num--) {
 		const gchar *u;
 
@@ -2635,6 +2731,8 @@ e_week_view_foreach_event_with_uid (EWeekView *week_view,
 
 		u = icalcomponent_get_uid (event->comp_data->icalcomp);
 		if (u && !strcmp (uid, u)) {
+			remaining--;
+
 			if (!(*callback) (week_view, event_num, data))
 				return;
 		}
@@ -2667,6 +2765,8 @@ e_week_view_remove_event_cb (EWeekView *week_view,
 	if (week_view->popup_event_num == event_num)
 		week_view->popup_event_num = -1;
 
+	week_view_index_event (week_view, event, -1);
+
 	if (is_comp_data_valid (event))
 		g_object_unref (event->comp_data);
 	event->comp_data = NULL;
@@ -3176,6 +3276,9 @@ e_week_view_free_events (EWeekView *week_view)
 
 	g_array_set_size (week_view->events, 0);
 
+	if (week_view->priv->uid_index)
+		g_hash_table_remove_all (week_view->priv->uid_index);
+
 	/* Destroy all the old canvas items. */
 	if (week_view->spans) {
 		for (span_num = 0; span_num < week_view->spans->len;
@@ -3280,6 +3383,7 @@ e_week_view_add_event (ECalClient *client,
 		g_array_prepend_val (add_event_data->week_view->events, event);
 	else
 		g_array_append_val (add_event_data->week_view->events, event);
+	week_view_index_event (add_event_data->week_view, &event, +1);
 	add_event_data->week_view->events_sorted = FALSE;
 	add_event_data->week_view->events_need_layout = TRUE;
 }
@@ -4734,13 +4838,16 @@ e_week_view_find_event_from_uid (EWeekView *week_view,
 {
 	EWeekViewEvent *event;
 	gint event_num, num_events;
+	guint remaining;
 
 	*event_num_return = -1;
 	if (!uid)
 		return FALSE;
 
+	remaining = week_view_lookup_uid (week_view, uid);
+
 	num_events = week_view->events->len;
-	for (event_num = 0; event_num < num_events; event_num++) {
+	for (event_num = 0; event_num < num_events && remaining > 0; event_num++) {
 		const gchar *u;
 		gchar *r = NULL;
 
@@ -4750,25 +4857,28 @@ e_week_view_find_event_from_uid (EWeekView *week_view,
 		if (!is_comp_data_valid (event))
 			continue;
 
+		u = icalcomponent_get_uid (event->comp_data->icalcomp);
+		if (!u || strcmp (uid, u) != 0)
+			continue;
+
+		remaining--;
+
 		if (event->comp_data->client != client)
 			continue;
 
-		u = icalcomponent_get_uid (event->comp_data->icalcomp);
-		if (u && !strcmp (uid, u)) {
-			if (rid && *rid) {
-				r = icaltime_as_ical_string_r (icalcomponent_get_recurrenceid (event->comp_data->icalcomp));
-				if (!r || !*r)
-					continue;
-				if (strcmp (rid, r) != 0) {
-					g_free (r);
-					continue;
-				}
+		if (rid && *rid) {
+			r = icaltime_as_ical_string_r (icalcomponent_get_recurrenceid (event->comp_data->icalcomp));
+			if (!r || !*r)
+				continue;
+			if (strcmp (rid, r) != 0) {
 				g_free (r);
+				continue;
 			}
-
-			*event_num_return = event_num;
-			return TRUE;
+			g_free (r);
 		}
+
+		*event_num_return = event_num;
+		return TRUE;
 	}
 
 	return FALSE;
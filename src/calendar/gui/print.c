@@ -706,18 +706,164 @@ format_date (struct tm *tm,
 	return buffer;
 }
 
+/* Instances of the model components, expanded once per printed page
+ * and replayed to every renderer of the page, so that the recurrences
+ * are not expanded again for each day cell and each sub-view. */
+typedef struct _PrintInstance {
+	ECalModelComponent *comp_data;
+	time_t start;
+	time_t end;
+} PrintInstance;
+
+typedef struct _PrintInstances {
+	time_t start;
+	time_t end;
+	GArray *instances; /* PrintInstance, in generation order */
+} PrintInstances;
+
+#define PRINT_INSTANCES_KEY "evolution-print-instances"
+
 static gboolean
-instance_cb (ECalComponent *comp,
-             time_t instance_start,
-             time_t instance_end,
-             gpointer data)
+print_instances_add_cb (ECalComponent *comp,
+                        time_t instance_start,
+                        time_t instance_end,
+                        gpointer data)
 {
+	ECalModelGenerateInstancesData *mdata = data;
+	GArray *instances = mdata->cb_data;
+	PrintInstance instance;
 
-	gboolean *found = ((ECalModelGenerateInstancesData *) data)->cb_data;
+	instance.comp_data = g_object_ref (mdata->comp_data);
+	instance.start = instance_start;
+	instance.end = instance_end;
 
-	*found = TRUE;
+	g_array_append_val (instances, instance);
 
-	return FALSE;
+	return TRUE;
+}
+
+static PrintInstances *
+print_instances_new (ECalModel *model,
+                     time_t start,
+                     time_t end)
+{
+	PrintInstances *pinstances;
+
+	pinstances = g_new0 (PrintInstances, 1);
+	pinstances->start = start;
+	pinstances->end = end;
+	pinstances->instances = g_array_new (FALSE, FALSE, sizeof (PrintInstance));
+
+	e_cal_model_generate_instances_sync (
+		model, start, end,
+		print_instances_add_cb, pinstances->instances);
+
+	return pinstances;
+}
+
+static void
+print_instances_free (gpointer ptr)
+{
+	PrintInstances *pinstances = ptr;
+	guint ii;
+
+	if (!pinstances)
+		return;
+
+	for (ii = 0; ii < pinstances->instances->len; ii++) {
+		PrintInstance *instance;
+
+		instance = &g_array_index (pinstances->instances, PrintInstance, ii);
+		g_object_unref (instance->comp_data);
+	}
+
+	g_array_free (pinstances->instances, TRUE);
+	g_free (pinstances);
+}
+
+/* The same overlap test the recurrence expansion uses, where
+ * a zero-length instance at the very start of the range counts. */
+static gboolean
+print_instance_in_range (time_t instance_start,
+                         time_t instance_end,
+                         time_t start,
+                         time_t end)
+{
+	return instance_start < end &&
+		(instance_end > start || instance_start == start);
+}
+
+/* Works like e_cal_model_generate_instances_sync(), only answers from
+ * the page's instance cache when it covers the range. The callback is
+ * called in the same order, but with a NULL component; the renderers
+ * use only the ECalModelGenerateInstancesData. */
+static void
+print_generate_instances (ECalModel *model,
+                          time_t start,
+                          time_t end,
+                          ECalRecurInstanceFn cb,
+                          gpointer cb_data)
+{
+	PrintInstances *pinstances;
+	ECalModelGenerateInstancesData mdata;
+	ECalModelComponent *stopped = NULL;
+	guint ii;
+
+	pinstances = g_object_get_data (G_OBJECT (model), PRINT_INSTANCES_KEY);
+
+	if (!pinstances || start < pinstances->start || end > pinstances->end) {
+		e_cal_model_generate_instances_sync (model, start, end, cb, cb_data);
+		return;
+	}
+
+	mdata.cb_data = cb_data;
+
+	for (ii = 0; ii < pinstances->instances->len; ii++) {
+		PrintInstance *instance;
+
+		instance = &g_array_index (pinstances->instances, PrintInstance, ii);
+
+		/* Returning FALSE stops only the current component's instances */
+		if (instance->comp_data == stopped)
+			continue;
+
+		if (!print_instance_in_range (instance->start, instance->end, start, end))
+			continue;
+
+		mdata.comp_data = instance->comp_data;
+
+		if (!cb (NULL, instance->start, instance->end, &mdata))
+			stopped = instance->comp_data;
+	}
+}
+
+typedef struct _PrintMonthSmallData {
+	time_t day_starts[31];
+	time_t day_ends[31];
+	gboolean found[31];
+	gint n_days;
+} PrintMonthSmallData;
+
+static gboolean
+print_month_small_instance_cb (ECalComponent *comp,
+                               time_t instance_start,
+                               time_t instance_end,
+                               gpointer data)
+{
+	PrintMonthSmallData *msdata = ((ECalModelGenerateInstancesData *) data)->cb_data;
+	gint ii;
+
+	for (ii = 0; ii < msdata->n_days; ii++) {
+		if (msdata->found[ii])
+			continue;
+
+		if (print_instance_in_range (
+			instance_start, instance_end,
+			msdata->day_starts[ii], msdata->day_ends[ii]))
+			msdata->found[ii] = TRUE;
+	}
+
+	return TRUE;
 }
 
 const gchar *daynames[] = {
@@ -780,6 +926,7 @@ print_month_small (GtkPrintContext *context,
 {
 	icaltimezone *zone;
 	PangoFontDescription *font, *font_bold, *font_normal;
+	PrintMonthSmallData msdata;
 	time_t now, next;
 	gint x, y;
 	gint day;
@@ -854,6 +1001,26 @@ print_month_small (GtkPrintContext *context,
 
 	y1 += row_height * 1.4;
 
+	/* Find the days with events in one pass over the whole month. */
+	memset (&msdata, 0, sizeof (PrintMonthSmallData));
+	now = time_month_begin_with_zone (month, zone);
+	for (x = 0; x < 42; x++) {
+		if (days[x] == 0 || msdata.n_days >= (gint) G_N_ELEMENTS (msdata.day_starts))
+			continue;
+
+		msdata.day_starts[msdata.n_days] = now;
+		msdata.day_ends[msdata.n_days] = time_day_end_with_zone (now, zone);
+		msdata.n_days++;
+
+		now = time_add_day_with_zone (now, 1, zone);
+	}
+
+	if (msdata.n_days > 0)
+		print_generate_instances (
+			model, msdata.day_starts[0],
+			msdata.day_ends[msdata.n_days - 1],
+			print_month_small_instance_cb, &msdata);
+
 	now = time_month_begin_with_zone (month, zone);
 	for (y = 0; y < 6; y++) {
 
@@ -915,14 +1082,10 @@ print_month_small (GtkPrintContext *context,
 
 			day = days[y * 7 + x];
 			if (day != 0) {
-				gboolean found = FALSE;
+				gboolean found;
 				sprintf (buf, "%d", day);
 
-				/* this is a slow messy way to do this ... but easy ... */
-				e_cal_model_generate_instances_sync (
-					model, now,
-					time_day_end_with_zone (now, zone),
-					instance_cb, &found);
+				found = day <= msdata.n_days && msdata.found[day - 1];
 
 				font = found ? font_bold : font_normal;
 
@@ -1589,7 +1752,7 @@ print_day_details (GtkPrintContext *context,
 	pdi.zone = e_cal_model_get_timezone (model);
 
 	/* Get the events from the server. */
-	e_cal_model_generate_instances_sync (model, start, end, print_day_details_cb, &pdi);
+	print_generate_instances (model, start, end, print_day_details_cb, &pdi);
 	qsort (
 		pdi.long_events->data, pdi.long_events->len,
 		sizeof (EDayViewEvent), e_day_view_event_sort_func);
@@ -2200,7 +2363,7 @@ print_week_summary (GtkPrintContext *context,
 	}
 
 	/* Get the events from the server. */
-	e_cal_model_generate_instances_sync (
+	print_generate_instances (
 		model,
 		psi.day_starts[0], psi.day_starts[psi.days_shown],
 		print_week_summary_cb, &psi);
@@ -2757,7 +2920,7 @@ print_work_week_day_details (GtkPrintContext *context,
 	pdi.zone = e_cal_model_get_timezone (model);
 
 	/* Get the events from the server. */
-	e_cal_model_generate_instances_sync (model, start, end, print_day_details_cb, &pdi);
+	print_generate_instances (model, start, end, print_day_details_cb, &pdi);
 	qsort (
 		pdi.long_events->data, pdi.long_events->len,
 		sizeof (EDayViewEvent), e_day_view_event_sort_func);
@@ -2958,7 +3121,7 @@ print_work_week_view (GtkPrintContext *context,
 	pdi.end_hour = e_cal_model_get_work_day_end_hour (model);
 	pdi.zone = zone;
 
-	e_cal_model_generate_instances_sync (model, start, end, print_work_week_view_cb, &pdi);
+	print_generate_instances (model, start, end, print_work_week_view_cb, &pdi);
 
 	print_work_week_background (
 		context, model, date, &pdi, 0.0, width,
@@ -3358,6 +3521,26 @@ print_calendar_draw_page (GtkPrintOperation *operation,
                           gint page_nr,
                           PrintCalItem *pcali)
 {
+	ECalModel *model;
+	icaltimezone *zone;
+	time_t start, end;
+
+	model = e_calendar_view_get_model (pcali->cal_view);
+	zone = e_cal_model_get_timezone (model);
+
+	/* Expand the instances once for everything the page can show,
+	 * the main view and the mini-months around it included. */
+	start = time_month_begin_with_zone (pcali->start, zone);
+	end = time_add_month_with_zone (start, 3, zone);
+	end = time_add_week_with_zone (end, 2, zone);
+	start = time_add_month_with_zone (start, -1, zone);
+	start = time_add_week_with_zone (start, -2, zone);
+
+	g_object_set_data_full (
+		G_OBJECT (model), PRINT_INSTANCES_KEY,
+		print_instances_new (model, start, end),
+		print_instances_free);
+
 	switch (pcali->print_view_type) {
 		case E_PRINT_VIEW_DAY:
 			print_day_view (context, pcali->cal_view, pcali->tasks_table, pcali->start);
@@ -3372,8 +3555,11 @@ print_calendar_draw_page (GtkPrintOperation *operation,
 			print_month_view (context, pcali->cal_view, pcali->print_view_type, pcali->start);
 			break;
 		default:
-			g_return_if_reached ();
+			g_warn_if_reached ();
+			break;
 	}
+
+	g_object_set_data (G_OBJECT (model), PRINT_INSTANCES_KEY, NULL);
 }
 
 void
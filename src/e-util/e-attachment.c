@@ -57,6 +57,18 @@
 /* Attributes needed for EAttachmentStore columns. */
 #define ATTACHMENT_QUERY "standard::*,preview::*,thumbnail::*"
 
+/* Sizes of the buffer used to copy attachment content into memory;
+ * it grows while the reads fill it. */
+#define LOAD_BUFFER_MIN_SIZE	(16 * 1024)
+#define LOAD_BUFFER_MAX_SIZE	(1024 * 1024)
+
+/* Size of the buffer used to stream a file-backed attachment content. */
+#define FILE_WRAPPER_BUFFER_SIZE	(64 * 1024)
+
+/* How much of a file-backed text attachment is checked
+ * for the best transfer encoding and character set. */
+#define BESTENC_PREFIX_SIZE	(64 * 1024)
+
 struct _EAttachmentPrivate {
 	GMutex property_lock;
 
@@ -122,6 +134,197 @@ G_DEFINE_TYPE (
 	e_attachment,
 	G_TYPE_OBJECT)
 
+/* EAttachmentFileWrapper references a local file and streams its content
+ * only when the MIME part is written, thus attachments loaded from files
+ * are never held in memory as a whole. */
+
+typedef struct _EAttachmentFileWrapper EAttachmentFileWrapper;
+typedef struct _EAttachmentFileWrapperClass EAttachmentFileWrapperClass;
+
+struct _EAttachmentFileWrapper {
+	CamelDataWrapper parent;
+	GFile *file;
+};
+
+struct _EAttachmentFileWrapperClass {
+	CamelDataWrapperClass parent_class;
+};
+
+/* Forward Declarations */
+GType		e_attachment_file_wrapper_get_type
+						(void) G_GNUC_CONST;
+
+G_DEFINE_TYPE (
+	EAttachmentFileWrapper,
+	e_attachment_file_wrapper,
+	CAMEL_TYPE_DATA_WRAPPER)
+
+#define E_IS_ATTACHMENT_FILE_WRAPPER(obj) \
+	(G_TYPE_CHECK_INSTANCE_TYPE \
+	((obj), e_attachment_file_wrapper_get_type ()))
+
+static gssize
+attachment_file_wrapper_write_to_stream_sync (CamelDataWrapper *data_wrapper,
+                                              CamelStream *stream,
+                                              GCancellable *cancellable,
+                                              GError **error)
+{
+	EAttachmentFileWrapper *file_wrapper;
+	GFileInputStream *input_stream;
+	gchar *buffer;
+	gssize total_bytes_written = 0;
+
+	file_wrapper = (EAttachmentFileWrapper *) data_wrapper;
+
+	input_stream = g_file_read (file_wrapper->file, cancellable, error);
+	if (input_stream == NULL)
+		return -1;
+
+	buffer = g_malloc (FILE_WRAPPER_BUFFER_SIZE);
+
+	while (TRUE) {
+		gssize bytes_read;
+		gssize bytes_written;
+
+		bytes_read = g_input_stream_read (
+			G_INPUT_STREAM (input_stream), buffer,
+			FILE_WRAPPER_BUFFER_SIZE, cancellable, error);
+
+		if (bytes_read < 0)
+			total_bytes_written = -1;
+
+		if (bytes_read <= 0)
+			break;
+
+		bytes_written = camel_stream_write (
+			stream, buffer, bytes_read, cancellable, error);
+
+		if (bytes_written < 0) {
+			total_bytes_written = -1;
+			break;
+		}
+
+		total_bytes_written += bytes_written;
+	}
+
+	g_free (buffer);
+	g_object_unref (input_stream);
+
+	return total_bytes_written;
+}
+
+static gssize
+attachment_file_wrapper_write_to_output_stream_sync (CamelDataWrapper *data_wrapper,
+                                                     GOutputStream *output_stream,
+                                                     GCancellable *cancellable,
+                                                     GError **error)
+{
+	EAttachmentFileWrapper *file_wrapper;
+	GFileInputStream *input_stream;
+	gssize bytes_written;
+
+	file_wrapper = (EAttachmentFileWrapper *) data_wrapper;
+
+	input_stream = g_file_read (file_wrapper->file, cancellable, error);
+	if (input_stream == NULL)
+		return -1;
+
+	bytes_written = g_output_stream_splice (
+		output_stream, G_INPUT_STREAM (input_stream),
+		G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE,
+		cancellable, error);
+
+	g_object_unref (input_stream);
+
+	return bytes_written;
+}
+
+static void
+attachment_file_wrapper_finalize (GObject *object)
+{
+	EAttachmentFileWrapper *file_wrapper;
+
+	file_wrapper = (EAttachmentFileWrapper *) object;
+
+	g_clear_object (&file_wrapper->file);
+
+	/* Chain up to parent's finalize() method. */
+	G_OBJECT_CLASS (e_attachment_file_wrapper_parent_class)->
+		finalize (object);
+}
+
+static void
+e_attachment_file_wrapper_class_init (EAttachmentFileWrapperClass *class)
+{
+	GObjectClass *object_class;
+	CamelDataWrapperClass *data_wrapper_class;
+
+	object_class = G_OBJECT_CLASS (class);
+	object_class->finalize = attachment_file_wrapper_finalize;
+
+	/* The content is stored as is, thus writing
+	 * and decoding it is one and the same. */
+	data_wrapper_class = CAMEL_DATA_WRAPPER_CLASS (class);
+	data_wrapper_class->write_to_stream_sync =
+		attachment_file_wrapper_write_to_stream_sync;
+	data_wrapper_class->decode_to_stream_sync =
+		attachment_file_wrapper_write_to_stream_sync;
+	data_wrapper_class->write_to_output_stream_sync =
+		attachment_file_wrapper_write_to_output_stream_sync;
+	data_wrapper_class->decode_to_output_stream_sync =
+		attachment_file_wrapper_write_to_output_stream_sync;
+}
+
+static void
+e_attachment_file_wrapper_init (EAttachmentFileWrapper *file_wrapper)
+{
+}
+
+static CamelDataWrapper *
+attachment_file_wrapper_new (GFile *file)
+{
+	EAttachmentFileWrapper *file_wrapper;
+
+	file_wrapper = g_object_new (
+		e_attachment_file_wrapper_get_type (), NULL);
+	file_wrapper->file = g_object_ref (file);
+
+	return CAMEL_DATA_WRAPPER (file_wrapper);
+}
+
+/* Reads at most BESTENC_PREFIX_SIZE bytes of the content, which is
+ * enough to guess the best transfer encoding and character set.
+ * Sets @out_complete to whether that is the whole content. */
+static GByteArray *
+attachment_file_wrapper_read_prefix (EAttachmentFileWrapper *file_wrapper,
+                                     gboolean *out_complete)
+{
+	GFileInputStream *input_stream;
+	GByteArray *prefix;
+	gsize bytes_read = 0;
+
+	prefix = g_byte_array_new ();
+	g_byte_array_set_size (prefix, BESTENC_PREFIX_SIZE + 1);
+	*out_complete = FALSE;
+
+	input_stream = g_file_read (file_wrapper->file, NULL, NULL);
+
+	/* Read one more byte, to know whether there is more. */
+	if (input_stream != NULL && g_input_stream_read_all (
+		G_INPUT_STREAM (input_stream), prefix->data,
+		BESTENC_PREFIX_SIZE + 1, &bytes_read, NULL, NULL)) {
+		*out_complete = bytes_read <= BESTENC_PREFIX_SIZE;
+		g_byte_array_set_size (
+			prefix, MIN (bytes_read, BESTENC_PREFIX_SIZE));
+	} else {
+		g_byte_array_set_size (prefix, 0);
+	}
+
+	g_clear_object (&input_stream);
+
+	return prefix;
+}
+
 static gboolean
 create_system_thumbnail (EAttachment *attachment,
                          GIcon **icon)
@@ -1184,6 +1387,7 @@ e_attachment_add_to_multipart (EAttachment *attachment,
 		CamelMimeFilter *filter;
 		CamelStream *stream;
 		const gchar *charset;
+		gboolean complete = TRUE;
 
 		charset = camel_content_type_param (content_type, "charset");
 
@@ -1196,8 +1400,21 @@ e_attachment_add_to_multipart (EAttachment *attachment,
 		camel_stream_filter_add (
 			CAMEL_STREAM_FILTER (filtered_stream),
 			CAMEL_MIME_FILTER (filter));
-		camel_data_wrapper_decode_to_stream_sync (
-			wrapper, filtered_stream, NULL, NULL);
+		if (E_IS_ATTACHMENT_FILE_WRAPPER (wrapper)) {
+			GByteArray *prefix;
+
+			/* Do not read the whole file, only its beginning. */
+			prefix = attachment_file_wrapper_read_prefix (
+				(EAttachmentFileWrapper *) wrapper, &complete);
+			camel_stream_write (
+				filtered_stream, (const gchar *) prefix->data,
+				prefix->len, NULL, NULL);
+			camel_stream_flush (filtered_stream, NULL, NULL);
+			g_byte_array_unref (prefix);
+		} else {
+			camel_data_wrapper_decode_to_stream_sync (
+				wrapper, filtered_stream, NULL, NULL);
+		}
 		g_object_unref (filtered_stream);
 		g_object_unref (stream);
 
@@ -1205,9 +1422,17 @@ e_attachment_add_to_multipart (EAttachment *attachment,
 		encoding = camel_mime_filter_bestenc_get_best_encoding (
 			CAMEL_MIME_FILTER_BESTENC (filter),
 			CAMEL_BESTENC_8BIT);
-		camel_mime_part_set_encoding (mime_part, encoding);
 		g_object_unref (filter);
 
+		/* The rest of the content may not fit the 7bit or
+		 * 8bit encoding, while quoted-printable fits anything. */
+		if (!complete && (
+		    encoding == CAMEL_TRANSFER_ENCODING_7BIT ||
+		    encoding == CAMEL_TRANSFER_ENCODING_8BIT))
+			encoding = CAMEL_TRANSFER_ENCODING_QUOTEDPRINTABLE;
+
+		camel_mime_part_set_encoding (mime_part, encoding);
+
 		if (encoding == CAMEL_TRANSFER_ENCODING_7BIT) {
 			/* The text fits within us-ascii, so this is safe.
 			 * FIXME Check that this isn't iso-2022-jp? */
@@ -1749,7 +1974,8 @@ struct _LoadContext {
 	GFileInfo *file_info;
 	goffset total_num_bytes;
 	gssize bytes_read;
-	gchar buffer[4096];
+	gchar *buffer;
+	gsize buffer_size;
 };
 
 /* Forward Declaration */
@@ -1803,6 +2029,8 @@ attachment_load_context_free (LoadContext *load_context)
 	if (load_context->file_info != NULL)
 		g_object_unref (load_context->file_info);
 
+	g_free (load_context->buffer);
+
 	g_slice_free (LoadContext, load_context);
 }
 
@@ -1824,48 +2052,77 @@ attachment_load_check_for_error (LoadContext *load_context,
 	return TRUE;
 }
 
+/* Whether the attachment content can be streamed from its file when
+ * needed, instead of being loaded into memory.  Only local regular
+ * files qualify, and not messages, which have to be parsed. */
+static gboolean
+attachment_load_can_stream_from_file (LoadContext *load_context,
+                                      GFile *file)
+{
+	GFileInfo *file_info;
+
+	file_info = load_context->file_info;
+
+	return g_file_is_native (file) &&
+		g_file_info_get_file_type (file_info) == G_FILE_TYPE_REGULAR &&
+		!e_attachment_is_rfc822 (load_context->attachment);
+}
+
 static void
 attachment_load_finish (LoadContext *load_context)
 {
 	GFileInfo *file_info;
 	EAttachment *attachment;
-	GMemoryOutputStream *output_stream;
 	GSimpleAsyncResult *simple;
 	CamelDataWrapper *wrapper;
 	CamelMimePart *mime_part;
-	CamelStream *stream;
 	const gchar *attribute;
 	const gchar *content_type;
 	const gchar *display_name;
 	const gchar *description;
 	const gchar *disposition;
 	gchar *mime_type;
-	gpointer data;
-	gsize size;
+	goffset size;
 
 	simple = load_context->simple;
 
 	file_info = load_context->file_info;
 	attachment = load_context->attachment;
-	output_stream = G_MEMORY_OUTPUT_STREAM (load_context->output_stream);
-
-	if (e_attachment_is_rfc822 (attachment))
-		wrapper = (CamelDataWrapper *) camel_mime_message_new ();
-	else
-		wrapper = camel_data_wrapper_new ();
 
 	content_type = g_file_info_get_content_type (file_info);
 	mime_type = g_content_type_get_mime_type (content_type);
 
-	data = g_memory_output_stream_get_data (output_stream);
-	size = g_memory_output_stream_get_data_size (output_stream);
+	if (load_context->output_stream != NULL) {
+		GMemoryOutputStream *output_stream;
+		CamelStream *stream;
+		gpointer data;
+
+		output_stream = G_MEMORY_OUTPUT_STREAM (
+			load_context->output_stream);
+
+		if (e_attachment_is_rfc822 (attachment))
+			wrapper = (CamelDataWrapper *) camel_mime_message_new ();
+		else
+			wrapper = camel_data_wrapper_new ();
+
+		data = g_memory_output_stream_get_data (output_stream);
+		size = g_memory_output_stream_get_data_size (output_stream);
+
+		stream = camel_stream_mem_new_with_buffer (data, size);
+		camel_data_wrapper_construct_from_stream_sync (
+			wrapper, stream, NULL, NULL);
+		camel_stream_close (stream, NULL, NULL);
+		g_object_unref (stream);
+	} else {
+		GFile *file;
+
+		file = e_attachment_ref_file (attachment);
+		wrapper = attachment_file_wrapper_new (file);
+		size = load_context->total_num_bytes;
+		g_object_unref (file);
+	}
 
-	stream = camel_stream_mem_new_with_buffer (data, size);
-	camel_data_wrapper_construct_from_stream_sync (
-		wrapper, stream, NULL, NULL);
 	camel_data_wrapper_set_mime_type (wrapper, mime_type);
-	camel_stream_close (stream, NULL, NULL);
-	g_object_unref (stream);
 
 	mime_part = camel_mime_part_new ();
 	camel_medium_set_content (CAMEL_MEDIUM (mime_part), wrapper);
@@ -1927,6 +2184,14 @@ attachment_load_write_cb (GOutputStream *output_stream,
 		g_seekable_tell (G_SEEKABLE (output_stream)),
 		load_context->total_num_bytes, attachment);
 
+	/* The last read filled the buffer, thus read bigger chunks. */
+	if ((gsize) bytes_written == load_context->buffer_size &&
+	    load_context->buffer_size < LOAD_BUFFER_MAX_SIZE) {
+		load_context->buffer_size *= 2;
+		load_context->buffer = g_realloc (
+			load_context->buffer, load_context->buffer_size);
+	}
+
 	if (bytes_written < load_context->bytes_read) {
 		memmove (
 			load_context->buffer,
@@ -1945,7 +2210,7 @@ attachment_load_write_cb (GOutputStream *output_stream,
 		g_input_stream_read_async (
 			input_stream,
 			load_context->buffer,
-			sizeof (load_context->buffer),
+			load_context->buffer_size,
 			G_PRIORITY_DEFAULT, cancellable,
 			(GAsyncReadyCallback) attachment_load_stream_read_cb,
 			load_context);
@@ -2005,18 +2270,26 @@ attachment_load_file_read_cb (GFile *file,
 	if (attachment_load_check_for_error (load_context, error))
 		return;
 
-	/* Load the contents into a GMemoryOutputStream. */
-	output_stream = g_memory_output_stream_new (
-		NULL, 0, g_realloc, g_free);
+	/* Load the contents into a GMemoryOutputStream, allocated
+	 * for the expected size upfront, to avoid reallocations. */
+	if (load_context->total_num_bytes > 0)
+		output_stream = g_memory_output_stream_new (
+			g_malloc (load_context->total_num_bytes),
+			load_context->total_num_bytes, g_realloc, g_free);
+	else
+		output_stream = g_memory_output_stream_new (
+			NULL, 0, g_realloc, g_free);
 
 	attachment = load_context->attachment;
 	cancellable = attachment->priv->cancellable;
 	load_context->output_stream = output_stream;
+	load_context->buffer_size = LOAD_BUFFER_MIN_SIZE;
+	load_context->buffer = g_malloc (load_context->buffer_size);
 
 	g_input_stream_read_async (
 		load_context->input_stream,
 		load_context->buffer,
-		sizeof (load_context->buffer),
+		load_context->buffer_size,
 		G_PRIORITY_DEFAULT, cancellable,
 		(GAsyncReadyCallback) attachment_load_stream_read_cb,
 		load_context);
@@ -2144,10 +2417,16 @@ attachment_load_query_info_cb (GFile *file,
 		g_object_unref (temporary);
 	} else {
 #endif
-		g_file_read_async (
-			file, G_PRIORITY_DEFAULT,
-			cancellable, (GAsyncReadyCallback)
-			attachment_load_file_read_cb, load_context);
+		if (attachment_load_can_stream_from_file (load_context, file)) {
+			/* Nothing to read now, the content
+			 * is read from the file when needed. */
+			attachment_load_finish (load_context);
+		} else {
+			g_file_read_async (
+				file, G_PRIORITY_DEFAULT,
+				cancellable, (GAsyncReadyCallback)
+				attachment_load_file_read_cb, load_context);
+		}
 #ifdef HAVE_AUTOAR
 	}
 #endif
@@ -3199,6 +3478,46 @@ attachment_save_got_output_stream (SaveContext *save_context)
 	attachment = save_context->attachment;
 	cancellable = attachment->priv->cancellable;
 	mime_part = e_attachment_ref_mime_part (attachment);
+	wrapper = camel_medium_get_content (CAMEL_MEDIUM (mime_part));
+
+	/* A file-backed content can be read from its file directly,
+	 * unless it is also to be extracted, which needs the buffer. */
+	if (E_IS_ATTACHMENT_FILE_WRAPPER (wrapper) &&
+	    attachment->priv->save_self &&
+	    !attachment->priv->save_extracted) {
+		EAttachmentFileWrapper *file_wrapper;
+		GFileInputStream *file_input_stream;
+		GFileInfo *file_info;
+		GError *error = NULL;
+
+		file_wrapper = (EAttachmentFileWrapper *) wrapper;
+		file_input_stream = g_file_read (
+			file_wrapper->file, cancellable, &error);
+
+		g_clear_object (&mime_part);
+
+		if (attachment_save_check_for_error (save_context, error))
+			return;
+
+		save_context->input_stream = G_INPUT_STREAM (file_input_stream);
+
+		file_info = e_attachment_ref_file_info (attachment);
+		if (file_info != NULL) {
+			save_context->total_num_bytes =
+				g_file_info_get_size (file_info);
+			g_object_unref (file_info);
+		}
+
+		g_input_stream_read_async (
+			save_context->input_stream,
+			save_context->buffer,
+			sizeof (save_context->buffer),
+			G_PRIORITY_DEFAULT, cancellable,
+			(GAsyncReadyCallback) attachment_save_read_cb,
+			save_context);
+
+		return;
+	}
 
 	/* Decode the MIME part to an in-memory buffer.  We have to do
 	 * this because CamelStream is synchronous-only, and using threads
@@ -3206,7 +3525,6 @@ attachment_save_got_output_stream (SaveContext *save_context)
 	buffer = g_byte_array_new ();
 	stream = camel_stream_mem_new ();
 	camel_stream_mem_set_byte_array (CAMEL_STREAM_MEM (stream), buffer);
-	wrapper = camel_medium_get_content (CAMEL_MEDIUM (mime_part));
 	camel_data_wrapper_decode_to_stream_sync (wrapper, stream, NULL, NULL);
 	g_object_unref (stream);
 
@@ -110,6 +110,16 @@ G_DEFINE_TYPE (ECellText, e_cell_text, E_TYPE_CELL)
 
 #define TEXT_PAD 4
 
+/* How many layouts are remembered by each ECellTextView */
+#define LAYOUT_CACHE_SIZE 256
+
+enum {
+	TEXT_ATTR_BOLD		= 1 << 0,
+	TEXT_ATTR_STRIKEOUT	= 1 << 1,
+	TEXT_ATTR_UNDERLINE	= 1 << 2,
+	TEXT_ATTR_ITALIC	= 1 << 3
+};
+
 typedef struct {
 	gpointer lines;			/* Text split into lines (private field) */
 	gint num_lines;			/* Number of lines of text */
@@ -133,8 +143,20 @@ typedef struct {
 	gint xofs, yofs;                 /* This gets added to the x
                                            and y for the cell text. */
 	gdouble ellipsis_width[2];      /* The width of the ellipsis. */
+
+	/*
+	 * Shaped layouts of not edited cells, with the most
+	 * recently used at the head of the layout_cache_lru.
+	 */
+	GHashTable *layout_cache;	/* gchar *key ~> GList *link */
+	GQueue layout_cache_lru;	/* LayoutCacheEntry * */
 } ECellTextView;
 
+typedef struct {
+	gchar *key;
+	PangoLayout *layout;
+} LayoutCacheEntry;
+
 struct _CellEdit {
 
 	ECellTextView *text_view;
@@ -332,6 +354,29 @@ ect_cancel_edit (ECellTextView *text_view)
 /*
  * ECell::new_view method
  */
+static void
+layout_cache_entry_free (gpointer ptr)
+{
+	LayoutCacheEntry *entry = ptr;
+
+	if (entry) {
+		g_free (entry->key);
+		g_clear_object (&entry->layout);
+		g_free (entry);
+	}
+}
+
+static void
+ect_layout_cache_clear (ECellTextView *text_view)
+{
+	LayoutCacheEntry *entry;
+
+	g_hash_table_remove_all (text_view->layout_cache);
+
+	while ((entry = g_queue_pop_head (&text_view->layout_cache_lru)) != NULL)
+		layout_cache_entry_free (entry);
+}
+
 static ECellView *
 ect_new_view (ECell *ecell,
               ETableModel *table_model,
@@ -351,6 +396,9 @@ ect_new_view (ECell *ecell,
 	text_view->xofs = 0.0;
 	text_view->yofs = 0.0;
 
+	text_view->layout_cache = g_hash_table_new (g_str_hash, g_str_equal);
+	g_queue_init (&text_view->layout_cache_lru);
+
 	return (ECellView *) text_view;
 }
 
@@ -368,6 +416,9 @@ ect_kill_view (ECellView *ecv)
 	if (text_view->cell_view.kill_view_cb_data)
 	    g_list_free (text_view->cell_view.kill_view_cb_data);
 
+	ect_layout_cache_clear (text_view);
+	g_hash_table_destroy (text_view->layout_cache);
+
 	g_free (text_view);
 }
 
@@ -399,38 +450,76 @@ ect_unrealize (ECellView *ecv)
 
 	g_object_unref (text_view->i_cursor);
 
+	ect_layout_cache_clear (text_view);
+
 	if (E_CELL_CLASS (e_cell_text_parent_class)->unrealize)
 		(* E_CELL_CLASS (e_cell_text_parent_class)->unrealize) (ecv);
 
 }
 
+/*
+ * ECell::style_updated method
+ */
+static void
+ect_style_updated (ECellView *ecell_view)
+{
+	ECellTextView *text_view = (ECellTextView *) ecell_view;
+
+	/* Fonts could change, thus the layouts need to be shaped again */
+	ect_layout_cache_clear (text_view);
+
+	if (E_CELL_CLASS (e_cell_text_parent_class)->style_updated)
+		(* E_CELL_CLASS (e_cell_text_parent_class)->style_updated) (ecell_view);
+}
+
+static guint
+get_attr_flags (ECellTextView *text_view,
+                gint row,
+                guint *strikeout_color)
+{
+	ECellView *ecell_view = (ECellView *) text_view;
+	ECellText *ect = E_CELL_TEXT (ecell_view->ecell);
+	guint flags = 0;
+
+	*strikeout_color = 0;
+
+	if (row < 0)
+		return flags;
+
+	if (ect->bold_column >= 0 &&
+	    e_table_model_value_at (ecell_view->e_table_model, ect->bold_column, row))
+		flags |= TEXT_ATTR_BOLD;
+	if (ect->strikeout_column >= 0 &&
+	    e_table_model_value_at (ecell_view->e_table_model, ect->strikeout_column, row))
+		flags |= TEXT_ATTR_STRIKEOUT;
+	if (ect->underline_column >= 0 &&
+	    e_table_model_value_at (ecell_view->e_table_model, ect->underline_column, row))
+		flags |= TEXT_ATTR_UNDERLINE;
+	if (ect->italic_column >= 0 &&
+	    e_table_model_value_at (ecell_view->e_table_model, ect->italic_column, row))
+		flags |= TEXT_ATTR_ITALIC;
+
+	if (ect->strikeout_color_column >= 0)
+		*strikeout_color = GPOINTER_TO_UINT (e_table_model_value_at (ecell_view->e_table_model, ect->strikeout_color_column, row));
+
+	return flags;
+}
+
 static PangoAttrList *
 build_attr_list (ECellTextView *text_view,
                  gint row,
                  gint text_length)
 {
-
-	ECellView *ecell_view = (ECellView *) text_view;
-	ECellText *ect = E_CELL_TEXT (ecell_view->ecell);
 	PangoAttrList *attrs = pango_attr_list_new ();
 	gboolean bold, strikeout, underline, italic;
-	gint strikeout_color = 0;
-
-	bold = ect->bold_column >= 0 &&
-		row >= 0 &&
-		e_table_model_value_at (ecell_view->e_table_model, ect->bold_column, row);
-	strikeout = ect->strikeout_column >= 0 &&
-		row >= 0 &&
-		e_table_model_value_at (ecell_view->e_table_model, ect->strikeout_column, row);
-	underline = ect->underline_column >= 0 &&
-		row >= 0 &&
-		e_table_model_value_at (ecell_view->e_table_model, ect->underline_column, row);
-	italic = ect->italic_column >= 0 &&
-		row >= 0 &&
-		e_table_model_value_at (ecell_view->e_table_model, ect->italic_column, row);
+	guint strikeout_color = 0;
+	guint flags;
 
-	if (ect->strikeout_color_column >= 0 && row >= 0)
-		strikeout_color = GPOINTER_TO_UINT (e_table_model_value_at (ecell_view->e_table_model, ect->strikeout_color_column, row));
+	flags = get_attr_flags (text_view, row, &strikeout_color);
+	bold = (flags & TEXT_ATTR_BOLD) != 0;
+	strikeout = (flags & TEXT_ATTR_STRIKEOUT) != 0;
+	underline = (flags & TEXT_ATTR_UNDERLINE) != 0;
+	italic = (flags & TEXT_ATTR_ITALIC) != 0;
 
 	if (bold) {
 		PangoAttribute *attr = pango_attr_weight_new (PANGO_WEIGHT_BOLD);
@@ -609,6 +698,68 @@ build_layout (ECellTextView *text_view,
 	return layout;
 }
 
+/* The key covers everything build_layout() sets on the layout, except
+ * of the canvas font, changes of which clear the whole cache. */
+static gchar *
+layout_cache_dup_key (ECellTextView *text_view,
+                      gint row,
+                      const gchar *text,
+                      gint width)
+{
+	ECellView *ecell_view = (ECellView *) text_view;
+	ECellText *ect = E_CELL_TEXT (ecell_view->ecell);
+	guint flags, strikeout_color = 0;
+
+	flags = get_attr_flags (text_view, row, &strikeout_color);
+
+	return g_strdup_printf (
+		"%d\t%d\t%u\t%u\t%s\t%s", width, ect->justify,
+		flags, strikeout_color, ect->font_name ? ect->font_name : "", text);
+}
+
+/* Returns a new reference of a (possibly shared) layout for the @text,
+ * which should not be modified by the caller. */
+static PangoLayout *
+layout_cache_get_layout (ECellTextView *text_view,
+                         gint row,
+                         const gchar *text,
+                         gint width)
+{
+	LayoutCacheEntry *entry;
+	GList *link;
+	gchar *key;
+
+	key = layout_cache_dup_key (text_view, row, text, width);
+	link = g_hash_table_lookup (text_view->layout_cache, key);
+
+	if (link) {
+		g_free (key);
+
+		g_queue_unlink (&text_view->layout_cache_lru, link);
+		g_queue_push_head_link (&text_view->layout_cache_lru, link);
+
+		entry = link->data;
+
+		return g_object_ref (entry->layout);
+	}
+
+	entry = g_new0 (LayoutCacheEntry, 1);
+	entry->key = key;
+	entry->layout = build_layout (text_view, row, text, width);
+
+	g_queue_push_head (&text_view->layout_cache_lru, entry);
+	g_hash_table_insert (text_view->layout_cache, entry->key, text_view->layout_cache_lru.head);
+
+	while (g_queue_get_length (&text_view->layout_cache_lru) > LAYOUT_CACHE_SIZE) {
+		LayoutCacheEntry *oldest = g_queue_pop_tail (&text_view->layout_cache_lru);
+
+		g_hash_table_remove (text_view->layout_cache, oldest->key);
+		layout_cache_entry_free (oldest);
+	}
+
+	return g_object_ref (entry->layout);
+}
+
 static PangoLayout *
 generate_layout (ECellTextView *text_view,
                  gint model_col,
@@ -626,12 +777,25 @@ generate_layout (ECellTextView *text_view,
 		return edit->layout;
 	}
 
+	/* The layouts built during editing are modified
+	 * in place, thus they cannot be shared. */
+	if (edit) {
+		if (row >= 0) {
+			gchar *temp = e_cell_text_get_text (ect, ecell_view->e_table_model, model_col, row);
+			layout = build_layout (text_view, row, temp ? temp : "?", width);
+			e_cell_text_free_text (ect, ecell_view->e_table_model, model_col, temp);
+		} else
+			layout = build_layout (text_view, row, "Mumbo Jumbo", width);
+
+		return layout;
+	}
+
 	if (row >= 0) {
 		gchar *temp = e_cell_text_get_text (ect, ecell_view->e_table_model, model_col, row);
-		layout = build_layout (text_view, row, temp ? temp : "?", width);
+		layout = layout_cache_get_layout (text_view, row, temp ? temp : "?", width);
 		e_cell_text_free_text (ect, ecell_view->e_table_model, model_col, temp);
 	} else
-		layout = build_layout (text_view, row, "Mumbo Jumbo", width);
+		layout = layout_cache_get_layout (text_view, row, "Mumbo Jumbo", width);
 
 	return layout;
 }
@@ -1679,6 +1843,7 @@ e_cell_text_class_init (ECellTextClass *class)
 	ecc->draw = ect_draw;
 	ecc->event = ect_event;
 	ecc->height = ect_height;
+	ecc->style_updated = ect_style_updated;
 	ecc->enter_edit = ect_enter_edit;
 	ecc->leave_edit = ect_leave_edit;
 	ecc->save_state = ect_save_state;
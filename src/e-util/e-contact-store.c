@@ -44,6 +44,10 @@ struct _EContactStorePrivate {
 	gint stamp;
 	EBookQuery *query;
 	GArray *contact_sources;
+
+	/* Completion cue answered from the book indexes, if any */
+	gchar *cue;
+	gboolean use_index;
 };
 
 /* Signals */
@@ -94,6 +98,31 @@ static gboolean     e_contact_store_iter_parent     (GtkTreeModel       *tree_mo
 						     GtkTreeIter        *iter,
 						     GtkTreeIter        *child);
 
+/* Prefix index of the names, nicknames and e-mail addresses of a book,
+ * shared by all the stores and kept current through a client view, thus
+ * the completion cues can be answered without querying the backend. */
+typedef struct
+{
+	gchar *key;		/* casefolded */
+	EContact *contact;	/* owned by the 'contacts' table */
+}
+IndexKey;
+
+typedef struct
+{
+	gint ref_count;
+	EBookClient *book_client;
+	EBookClientView *client_view;
+	GHashTable *contacts;	/* UID ~> EContact */
+	GArray *keys;		/* IndexKey, sorted by the key */
+	gboolean keys_valid;
+	gboolean complete;
+	GSList *stores;		/* EContactStore, not referenced */
+}
+BookIndex;
+
+static GHashTable *book_indexes = NULL; /* EBookClient ~> BookIndex */
+
 typedef struct
 {
 	EBookClient *book_client;
@@ -103,12 +132,17 @@ typedef struct
 
 	EBookClientView *client_view_pending;
 	GPtrArray *contacts_pending;
+
+	BookIndex *index;
+	gboolean from_index;
 }
 ContactSource;
 
 static void free_contact_ptrarray (GPtrArray *contacts);
 static void clear_contact_source  (EContactStore *contact_store, ContactSource *source);
 static void stop_view             (EContactStore *contact_store, EBookClientView *view);
+static void query_contact_source  (EContactStore *contact_store, ContactSource *source);
+static void book_index_detach     (EContactStore *contact_store, ContactSource *source);
 
 static void
 contact_store_dispose (GObject *object)
@@ -127,6 +161,7 @@ contact_store_dispose (GObject *object)
 			priv->contact_sources, ContactSource, priv->contact_sources->len - ii - 1);
 
 		clear_contact_source (E_CONTACT_STORE (object), source);
+		book_index_detach (E_CONTACT_STORE (object), source);
 		free_contact_ptrarray (source->contacts);
 		g_object_unref (source->book_client);
 	}
@@ -137,6 +172,8 @@ contact_store_dispose (GObject *object)
 		priv->query = NULL;
 	}
 
+	g_clear_pointer (&priv->cue, g_free);
+
 	/* Chain up to parent's dispose() method. */
 	G_OBJECT_CLASS (e_contact_store_parent_class)->dispose (object);
 }
@@ -579,6 +616,335 @@ find_contact_source_details_by_view (EContactStore *contact_store,
 	return TRUE;
 }
 
+/* ------------ *
+ * Book indexes *
+ * ------------ */
+
+static gint
+index_key_compare (gconstpointer ptr1,
+                   gconstpointer ptr2)
+{
+	const IndexKey *ik1 = ptr1, *ik2 = ptr2;
+
+	return strcmp (ik1->key, ik2->key);
+}
+
+static void
+book_index_add_key (GArray *keys,
+                    EContact *contact,
+                    const gchar *value,
+                    gboolean with_words)
+{
+	IndexKey ik;
+	const gchar *p;
+
+	if (!value || !*value)
+		return;
+
+	ik.key = g_utf8_casefold (value, -1);
+	ik.contact = contact;
+	g_array_append_val (keys, ik);
+
+	if (!with_words)
+		return;
+
+	/* Every word start, the closest the index gets to 'contains' */
+	for (p = value; *p; p = g_utf8_next_char (p)) {
+		const gchar *next = g_utf8_next_char (p);
+
+		if (*next && !g_unichar_isalnum (g_utf8_get_char (p)) &&
+		    g_unichar_isalnum (g_utf8_get_char (next)))
+			book_index_add_key (keys, contact, next, FALSE);
+	}
+}
+
+static void
+book_index_ensure_keys (BookIndex *index)
+{
+	GHashTableIter iter;
+	gpointer value;
+	guint ii;
+
+	if (index->keys_valid)
+		return;
+
+	for (ii = 0; ii < index->keys->len; ii++)
+		g_free (g_array_index (index->keys, IndexKey, ii).key);
+	g_array_set_size (index->keys, 0);
+
+	g_hash_table_iter_init (&iter, index->contacts);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		EContact *contact = value;
+		EContactName *name;
+		GList *emails, *link;
+
+		/* Word starts as well, thus "smith" finds "John Smith",
+		 * the same as the name queries of the backends do */
+		book_index_add_key (index->keys, contact, e_contact_get_const (contact, E_CONTACT_FULL_NAME), TRUE);
+		book_index_add_key (index->keys, contact, e_contact_get_const (contact, E_CONTACT_FILE_AS), TRUE);
+		book_index_add_key (index->keys, contact, e_contact_get_const (contact, E_CONTACT_NICKNAME), TRUE);
+
+		name = e_contact_get (contact, E_CONTACT_NAME);
+		if (name) {
+			book_index_add_key (index->keys, contact, name->given, TRUE);
+			book_index_add_key (index->keys, contact, name->additional, TRUE);
+			book_index_add_key (index->keys, contact, name->family, TRUE);
+			e_contact_name_free (name);
+		}
+
+		emails = e_contact_get (contact, E_CONTACT_EMAIL);
+		for (link = emails; link; link = g_list_next (link))
+			book_index_add_key (index->keys, contact, link->data, TRUE);
+		g_list_free_full (emails, g_free);
+	}
+
+	g_array_sort (index->keys, index_key_compare);
+	index->keys_valid = TRUE;
+}
+
+/* Adds contacts with a key beginning with the 'cue' into 'matches',
+ * each of them only once. */
+static void
+book_index_lookup (BookIndex *index,
+                   const gchar *cue,
+                   GHashTable *seen,
+                   GPtrArray *matches)
+{
+	guint low, high;
+
+	book_index_ensure_keys (index);
+
+	/* The first key not less than the cue */
+	low = 0;
+	high = index->keys->len;
+	while (low < high) {
+		guint middle = (low + high) / 2;
+
+		if (strcmp (g_array_index (index->keys, IndexKey, middle).key, cue) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	for (; low < index->keys->len; low++) {
+		IndexKey *ik = &g_array_index (index->keys, IndexKey, low);
+
+		if (!g_str_has_prefix (ik->key, cue))
+			break;
+
+		if (g_hash_table_contains (seen, ik->contact))
+			continue;
+
+		g_hash_table_add (seen, ik->contact);
+		g_ptr_array_add (matches, g_object_ref (ik->contact));
+	}
+}
+
+static void
+book_index_changed (BookIndex *index)
+{
+	GSList *link;
+
+	if (!index->complete)
+		return;
+
+	for (link = index->stores; link; link = g_slist_next (link)) {
+		EContactStore *contact_store = link->data;
+		GArray *array = contact_store->priv->contact_sources;
+		guint ii;
+
+		if (!contact_store->priv->cue)
+			continue;
+
+		for (ii = 0; ii < array->len; ii++) {
+			ContactSource *source = &g_array_index (array, ContactSource, ii);
+
+			if (source->index == index)
+				query_contact_source (contact_store, source);
+		}
+	}
+}
+
+static void
+book_index_contacts_added (EBookClientView *client_view,
+                           const GSList *contacts,
+                           BookIndex *index)
+{
+	const GSList *link;
+
+	for (link = contacts; link; link = g_slist_next (link)) {
+		EContact *contact = link->data;
+		const gchar *uid = e_contact_get_const (contact, E_CONTACT_UID);
+
+		if (uid)
+			g_hash_table_insert (index->contacts, g_strdup (uid), g_object_ref (contact));
+	}
+
+	index->keys_valid = FALSE;
+	book_index_changed (index);
+}
+
+static void
+book_index_contacts_removed (EBookClientView *client_view,
+                             const GSList *uids,
+                             BookIndex *index)
+{
+	const GSList *link;
+
+	for (link = uids; link; link = g_slist_next (link))
+		g_hash_table_remove (index->contacts, link->data);
+
+	index->keys_valid = FALSE;
+	book_index_changed (index);
+}
+
+static void
+book_index_complete (EBookClientView *client_view,
+                     const GError *error,
+                     BookIndex *index)
+{
+	if (error) {
+		g_warning ("%s: Failed to index book: %s", G_STRFUNC, error->message);
+		return;
+	}
+
+	index->complete = TRUE;
+	book_index_changed (index);
+}
+
+static void
+book_index_view_ready_cb (GObject *source_object,
+                          GAsyncResult *result,
+                          gpointer user_data)
+{
+	BookIndex *index;
+	EBookClientView *client_view = NULL;
+	GError *error = NULL;
+
+	e_book_client_get_view_finish (E_BOOK_CLIENT (source_object), result, &client_view, &error);
+
+	if (error) {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("%s: Failed to index book: %s", G_STRFUNC, error->message);
+		g_clear_error (&error);
+		return;
+	}
+
+	/* The index could be gone meanwhile */
+	index = book_indexes ? g_hash_table_lookup (book_indexes, source_object) : NULL;
+	if (!index || index->client_view) {
+		e_book_client_view_stop (client_view, NULL);
+		g_object_unref (client_view);
+		return;
+	}
+
+	index->client_view = client_view;
+
+	g_signal_connect (
+		client_view, "objects-added",
+		G_CALLBACK (book_index_contacts_added), index);
+	g_signal_connect (
+		client_view, "objects-modified",
+		G_CALLBACK (book_index_contacts_added), index);
+	g_signal_connect (
+		client_view, "objects-removed",
+		G_CALLBACK (book_index_contacts_removed), index);
+	g_signal_connect (
+		client_view, "complete",
+		G_CALLBACK (book_index_complete), index);
+
+	e_book_client_view_start (client_view, NULL);
+}
+
+static BookIndex *
+book_index_ref (EBookClient *book_client)
+{
+	BookIndex *index;
+
+	if (!book_indexes)
+		book_indexes = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	index = g_hash_table_lookup (book_indexes, book_client);
+	if (index) {
+		index->ref_count++;
+		return index;
+	}
+
+	index = g_new0 (BookIndex, 1);
+	index->ref_count = 1;
+	index->book_client = g_object_ref (book_client);
+	index->contacts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+	index->keys = g_array_new (FALSE, FALSE, sizeof (IndexKey));
+
+	g_hash_table_insert (book_indexes, book_client, index);
+
+	e_book_client_get_view (book_client, "#t", NULL, book_index_view_ready_cb, NULL);
+
+	return index;
+}
+
+static gpointer contact_store_stop_view_in_thread (gpointer user_data);
+
+static void
+book_index_unref (BookIndex *index)
+{
+	guint ii;
+
+	index->ref_count--;
+	if (index->ref_count > 0)
+		return;
+
+	g_hash_table_remove (book_indexes, index->book_client);
+
+	if (index->client_view) {
+		GThread *thread;
+
+		g_signal_handlers_disconnect_matched (
+			index->client_view, G_SIGNAL_MATCH_DATA,
+			0, 0, NULL, NULL, index);
+
+		thread = g_thread_new (NULL, contact_store_stop_view_in_thread, index->client_view);
+		g_thread_unref (thread);
+	}
+
+	for (ii = 0; ii < index->keys->len; ii++)
+		g_free (g_array_index (index->keys, IndexKey, ii).key);
+	g_array_free (index->keys, TRUE);
+
+	g_hash_table_destroy (index->contacts);
+	g_object_unref (index->book_client);
+	g_slist_free (index->stores);
+	g_free (index);
+}
+
+/* Books which can list all of their contacts are indexed */
+static void
+book_index_attach (EContactStore *contact_store,
+                   ContactSource *source)
+{
+	if (source->index || !contact_store->priv->use_index)
+		return;
+
+	if (!e_client_check_capability (E_CLIENT (source->book_client), "do-initial-query"))
+		return;
+
+	source->index = book_index_ref (source->book_client);
+	source->index->stores = g_slist_prepend (source->index->stores, contact_store);
+}
+
+static void
+book_index_detach (EContactStore *contact_store,
+                   ContactSource *source)
+{
+	if (!source->index)
+		return;
+
+	source->index->stores = g_slist_remove (source->index->stores, contact_store);
+	book_index_unref (source->index);
+	source->index = NULL;
+	source->from_index = FALSE;
+}
+
 /* ------------------------- *
  * EBookView signal handlers *
  * ------------------------- */
@@ -927,7 +1293,11 @@ client_view_ready_cb (GObject *source_object,
 
 		source = &g_array_index (contact_store->priv->contact_sources, ContactSource, source_idx);
 
-		if (source->client_view) {
+		if (source->from_index) {
+			/* The index answered meanwhile */
+			if (client_view)
+				g_thread_unref (g_thread_new (NULL, contact_store_stop_view_in_thread, client_view));
+		} else if (source->client_view) {
 			if (source->client_view_pending) {
 				stop_view (contact_store, source->client_view_pending);
 				g_object_unref (source->client_view_pending);
@@ -954,6 +1324,111 @@ client_view_ready_cb (GObject *source_object,
 	g_object_unref (contact_store);
 }
 
+/* Replaces the contacts of the 'source' with the index matches of the
+ * completion cue, emitting only the differences. */
+static void
+query_contact_source_index (EContactStore *contact_store,
+                            ContactSource *source)
+{
+	GPtrArray *matches;
+	GHashTable *seen, *hash;
+	gchar *cue, **words;
+	gint offset, ii;
+
+	/* Views of the backend are not needed any more */
+	if (source->client_view_pending) {
+		stop_view (contact_store, source->client_view_pending);
+		g_object_unref (source->client_view_pending);
+		free_contact_ptrarray (source->contacts_pending);
+		source->client_view_pending = NULL;
+		source->contacts_pending = NULL;
+	}
+
+	if (source->client_view) {
+		stop_view (contact_store, source->client_view);
+		g_object_unref (source->client_view);
+		source->client_view = NULL;
+	}
+
+	matches = g_ptr_array_new ();
+	seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	cue = g_utf8_casefold (contact_store->priv->cue, -1);
+	g_strstrip (cue);
+	book_index_lookup (source->index, cue, seen, matches);
+
+	/* "first last" also matches "first, last", like the name queries do */
+	words = g_strsplit (cue, " ", 0);
+	if (words[0] && words[1]) {
+		gchar *comma_cue = g_strjoinv (", ", words);
+
+		book_index_lookup (source->index, comma_cue, seen, matches);
+		g_free (comma_cue);
+	}
+	g_strfreev (words);
+	g_free (cue);
+
+	g_hash_table_destroy (seen);
+
+	offset = get_contact_source_offset (contact_store, find_contact_source_by_pointer (contact_store, source));
+
+	g_signal_emit (contact_store, signals[START_UPDATE], 0, NULL);
+
+	/* Deletions */
+	hash = g_hash_table_new (g_str_hash, g_str_equal);
+	for (ii = 0; ii < matches->len; ii++) {
+		const gchar *uid = e_contact_get_const (g_ptr_array_index (matches, ii), E_CONTACT_UID);
+
+		g_hash_table_add (hash, (gpointer) uid);
+	}
+
+	for (ii = source->contacts->len - 1; ii >= 0; ii--) {
+		EContact *old_contact = g_ptr_array_index (source->contacts, ii);
+
+		if (!g_hash_table_contains (hash, e_contact_get_const (old_contact, E_CONTACT_UID))) {
+			g_object_unref (old_contact);
+			g_ptr_array_remove_index (source->contacts, ii);
+			row_deleted (contact_store, offset + ii);
+		}
+	}
+	g_hash_table_destroy (hash);
+
+	/* Insertions and changes */
+	hash = g_hash_table_new (g_str_hash, g_str_equal);
+	for (ii = 0; ii < source->contacts->len; ii++) {
+		const gchar *uid = e_contact_get_const (g_ptr_array_index (source->contacts, ii), E_CONTACT_UID);
+
+		g_hash_table_insert (hash, (gpointer) uid, GINT_TO_POINTER (ii));
+	}
+
+	for (ii = 0; ii < matches->len; ii++) {
+		EContact *new_contact = g_ptr_array_index (matches, ii);
+		gpointer value;
+
+		if (g_hash_table_lookup_extended (hash, e_contact_get_const (new_contact, E_CONTACT_UID), NULL, &value)) {
+			gint n = GPOINTER_TO_INT (value);
+
+			if (source->contacts->pdata[n] != new_contact) {
+				g_object_unref (source->contacts->pdata[n]);
+				source->contacts->pdata[n] = new_contact;
+				row_changed (contact_store, offset + n);
+			} else {
+				g_object_unref (new_contact);
+			}
+		} else {
+			g_ptr_array_add (source->contacts, new_contact);
+			row_inserted (contact_store, offset + source->contacts->len - 1);
+		}
+	}
+	g_hash_table_destroy (hash);
+
+	g_signal_emit (contact_store, signals[STOP_UPDATE], 0, NULL);
+
+	g_ptr_array_free (matches, TRUE);
+
+	source->from_index = TRUE;
+}
+
 static void
 query_contact_source (EContactStore *contact_store,
                       ContactSource *source)
@@ -962,6 +1437,17 @@ query_contact_source (EContactStore *contact_store,
 
 	g_return_if_fail (source->book_client != NULL);
 
+	if (contact_store->priv->cue && source->index && source->index->complete) {
+		query_contact_source_index (contact_store, source);
+		return;
+	}
+
+	/* The contacts came from the index, the view starts from scratch */
+	if (source->from_index) {
+		clear_contact_source (contact_store, source);
+		source->from_index = FALSE;
+	}
+
 	if (!contact_store->priv->query) {
 		clear_contact_source (contact_store, source);
 		return;
@@ -1129,6 +1615,7 @@ e_contact_store_add_client (EContactStore *contact_store,
 
 	indexed_source = &g_array_index (array, ContactSource, array->len - 1);
 
+	book_index_attach (contact_store, indexed_source);
 	query_contact_source (contact_store, indexed_source);
 }
 
@@ -1163,6 +1650,7 @@ e_contact_store_remove_client (EContactStore *contact_store,
 
 	source = &g_array_index (array, ContactSource, source_index);
 	clear_contact_source (contact_store, source);
+	book_index_detach (contact_store, source);
 	free_contact_ptrarray (source->contacts);
 	g_object_unref (book_client);
 
@@ -1188,9 +1676,11 @@ e_contact_store_set_query (EContactStore *contact_store,
 
 	g_return_if_fail (E_IS_CONTACT_STORE (contact_store));
 
-	if (book_query == contact_store->priv->query)
+	if (book_query == contact_store->priv->query && !contact_store->priv->cue)
 		return;
 
+	g_clear_pointer (&contact_store->priv->cue, g_free);
+
 	if (contact_store->priv->query)
 		e_book_query_unref (contact_store->priv->query);
 
@@ -1208,6 +1698,53 @@ e_contact_store_set_query (EContactStore *contact_store,
 	}
 }
 
+/**
+ * e_contact_store_set_completion_query:
+ * @contact_store: an #EContactStore
+ * @book_query: an #EBookQuery
+ * @cue: the text being completed
+ *
+ * Similar to e_contact_store_set_query(), only the books which can list
+ * all their contacts are answered from an index, shared by the stores,
+ * with contacts whose name, nickname or e-mail address, or any word
+ * of the last two, begins with @cue.  The other books, and the books
+ * whose index is not ready yet, are queried with @book_query.
+ *
+ * Since: 3.24
+ **/
+void
+e_contact_store_set_completion_query (EContactStore *contact_store,
+                                      EBookQuery *book_query,
+                                      const gchar *cue)
+{
+	GArray *array;
+	gint i;
+
+	g_return_if_fail (E_IS_CONTACT_STORE (contact_store));
+	g_return_if_fail (cue != NULL);
+
+	contact_store->priv->use_index = TRUE;
+
+	if (contact_store->priv->query)
+		e_book_query_unref (contact_store->priv->query);
+
+	contact_store->priv->query = book_query;
+	if (book_query)
+		e_book_query_ref (book_query);
+
+	g_free (contact_store->priv->cue);
+	contact_store->priv->cue = g_strdup (cue);
+
+	array = contact_store->priv->contact_sources;
+	for (i = 0; i < array->len; i++) {
+		ContactSource *contact_source;
+
+		contact_source = &g_array_index (array, ContactSource, i);
+		book_index_attach (contact_store, contact_source);
+		query_contact_source (contact_store, contact_source);
+	}
+}
+
 /**
  * e_contact_store_peek_query:
  * @contact_store: an #EContactStore
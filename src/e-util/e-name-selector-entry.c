@@ -873,7 +873,13 @@ set_completion_query (ENameSelectorEntry *name_selector_entry,
 	ENS_DEBUG (g_print ("%s\n", query_str));
 
 	book_query = e_book_query_from_string (query_str);
-	e_contact_store_set_query (name_selector_entry->priv->contact_store, book_query);
+
+	/* The book indexes do not know about the user query fields */
+	if (priv->user_query_fields)
+		e_contact_store_set_query (name_selector_entry->priv->contact_store, book_query);
+	else
+		e_contact_store_set_completion_query (name_selector_entry->priv->contact_store, book_query, cue_str);
+
 	e_book_query_unref (book_query);
 
 	g_free (query_str);
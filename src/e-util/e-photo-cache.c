@@ -23,13 +23,14 @@
  * #EPhotoCache finds photos associated with an email address.
  *
  * A limited internal cache is employed to speed up frequently searched
- * email addresses.  The exact caching semantics are private and subject
- * to change.
+ * email addresses, backed by an on-disk cache in the user's cache directory.
+ * The exact caching semantics are private and subject to change.
  **/
 
 #include "e-photo-cache.h"
 
 #include <string.h>
+#include <glib/gstdio.h>
 #include <libebackend/libebackend.h>
 
 #include <e-util/e-data-capture.h>
@@ -42,11 +43,19 @@
  * priority photo source, after which we settle for what we have. */
 #define ASYNC_TIMEOUT_SECONDS 3.0
 
-/* How many email addresses we track at once, regardless of whether
- * the email address has a photo.  As new cache entries are added, we
- * discard the least recently accessed entries to keep the cache size
- * within the limit. */
-#define MAX_CACHE_SIZE 20
+/* How many email addresses we track in memory at once by default,
+ * regardless of whether the email address has a photo.  As new cache
+ * entries are added, we discard the least recently accessed entries
+ * to keep the cache size within the limit. */
+#define DEFAULT_MAX_CACHE_SIZE 100
+
+/* How long (in seconds) to remember that an email address has no photo,
+ * thus a newly added photo in any of the photo sources is noticed. */
+#define NEGATIVE_CACHE_TTL_SECONDS (60 * 60)
+
+/* How long (in seconds) to use a photo stored in the on-disk cache,
+ * before asking the photo sources again. */
+#define DISK_CACHE_MAX_AGE_SECONDS (24 * 60 * 60)
 
 #define ERROR_IS_CANCELLED(error) \
 	(g_error_matches ((error), G_IO_ERROR, G_IO_ERROR_CANCELLED))
@@ -54,15 +63,18 @@
 typedef struct _AsyncContext AsyncContext;
 typedef struct _AsyncSubtask AsyncSubtask;
 typedef struct _DataCaptureClosure DataCaptureClosure;
+typedef struct _DiskLookup DiskLookup;
 typedef struct _PhotoData PhotoData;
 
 struct _EPhotoCachePrivate {
 	EClientCache *client_cache;
 	GMainContext *main_context;
+	gchar *disk_cache_dir;
 
 	GHashTable *photo_ht;
-	GQueue photo_ht_keys;
+	GQueue photo_ht_keys; /* gchar *, owned by the photo_ht */
 	GMutex photo_ht_lock;
+	guint max_cache_size;
 
 	GHashTable *sources_ht;
 	GMutex sources_ht_lock;
@@ -71,6 +83,7 @@ struct _EPhotoCachePrivate {
 struct _AsyncContext {
 	GMutex lock;
 	GTimer *timer;
+	gchar *email_address;
 	GHashTable *subtasks;
 	GQueue results;
 	GInputStream *stream;
@@ -95,15 +108,27 @@ struct _DataCaptureClosure {
 	gchar *email_address;
 };
 
+struct _DiskLookup {
+	gchar *filename;
+	GBytes *bytes;
+	gboolean no_photo;
+	gint64 no_photo_expires_in; /* seconds */
+};
+
 struct _PhotoData {
 	volatile gint ref_count;
 	GMutex lock;
 	GBytes *bytes;
+
+	/* Both protected by the photo_ht_lock */
+	GList *link; /* in the photo_ht_keys */
+	gint64 expiration; /* monotonic time; 0 = never */
 };
 
 enum {
 	PROP_0,
-	PROP_CLIENT_CACHE
+	PROP_CLIENT_CACHE,
+	PROP_MAX_CACHE_SIZE
 };
 
 /* Forward Declarations */
@@ -216,6 +241,7 @@ async_subtask_complete (AsyncSubtask *async_subtask)
 	GSimpleAsyncResult *simple;
 	AsyncContext *async_context;
 	gboolean cancel_subtasks = FALSE;
+	gboolean no_photo = FALSE;
 	gdouble seconds_elapsed;
 
 	simple = async_subtask->simple;
@@ -276,6 +302,9 @@ async_subtask_complete (AsyncSubtask *async_subtask)
 		}
 
 		async_subtask_unref (async_subtask);
+	} else {
+		/* All the photo sources finished without a match. */
+		no_photo = TRUE;
 	}
 
 	g_simple_async_result_complete_in_idle (simple);
@@ -287,6 +316,19 @@ exit:
 		/* Call this after the mutex is unlocked. */
 		async_context_cancel_subtasks (async_context);
 	}
+
+	if (no_photo) {
+		GObject *photo_cache;
+
+		/* Remember there is no photo, to not ask the photo
+		 * sources again for some time. */
+		photo_cache = g_async_result_get_source_object (
+			G_ASYNC_RESULT (simple));
+		e_photo_cache_add_photo (
+			E_PHOTO_CACHE (photo_cache),
+			async_context->email_address, NULL);
+		g_object_unref (photo_cache);
+	}
 }
 
 static void
@@ -297,7 +339,8 @@ async_context_cancelled_cb (GCancellable *cancellable,
 }
 
 static AsyncContext *
-async_context_new (EDataCapture *data_capture,
+async_context_new (const gchar *email_address,
+                   EDataCapture *data_capture,
                    GCancellable *cancellable)
 {
 	AsyncContext *async_context;
@@ -305,6 +348,7 @@ async_context_new (EDataCapture *data_capture,
 	async_context = g_slice_new0 (AsyncContext);
 	g_mutex_init (&async_context->lock);
 	async_context->timer = g_timer_new ();
+	async_context->email_address = g_strdup (email_address);
 
 	async_context->subtasks = g_hash_table_new_full (
 		(GHashFunc) g_direct_hash,
@@ -342,6 +386,7 @@ async_context_free (AsyncContext *async_context)
 
 	g_mutex_clear (&async_context->lock);
 	g_timer_destroy (async_context->timer);
+	g_free (async_context->email_address);
 
 	g_hash_table_destroy (async_context->subtasks);
 
@@ -412,6 +457,16 @@ data_capture_closure_free (DataCaptureClosure *closure)
 	g_slice_free (DataCaptureClosure, closure);
 }
 
+static void
+disk_lookup_free (DiskLookup *disk_lookup)
+{
+	g_free (disk_lookup->filename);
+	if (disk_lookup->bytes != NULL)
+		g_bytes_unref (disk_lookup->bytes);
+
+	g_slice_free (DiskLookup, disk_lookup);
+}
+
 static PhotoData *
 photo_data_new (GBytes *bytes)
 {
@@ -497,10 +552,27 @@ photo_ht_normalize_key (const gchar *email_address)
 	return collation_key;
 }
 
+/* Call with the photo_ht_lock held. */
+static void
+photo_ht_trim (EPhotoCache *photo_cache)
+{
+	GHashTable *photo_ht;
+	GQueue *photo_ht_keys;
+
+	photo_ht = photo_cache->priv->photo_ht;
+	photo_ht_keys = &photo_cache->priv->photo_ht_keys;
+
+	while (g_queue_get_length (photo_ht_keys) > photo_cache->priv->max_cache_size) {
+		/* The key is owned by the hash table. */
+		g_hash_table_remove (photo_ht, g_queue_pop_tail (photo_ht_keys));
+	}
+}
+
 static void
 photo_ht_insert (EPhotoCache *photo_cache,
                  const gchar *email_address,
-                 GBytes *bytes)
+                 GBytes *bytes,
+                 gint64 expiration)
 {
 	GHashTable *photo_ht;
 	GQueue *photo_ht_keys;
@@ -519,41 +591,32 @@ photo_ht_insert (EPhotoCache *photo_cache,
 	photo_data = g_hash_table_lookup (photo_ht, key);
 
 	if (photo_data != NULL) {
-		GList *link;
-
 		/* Replace the old photo data if we have new photo
 		 * data, otherwise leave the old photo data alone. */
-		if (bytes != NULL)
+		if (bytes != NULL) {
 			photo_data_set_bytes (photo_data, bytes);
+			photo_data->expiration = expiration;
+		} else if (photo_data->bytes == NULL) {
+			photo_data->expiration = expiration;
+		}
 
 		/* Move the key to the head of the MRU queue. */
-		link = g_queue_find_custom (
-			photo_ht_keys, key,
-			(GCompareFunc) strcmp);
-		if (link != NULL) {
-			g_queue_unlink (photo_ht_keys, link);
-			g_queue_push_head_link (photo_ht_keys, link);
-		}
+		g_queue_unlink (photo_ht_keys, photo_data->link);
+		g_queue_push_head_link (photo_ht_keys, photo_data->link);
+
+		g_free (key);
 	} else {
 		photo_data = photo_data_new (bytes);
+		photo_data->expiration = expiration;
 
-		g_hash_table_insert (
-			photo_ht, g_strdup (key),
-			photo_data_ref (photo_data));
+		g_hash_table_insert (photo_ht, key, photo_data);
 
 		/* Push the key to the head of the MRU queue. */
-		g_queue_push_head (photo_ht_keys, g_strdup (key));
+		g_queue_push_head (photo_ht_keys, key);
+		photo_data->link = g_queue_peek_head_link (photo_ht_keys);
 
 		/* Trim the cache if necessary. */
-		while (g_queue_get_length (photo_ht_keys) > MAX_CACHE_SIZE) {
-			gchar *oldest_key;
-
-			oldest_key = g_queue_pop_tail (photo_ht_keys);
-			g_hash_table_remove (photo_ht, oldest_key);
-			g_free (oldest_key);
-		}
-
-		photo_data_unref (photo_data);
+		photo_ht_trim (photo_cache);
 	}
 
 	/* Hash table and queue sizes should be equal at all times. */
@@ -562,8 +625,6 @@ photo_ht_insert (EPhotoCache *photo_cache,
 		g_queue_get_length (photo_ht_keys));
 
 	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
-
-	g_free (key);
 }
 
 static gboolean
@@ -572,6 +633,7 @@ photo_ht_lookup (EPhotoCache *photo_cache,
                  GInputStream **out_stream)
 {
 	GHashTable *photo_ht;
+	GQueue *photo_ht_keys;
 	PhotoData *photo_data;
 	gboolean found = FALSE;
 	gchar *key;
@@ -580,6 +642,7 @@ photo_ht_lookup (EPhotoCache *photo_cache,
 	g_return_val_if_fail (out_stream != NULL, FALSE);
 
 	photo_ht = photo_cache->priv->photo_ht;
+	photo_ht_keys = &photo_cache->priv->photo_ht_keys;
 
 	key = photo_ht_normalize_key (email_address);
 
@@ -587,6 +650,13 @@ photo_ht_lookup (EPhotoCache *photo_cache,
 
 	photo_data = g_hash_table_lookup (photo_ht, key);
 
+	if (photo_data != NULL && photo_data->expiration > 0 &&
+	    photo_data->expiration <= g_get_monotonic_time ()) {
+		g_queue_delete_link (photo_ht_keys, photo_data->link);
+		g_hash_table_remove (photo_ht, key);
+		photo_data = NULL;
+	}
+
 	if (photo_data != NULL) {
 		GBytes *bytes;
 
@@ -599,6 +669,10 @@ photo_ht_lookup (EPhotoCache *photo_cache,
 			*out_stream = NULL;
 		}
 		found = TRUE;
+
+		/* Move the key to the head of the MRU queue. */
+		g_queue_unlink (photo_ht_keys, photo_data->link);
+		g_queue_push_head_link (photo_ht_keys, photo_data->link);
 	}
 
 	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
@@ -614,6 +688,7 @@ photo_ht_remove (EPhotoCache *photo_cache,
 {
 	GHashTable *photo_ht;
 	GQueue *photo_ht_keys;
+	PhotoData *photo_data;
 	gchar *key;
 	gboolean removed = FALSE;
 
@@ -626,17 +701,12 @@ photo_ht_remove (EPhotoCache *photo_cache,
 
 	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
 
-	if (g_hash_table_remove (photo_ht, key)) {
-		GList *link;
+	photo_data = g_hash_table_lookup (photo_ht, key);
 
-		link = g_queue_find_custom (
-			photo_ht_keys, key,
-			(GCompareFunc) strcmp);
-		if (link != NULL) {
-			g_free (link->data);
-			g_queue_delete_link (photo_ht_keys, link);
-			removed = TRUE;
-		}
+	if (photo_data != NULL) {
+		g_queue_delete_link (photo_ht_keys, photo_data->link);
+		g_hash_table_remove (photo_ht, key);
+		removed = TRUE;
 	}
 
 	/* Hash table and queue sizes should be equal at all times. */
@@ -662,14 +732,161 @@ photo_ht_remove_all (EPhotoCache *photo_cache)
 
 	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
 
+	g_queue_clear (photo_ht_keys);
 	g_hash_table_remove_all (photo_ht);
 
-	while (!g_queue_is_empty (photo_ht_keys))
-		g_free (g_queue_pop_head (photo_ht_keys));
-
 	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
 }
 
+static gchar *
+photo_cache_dup_disk_filename (EPhotoCache *photo_cache,
+                               const gchar *email_address)
+{
+	gchar *lowercase_email_address;
+	gchar *checksum;
+	gchar *filename;
+
+	lowercase_email_address = g_strstrip (g_utf8_strdown (email_address, -1));
+	checksum = g_compute_checksum_for_string (
+		G_CHECKSUM_SHA1, lowercase_email_address, -1);
+	filename = g_build_filename (
+		photo_cache->priv->disk_cache_dir, checksum, NULL);
+	g_free (lowercase_email_address);
+	g_free (checksum);
+
+	return filename;
+}
+
+static void
+photo_cache_disk_store_done_cb (GObject *source_object,
+                                GAsyncResult *result,
+                                gpointer user_data)
+{
+	GError *local_error = NULL;
+
+	g_file_replace_contents_finish (
+		G_FILE (source_object), result, NULL, &local_error);
+
+	if (local_error != NULL) {
+		g_debug (
+			"%s: Failed to store photo: %s",
+			G_STRFUNC, local_error->message);
+		g_error_free (local_error);
+	}
+}
+
+static void
+photo_cache_disk_store (EPhotoCache *photo_cache,
+                        const gchar *email_address,
+                        GBytes *bytes)
+{
+	GFile *file;
+	gchar *filename;
+
+	filename = photo_cache_dup_disk_filename (photo_cache, email_address);
+	file = g_file_new_for_path (filename);
+
+	/* An empty file means the email address has no photo. */
+	if (bytes != NULL)
+		g_bytes_ref (bytes);
+	else
+		bytes = g_bytes_new_static ("", 0);
+
+	g_file_replace_contents_bytes_async (
+		file, bytes, NULL, FALSE,
+		G_FILE_CREATE_PRIVATE | G_FILE_CREATE_REPLACE_DESTINATION,
+		NULL, photo_cache_disk_store_done_cb, NULL);
+
+	g_bytes_unref (bytes);
+	g_object_unref (file);
+	g_free (filename);
+}
+
+static gboolean
+photo_cache_disk_remove (EPhotoCache *photo_cache,
+                         const gchar *email_address)
+{
+	gchar *filename;
+	gboolean removed;
+
+	filename = photo_cache_dup_disk_filename (photo_cache, email_address);
+	removed = g_unlink (filename) == 0;
+	g_free (filename);
+
+	return removed;
+}
+
+static void
+photo_cache_disk_lookup_thread (GSimpleAsyncResult *simple,
+                                GObject *source_object,
+                                GCancellable *cancellable)
+{
+	DiskLookup *disk_lookup;
+	GStatBuf st;
+	gint64 age;
+
+	disk_lookup = g_simple_async_result_get_op_res_gpointer (simple);
+
+	if (g_stat (disk_lookup->filename, &st) != 0)
+		return;
+
+	age = g_get_real_time () / G_USEC_PER_SEC - st.st_mtime;
+
+	if (st.st_size == 0 && age >= 0 && age < NEGATIVE_CACHE_TTL_SECONDS) {
+		disk_lookup->no_photo = TRUE;
+		disk_lookup->no_photo_expires_in =
+			NEGATIVE_CACHE_TTL_SECONDS - age;
+
+	} else if (st.st_size > 0 && age >= 0 && age < DISK_CACHE_MAX_AGE_SECONDS) {
+		gchar *contents = NULL;
+		gsize length = 0;
+
+		if (g_file_get_contents (disk_lookup->filename, &contents, &length, NULL))
+			disk_lookup->bytes = g_bytes_new_take (contents, length);
+
+	} else {
+		/* Expired, ask the photo sources again. */
+		g_unlink (disk_lookup->filename);
+	}
+}
+
+static gpointer
+photo_cache_disk_prune_thread (gpointer user_data)
+{
+	gchar *disk_cache_dir = user_data;
+	const gchar *name;
+	gint64 now;
+	GDir *dir;
+
+	dir = g_dir_open (disk_cache_dir, 0, NULL);
+	if (dir == NULL)
+		goto exit;
+
+	now = g_get_real_time () / G_USEC_PER_SEC;
+
+	/* Remove the entries for email addresses not looked up for a long
+	 * time; the others are removed or refreshed on the next lookup. */
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		gchar *filename;
+		GStatBuf st;
+
+		filename = g_build_filename (disk_cache_dir, name, NULL);
+
+		if (g_stat (filename, &st) == 0 &&
+		    now - st.st_mtime > DISK_CACHE_MAX_AGE_SECONDS)
+			g_unlink (filename);
+
+		g_free (filename);
+	}
+
+	g_dir_close (dir);
+
+exit:
+	g_free (disk_cache_dir);
+
+	return NULL;
+}
+
 static void
 photo_cache_data_captured_cb (EDataCapture *data_capture,
                               GBytes *bytes,
@@ -704,6 +921,93 @@ photo_cache_async_subtask_done_cb (GObject *source_object,
 	async_subtask_unref (async_subtask);
 }
 
+static void
+photo_cache_dispatch_subtasks (EPhotoCache *photo_cache,
+                               GSimpleAsyncResult *simple)
+{
+	AsyncContext *async_context;
+	GList *list, *link;
+
+	async_context = g_simple_async_result_get_op_res_gpointer (simple);
+
+	list = e_photo_cache_list_photo_sources (photo_cache);
+
+	if (list == NULL) {
+		g_simple_async_result_complete_in_idle (simple);
+		return;
+	}
+
+	g_mutex_lock (&async_context->lock);
+
+	/* Dispatch a subtask for each photo source. */
+	for (link = list; link != NULL; link = g_list_next (link)) {
+		EPhotoSource *photo_source;
+		AsyncSubtask *async_subtask;
+
+		photo_source = E_PHOTO_SOURCE (link->data);
+		async_subtask = async_subtask_new (photo_source, simple);
+
+		g_hash_table_add (
+			async_context->subtasks,
+			async_subtask_ref (async_subtask));
+
+		e_photo_source_get_photo (
+			photo_source, async_context->email_address,
+			async_subtask->cancellable,
+			photo_cache_async_subtask_done_cb,
+			async_subtask_ref (async_subtask));
+
+		async_subtask_unref (async_subtask);
+	}
+
+	g_mutex_unlock (&async_context->lock);
+
+	g_list_free_full (list, (GDestroyNotify) g_object_unref);
+
+	/* Check if we were cancelled while dispatching subtasks. */
+	if (g_cancellable_is_cancelled (async_context->cancellable))
+		async_context_cancel_subtasks (async_context);
+}
+
+static void
+photo_cache_disk_lookup_done_cb (GObject *source_object,
+                                 GAsyncResult *result,
+                                 gpointer user_data)
+{
+	EPhotoCache *photo_cache;
+	GSimpleAsyncResult *simple;
+	AsyncContext *async_context;
+	DiskLookup *disk_lookup;
+
+	photo_cache = E_PHOTO_CACHE (source_object);
+	simple = G_SIMPLE_ASYNC_RESULT (user_data);
+	async_context = g_simple_async_result_get_op_res_gpointer (simple);
+
+	disk_lookup = g_simple_async_result_get_op_res_gpointer (
+		G_SIMPLE_ASYNC_RESULT (result));
+
+	if (disk_lookup->bytes != NULL) {
+		photo_ht_insert (
+			photo_cache, async_context->email_address,
+			disk_lookup->bytes, 0);
+		async_context->stream =
+			g_memory_input_stream_new_from_bytes (
+			disk_lookup->bytes);
+		g_simple_async_result_complete (simple);
+
+	} else if (disk_lookup->no_photo) {
+		photo_ht_insert (
+			photo_cache, async_context->email_address, NULL,
+			g_get_monotonic_time () + disk_lookup->no_photo_expires_in * G_USEC_PER_SEC);
+		g_simple_async_result_complete (simple);
+
+	} else {
+		photo_cache_dispatch_subtasks (photo_cache, simple);
+	}
+
+	g_object_unref (simple);
+}
+
 static void
 photo_cache_set_client_cache (EPhotoCache *photo_cache,
                               EClientCache *client_cache)
@@ -726,6 +1030,12 @@ photo_cache_set_property (GObject *object,
 				E_PHOTO_CACHE (object),
 				g_value_get_object (value));
 			return;
+
+		case PROP_MAX_CACHE_SIZE:
+			e_photo_cache_set_max_cache_size (
+				E_PHOTO_CACHE (object),
+				g_value_get_uint (value));
+			return;
 	}
 
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -744,6 +1054,13 @@ photo_cache_get_property (GObject *object,
 				e_photo_cache_ref_client_cache (
 				E_PHOTO_CACHE (object)));
 			return;
+
+		case PROP_MAX_CACHE_SIZE:
+			g_value_set_uint (
+				value,
+				e_photo_cache_get_max_cache_size (
+				E_PHOTO_CACHE (object)));
+			return;
 	}
 
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -772,6 +1089,7 @@ photo_cache_finalize (GObject *object)
 	priv = E_PHOTO_CACHE_GET_PRIVATE (object);
 
 	g_main_context_unref (priv->main_context);
+	g_free (priv->disk_cache_dir);
 
 	g_hash_table_destroy (priv->photo_ht);
 	g_hash_table_destroy (priv->sources_ht);
@@ -786,9 +1104,21 @@ photo_cache_finalize (GObject *object)
 static void
 photo_cache_constructed (GObject *object)
 {
+	EPhotoCachePrivate *priv;
+	GThread *thread;
+
+	priv = E_PHOTO_CACHE_GET_PRIVATE (object);
+
 	/* Chain up to parent's constructed() method. */
 	G_OBJECT_CLASS (e_photo_cache_parent_class)->constructed (object);
 
+	if (g_mkdir_with_parents (priv->disk_cache_dir, 0700) == 0) {
+		thread = g_thread_new (
+			NULL, photo_cache_disk_prune_thread,
+			g_strdup (priv->disk_cache_dir));
+		g_thread_unref (thread);
+	}
+
 	e_extensible_load_extensions (E_EXTENSIBLE (object));
 }
 
@@ -822,6 +1152,25 @@ e_photo_cache_class_init (EPhotoCacheClass *class)
 			G_PARAM_READWRITE |
 			G_PARAM_CONSTRUCT_ONLY |
 			G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * EPhotoCache:max-cache-size:
+	 *
+	 * How many email addresses are held in memory at once.
+	 *
+	 * Since: 3.24
+	 **/
+	g_object_class_install_property (
+		object_class,
+		PROP_MAX_CACHE_SIZE,
+		g_param_spec_uint (
+			"max-cache-size",
+			"Max Cache Size",
+			"How many email addresses are held in memory at once",
+			1, G_MAXUINT,
+			DEFAULT_MAX_CACHE_SIZE,
+			G_PARAM_READWRITE |
+			G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -846,6 +1195,9 @@ e_photo_cache_init (EPhotoCache *photo_cache)
 	photo_cache->priv->main_context = g_main_context_ref_thread_default ();
 	photo_cache->priv->photo_ht = photo_ht;
 	photo_cache->priv->sources_ht = sources_ht;
+	photo_cache->priv->max_cache_size = DEFAULT_MAX_CACHE_SIZE;
+	photo_cache->priv->disk_cache_dir = g_build_filename (
+		e_get_user_cache_dir (), "photos", NULL);
 
 	g_mutex_init (&photo_cache->priv->photo_ht_lock);
 	g_mutex_init (&photo_cache->priv->sources_ht_lock);
@@ -888,6 +1240,58 @@ e_photo_cache_ref_client_cache (EPhotoCache *photo_cache)
 	return g_object_ref (photo_cache->priv->client_cache);
 }
 
+/**
+ * e_photo_cache_get_max_cache_size:
+ * @photo_cache: an #EPhotoCache
+ *
+ * Returns how many email addresses @photo_cache holds in memory at once,
+ * regardless of whether the email address has a photo.
+ *
+ * Returns: the maximum in-memory cache size
+ *
+ * Since: 3.24
+ **/
+guint
+e_photo_cache_get_max_cache_size (EPhotoCache *photo_cache)
+{
+	g_return_val_if_fail (E_IS_PHOTO_CACHE (photo_cache), 0);
+
+	return photo_cache->priv->max_cache_size;
+}
+
+/**
+ * e_photo_cache_set_max_cache_size:
+ * @photo_cache: an #EPhotoCache
+ * @max_cache_size: how many email addresses to hold in memory
+ *
+ * Sets how many email addresses @photo_cache holds in memory at once.
+ * The least recently used entries are discarded when there are more.
+ * The on-disk cache is not limited by this.
+ *
+ * Since: 3.24
+ **/
+void
+e_photo_cache_set_max_cache_size (EPhotoCache *photo_cache,
+                                  guint max_cache_size)
+{
+	g_return_if_fail (E_IS_PHOTO_CACHE (photo_cache));
+	g_return_if_fail (max_cache_size > 0);
+
+	g_mutex_lock (&photo_cache->priv->photo_ht_lock);
+
+	if (photo_cache->priv->max_cache_size == max_cache_size) {
+		g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+		return;
+	}
+
+	photo_cache->priv->max_cache_size = max_cache_size;
+	photo_ht_trim (photo_cache);
+
+	g_mutex_unlock (&photo_cache->priv->photo_ht_lock);
+
+	g_object_notify (G_OBJECT (photo_cache), "max-cache-size");
+}
+
 /**
  * e_photo_cache_add_photo_source:
  * @photo_cache: an #EPhotoCache
@@ -993,7 +1397,7 @@ e_photo_cache_remove_photo_source (EPhotoCache *photo_cache,
  *
  * The @bytes argument can also be %NULL to indicate no photo is available for
  * @email_address.  Subsequent photo requests for @email_address will yield no
- * input stream.
+ * input stream, until the entry expires.
  *
  * The entry may be removed without notice however, subject to @photo_cache's
  * internal caching policy.
@@ -1003,10 +1407,17 @@ e_photo_cache_add_photo (EPhotoCache *photo_cache,
                          const gchar *email_address,
                          GBytes *bytes)
 {
+	gint64 expiration = 0;
+
 	g_return_if_fail (E_IS_PHOTO_CACHE (photo_cache));
 	g_return_if_fail (email_address != NULL);
 
-	photo_ht_insert (photo_cache, email_address, bytes);
+	if (bytes == NULL)
+		expiration = g_get_monotonic_time () +
+			NEGATIVE_CACHE_TTL_SECONDS * G_USEC_PER_SEC;
+
+	photo_ht_insert (photo_cache, email_address, bytes, expiration);
+	photo_cache_disk_store (photo_cache, email_address, bytes);
 }
 
 /**
@@ -1022,10 +1433,17 @@ gboolean
 e_photo_cache_remove_photo (EPhotoCache *photo_cache,
                             const gchar *email_address)
 {
+	gboolean removed;
+
 	g_return_val_if_fail (E_IS_PHOTO_CACHE (photo_cache), FALSE);
 	g_return_val_if_fail (email_address != NULL, FALSE);
 
-	return photo_ht_remove (photo_cache, email_address);
+	removed = photo_ht_remove (photo_cache, email_address);
+
+	if (photo_cache_disk_remove (photo_cache, email_address))
+		removed = TRUE;
+
+	return removed;
 }
 
 /**
@@ -1098,10 +1516,11 @@ e_photo_cache_get_photo (EPhotoCache *photo_cache,
                          gpointer user_data)
 {
 	GSimpleAsyncResult *simple;
+	GSimpleAsyncResult *disk_simple;
 	AsyncContext *async_context;
+	DiskLookup *disk_lookup;
 	EDataCapture *data_capture;
 	GInputStream *stream = NULL;
-	GList *list, *link;
 
 	g_return_if_fail (E_IS_PHOTO_CACHE (photo_cache));
 	g_return_if_fail (email_address != NULL);
@@ -1116,7 +1535,8 @@ e_photo_cache_get_photo (EPhotoCache *photo_cache,
 		data_capture_closure_new (photo_cache, email_address),
 		(GClosureNotify) data_capture_closure_free, 0);
 
-	async_context = async_context_new (data_capture, cancellable);
+	async_context = async_context_new (
+		email_address, data_capture, cancellable);
 
 	simple = g_simple_async_result_new (
 		G_OBJECT (photo_cache), callback,
@@ -1134,43 +1554,24 @@ e_photo_cache_get_photo (EPhotoCache *photo_cache,
 		goto exit;
 	}
 
-	list = e_photo_cache_list_photo_sources (photo_cache);
-
-	if (list == NULL) {
-		g_simple_async_result_complete_in_idle (simple);
-		goto exit;
-	}
-
-	g_mutex_lock (&async_context->lock);
-
-	/* Dispatch a subtask for each photo source. */
-	for (link = list; link != NULL; link = g_list_next (link)) {
-		EPhotoSource *photo_source;
-		AsyncSubtask *async_subtask;
-
-		photo_source = E_PHOTO_SOURCE (link->data);
-		async_subtask = async_subtask_new (photo_source, simple);
+	/* Check the on-disk cache from a thread, then
+	 * ask the photo sources if it's not there. */
+	disk_lookup = g_slice_new0 (DiskLookup);
+	disk_lookup->filename = photo_cache_dup_disk_filename (
+		photo_cache, email_address);
 
-		g_hash_table_add (
-			async_context->subtasks,
-			async_subtask_ref (async_subtask));
-
-		e_photo_source_get_photo (
-			photo_source, email_address,
-			async_subtask->cancellable,
-			photo_cache_async_subtask_done_cb,
-			async_subtask_ref (async_subtask));
+	disk_simple = g_simple_async_result_new (
+		G_OBJECT (photo_cache), photo_cache_disk_lookup_done_cb,
+		g_object_ref (simple), photo_cache_disk_lookup_thread);
 
-		async_subtask_unref (async_subtask);
-	}
-
-	g_mutex_unlock (&async_context->lock);
+	g_simple_async_result_set_op_res_gpointer (
+		disk_simple, disk_lookup, (GDestroyNotify) disk_lookup_free);
 
-	g_list_free_full (list, (GDestroyNotify) g_object_unref);
+	g_simple_async_result_run_in_thread (
+		disk_simple, photo_cache_disk_lookup_thread,
+		G_PRIORITY_DEFAULT, cancellable);
 
-	/* Check if we were cancelled while dispatching subtasks. */
-	if (g_cancellable_is_cancelled (cancellable))
-		async_context_cancel_subtasks (async_context);
+	g_object_unref (disk_simple);
 
 exit:
 	g_object_unref (simple);
@@ -38,6 +38,7 @@ enum {
 	MODEL_ITEMS_INSERTED,
 	MODEL_ITEM_CHANGED,
 	MODEL_ITEM_REMOVED,
+	MODEL_ITEMS_REMOVED,
 	LAST_SIGNAL
 };
 
@@ -222,6 +223,7 @@ e_reflow_model_class_init (EReflowModelClass *class)
 	class->comparison_changed = NULL;
 	class->model_items_inserted = NULL;
 	class->model_item_removed = NULL;
+	class->model_items_removed = NULL;
 	class->model_item_changed = NULL;
 
 	signals[MODEL_CHANGED] = g_signal_new (
@@ -268,6 +270,15 @@ e_reflow_model_class_init (EReflowModelClass *class)
 		NULL, NULL,
 		g_cclosure_marshal_VOID__INT,
 		G_TYPE_NONE, 1, G_TYPE_INT);
+
+	signals[MODEL_ITEMS_REMOVED] = g_signal_new (
+		"model_items_removed",
+		G_OBJECT_CLASS_TYPE (object_class),
+		G_SIGNAL_RUN_LAST,
+		G_STRUCT_OFFSET (EReflowModelClass, model_items_removed),
+		NULL, NULL,
+		e_marshal_NONE__INT_INT,
+		G_TYPE_NONE, 2, G_TYPE_INT, G_TYPE_INT);
 }
 
 static void
@@ -378,6 +389,33 @@ e_reflow_model_item_removed (EReflowModel *reflow_model,
 	d (depth--);
 }
 
+/**
+ * e_reflow_model_items_removed:
+ * @reflow_model: The model changed.
+ * @position: The position from which the items were removed.
+ * @count: The number of items removed.
+ *
+ * Use this function to notify any views of the reflow model that
+ * a continuous range of items has been removed.
+ *
+ * Since: 3.24
+ **/
+void
+e_reflow_model_items_removed (EReflowModel *reflow_model,
+                              gint position,
+                              gint count)
+{
+	g_return_if_fail (E_IS_REFLOW_MODEL (reflow_model));
+
+	d (print_tabs ());
+	d (depth++);
+	g_signal_emit (
+		reflow_model,
+		signals[MODEL_ITEMS_REMOVED], 0,
+		position, count);
+	d (depth--);
+}
+
 /**
  * e_reflow_model_item_changed:
  * @reflow_model: the reflow model to notify of the change
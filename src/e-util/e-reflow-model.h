@@ -94,6 +94,9 @@ struct _EReflowModelClass {
 						 gint count);
 	void		(*model_item_removed)	(EReflowModel *reflow_model,
 						 gint position);
+	void		(*model_items_removed)	(EReflowModel *reflow_model,
+						 gint position,
+						 gint count);
 	void		(*model_item_changed)	(EReflowModel *reflow_model,
 						 gint n);
 };
@@ -125,6 +128,9 @@ void		e_reflow_model_items_inserted	(EReflowModel *reflow_model,
 						 gint count);
 void		e_reflow_model_item_removed	(EReflowModel *reflow_model,
 						 gint n);
+void		e_reflow_model_items_removed	(EReflowModel *reflow_model,
+						 gint position,
+						 gint count);
 void		e_reflow_model_item_changed	(EReflowModel *reflow_model,
 						 gint n);
 
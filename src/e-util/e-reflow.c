@@ -53,6 +53,23 @@ static void e_reflow_resize_children (GnomeCanvasItem *item);
 #define E_REFLOW_BORDER_WIDTH 7
 #define E_REFLOW_FULL_GUTTER (E_REFLOW_DIVIDER_WIDTH + E_REFLOW_BORDER_WIDTH * 2)
 
+/* Items are measured only when they are about to be shown, until then
+ * the average height of the measured items is used for them. */
+#define E_REFLOW_HEIGHT_UNKNOWN (-1)
+
+#define E_REFLOW_GET_PRIVATE(obj) \
+	(G_TYPE_INSTANCE_GET_PRIVATE \
+	((obj), E_TYPE_REFLOW, EReflowPrivate))
+
+typedef struct _EReflowPrivate EReflowPrivate;
+
+struct _EReflowPrivate {
+	/* Used for the items not measured yet */
+	gint estimated_height;
+	gint64 measured_heights_total;
+	gint measured_heights_count;
+};
+
 G_DEFINE_TYPE (EReflow, e_reflow, GNOME_TYPE_CANVAS_GROUP)
 
 enum {
@@ -111,6 +128,108 @@ er_find_item (EReflow *reflow,
 	return -1;
 }
 
+/* Returns the column containing the sorted item, or -1 if none. */
+static gint
+er_find_column (EReflow *reflow,
+                gint sorted)
+{
+	gint low = 0, high = reflow->column_count - 1;
+
+	if (high < 0 || !reflow->columns || reflow->columns[0] > sorted)
+		return -1;
+
+	while (low < high) {
+		gint middle = (low + high + 1) / 2;
+
+		if (reflow->columns[middle] <= sorted)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+
+	return low;
+}
+
+static void
+er_reflow_from_sorted (EReflow *reflow,
+                       gint sorted)
+{
+	gint c;
+
+	c = er_find_column (reflow, sorted);
+
+	if (c >= 0 && (reflow->reflow_from_column == -1 || reflow->reflow_from_column > c))
+		reflow->reflow_from_column = c;
+}
+
+static gint
+er_get_height (EReflow *reflow,
+               gint unsorted)
+{
+	if (reflow->heights[unsorted] == E_REFLOW_HEIGHT_UNKNOWN)
+		return E_REFLOW_GET_PRIVATE (reflow)->estimated_height;
+
+	return reflow->heights[unsorted];
+}
+
+/* Returns whether the item's height differs from what was used for it. */
+static gboolean
+er_measure_height (EReflow *reflow,
+                   gint unsorted)
+{
+	EReflowPrivate *priv = E_REFLOW_GET_PRIVATE (reflow);
+	gint height;
+
+	if (reflow->heights[unsorted] != E_REFLOW_HEIGHT_UNKNOWN)
+		return FALSE;
+
+	height = e_reflow_model_height (reflow->model, unsorted, GNOME_CANVAS_GROUP (reflow));
+	reflow->heights[unsorted] = height;
+
+	priv->measured_heights_total += height;
+	priv->measured_heights_count++;
+
+	return height != priv->estimated_height;
+}
+
+/* Takes the item's height out of the average, before it is measured again
+ * or the item is removed. */
+static void
+er_forget_height (EReflow *reflow,
+                  gint unsorted)
+{
+	EReflowPrivate *priv = E_REFLOW_GET_PRIVATE (reflow);
+
+	if (reflow->heights[unsorted] == E_REFLOW_HEIGHT_UNKNOWN)
+		return;
+
+	priv->measured_heights_total -= reflow->heights[unsorted];
+	priv->measured_heights_count--;
+
+	reflow->heights[unsorted] = E_REFLOW_HEIGHT_UNKNOWN;
+}
+
+static void
+er_forget_all_heights (EReflow *reflow)
+{
+	EReflowPrivate *priv = E_REFLOW_GET_PRIVATE (reflow);
+
+	priv->measured_heights_total = 0;
+	priv->measured_heights_count = 0;
+}
+
+static void
+er_update_estimated_height (EReflow *reflow)
+{
+	EReflowPrivate *priv = E_REFLOW_GET_PRIVATE (reflow);
+
+	if (priv->measured_heights_count == 0 && reflow->count > 0 && reflow->model)
+		er_measure_height (reflow, 0);
+
+	if (priv->measured_heights_count > 0)
+		priv->estimated_height = priv->measured_heights_total / priv->measured_heights_count;
+}
+
 static void
 e_reflow_resize_children (GnomeCanvasItem *item)
 {
@@ -295,6 +414,24 @@ incarnate (EReflow *reflow)
 	else
 		last_cell = reflow->count;
 
+	/* Measure the shown items first; when they differ from the estimate,
+	 * the columns from the first such item on are laid out again, and
+	 * this is called again for what is shown afterwards. */
+	for (i = first_cell; i < last_cell; i++) {
+		gint unsorted = e_sorter_sorted_to_model (E_SORTER (reflow->sorter), i);
+
+		if (reflow->model && er_measure_height (reflow, unsorted)) {
+			er_reflow_from_sorted (reflow, i);
+			reflow->need_reflow_columns = TRUE;
+		}
+	}
+
+	if (reflow->need_reflow_columns) {
+		reflow->incarnate_idle_id = 0;
+		e_canvas_item_request_reflow (GNOME_CANVAS_ITEM (reflow));
+		return;
+	}
+
 	for (i = first_cell; i < last_cell; i++) {
 		gint unsorted = e_sorter_sorted_to_model (E_SORTER (reflow->sorter), i);
 		if (reflow->items[unsorted] == NULL) {
@@ -341,6 +478,10 @@ reflow_columns (EReflow *reflow)
 		start = 0;
 		column_count = 1;
 		column_start = 0;
+
+		/* Refresh the estimate only when all the columns are
+		 * laid out, thus they all use the same estimate. */
+		er_update_estimated_height (reflow);
 	}
 	else {
 		/* we start one column before the earliest new entry,
@@ -358,12 +499,14 @@ reflow_columns (EReflow *reflow)
 	count = reflow->count - start;
 	for (i = start; i < count; i++) {
 		gint unsorted = e_sorter_sorted_to_model (E_SORTER (reflow->sorter), i);
-		if (i != 0 && running_height + reflow->heights[unsorted] + E_REFLOW_BORDER_WIDTH > reflow->height) {
+		gint height = er_get_height (reflow, unsorted);
+
+		if (i != 0 && running_height + height + E_REFLOW_BORDER_WIDTH > reflow->height) {
 			list = g_slist_prepend (list, GINT_TO_POINTER (i));
 			column_count++;
-			running_height = E_REFLOW_BORDER_WIDTH * 2 + reflow->heights[unsorted];
+			running_height = E_REFLOW_BORDER_WIDTH * 2 + height;
 		} else
-			running_height += reflow->heights[unsorted] + E_REFLOW_BORDER_WIDTH;
+			running_height += height + E_REFLOW_BORDER_WIDTH;
 	}
 
 	reflow->column_count = column_count;
@@ -393,9 +536,12 @@ item_changed (EReflowModel *model,
 	if (i < 0 || i >= reflow->count)
 		return;
 
-	reflow->heights[i] = e_reflow_model_height (reflow->model, i, GNOME_CANVAS_GROUP (reflow));
-	if (reflow->items[i] != NULL)
+	/* Measure it again only if it is shown. */
+	er_forget_height (reflow, i);
+	if (reflow->items[i] != NULL) {
+		er_measure_height (reflow, i);
 		e_reflow_model_reincarnate (model, i, reflow->items[i]);
+	}
 	e_sorter_array_clean (reflow->sorter);
 	reflow->reflow_from_column = -1;
 	reflow->need_reflow_columns = TRUE;
@@ -403,39 +549,35 @@ item_changed (EReflowModel *model,
 }
 
 static void
-item_removed (EReflowModel *model,
-              gint i,
-              EReflow *reflow)
+items_removed (EReflowModel *model,
+               gint position,
+               gint count,
+               EReflow *reflow)
 {
-	gint c;
-	gint sorted;
+	gint i, sorted;
 
-	if (i < 0 || i >= reflow->count)
+	if (position < 0 || count <= 0 || position + count > reflow->count)
 		return;
 
-	sorted = e_sorter_model_to_sorted (E_SORTER (reflow->sorter), i);
-	for (c = reflow->column_count - 1; c >= 0; c--) {
-		gint start_of_column = reflow->columns[c];
+	for (i = position; i < position + count; i++) {
+		sorted = e_sorter_model_to_sorted (E_SORTER (reflow->sorter), i);
+		er_reflow_from_sorted (reflow, sorted);
 
-		if (start_of_column <= sorted) {
-			if (reflow->reflow_from_column == -1
-			    || reflow->reflow_from_column > c) {
-				reflow->reflow_from_column = c;
-			}
-			break;
-		}
-	}
+		if (reflow->items[i])
+			g_object_run_dispose (G_OBJECT (reflow->items[i]));
 
-	if (reflow->items[i])
-		g_object_run_dispose (G_OBJECT (reflow->items[i]));
+		er_forget_height (reflow, i);
+	}
 
-	memmove (reflow->heights + i, reflow->heights + i + 1, (reflow->count - i - 1) * sizeof (gint));
-	memmove (reflow->items + i, reflow->items + i + 1, (reflow->count - i - 1) * sizeof (GnomeCanvasItem *));
+	memmove (reflow->heights + position, reflow->heights + position + count, (reflow->count - position - count) * sizeof (gint));
+	memmove (reflow->items + position, reflow->items + position + count, (reflow->count - position - count) * sizeof (GnomeCanvasItem *));
 
-	reflow->count--;
+	reflow->count -= count;
 
-	reflow->heights[reflow->count] = 0;
-	reflow->items[reflow->count] = NULL;
+	for (i = reflow->count; i < reflow->count + count; i++) {
+		reflow->heights[i] = 0;
+		reflow->items[i] = NULL;
+	}
 
 	reflow->need_reflow_columns = TRUE;
 	set_empty (reflow);
@@ -443,7 +585,15 @@ item_removed (EReflowModel *model,
 
 	e_sorter_array_set_count (reflow->sorter, reflow->count);
 
-	e_selection_model_simple_delete_rows (E_SELECTION_MODEL_SIMPLE (reflow->selection), i, 1);
+	e_selection_model_simple_delete_rows (E_SELECTION_MODEL_SIMPLE (reflow->selection), position, count);
+}
+
+static void
+item_removed (EReflowModel *model,
+              gint i,
+              EReflow *reflow)
+{
+	items_removed (model, i, 1, reflow);
 }
 
 static void
@@ -471,7 +621,7 @@ items_inserted (EReflowModel *model,
 	memmove (reflow->items + position + count, reflow->items + position, (reflow->count - position - count) * sizeof (GnomeCanvasItem *));
 	for (i = position; i < position + count; i++) {
 		reflow->items[i] = NULL;
-		reflow->heights[i] = e_reflow_model_height (reflow->model, i, GNOME_CANVAS_GROUP (reflow));
+		reflow->heights[i] = E_REFLOW_HEIGHT_UNKNOWN;
 	}
 
 	e_selection_model_simple_set_row_count (E_SELECTION_MODEL_SIMPLE (reflow->selection), reflow->count);
@@ -482,19 +632,8 @@ items_inserted (EReflowModel *model,
 
 	for (i = position; i < position + count; i++) {
 		gint sorted = e_sorter_model_to_sorted (E_SORTER (reflow->sorter), i);
-		gint c;
 
-		for (c = reflow->column_count - 1; c >= 0; c--) {
-			gint start_of_column = reflow->columns[c];
-
-			if (start_of_column <= sorted) {
-				if (reflow->reflow_from_column == -1
-				    || reflow->reflow_from_column > c) {
-					reflow->reflow_from_column = c;
-				}
-				break;
-			}
-		}
+		er_reflow_from_sorted (reflow, sorted);
 	}
 
 	reflow->need_reflow_columns = TRUE;
@@ -519,6 +658,7 @@ model_changed (EReflowModel *model,
 	}
 	g_free (reflow->items);
 	g_free (reflow->heights);
+	er_forget_all_heights (reflow);
 	reflow->count = e_reflow_model_count (model);
 	reflow->allocated_count = reflow->count;
 	reflow->items = g_new (GnomeCanvasItem *, reflow->count);
@@ -527,7 +667,7 @@ model_changed (EReflowModel *model,
 	count = reflow->count;
 	for (i = 0; i < count; i++) {
 		reflow->items[i] = NULL;
-		reflow->heights[i] = e_reflow_model_height (reflow->model, i, GNOME_CANVAS_GROUP (reflow));
+		reflow->heights[i] = E_REFLOW_HEIGHT_UNKNOWN;
 	}
 
 	e_selection_model_simple_set_row_count (E_SELECTION_MODEL_SIMPLE (reflow->selection), count);
@@ -613,6 +753,9 @@ disconnect_model (EReflow *reflow)
 	g_signal_handler_disconnect (
 		reflow->model,
 		reflow->model_item_removed_id);
+	g_signal_handler_disconnect (
+		reflow->model,
+		reflow->model_items_removed_id);
 	g_signal_handler_disconnect (
 		reflow->model,
 		reflow->model_item_changed_id);
@@ -622,6 +765,7 @@ disconnect_model (EReflow *reflow)
 	reflow->comparison_changed_id = 0;
 	reflow->model_items_inserted_id = 0;
 	reflow->model_item_removed_id = 0;
+	reflow->model_items_removed_id = 0;
 	reflow->model_item_changed_id = 0;
 	reflow->model = NULL;
 }
@@ -677,6 +821,10 @@ connect_model (EReflow *reflow,
 		reflow->model, "model_item_removed",
 		G_CALLBACK (item_removed), reflow);
 
+	reflow->model_items_removed_id = g_signal_connect (
+		reflow->model, "model_items_removed",
+		G_CALLBACK (items_removed), reflow);
+
 	reflow->model_item_changed_id = g_signal_connect (
 		reflow->model, "model_item_changed",
 		G_CALLBACK (item_changed), reflow);
@@ -874,6 +1022,7 @@ e_reflow_dispose (GObject *object)
 	g_free (reflow->items);
 	g_free (reflow->heights);
 	g_free (reflow->columns);
+	er_forget_all_heights (reflow);
 
 	reflow->items = NULL;
 	reflow->heights = NULL;
@@ -1490,7 +1639,7 @@ e_reflow_reflow (GnomeCanvasItem *item,
 				GNOME_CANVAS_ITEM (reflow->items[unsorted]),
 				(gdouble) running_width,
 				(gdouble) running_height);
-			running_height += reflow->heights[unsorted] + E_REFLOW_BORDER_WIDTH;
+			running_height += er_get_height (reflow, unsorted) + E_REFLOW_BORDER_WIDTH;
 		}
 	}
 	reflow->width = running_width + reflow->column_width + E_REFLOW_BORDER_WIDTH;
@@ -1566,6 +1715,8 @@ e_reflow_class_init (EReflowClass *class)
 	GObjectClass *object_class;
 	GnomeCanvasItemClass *item_class;
 
+	g_type_class_add_private (class, sizeof (EReflowPrivate));
+
 	object_class = (GObjectClass *) class;
 	item_class = (GnomeCanvasItemClass *) class;
 
@@ -66,6 +66,7 @@ struct _EReflow {
 	guint comparison_changed_id;
 	guint model_items_inserted_id;
 	guint model_item_removed_id;
+	guint model_items_removed_id;
 	guint model_item_changed_id;
 
 	ESelectionModel *selection;
@@ -79,7 +80,7 @@ struct _EReflow {
 	guint adjustment_value_changed_id;
 	guint set_scroll_adjustments_id;
 
-	gint *heights;
+	gint *heights; /* -1 for items not measured yet */
 	GnomeCanvasItem **items;
 	gint count;
 	gint allocated_count;
@@ -77,7 +77,18 @@ struct _ETreeTableAdapterPrivate {
 	GNode *root;
 
 	guint root_visible : 1;
-	guint remap_needed : 1;
+
+	/* The first row whose node index can be stale; the indices
+	 * are recomputed from it on the next row_of_node() call. */
+	gint remap_from;
+
+	/* While above zero, expand and collapse change only the tree
+	 * and the map is rebuilt once by tree_table_adapter_thaw_map(). */
+	guint map_frozen;
+
+	/* node_t-s removed from the tree while the map is frozen; the map
+	 * can still point to them, thus they are freed only on thaw. */
+	GSList *frozen_dead_nodes;
 
 	gint last_access;
 
@@ -148,7 +159,7 @@ move_map_elements (ETreeTableAdapter *etta,
 	if (count <= 0 || from >= etta->priv->n_map)
 		return;
 	memmove (etta->priv->map_table + to, etta->priv->map_table + from, count * sizeof (node_t *));
-	etta->priv->remap_needed = TRUE;
+	etta->priv->remap_from = MIN (etta->priv->remap_from, MIN (to, from));
 }
 
 static gint
@@ -158,13 +169,14 @@ fill_map (ETreeTableAdapter *etta,
 {
 	GNode *p;
 
+	etta->priv->remap_from = MIN (etta->priv->remap_from, index);
+
 	if ((gnode != etta->priv->root) || etta->priv->root_visible)
 		etta->priv->map_table[index++] = gnode->data;
 
 	for (p = gnode->children; p; p = p->next)
 		index = fill_map (etta, index, p);
 
-	etta->priv->remap_needed = TRUE;
 	return index;
 }
 
@@ -172,9 +184,43 @@ static void
 remap_indices (ETreeTableAdapter *etta)
 {
 	gint i;
-	for (i = 0; i < etta->priv->n_map; i++)
+	for (i = etta->priv->remap_from; i < etta->priv->n_map; i++)
 		etta->priv->map_table[i]->index = i;
-	etta->priv->remap_needed = FALSE;
+	etta->priv->remap_from = G_MAXINT;
+}
+
+static void
+tree_table_adapter_freeze_map (ETreeTableAdapter *etta)
+{
+	if (!etta->priv->map_frozen)
+		e_table_model_pre_change (E_TABLE_MODEL (etta));
+
+	etta->priv->map_frozen++;
+}
+
+static void
+tree_table_adapter_thaw_map (ETreeTableAdapter *etta)
+{
+	g_return_if_fail (etta->priv->map_frozen > 0);
+
+	etta->priv->map_frozen--;
+
+	if (etta->priv->map_frozen)
+		return;
+
+	if (etta->priv->root) {
+		node_t *root_node = etta->priv->root->data;
+
+		resize_map (etta, root_node->num_visible_children + (etta->priv->root_visible ? 1 : 0));
+		fill_map (etta, 0, etta->priv->root);
+	} else {
+		resize_map (etta, 0);
+	}
+
+	g_slist_free_full (etta->priv->frozen_dead_nodes, g_free);
+	etta->priv->frozen_dead_nodes = NULL;
+
+	e_table_model_changed (E_TABLE_MODEL (etta));
 }
 
 static node_t *
@@ -284,7 +330,10 @@ kill_gnode (GNode *node,
 		node->children = next;
 	}
 
-	g_free (node->data);
+	if (etta->priv->map_frozen)
+		etta->priv->frozen_dead_nodes = g_slist_prepend (etta->priv->frozen_dead_nodes, node->data);
+	else
+		g_free (node->data);
 	if (node == etta->priv->root)
 		etta->priv->root = NULL;
 	g_node_destroy (node);
@@ -847,6 +896,7 @@ tree_table_adapter_finalize (GObject *object)
 
 	g_hash_table_destroy (priv->nodes);
 
+	g_slist_free_full (priv->frozen_dead_nodes, g_free);
 	g_free (priv->map_table);
 
 	/* Chain up to parent's finalize() method. */
@@ -1143,7 +1193,7 @@ e_tree_table_adapter_init (ETreeTableAdapter *etta)
 	etta->priv->nodes = g_hash_table_new (NULL, NULL);
 
 	etta->priv->root_visible = TRUE;
-	etta->priv->remap_needed = TRUE;
+	etta->priv->remap_from = 0;
 }
 
 ETableModel *
@@ -1400,8 +1450,6 @@ e_tree_table_adapter_load_expanded_state_xml (ETreeTableAdapter *etta,
 
 	root = xmlDocGetRootElement (doc);
 
-	e_table_model_pre_change (E_TABLE_MODEL (etta));
-
 	model_default = e_tree_model_get_expanded_default (etta->priv->source_model);
 
 	if (!strcmp ((gchar *) root->name, "expanded_state")) {
@@ -1424,6 +1472,8 @@ e_tree_table_adapter_load_expanded_state_xml (ETreeTableAdapter *etta,
 		return;
 	}
 
+	tree_table_adapter_freeze_map (etta);
+
 	for (child = root->xmlChildrenNode; child; child = child->next) {
 		gchar *id;
 		ETreePath path;
@@ -1447,7 +1497,8 @@ e_tree_table_adapter_load_expanded_state_xml (ETreeTableAdapter *etta,
 		g_free (id);
 	}
 
-	e_table_model_changed (E_TABLE_MODEL (etta));
+	/* Announces the change of the whole map. */
+	tree_table_adapter_thaw_map (etta);
 }
 
 void
@@ -1524,6 +1575,22 @@ e_tree_table_adapter_node_set_expanded (ETreeTableAdapter *etta,
 
 	node->expanded = expanded;
 
+	if (etta->priv->map_frozen) {
+		gint num_children;
+
+		if (expanded) {
+			num_children = insert_children (etta, gnode);
+			update_child_counts (gnode, num_children);
+			if (etta->priv->sort_info && e_table_sort_info_sorting_get_count (etta->priv->sort_info) > 0)
+				resort_node (etta, gnode, TRUE);
+		} else {
+			num_children = delete_children (etta, gnode);
+			update_child_counts (gnode, - num_children);
+		}
+
+		return;
+	}
+
 	row = e_tree_table_adapter_row_of_node (etta, path);
 	if (row == -1)
 		return;
@@ -1566,6 +1633,9 @@ e_tree_table_adapter_node_set_expanded_recurse (ETreeTableAdapter *etta,
 
 	g_return_if_fail (E_IS_TREE_TABLE_ADAPTER (etta));
 
+	/* The map is rebuilt only once, at the end, with a single change. */
+	tree_table_adapter_freeze_map (etta);
+
 	e_tree_table_adapter_node_set_expanded (etta, path, expanded);
 
 	for (children = e_tree_model_node_get_first_child (etta->priv->source_model, path);
@@ -1573,6 +1643,8 @@ e_tree_table_adapter_node_set_expanded_recurse (ETreeTableAdapter *etta,
 	     children = e_tree_model_node_get_next (etta->priv->source_model, children)) {
 		e_tree_table_adapter_node_set_expanded_recurse (etta, children, expanded);
 	}
+
+	tree_table_adapter_thaw_map (etta);
 }
 
 ETreePath
@@ -1601,7 +1673,7 @@ e_tree_table_adapter_row_of_node (ETreeTableAdapter *etta,
 	if (node == NULL)
 		return -1;
 
-	if (etta->priv->remap_needed)
+	if (etta->priv->remap_from < etta->priv->n_map)
 		remap_indices (etta);
 
 	return node->index;
@@ -0,0 +1,573 @@
+/*
+ * test-photo-cache.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Checks the in-memory and the on-disk caches of EPhotoCache, with
+ * a photo source which counts its requests and never has a photo.
+ * The in-memory tests replace the on-disk cache directory with
+ * a regular file, thus nothing can be stored there. */
+
+#include "evolution-config.h"
+
+#include <string.h>
+#include <utime.h>
+#include <glib/gstdio.h>
+
+#include <e-util/e-util.h>
+
+/* Keep these in sync with e-photo-cache.c */
+#define NEGATIVE_CACHE_TTL_SECONDS (60 * 60)
+#define DISK_CACHE_MAX_AGE_SECONDS (24 * 60 * 60)
+
+#define PHOTO_DATA "not really a PNG"
+
+typedef struct _TestPhotoSource TestPhotoSource;
+typedef struct _TestPhotoSourceClass TestPhotoSourceClass;
+
+struct _TestPhotoSource {
+	GObject parent;
+	guint n_requests;
+};
+
+struct _TestPhotoSourceClass {
+	GObjectClass parent_class;
+};
+
+typedef struct _Fixture Fixture;
+
+struct _Fixture {
+	gchar *disk_cache_dir;
+	EPhotoCache *photo_cache;
+	TestPhotoSource *photo_source;
+	GMainLoop *main_loop;
+
+	/* Results of the last lookup. */
+	GInputStream *stream;
+	gboolean success;
+	GError *error;
+};
+
+GType test_photo_source_get_type (void);
+static void test_photo_source_interface_init (EPhotoSourceInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (
+	TestPhotoSource, test_photo_source, G_TYPE_OBJECT,
+	G_IMPLEMENT_INTERFACE (
+		E_TYPE_PHOTO_SOURCE,
+		test_photo_source_interface_init))
+
+static void
+test_photo_source_get_photo (EPhotoSource *photo_source,
+                             const gchar *email_address,
+                             GCancellable *cancellable,
+                             GAsyncReadyCallback callback,
+                             gpointer user_data)
+{
+	GSimpleAsyncResult *simple;
+
+	((TestPhotoSource *) photo_source)->n_requests++;
+
+	simple = g_simple_async_result_new (
+		G_OBJECT (photo_source), callback,
+		user_data, test_photo_source_get_photo);
+
+	g_simple_async_result_complete_in_idle (simple);
+
+	g_object_unref (simple);
+}
+
+static gboolean
+test_photo_source_get_photo_finish (EPhotoSource *photo_source,
+                                    GAsyncResult *result,
+                                    GInputStream **out_stream,
+                                    gint *out_priority,
+                                    GError **error)
+{
+	*out_stream = NULL;
+
+	return TRUE;
+}
+
+static void
+test_photo_source_class_init (TestPhotoSourceClass *class)
+{
+}
+
+static void
+test_photo_source_interface_init (EPhotoSourceInterface *iface)
+{
+	iface->get_photo = test_photo_source_get_photo;
+	iface->get_photo_finish = test_photo_source_get_photo_finish;
+}
+
+static void
+test_photo_source_init (TestPhotoSource *photo_source)
+{
+}
+
+static void
+remove_disk_cache (const gchar *disk_cache_dir)
+{
+	GDir *dir;
+
+	dir = g_dir_open (disk_cache_dir, 0, NULL);
+
+	if (dir != NULL) {
+		const gchar *name;
+
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			gchar *filename;
+
+			filename = g_build_filename (disk_cache_dir, name, NULL);
+			g_unlink (filename);
+			g_free (filename);
+		}
+
+		g_dir_close (dir);
+		g_rmdir (disk_cache_dir);
+	} else {
+		g_unlink (disk_cache_dir);
+	}
+}
+
+static void
+fixture_set_up (Fixture *fixture,
+                gconstpointer user_data)
+{
+	gboolean with_disk_cache = GPOINTER_TO_INT (user_data);
+	GError *error = NULL;
+
+	fixture->disk_cache_dir = g_build_filename (
+		e_get_user_cache_dir (), "photos", NULL);
+
+	remove_disk_cache (fixture->disk_cache_dir);
+
+	if (with_disk_cache) {
+		g_assert_cmpint (g_mkdir_with_parents (fixture->disk_cache_dir, 0700), ==, 0);
+	} else {
+		g_assert_cmpint (g_mkdir_with_parents (e_get_user_cache_dir (), 0700), ==, 0);
+		g_file_set_contents (fixture->disk_cache_dir, "", 0, &error);
+		g_assert_no_error (error);
+	}
+
+	/* No client cache is needed without the contact photo sources. */
+	fixture->photo_cache = g_object_new (E_TYPE_PHOTO_CACHE, NULL);
+	fixture->photo_source = g_object_new (test_photo_source_get_type (), NULL);
+
+	e_photo_cache_add_photo_source (
+		fixture->photo_cache,
+		E_PHOTO_SOURCE (fixture->photo_source));
+
+	fixture->main_loop = g_main_loop_new (NULL, FALSE);
+}
+
+static void
+fixture_tear_down (Fixture *fixture,
+                   gconstpointer user_data)
+{
+	g_clear_object (&fixture->stream);
+	g_clear_error (&fixture->error);
+	g_main_loop_unref (fixture->main_loop);
+	g_object_unref (fixture->photo_source);
+	g_object_unref (fixture->photo_cache);
+
+	remove_disk_cache (fixture->disk_cache_dir);
+	g_free (fixture->disk_cache_dir);
+}
+
+static gchar *
+fixture_dup_disk_filename (Fixture *fixture,
+                           const gchar *email_address)
+{
+	gchar *checksum;
+	gchar *filename;
+
+	checksum = g_compute_checksum_for_string (
+		G_CHECKSUM_SHA1, email_address, -1);
+	filename = g_build_filename (fixture->disk_cache_dir, checksum, NULL);
+	g_free (checksum);
+
+	return filename;
+}
+
+/* Writes an on-disk cache entry, which was stored age_seconds ago. */
+static void
+fixture_write_disk_entry (Fixture *fixture,
+                          const gchar *email_address,
+                          const gchar *contents,
+                          gint64 age_seconds)
+{
+	struct utimbuf times;
+	gchar *filename;
+	GError *error = NULL;
+
+	filename = fixture_dup_disk_filename (fixture, email_address);
+
+	g_file_set_contents (filename, contents, -1, &error);
+	g_assert_no_error (error);
+
+	times.actime = g_get_real_time () / G_USEC_PER_SEC - age_seconds;
+	times.modtime = times.actime;
+	g_assert_cmpint (g_utime (filename, &times), ==, 0);
+
+	g_free (filename);
+}
+
+/* Waits for the asynchronous store of an on-disk cache entry. */
+static void
+fixture_wait_disk_entry (Fixture *fixture,
+                         const gchar *email_address,
+                         gsize size)
+{
+	gchar *filename;
+	GStatBuf st;
+
+	filename = fixture_dup_disk_filename (fixture, email_address);
+
+	while (g_stat (filename, &st) != 0 || (gsize) st.st_size != size)
+		g_main_context_iteration (NULL, TRUE);
+
+	g_free (filename);
+}
+
+static gboolean
+fixture_has_disk_entry (Fixture *fixture,
+                        const gchar *email_address)
+{
+	gchar *filename;
+	gboolean exists;
+
+	filename = fixture_dup_disk_filename (fixture, email_address);
+	exists = g_file_test (filename, G_FILE_TEST_EXISTS);
+	g_free (filename);
+
+	return exists;
+}
+
+static void
+get_photo_cb (GObject *source_object,
+              GAsyncResult *result,
+              gpointer user_data)
+{
+	Fixture *fixture = user_data;
+
+	fixture->success = e_photo_cache_get_photo_finish (
+		E_PHOTO_CACHE (source_object), result,
+		&fixture->stream, &fixture->error);
+
+	g_main_loop_quit (fixture->main_loop);
+}
+
+/* Returns whether the photo source had to be asked. */
+static gboolean
+fixture_get_photo (Fixture *fixture,
+                   const gchar *email_address)
+{
+	guint n_requests = fixture->photo_source->n_requests;
+
+	g_clear_object (&fixture->stream);
+	g_clear_error (&fixture->error);
+	fixture->success = FALSE;
+
+	e_photo_cache_get_photo (
+		fixture->photo_cache, email_address, NULL,
+		get_photo_cb, fixture);
+
+	g_main_loop_run (fixture->main_loop);
+
+	g_assert_no_error (fixture->error);
+	g_assert (fixture->success);
+
+	return fixture->photo_source->n_requests != n_requests;
+}
+
+static void
+fixture_assert_photo (Fixture *fixture,
+                      const gchar *expected)
+{
+	gchar buffer[64];
+	gsize bytes_read = 0;
+	gboolean success;
+	GError *error = NULL;
+
+	if (expected == NULL) {
+		g_assert (fixture->stream == NULL);
+		return;
+	}
+
+	g_assert (G_IS_INPUT_STREAM (fixture->stream));
+
+	success = g_input_stream_read_all (
+		fixture->stream, buffer, sizeof (buffer) - 1,
+		&bytes_read, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (success);
+
+	buffer[bytes_read] = '\0';
+	g_assert_cmpstr (buffer, ==, expected);
+}
+
+static void
+fixture_add_photo (Fixture *fixture,
+                   const gchar *email_address,
+                   const gchar *data)
+{
+	GBytes *bytes = NULL;
+
+	if (data != NULL)
+		bytes = g_bytes_new_static (data, strlen (data));
+
+	e_photo_cache_add_photo (fixture->photo_cache, email_address, bytes);
+
+	if (bytes != NULL)
+		g_bytes_unref (bytes);
+}
+
+static void
+notify_cb (GObject *object,
+           GParamSpec *pspec,
+           gpointer user_data)
+{
+	guint *n_notify = user_data;
+
+	(*n_notify)++;
+}
+
+static void
+test_max_cache_size (Fixture *fixture,
+                     gconstpointer user_data)
+{
+	guint max_cache_size = 0;
+	guint n_notify = 0;
+
+	g_assert_cmpuint (e_photo_cache_get_max_cache_size (fixture->photo_cache), ==, 100);
+
+	g_signal_connect (
+		fixture->photo_cache, "notify::max-cache-size",
+		G_CALLBACK (notify_cb), &n_notify);
+
+	g_object_set (fixture->photo_cache, "max-cache-size", 3, NULL);
+	g_object_get (fixture->photo_cache, "max-cache-size", &max_cache_size, NULL);
+	g_assert_cmpuint (max_cache_size, ==, 3);
+	g_assert_cmpuint (n_notify, ==, 1);
+
+	/* Setting the same value does not notify. */
+	e_photo_cache_set_max_cache_size (fixture->photo_cache, 3);
+	g_assert_cmpuint (n_notify, ==, 1);
+
+	fixture_add_photo (fixture, "a@example.com", PHOTO_DATA);
+	fixture_add_photo (fixture, "b@example.com", PHOTO_DATA);
+	fixture_add_photo (fixture, "c@example.com", PHOTO_DATA);
+
+	/* Lowering the size discards the least recently used entries. */
+	e_photo_cache_set_max_cache_size (fixture->photo_cache, 1);
+	g_assert_cmpuint (n_notify, ==, 2);
+
+	g_assert (!fixture_get_photo (fixture, "c@example.com"));
+	fixture_assert_photo (fixture, PHOTO_DATA);
+	g_assert (fixture_get_photo (fixture, "b@example.com"));
+	fixture_assert_photo (fixture, NULL);
+	g_assert (fixture_get_photo (fixture, "a@example.com"));
+	fixture_assert_photo (fixture, NULL);
+}
+
+static void
+test_lru (Fixture *fixture,
+          gconstpointer user_data)
+{
+	e_photo_cache_set_max_cache_size (fixture->photo_cache, 2);
+
+	fixture_add_photo (fixture, "a@example.com", PHOTO_DATA);
+	fixture_add_photo (fixture, "b@example.com", PHOTO_DATA);
+
+	/* A lookup makes the entry the most recently used one. */
+	g_assert (!fixture_get_photo (fixture, "A@Example.com"));
+	fixture_assert_photo (fixture, PHOTO_DATA);
+
+	fixture_add_photo (fixture, "c@example.com", PHOTO_DATA);
+
+	g_assert (!fixture_get_photo (fixture, "a@example.com"));
+	fixture_assert_photo (fixture, PHOTO_DATA);
+	g_assert (!fixture_get_photo (fixture, "c@example.com"));
+	fixture_assert_photo (fixture, PHOTO_DATA);
+
+	/* The evicted entry is looked up again, and the answer
+	 * of the photo source evicts the next least recent one. */
+	g_assert (fixture_get_photo (fixture, "b@example.com"));
+	fixture_assert_photo (fixture, NULL);
+
+	g_assert (!fixture_get_photo (fixture, "c@example.com"));
+	g_assert (!fixture_get_photo (fixture, "b@example.com"));
+	g_assert (fixture_get_photo (fixture, "a@example.com"));
+
+	/* Replacing an entry does not grow the cache. */
+	fixture_add_photo (fixture, "a@example.com", PHOTO_DATA);
+	fixture_add_photo (fixture, "a@example.com", PHOTO_DATA);
+	g_assert (!fixture_get_photo (fixture, "b@example.com"));
+	g_assert (!fixture_get_photo (fixture, "a@example.com"));
+	fixture_assert_photo (fixture, PHOTO_DATA);
+}
+
+static void
+test_negative (Fixture *fixture,
+               gconstpointer user_data)
+{
+	/* No photo is an answer too. */
+	fixture_add_photo (fixture, "a@example.com", NULL);
+	g_assert (!fixture_get_photo (fixture, "a@example.com"));
+	fixture_assert_photo (fixture, NULL);
+
+	/* A photo replaces the negative answer, but not vice versa. */
+	fixture_add_photo (fixture, "a@example.com", PHOTO_DATA);
+	fixture_add_photo (fixture, "a@example.com", NULL);
+	g_assert (!fixture_get_photo (fixture, "a@example.com"));
+	fixture_assert_photo (fixture, PHOTO_DATA);
+
+	/* The photo sources are asked once. */
+	g_assert (fixture_get_photo (fixture, "b@example.com"));
+	g_assert (!fixture_get_photo (fixture, "b@example.com"));
+	fixture_assert_photo (fixture, NULL);
+
+	g_assert (e_photo_cache_remove_photo (fixture->photo_cache, "b@example.com"));
+	g_assert (!e_photo_cache_remove_photo (fixture->photo_cache, "b@example.com"));
+	g_assert (fixture_get_photo (fixture, "b@example.com"));
+}
+
+static void
+test_disk_store (Fixture *fixture,
+                 gconstpointer user_data)
+{
+	EPhotoCache *photo_cache;
+
+	fixture_add_photo (fixture, " A@Example.com ", PHOTO_DATA);
+	fixture_add_photo (fixture, "b@example.com", NULL);
+
+	fixture_wait_disk_entry (fixture, "a@example.com", strlen (PHOTO_DATA));
+	fixture_wait_disk_entry (fixture, "b@example.com", 0);
+
+	/* A new instance finds both answers on the disk. */
+	photo_cache = g_object_new (E_TYPE_PHOTO_CACHE, NULL);
+	e_photo_cache_add_photo_source (
+		photo_cache, E_PHOTO_SOURCE (fixture->photo_source));
+
+	g_object_unref (fixture->photo_cache);
+	fixture->photo_cache = photo_cache;
+
+	g_assert (!fixture_get_photo (fixture, "a@example.com"));
+	fixture_assert_photo (fixture, PHOTO_DATA);
+	g_assert (!fixture_get_photo (fixture, "b@example.com"));
+	fixture_assert_photo (fixture, NULL);
+
+	/* Removing the entry removes also the file. */
+	g_assert (e_photo_cache_remove_photo (fixture->photo_cache, "a@example.com"));
+	g_assert (!fixture_has_disk_entry (fixture, "a@example.com"));
+	g_assert (fixture_get_photo (fixture, "a@example.com"));
+	fixture_assert_photo (fixture, NULL);
+
+	fixture_wait_disk_entry (fixture, "a@example.com", 0);
+}
+
+static void
+test_disk_max_age (Fixture *fixture,
+                   gconstpointer user_data)
+{
+	fixture_write_disk_entry (
+		fixture, "a@example.com", PHOTO_DATA,
+		DISK_CACHE_MAX_AGE_SECONDS - 60);
+	fixture_write_disk_entry (
+		fixture, "b@example.com", PHOTO_DATA,
+		DISK_CACHE_MAX_AGE_SECONDS + 60);
+
+	g_assert (!fixture_get_photo (fixture, "a@example.com"));
+	fixture_assert_photo (fixture, PHOTO_DATA);
+
+	/* Too old photos are looked up again. */
+	g_assert (fixture_get_photo (fixture, "b@example.com"));
+	fixture_assert_photo (fixture, NULL);
+
+	fixture_wait_disk_entry (fixture, "b@example.com", 0);
+}
+
+static void
+test_disk_negative_ttl (Fixture *fixture,
+                        gconstpointer user_data)
+{
+	fixture_write_disk_entry (
+		fixture, "a@example.com", "",
+		NEGATIVE_CACHE_TTL_SECONDS - 60);
+	fixture_write_disk_entry (
+		fixture, "b@example.com", "",
+		NEGATIVE_CACHE_TTL_SECONDS + 60);
+	fixture_write_disk_entry (
+		fixture, "c@example.com", "", -60);
+
+	g_assert (!fixture_get_photo (fixture, "a@example.com"));
+	fixture_assert_photo (fixture, NULL);
+
+	/* A negative answer expires sooner than a photo, and one
+	 * from the future, after a clock change, is not trusted. */
+	g_assert (fixture_get_photo (fixture, "b@example.com"));
+	g_assert (fixture_get_photo (fixture, "c@example.com"));
+
+	/* The new answers are stored again. */
+	fixture_wait_disk_entry (fixture, "b@example.com", 0);
+	fixture_wait_disk_entry (fixture, "c@example.com", 0);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	gchar *cache_home;
+	gint result;
+
+	/* Do not touch the user's cache. */
+	cache_home = g_dir_make_tmp ("test-photo-cache-XXXXXX", NULL);
+	g_assert (cache_home != NULL);
+	g_setenv ("XDG_CACHE_HOME", cache_home, TRUE);
+
+	g_test_init (&argc, &argv, NULL);
+
+	/* The on-disk tests wait for all their stores and run first,
+	 * thus no store of an earlier test lands in a later one; the
+	 * stores of the in-memory tests cannot succeed at all. */
+	g_test_add (
+		"/PhotoCache/DiskStore", Fixture, GINT_TO_POINTER (TRUE),
+		fixture_set_up, test_disk_store, fixture_tear_down);
+	g_test_add (
+		"/PhotoCache/DiskMaxAge", Fixture, GINT_TO_POINTER (TRUE),
+		fixture_set_up, test_disk_max_age, fixture_tear_down);
+	g_test_add (
+		"/PhotoCache/DiskNegativeTTL", Fixture, GINT_TO_POINTER (TRUE),
+		fixture_set_up, test_disk_negative_ttl, fixture_tear_down);
+	g_test_add (
+		"/PhotoCache/MaxCacheSize", Fixture, GINT_TO_POINTER (FALSE),
+		fixture_set_up, test_max_cache_size, fixture_tear_down);
+	g_test_add (
+		"/PhotoCache/LRU", Fixture, GINT_TO_POINTER (FALSE),
+		fixture_set_up, test_lru, fixture_tear_down);
+	g_test_add (
+		"/PhotoCache/Negative", Fixture, GINT_TO_POINTER (FALSE),
+		fixture_set_up, test_negative, fixture_tear_down);
+
+	result = g_test_run ();
+
+	g_rmdir (e_get_user_cache_dir ());
+	g_rmdir (cache_home);
+	g_free (cache_home);
+
+	return result;
+}
@@ -0,0 +1,509 @@
+/*
+ * e-mail-crypto-cache.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "evolution-config.h"
+
+#include <string.h>
+
+#include <e-util/e-util.h>
+
+#include "e-mail-crypto-cache.h"
+
+/* Verification results are small, keep plenty of them. */
+#define MAX_VALIDITIES 512
+
+/* Certificates expire and get revoked without any change of the local
+ * key stores, thus do not trust the remembered results for too long. */
+#define MAX_ENTRY_AGE (60 * G_TIME_SPAN_MINUTE)
+
+typedef struct _CacheEntry {
+	gchar *key;
+	CamelCipherValidity *validity;
+	GByteArray *content;	/* decrypted MIME part, or NULL */
+	gint64 stamp;
+	GList *link;		/* in CryptoCache::lru */
+} CacheEntry;
+
+typedef struct _CryptoCache {
+	GHashTable *entries;	/* gchar *key ~> CacheEntry */
+	GQueue lru;		/* CacheEntry, the most recent first */
+	gsize content_size;
+} CryptoCache;
+
+/* Must hold the crypto_cache lock to access these. */
+static CryptoCache validities;
+static CryptoCache decrypted;
+static GPtrArray *monitors;
+G_LOCK_DEFINE_STATIC (crypto_cache);
+
+/* Files of the GnuPG home and of the NSS certificate databases;
+ * a change of any of them can change the result of an operation. */
+static const gchar *keyring_files[] = {
+	"pubring.gpg",
+	"pubring.kbx",
+	"secring.gpg",
+	"trustdb.gpg",
+	"private-keys-v1.d",
+	"cert8.db",
+	"cert9.db",
+	"key3.db",
+	"key4.db",
+	"secmod.db",
+	"pkcs11.txt"
+};
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+	g_free (entry->key);
+	camel_cipher_validity_free (entry->validity);
+
+	if (entry->content != NULL) {
+		/* The decrypted content should not linger in memory. */
+		memset (entry->content->data, 0, entry->content->len);
+		g_byte_array_free (entry->content, TRUE);
+	}
+
+	g_slice_free (CacheEntry, entry);
+}
+
+static void
+crypto_cache_remove_locked (CryptoCache *cache,
+                            CacheEntry *entry)
+{
+	g_queue_delete_link (&cache->lru, entry->link);
+
+	if (entry->content != NULL)
+		cache->content_size -= entry->content->len;
+
+	/* Frees the entry. */
+	g_hash_table_remove (cache->entries, entry->key);
+}
+
+static void
+crypto_cache_clear_locked (CryptoCache *cache)
+{
+	if (cache->entries == NULL)
+		return;
+
+	g_queue_clear (&cache->lru);
+	g_hash_table_remove_all (cache->entries);
+	cache->content_size = 0;
+}
+
+static void
+crypto_cache_keyring_changed_cb (GFileMonitor *monitor,
+                                 GFile *file,
+                                 GFile *other_file,
+                                 GFileMonitorEvent event_type,
+                                 gpointer user_data)
+{
+	gchar *basename;
+	guint ii;
+
+	if (event_type == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT ||
+	    event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+		return;
+
+	basename = g_file_get_basename (file);
+
+	for (ii = 0; basename != NULL && ii < G_N_ELEMENTS (keyring_files); ii++) {
+		if (g_strcmp0 (basename, keyring_files[ii]) == 0) {
+			e_mail_crypto_cache_clear ();
+			break;
+		}
+	}
+
+	g_free (basename);
+}
+
+static void
+crypto_cache_monitor_directory_locked (const gchar *path)
+{
+	GFileMonitor *monitor;
+	GFile *file;
+
+	file = g_file_new_for_path (path);
+	monitor = g_file_monitor_directory (
+		file, G_FILE_MONITOR_NONE, NULL, NULL);
+	g_object_unref (file);
+
+	if (monitor == NULL)
+		return;
+
+	g_signal_connect (
+		monitor, "changed",
+		G_CALLBACK (crypto_cache_keyring_changed_cb), NULL);
+
+	g_ptr_array_add (monitors, monitor);
+}
+
+static void
+crypto_cache_init_locked (void)
+{
+	const gchar *gnupg_home;
+	gchar *path;
+
+	if (validities.entries != NULL)
+		return;
+
+	validities.entries = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) NULL,
+		(GDestroyNotify) cache_entry_free);
+	g_queue_init (&validities.lru);
+
+	decrypted.entries = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) NULL,
+		(GDestroyNotify) cache_entry_free);
+	g_queue_init (&decrypted.lru);
+
+	/* The monitors report into the thread-default main context of
+	 * the caller. The parsers run in threads without their own one,
+	 * thus it is the main loop; the default context cannot be pushed
+	 * from there, because the main thread owns it. */
+	monitors = g_ptr_array_new_with_free_func (g_object_unref);
+
+	gnupg_home = g_getenv ("GNUPGHOME");
+	if (gnupg_home != NULL && *gnupg_home != '\0') {
+		crypto_cache_monitor_directory_locked (gnupg_home);
+	} else {
+		path = g_build_filename (g_get_home_dir (), ".gnupg", NULL);
+		crypto_cache_monitor_directory_locked (path);
+		g_free (path);
+	}
+
+	/* Camel opens the shared NSS database when it exists,
+	 * otherwise the one in the user data directory. */
+	path = g_build_filename (g_get_home_dir (), ".pki", "nssdb", NULL);
+	crypto_cache_monitor_directory_locked (path);
+	g_free (path);
+
+	crypto_cache_monitor_directory_locked (e_get_user_data_dir ());
+}
+
+static CacheEntry *
+crypto_cache_lookup_locked (CryptoCache *cache,
+                            const gchar *key)
+{
+	CacheEntry *entry;
+
+	entry = g_hash_table_lookup (cache->entries, key);
+	if (entry == NULL)
+		return NULL;
+
+	if (g_get_monotonic_time () - entry->stamp > MAX_ENTRY_AGE) {
+		crypto_cache_remove_locked (cache, entry);
+		return NULL;
+	}
+
+	g_queue_unlink (&cache->lru, entry->link);
+	g_queue_push_head_link (&cache->lru, entry->link);
+
+	return entry;
+}
+
+static void
+crypto_cache_add_locked (CryptoCache *cache,
+                         const gchar *key,
+                         CamelCipherValidity *validity,
+                         GByteArray *content)
+{
+	CacheEntry *entry;
+
+	entry = g_hash_table_lookup (cache->entries, key);
+	if (entry != NULL)
+		crypto_cache_remove_locked (cache, entry);
+
+	entry = g_slice_new0 (CacheEntry);
+	entry->key = g_strdup (key);
+	entry->validity = camel_cipher_validity_clone (validity);
+	entry->content = content;
+	entry->stamp = g_get_monotonic_time ();
+
+	g_queue_push_head (&cache->lru, entry);
+	entry->link = g_queue_peek_head_link (&cache->lru);
+
+	if (content != NULL)
+		cache->content_size += content->len;
+
+	g_hash_table_insert (cache->entries, entry->key, entry);
+}
+
+/* Drops the least recently used entries until both limits are met. */
+static void
+crypto_cache_trim_locked (CryptoCache *cache,
+                          guint max_entries,
+                          gsize max_content_size)
+{
+	while (cache->lru.length > max_entries ||
+	       cache->content_size > max_content_size) {
+		CacheEntry *entry = g_queue_peek_tail (&cache->lru);
+
+		if (entry == NULL)
+			break;
+
+		crypto_cache_remove_locked (cache, entry);
+	}
+}
+
+static gchar *
+crypto_cache_build_key (CamelCipherContext *context,
+                        CamelMimePart *part,
+                        GCancellable *cancellable)
+{
+	CamelStream *stream;
+	GByteArray *byte_array;
+	gchar *digest, *key = NULL;
+
+	stream = camel_stream_mem_new ();
+
+	if (camel_data_wrapper_write_to_stream_sync (
+		CAMEL_DATA_WRAPPER (part), stream, cancellable, NULL) >= 0) {
+		byte_array = camel_stream_mem_get_byte_array (
+			CAMEL_STREAM_MEM (stream));
+
+		digest = g_compute_checksum_for_data (
+			G_CHECKSUM_SHA256, byte_array->data, byte_array->len);
+
+		/* The same content is verified differently by
+		 * different contexts, S/MIME and OpenPGP. */
+		key = g_strconcat (
+			G_OBJECT_TYPE_NAME (context), ":", digest, NULL);
+
+		g_free (digest);
+	}
+
+	g_object_unref (stream);
+
+	return key;
+}
+
+static gsize
+crypto_cache_get_decrypted_limit (void)
+{
+	GSettings *settings;
+	gint size_kb;
+
+	settings = e_util_ref_settings ("org.gnome.evolution.mail");
+	size_kb = g_settings_get_int (settings, "crypto-decrypted-cache-size");
+	g_clear_object (&settings);
+
+	return size_kb > 0 ? ((gsize) size_kb) * 1024 : 0;
+}
+
+/**
+ * e_mail_crypto_cache_verify_sync:
+ * @context: a #CamelCipherContext
+ * @ipart: the #CamelMimePart to verify
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Like camel_cipher_context_verify_sync(), only the result for the same
+ * content is remembered, thus the next call for it doesn't run the crypto
+ * operation again.  The remembered results are forgotten when the GnuPG
+ * or NSS key stores change.  Failures are not remembered.
+ *
+ * Returns: a #CamelCipherValidity, free it with camel_cipher_validity_free()
+ *
+ * Since: 3.24
+ **/
+CamelCipherValidity *
+e_mail_crypto_cache_verify_sync (CamelCipherContext *context,
+                                 CamelMimePart *ipart,
+                                 GCancellable *cancellable,
+                                 GError **error)
+{
+	CamelCipherValidity *validity = NULL;
+	CacheEntry *entry;
+	gchar *key;
+
+	g_return_val_if_fail (CAMEL_IS_CIPHER_CONTEXT (context), NULL);
+	g_return_val_if_fail (CAMEL_IS_MIME_PART (ipart), NULL);
+
+	key = crypto_cache_build_key (context, ipart, cancellable);
+
+	if (key != NULL) {
+		G_LOCK (crypto_cache);
+
+		crypto_cache_init_locked ();
+
+		entry = crypto_cache_lookup_locked (&validities, key);
+		if (entry != NULL)
+			validity = camel_cipher_validity_clone (entry->validity);
+
+		G_UNLOCK (crypto_cache);
+	}
+
+	if (validity == NULL) {
+		validity = camel_cipher_context_verify_sync (
+			context, ipart, cancellable, error);
+
+		if (validity != NULL && key != NULL) {
+			G_LOCK (crypto_cache);
+
+			crypto_cache_add_locked (&validities, key, validity, NULL);
+			crypto_cache_trim_locked (&validities, MAX_VALIDITIES, G_MAXSIZE);
+
+			G_UNLOCK (crypto_cache);
+		}
+	}
+
+	g_free (key);
+
+	return validity;
+}
+
+/**
+ * e_mail_crypto_cache_decrypt_sync:
+ * @context: a #CamelCipherContext
+ * @ipart: the #CamelMimePart to decrypt
+ * @opart: a #CamelMimePart to decrypt into
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Like camel_cipher_context_decrypt_sync().  The decrypted content is
+ * remembered in memory only when the "crypto-decrypted-cache-size" setting
+ * is positive, up to that many kilobytes in total, and it's overwritten
+ * when forgotten.  It's never written to disk.
+ *
+ * Returns: a #CamelCipherValidity, free it with camel_cipher_validity_free()
+ *
+ * Since: 3.24
+ **/
+CamelCipherValidity *
+e_mail_crypto_cache_decrypt_sync (CamelCipherContext *context,
+                                  CamelMimePart *ipart,
+                                  CamelMimePart *opart,
+                                  GCancellable *cancellable,
+                                  GError **error)
+{
+	CamelCipherValidity *validity = NULL;
+	CamelStream *stream;
+	CacheEntry *entry;
+	GByteArray *content;
+	gsize limit;
+	gchar *key = NULL;
+
+	g_return_val_if_fail (CAMEL_IS_CIPHER_CONTEXT (context), NULL);
+	g_return_val_if_fail (CAMEL_IS_MIME_PART (ipart), NULL);
+	g_return_val_if_fail (CAMEL_IS_MIME_PART (opart), NULL);
+
+	limit = crypto_cache_get_decrypted_limit ();
+
+	if (limit == 0) {
+		G_LOCK (crypto_cache);
+		if (decrypted.entries != NULL)
+			crypto_cache_clear_locked (&decrypted);
+		G_UNLOCK (crypto_cache);
+
+		return camel_cipher_context_decrypt_sync (
+			context, ipart, opart, cancellable, error);
+	}
+
+	key = crypto_cache_build_key (context, ipart, cancellable);
+
+	if (key != NULL) {
+		stream = NULL;
+
+		G_LOCK (crypto_cache);
+
+		crypto_cache_init_locked ();
+
+		entry = crypto_cache_lookup_locked (&decrypted, key);
+		if (entry != NULL) {
+			validity = camel_cipher_validity_clone (entry->validity);
+			stream = camel_stream_mem_new_with_buffer (
+				(const gchar *) entry->content->data,
+				entry->content->len);
+			camel_stream_mem_set_secure (CAMEL_STREAM_MEM (stream));
+		}
+
+		G_UNLOCK (crypto_cache);
+
+		if (stream != NULL && !camel_data_wrapper_construct_from_stream_sync (
+			CAMEL_DATA_WRAPPER (opart), stream, cancellable, NULL)) {
+			camel_cipher_validity_free (validity);
+			validity = NULL;
+		}
+
+		g_clear_object (&stream);
+
+		if (validity != NULL) {
+			g_free (key);
+			return validity;
+		}
+	}
+
+	validity = camel_cipher_context_decrypt_sync (
+		context, ipart, opart, cancellable, error);
+
+	if (validity == NULL || key == NULL) {
+		g_free (key);
+		return validity;
+	}
+
+	stream = camel_stream_mem_new ();
+	camel_stream_mem_set_secure (CAMEL_STREAM_MEM (stream));
+
+	if (camel_data_wrapper_write_to_stream_sync (
+		CAMEL_DATA_WRAPPER (opart), stream, cancellable, NULL) >= 0) {
+		GByteArray *byte_array;
+
+		byte_array = camel_stream_mem_get_byte_array (
+			CAMEL_STREAM_MEM (stream));
+
+		if (byte_array->len <= limit) {
+			content = g_byte_array_sized_new (byte_array->len);
+			g_byte_array_append (
+				content, byte_array->data, byte_array->len);
+
+			G_LOCK (crypto_cache);
+
+			crypto_cache_add_locked (&decrypted, key, validity, content);
+			crypto_cache_trim_locked (&decrypted, G_MAXUINT, limit);
+
+			G_UNLOCK (crypto_cache);
+		}
+	}
+
+	g_object_unref (stream);
+	g_free (key);
+
+	return validity;
+}
+
+/**
+ * e_mail_crypto_cache_clear:
+ *
+ * Forgets all the remembered verification and decryption results.
+ *
+ * Since: 3.24
+ **/
+void
+e_mail_crypto_cache_clear (void)
+{
+	G_LOCK (crypto_cache);
+
+	crypto_cache_clear_locked (&validities);
+	crypto_cache_clear_locked (&decrypted);
+
+	G_UNLOCK (crypto_cache);
+}
@@ -0,0 +1,44 @@
+/*
+ * e-mail-crypto-cache.h
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef E_MAIL_CRYPTO_CACHE_H
+#define E_MAIL_CRYPTO_CACHE_H
+
+/* CamelCipherContext wrappers remembering the results of previous
+ * operations on the same content for the rest of the session. */
+
+#include <camel/camel.h>
+
+G_BEGIN_DECLS
+
+CamelCipherValidity *
+		e_mail_crypto_cache_verify_sync	(CamelCipherContext *context,
+						 CamelMimePart *ipart,
+						 GCancellable *cancellable,
+						 GError **error);
+CamelCipherValidity *
+		e_mail_crypto_cache_decrypt_sync
+						(CamelCipherContext *context,
+						 CamelMimePart *ipart,
+						 CamelMimePart *opart,
+						 GCancellable *cancellable,
+						 GError **error);
+void		e_mail_crypto_cache_clear	(void);
+
+G_END_DECLS
+
+#endif /* E_MAIL_CRYPTO_CACHE_H */
@@ -22,6 +22,7 @@
 
 #include <e-util/e-util.h>
 
+#include "e-mail-crypto-cache.h"
 #include "e-mail-parser-extension.h"
 #include "e-mail-part-utils.h"
 
@@ -69,7 +70,7 @@ empe_app_smime_parse (EMailParserExtension *extension,
 	context = camel_smime_context_new (e_mail_parser_get_session (parser));
 
 	opart = camel_mime_part_new ();
-	valid = camel_cipher_context_decrypt_sync (
+	valid = e_mail_crypto_cache_decrypt_sync (
 		context, part, opart,
 		cancellable, &local_error);
 
@@ -22,6 +22,7 @@
 
 #include <e-util/e-util.h>
 
+#include "e-mail-crypto-cache.h"
 #include "e-mail-parser-extension.h"
 #include "e-mail-part-utils.h"
 
@@ -66,7 +67,7 @@ empe_inlinepgp_encrypted_parse (EMailParserExtension *extension,
 	opart = camel_mime_part_new ();
 
 	/* Decrypt the message */
-	valid = camel_cipher_context_decrypt_sync (
+	valid = e_mail_crypto_cache_decrypt_sync (
 		cipher, part, opart, cancellable, &local_error);
 
 	if (local_error != NULL) {
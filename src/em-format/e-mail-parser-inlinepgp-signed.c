@@ -22,6 +22,7 @@
 
 #include <e-util/e-util.h>
 
+#include "e-mail-crypto-cache.h"
 #include "e-mail-parser-extension.h"
 #include "e-mail-part-utils.h"
 
@@ -69,7 +70,7 @@ empe_inlinepgp_signed_parse (EMailParserExtension *extension,
 	cipher = camel_gpg_context_new (e_mail_parser_get_session (parser));
 
 	/* Verify the signature of the message */
-	valid = camel_cipher_context_verify_sync (
+	valid = e_mail_crypto_cache_verify_sync (
 		cipher, part, cancellable, &local_error);
 
 	if (local_error != NULL) {
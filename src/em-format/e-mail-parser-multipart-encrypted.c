@@ -21,6 +21,7 @@
 
 #include <libedataserver/libedataserver.h>
 
+#include "e-mail-crypto-cache.h"
 #include "e-mail-parser-extension.h"
 #include "e-mail-part-utils.h"
 
@@ -87,7 +88,7 @@ empe_mp_encrypted_parse (EMailParserExtension *extension,
 	context = camel_gpg_context_new (e_mail_parser_get_session (parser));
 
 	opart = camel_mime_part_new ();
-	valid = camel_cipher_context_decrypt_sync (
+	valid = e_mail_crypto_cache_decrypt_sync (
 		context, part, opart, cancellable, &local_error);
 
 	e_mail_part_preserve_charset_in_content_type (part, opart);
@@ -21,6 +21,7 @@
 
 #include <libedataserver/libedataserver.h>
 
+#include "e-mail-crypto-cache.h"
 #include "e-mail-parser-extension.h"
 #include "e-mail-part-utils.h"
 
@@ -124,7 +125,7 @@ empe_mp_signed_parse (EMailParserExtension *extension,
 		return TRUE;
 	}
 
-	valid = camel_cipher_context_verify_sync (
+	valid = e_mail_crypto_cache_verify_sync (
 		cipher, part, cancellable, &local_error);
 
 	if (local_error != NULL) {
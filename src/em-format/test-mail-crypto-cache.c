@@ -0,0 +1,532 @@
+/*
+ * test-mail-crypto-cache.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Runs the crypto cache over a cipher context stub, which counts how many
+ * times it was asked, with the GnuPG home in a temporary directory. */
+
+#include "evolution-config.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include <e-util/e-util.h>
+
+#include "e-mail-crypto-cache.h"
+
+#define SIGNED_CONTENT		"signed content"
+#define ENCRYPTED_CONTENT	"encrypted content"
+#define DECRYPTED_CONTENT	"decrypted content"
+
+typedef struct _TestSession TestSession;
+typedef struct _TestSessionClass TestSessionClass;
+typedef struct _TestCipherContext TestCipherContext;
+typedef struct _TestCipherContextClass TestCipherContextClass;
+
+struct _TestSession {
+	CamelSession parent;
+};
+
+struct _TestSessionClass {
+	CamelSessionClass parent_class;
+};
+
+struct _TestCipherContext {
+	CamelCipherContext parent;
+	guint n_verify;
+	guint n_decrypt;
+};
+
+struct _TestCipherContextClass {
+	CamelCipherContextClass parent_class;
+};
+
+typedef struct _Fixture Fixture;
+
+struct _Fixture {
+	CamelSession *session;
+	TestCipherContext *context;
+};
+
+static gchar *tmp_dir;
+
+GType test_session_get_type (void);
+GType test_cipher_context_get_type (void);
+
+G_DEFINE_TYPE (TestSession, test_session, CAMEL_TYPE_SESSION)
+G_DEFINE_TYPE (TestCipherContext, test_cipher_context, CAMEL_TYPE_CIPHER_CONTEXT)
+
+static void
+test_session_class_init (TestSessionClass *class)
+{
+}
+
+static void
+test_session_init (TestSession *session)
+{
+}
+
+static CamelCipherValidity *
+test_cipher_context_verify_sync (CamelCipherContext *context,
+                                 CamelMimePart *ipart,
+                                 GCancellable *cancellable,
+                                 GError **error)
+{
+	CamelCipherValidity *validity;
+
+	((TestCipherContext *) context)->n_verify++;
+
+	validity = camel_cipher_validity_new ();
+	validity->sign.status = CAMEL_CIPHER_VALIDITY_SIGN_GOOD;
+
+	return validity;
+}
+
+static CamelCipherValidity *
+test_cipher_context_decrypt_sync (CamelCipherContext *context,
+                                  CamelMimePart *ipart,
+                                  CamelMimePart *opart,
+                                  GCancellable *cancellable,
+                                  GError **error)
+{
+	CamelCipherValidity *validity;
+
+	((TestCipherContext *) context)->n_decrypt++;
+
+	camel_mime_part_set_content (
+		opart, DECRYPTED_CONTENT,
+		strlen (DECRYPTED_CONTENT), "text/plain");
+
+	validity = camel_cipher_validity_new ();
+	validity->encrypt.status = CAMEL_CIPHER_VALIDITY_ENCRYPT_ENCRYPTED;
+
+	return validity;
+}
+
+static void
+test_cipher_context_class_init (TestCipherContextClass *class)
+{
+	CamelCipherContextClass *cipher_context_class;
+
+	cipher_context_class = CAMEL_CIPHER_CONTEXT_CLASS (class);
+	cipher_context_class->verify_sync = test_cipher_context_verify_sync;
+	cipher_context_class->decrypt_sync = test_cipher_context_decrypt_sync;
+}
+
+static void
+test_cipher_context_init (TestCipherContext *context)
+{
+}
+
+static CamelMimePart *
+new_mime_part (const gchar *content)
+{
+	CamelMimePart *part;
+
+	part = camel_mime_part_new ();
+	camel_mime_part_set_content (part, content, strlen (content), "text/plain");
+
+	return part;
+}
+
+static gchar *
+dup_mime_part_content (CamelMimePart *part)
+{
+	CamelDataWrapper *dw;
+	CamelStream *stream;
+	GByteArray *byte_array;
+	gchar *content;
+
+	dw = camel_medium_get_content (CAMEL_MEDIUM (part));
+	g_assert (dw != NULL);
+
+	stream = camel_stream_mem_new ();
+	camel_data_wrapper_decode_to_stream_sync (dw, stream, NULL, NULL);
+
+	byte_array = camel_stream_mem_get_byte_array (CAMEL_STREAM_MEM (stream));
+	content = g_strndup ((const gchar *) byte_array->data, byte_array->len);
+
+	g_object_unref (stream);
+
+	return content;
+}
+
+static void
+remove_tree (const gchar *path)
+{
+	GDir *dir;
+
+	dir = g_dir_open (path, 0, NULL);
+
+	if (dir != NULL) {
+		const gchar *name;
+
+		while ((name = g_dir_read_name (dir)) != NULL) {
+			gchar *child;
+
+			child = g_build_filename (path, name, NULL);
+			remove_tree (child);
+			g_free (child);
+		}
+
+		g_dir_close (dir);
+		g_rmdir (path);
+	} else {
+		g_unlink (path);
+	}
+}
+
+static void
+set_decrypted_cache_size (gint size_kb)
+{
+	GSettings *settings;
+
+	settings = e_util_ref_settings ("org.gnome.evolution.mail");
+	g_settings_set_int (settings, "crypto-decrypted-cache-size", size_kb);
+	g_object_unref (settings);
+}
+
+static void
+fixture_set_up (Fixture *fixture,
+                gconstpointer user_data)
+{
+	e_mail_crypto_cache_clear ();
+	set_decrypted_cache_size (0);
+
+	fixture->session = g_object_new (
+		test_session_get_type (),
+		"user-data-dir", tmp_dir,
+		"user-cache-dir", tmp_dir,
+		NULL);
+
+	fixture->context = g_object_new (
+		test_cipher_context_get_type (),
+		"session", fixture->session,
+		NULL);
+}
+
+static void
+fixture_tear_down (Fixture *fixture,
+                   gconstpointer user_data)
+{
+	g_object_unref (fixture->context);
+	g_object_unref (fixture->session);
+}
+
+static void
+fixture_verify (Fixture *fixture,
+                CamelMimePart *ipart)
+{
+	CamelCipherValidity *validity;
+	GError *error = NULL;
+
+	validity = e_mail_crypto_cache_verify_sync (
+		CAMEL_CIPHER_CONTEXT (fixture->context), ipart, NULL, &error);
+
+	g_assert_no_error (error);
+	g_assert (validity != NULL);
+	g_assert_cmpint (validity->sign.status, ==, CAMEL_CIPHER_VALIDITY_SIGN_GOOD);
+
+	camel_cipher_validity_free (validity);
+}
+
+static void
+fixture_decrypt (Fixture *fixture,
+                 CamelMimePart *ipart)
+{
+	CamelCipherValidity *validity;
+	CamelMimePart *opart;
+	gchar *content;
+	GError *error = NULL;
+
+	opart = camel_mime_part_new ();
+
+	validity = e_mail_crypto_cache_decrypt_sync (
+		CAMEL_CIPHER_CONTEXT (fixture->context), ipart, opart, NULL, &error);
+
+	g_assert_no_error (error);
+	g_assert (validity != NULL);
+	g_assert_cmpint (validity->encrypt.status, ==, CAMEL_CIPHER_VALIDITY_ENCRYPT_ENCRYPTED);
+
+	content = dup_mime_part_content (opart);
+	g_assert_cmpstr (content, ==, DECRYPTED_CONTENT);
+
+	g_free (content);
+	camel_cipher_validity_free (validity);
+	g_object_unref (opart);
+}
+
+static void
+keyring_changed_cb (GFileMonitor *monitor,
+                    GFile *file,
+                    GFile *other_file,
+                    GFileMonitorEvent event_type,
+                    gpointer user_data)
+{
+	gboolean *changed = user_data;
+
+	*changed = TRUE;
+}
+
+static gboolean
+keyring_timeout_cb (gpointer user_data)
+{
+	gboolean *timed_out = user_data;
+
+	*timed_out = TRUE;
+
+	return FALSE;
+}
+
+/* Writes a keyring file in the GnuPG home and waits until
+ * the change is reported into the main context. */
+static void
+touch_keyring (const gchar *basename)
+{
+	GFileMonitor *monitor;
+	GFile *file;
+	gchar *filename;
+	gboolean changed = FALSE;
+	gboolean timed_out = FALSE;
+	guint timeout_id;
+	GError *error = NULL;
+
+	file = g_file_new_for_path (tmp_dir);
+	monitor = g_file_monitor_directory (file, G_FILE_MONITOR_NONE, NULL, &error);
+	g_assert_no_error (error);
+	g_object_unref (file);
+
+	g_signal_connect (monitor, "changed", G_CALLBACK (keyring_changed_cb), &changed);
+
+	filename = g_build_filename (tmp_dir, basename, NULL);
+	g_file_set_contents (filename, "keys", -1, &error);
+	g_assert_no_error (error);
+	g_free (filename);
+
+	timeout_id = g_timeout_add_seconds (10, keyring_timeout_cb, &timed_out);
+
+	while (!changed && !timed_out)
+		g_main_context_iteration (NULL, TRUE);
+
+	g_assert (!timed_out);
+	g_source_remove (timeout_id);
+
+	/* Let the cache's own monitor see the same change. */
+	while (g_main_context_iteration (NULL, FALSE))
+		;
+
+	g_signal_handlers_disconnect_by_func (monitor, keyring_changed_cb, &changed);
+	g_object_unref (monitor);
+}
+
+static void
+test_verify_cached (Fixture *fixture,
+                    gconstpointer user_data)
+{
+	CamelMimePart *ipart, *other;
+
+	ipart = new_mime_part (SIGNED_CONTENT);
+	other = new_mime_part (SIGNED_CONTENT " too");
+
+	fixture_verify (fixture, ipart);
+	g_assert_cmpuint (fixture->context->n_verify, ==, 1);
+
+	/* The second verify of the same content is served from the cache. */
+	fixture_verify (fixture, ipart);
+	g_assert_cmpuint (fixture->context->n_verify, ==, 1);
+
+	/* Other content is not. */
+	fixture_verify (fixture, other);
+	g_assert_cmpuint (fixture->context->n_verify, ==, 2);
+
+	g_object_unref (ipart);
+	g_object_unref (other);
+}
+
+static gpointer
+verify_thread (gpointer user_data)
+{
+	Fixture *fixture = user_data;
+	CamelMimePart *ipart;
+
+	ipart = new_mime_part (SIGNED_CONTENT);
+
+	fixture_verify (fixture, ipart);
+	fixture_verify (fixture, ipart);
+
+	fixture_decrypt (fixture, ipart);
+
+	g_object_unref (ipart);
+
+	return NULL;
+}
+
+static void
+test_verify_in_thread (Fixture *fixture,
+                       gconstpointer user_data)
+{
+	CamelMimePart *ipart;
+	GThread *thread;
+
+	/* The parsers call the cache from their threads, while
+	 * the main thread owns the default main context. */
+	g_assert (g_main_context_acquire (NULL));
+
+	thread = g_thread_new ("verify", verify_thread, fixture);
+	g_thread_join (thread);
+
+	g_assert_cmpuint (fixture->context->n_verify, ==, 1);
+	g_assert_cmpuint (fixture->context->n_decrypt, ==, 1);
+
+	/* The keyring monitors, created by the thread when it used
+	 * the cache for the first time, report into the main loop. */
+	ipart = new_mime_part (SIGNED_CONTENT);
+
+	touch_keyring ("pubring.kbx");
+
+	fixture_verify (fixture, ipart);
+	g_assert_cmpuint (fixture->context->n_verify, ==, 2);
+
+	g_main_context_release (NULL);
+
+	g_object_unref (ipart);
+}
+
+static void
+test_keyring_change (Fixture *fixture,
+                     gconstpointer user_data)
+{
+	CamelMimePart *ipart;
+
+	ipart = new_mime_part (SIGNED_CONTENT);
+
+	fixture_verify (fixture, ipart);
+	fixture_verify (fixture, ipart);
+	g_assert_cmpuint (fixture->context->n_verify, ==, 1);
+
+	/* A new key can change the result, thus it is verified again. */
+	touch_keyring ("pubring.kbx");
+
+	fixture_verify (fixture, ipart);
+	g_assert_cmpuint (fixture->context->n_verify, ==, 2);
+
+	fixture_verify (fixture, ipart);
+	g_assert_cmpuint (fixture->context->n_verify, ==, 2);
+
+	/* Other files in the GnuPG home do not matter. */
+	touch_keyring ("gpg.conf");
+
+	fixture_verify (fixture, ipart);
+	g_assert_cmpuint (fixture->context->n_verify, ==, 2);
+
+	touch_keyring ("trustdb.gpg");
+
+	fixture_verify (fixture, ipart);
+	g_assert_cmpuint (fixture->context->n_verify, ==, 3);
+
+	g_object_unref (ipart);
+}
+
+static void
+test_decrypt_disabled (Fixture *fixture,
+                       gconstpointer user_data)
+{
+	CamelMimePart *ipart;
+
+	ipart = new_mime_part (ENCRYPTED_CONTENT);
+
+	/* The decrypted content is not kept by default. */
+	fixture_decrypt (fixture, ipart);
+	fixture_decrypt (fixture, ipart);
+	g_assert_cmpuint (fixture->context->n_decrypt, ==, 2);
+
+	g_object_unref (ipart);
+}
+
+static void
+test_decrypt_cached (Fixture *fixture,
+                     gconstpointer user_data)
+{
+	CamelMimePart *ipart;
+
+	ipart = new_mime_part (ENCRYPTED_CONTENT);
+
+	set_decrypted_cache_size (64);
+
+	fixture_decrypt (fixture, ipart);
+	fixture_decrypt (fixture, ipart);
+	g_assert_cmpuint (fixture->context->n_decrypt, ==, 1);
+
+	/* Turning the cache off forgets what was kept. */
+	set_decrypted_cache_size (0);
+
+	fixture_decrypt (fixture, ipart);
+	g_assert_cmpuint (fixture->context->n_decrypt, ==, 2);
+
+	set_decrypted_cache_size (64);
+
+	fixture_decrypt (fixture, ipart);
+	g_assert_cmpuint (fixture->context->n_decrypt, ==, 3);
+
+	g_object_unref (ipart);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	gint result;
+	GError *error = NULL;
+
+	tmp_dir = g_dir_make_tmp ("test-mail-crypto-cache-XXXXXX", &error);
+	g_assert_no_error (error);
+
+	/* Keep the test away from the user's keys, data and settings. */
+	g_setenv ("GNUPGHOME", tmp_dir, TRUE);
+	g_setenv ("HOME", tmp_dir, TRUE);
+	g_setenv ("XDG_DATA_HOME", tmp_dir, TRUE);
+	g_setenv ("XDG_CACHE_HOME", tmp_dir, TRUE);
+	g_setenv ("XDG_CONFIG_HOME", tmp_dir, TRUE);
+	g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+	g_test_init (&argc, &argv, NULL);
+
+	/* Goes first, thus the cache is set up from the thread. */
+	g_test_add (
+		"/MailCryptoCache/VerifyInThread", Fixture, NULL,
+		fixture_set_up, test_verify_in_thread, fixture_tear_down);
+	g_test_add (
+		"/MailCryptoCache/VerifyCached", Fixture, NULL,
+		fixture_set_up, test_verify_cached, fixture_tear_down);
+	g_test_add (
+		"/MailCryptoCache/KeyringChange", Fixture, NULL,
+		fixture_set_up, test_keyring_change, fixture_tear_down);
+	g_test_add (
+		"/MailCryptoCache/DecryptDisabled", Fixture, NULL,
+		fixture_set_up, test_decrypt_disabled, fixture_tear_down);
+	g_test_add (
+		"/MailCryptoCache/DecryptCached", Fixture, NULL,
+		fixture_set_up, test_decrypt_cached, fixture_tear_down);
+
+	result = g_test_run ();
+
+	e_mail_crypto_cache_clear ();
+
+	remove_tree (tmp_dir);
+	g_free (tmp_dir);
+
+	return result;
+}
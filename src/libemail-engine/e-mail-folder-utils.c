@@ -24,6 +24,7 @@
 #include <libedataserver/libedataserver.h>
 
 #include <libemail-engine/e-mail-session.h>
+#include <libemail-engine/mail-mt.h>
 #include <libemail-engine/mail-tools.h>
 
 #include "e-mail-utils.h"
@@ -197,12 +198,64 @@ mail_folder_expunge_thread (GSimpleAsyncResult *simple,
 		g_simple_async_result_take_error (simple, error);
 }
 
+/* Returns the POP3 origin of the message from its user tags, recorded
+ * when the message was fetched.  Messages fetched by older versions do
+ * not have them, these are read from the message headers once and
+ * recorded, thus the message is not read next time. */
+static gboolean
+mail_folder_dup_pop3_origin (CamelFolder *folder,
+                             const gchar *message_uid,
+                             CamelMessageInfo *info,
+                             gchar **out_pop3_uid,
+                             gchar **out_source_uid,
+                             GCancellable *cancellable)
+{
+	CamelMimeMessage *message;
+	const gchar *pop3_uid;
+	const gchar *source_uid;
+
+	*out_pop3_uid = camel_message_info_dup_user_tag (info, E_MAIL_POP3_UID_TAG);
+	*out_source_uid = camel_message_info_dup_user_tag (info, E_MAIL_POP3_SOURCE_TAG);
+
+	if (*out_pop3_uid && *out_source_uid)
+		return TRUE;
+
+	g_clear_pointer (out_pop3_uid, g_free);
+	g_clear_pointer (out_source_uid, g_free);
+
+	/* because the UID in the local store doesn't
+	 * match with the UID in the pop3 store */
+	message = camel_folder_get_message_sync (
+		folder, message_uid, cancellable, NULL);
+
+	if (message == NULL)
+		return FALSE;
+
+	pop3_uid = camel_medium_get_header (
+		CAMEL_MEDIUM (message), "X-Evolution-POP3-UID");
+	source_uid = camel_mime_message_get_source (message);
+
+	if (pop3_uid != NULL && source_uid != NULL) {
+		*out_pop3_uid = g_strstrip (g_strdup (pop3_uid));
+		*out_source_uid = g_strstrip (g_strdup (source_uid));
+
+		camel_message_info_set_user_tag (info, E_MAIL_POP3_UID_TAG, *out_pop3_uid);
+		camel_message_info_set_user_tag (info, E_MAIL_POP3_SOURCE_TAG, *out_source_uid);
+	}
+
+	g_object_unref (message);
+
+	return *out_pop3_uid != NULL;
+}
+
 static gboolean
 mail_folder_expunge_pop3_stores (CamelFolder *folder,
                                  GCancellable *cancellable,
                                  GError **error)
 {
 	GHashTable *expunging_uids;
+	GHashTable *pop3_services;
+	GHashTableIter iter;
 	CamelStore *parent_store;
 	CamelService *service;
 	CamelSession *session;
@@ -210,6 +263,7 @@ mail_folder_expunge_pop3_stores (CamelFolder *folder,
 	GPtrArray *uids;
 	GList *list, *link;
 	const gchar *extension_name;
+	gpointer value;
 	gboolean success = TRUE;
 	guint ii;
 
@@ -219,64 +273,13 @@ mail_folder_expunge_pop3_stores (CamelFolder *folder,
 	session = camel_service_ref_session (service);
 	registry = e_mail_session_get_registry (E_MAIL_SESSION (session));
 
-	uids = camel_folder_get_uids (folder);
-
-	if (uids == NULL)
-		goto exit;
-
-	expunging_uids = g_hash_table_new_full (
+	/* Find the POP3 accounts deleting expunged messages on the server
+	 * first, there is nothing to look up in the messages without them. */
+	pop3_services = g_hash_table_new_full (
 		(GHashFunc) g_str_hash,
 		(GEqualFunc) g_str_equal,
 		(GDestroyNotify) g_free,
-		(GDestroyNotify) g_free);
-
-	for (ii = 0; ii < uids->len; ii++) {
-		CamelMessageInfo *info;
-		CamelMessageFlags flags = 0;
-		CamelMimeMessage *message;
-		const gchar *pop3_uid;
-		const gchar *source_uid;
-
-		info = camel_folder_get_message_info (
-			folder, uids->pdata[ii]);
-
-		if (info != NULL) {
-			flags = camel_message_info_get_flags (info);
-			g_clear_object (&info);
-		}
-
-		/* Only interested in deleted messages. */
-		if ((flags & CAMEL_MESSAGE_DELETED) == 0)
-			continue;
-
-		/* because the UID in the local store doesn't
-		 * match with the UID in the pop3 store */
-		message = camel_folder_get_message_sync (
-			folder, uids->pdata[ii], cancellable, NULL);
-
-		if (message == NULL)
-			continue;
-
-		pop3_uid = camel_medium_get_header (
-			CAMEL_MEDIUM (message), "X-Evolution-POP3-UID");
-		source_uid = camel_mime_message_get_source (message);
-
-		if (pop3_uid != NULL)
-			g_hash_table_insert (
-				expunging_uids,
-				g_strstrip (g_strdup (pop3_uid)),
-				g_strstrip (g_strdup (source_uid)));
-
-		g_object_unref (message);
-	}
-
-	camel_folder_free_uids (folder, uids);
-	uids = NULL;
-
-	if (g_hash_table_size (expunging_uids) == 0) {
-		g_hash_table_destroy (expunging_uids);
-		return TRUE;
-	}
+		(GDestroyNotify) g_object_unref);
 
 	extension_name = E_SOURCE_EXTENSION_MAIL_ACCOUNT;
 	list = e_source_registry_list_enabled (registry, extension_name);
@@ -284,13 +287,10 @@ mail_folder_expunge_pop3_stores (CamelFolder *folder,
 	for (link = list; link != NULL; link = g_list_next (link)) {
 		ESource *source = E_SOURCE (link->data);
 		ESourceBackend *extension;
-		CamelFolder *folder;
 		CamelService *service;
 		CamelSettings *settings;
 		const gchar *backend_name;
-		const gchar *service_uid;
 		const gchar *source_uid;
-		gboolean any_found = FALSE;
 		gboolean delete_expunged = FALSE;
 		gboolean keep_on_server = FALSE;
 
@@ -305,7 +305,9 @@ mail_folder_expunge_pop3_stores (CamelFolder *folder,
 		service = camel_session_ref_service (
 			CAMEL_SESSION (session), source_uid);
 
-		service_uid = camel_service_get_uid (service);
+		if (service == NULL)
+			continue;
+
 		settings = camel_service_ref_settings (service);
 
 		g_object_get (
@@ -321,12 +323,75 @@ mail_folder_expunge_pop3_stores (CamelFolder *folder,
 			continue;
 		}
 
+		g_hash_table_insert (
+			pop3_services,
+			g_strdup (camel_service_get_uid (service)),
+			service);
+	}
+
+	g_list_free_full (list, (GDestroyNotify) g_object_unref);
+
+	if (g_hash_table_size (pop3_services) == 0)
+		goto exit;
+
+	uids = camel_folder_get_uids (folder);
+
+	if (uids == NULL)
+		goto exit;
+
+	/* pop3 uid ~> service uid */
+	expunging_uids = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) g_free);
+
+	for (ii = 0; ii < uids->len; ii++) {
+		CamelMessageInfo *info;
+		gchar *pop3_uid = NULL;
+		gchar *source_uid = NULL;
+
+		info = camel_folder_get_message_info (
+			folder, uids->pdata[ii]);
+
+		if (info == NULL)
+			continue;
+
+		/* Only interested in deleted messages. */
+		if ((camel_message_info_get_flags (info) & CAMEL_MESSAGE_DELETED) != 0 &&
+		    mail_folder_dup_pop3_origin (folder, uids->pdata[ii], info, &pop3_uid, &source_uid, cancellable) &&
+		    g_hash_table_contains (pop3_services, source_uid)) {
+			g_hash_table_insert (expunging_uids, pop3_uid, source_uid);
+		} else {
+			g_free (pop3_uid);
+			g_free (source_uid);
+		}
+
+		g_clear_object (&info);
+	}
+
+	camel_folder_free_uids (folder, uids);
+	uids = NULL;
+
+	if (g_hash_table_size (expunging_uids) == 0) {
+		g_hash_table_destroy (expunging_uids);
+		goto exit;
+	}
+
+	g_hash_table_iter_init (&iter, pop3_services);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		CamelFolder *folder;
+		CamelService *service = value;
+		const gchar *service_uid;
+		gboolean any_found = FALSE;
+
+		service_uid = camel_service_get_uid (service);
+
 		folder = camel_store_get_inbox_folder_sync (
 			CAMEL_STORE (service), cancellable, error);
 
 		/* Abort the loop on error. */
 		if (folder == NULL) {
-			g_object_unref (service);
 			success = FALSE;
 			break;
 		}
@@ -334,7 +399,6 @@ mail_folder_expunge_pop3_stores (CamelFolder *folder,
 		uids = camel_folder_get_uids (folder);
 
 		if (uids == NULL) {
-			g_object_unref (service);
 			g_object_unref (folder);
 			continue;
 		}
@@ -358,18 +422,16 @@ mail_folder_expunge_pop3_stores (CamelFolder *folder,
 				folder, TRUE, cancellable, error);
 
 		g_object_unref (folder);
-		g_object_unref (service);
 
 		/* Abort the loop on error. */
 		if (!success)
 			break;
 	}
 
-	g_list_free_full (list, (GDestroyNotify) g_object_unref);
-
 	g_hash_table_destroy (expunging_uids);
 
 exit:
+	g_hash_table_destroy (pop3_services);
 	g_object_unref (session);
 
 	return success;
@@ -656,6 +718,225 @@ mail_folder_find_duplicate_messages_thread (GSimpleAsyncResult *simple,
 		g_simple_async_result_take_error (simple, error);
 }
 
+/* A message with no content is recorded with this digest, rather
+ * than not at all, thus it is not retrieved again next time. */
+#define NO_CONTENT_DIGEST "-"
+
+/* How many messages are retrieved at once for their digests. */
+#define MAX_DIGEST_THREADS 4
+
+typedef struct _DigestData DigestData;
+typedef struct _HashData HashData;
+
+struct _DigestData {
+	CamelFolder *folder;
+	gchar *message_uid;
+	CamelMimeMessage *message;
+};
+
+struct _HashData {
+	GMutex lock;
+	CamelFolder *folder;
+	GCancellable *cancellable;
+	GHashTable *hash_table;
+	gboolean failed;
+	GError *error;
+	guint n_done;
+	guint n_total;
+};
+
+static gboolean
+mail_folder_compute_content_digest (CamelMimeMessage *message,
+                                    gchar **out_digest,
+                                    GCancellable *cancellable)
+{
+	CamelDataWrapper *content;
+	CamelStream *stream;
+	GByteArray *buffer;
+	guint data_len;
+
+	*out_digest = NULL;
+
+	/* Generate a digest string from the message's content. */
+	content = camel_medium_get_content (CAMEL_MEDIUM (message));
+
+	if (content == NULL)
+		return TRUE;
+
+	stream = camel_stream_mem_new ();
+
+	if (camel_data_wrapper_decode_to_stream_sync (content, stream, cancellable, NULL) < 0) {
+		g_object_unref (stream);
+		return FALSE;
+	}
+
+	/* The CamelStreamMem owns the buffer. */
+	buffer = camel_stream_mem_get_byte_array (CAMEL_STREAM_MEM (stream));
+	data_len = buffer != NULL ? buffer->len : 0;
+
+	/* Strip trailing white-spaces and empty lines */
+	while (data_len > 0 && g_ascii_isspace (buffer->data[data_len - 1]))
+		data_len--;
+
+	if (data_len > 0)
+		*out_digest = g_compute_checksum_for_data (G_CHECKSUM_SHA256, buffer->data, data_len);
+
+	g_object_unref (stream);
+
+	return TRUE;
+}
+
+static void
+mail_folder_record_content_digest (CamelFolder *folder,
+                                   const gchar *message_uid,
+                                   const gchar *digest)
+{
+	CamelMessageInfo *info;
+
+	info = camel_folder_get_message_info (folder, message_uid);
+
+	if (info != NULL) {
+		camel_message_info_set_user_tag (
+			info, E_MAIL_CONTENT_DIGEST_TAG,
+			digest != NULL ? digest : NO_CONTENT_DIGEST);
+		g_object_unref (info);
+	}
+}
+
+static void
+digest_data_free (DigestData *dd)
+{
+	g_clear_object (&dd->folder);
+	g_clear_object (&dd->message);
+	g_free (dd->message_uid);
+
+	g_slice_free (DigestData, dd);
+}
+
+static void
+mail_folder_remember_digest_thread (gpointer data,
+                                    gpointer user_data)
+{
+	DigestData *dd = data;
+	gchar *digest = NULL;
+
+	if (mail_folder_compute_content_digest (dd->message, &digest, NULL))
+		mail_folder_record_content_digest (dd->folder, dd->message_uid, digest);
+
+	g_free (digest);
+	digest_data_free (dd);
+}
+
+/**
+ * e_mail_folder_remember_content_digest:
+ * @folder: a #CamelFolder
+ * @message_uid: UID of the @message
+ * @message: a #CamelMimeMessage, already retrieved from the @folder
+ *
+ * Records the digest of the @message content in its message info, unless
+ * it is already known, thus e_mail_folder_find_duplicate_messages() does
+ * not need to retrieve the @message again.  The digest is computed in
+ * a dedicated thread.
+ *
+ * Since: 3.24
+ **/
+void
+e_mail_folder_remember_content_digest (CamelFolder *folder,
+                                       const gchar *message_uid,
+                                       CamelMimeMessage *message)
+{
+	static GThreadPool *thread_pool = NULL;
+	static GMutex thread_pool_lock;
+	CamelMessageInfo *info;
+	DigestData *dd;
+	gchar *digest;
+
+	g_return_if_fail (CAMEL_IS_FOLDER (folder));
+	g_return_if_fail (message_uid != NULL);
+	g_return_if_fail (CAMEL_IS_MIME_MESSAGE (message));
+
+	info = camel_folder_get_message_info (folder, message_uid);
+
+	if (info == NULL)
+		return;
+
+	digest = camel_message_info_dup_user_tag (info, E_MAIL_CONTENT_DIGEST_TAG);
+
+	g_object_unref (info);
+
+	if (digest != NULL) {
+		g_free (digest);
+		return;
+	}
+
+	g_mutex_lock (&thread_pool_lock);
+
+	if (thread_pool == NULL)
+		thread_pool = g_thread_pool_new (
+			mail_folder_remember_digest_thread,
+			NULL, 1, FALSE, NULL);
+
+	g_mutex_unlock (&thread_pool_lock);
+
+	dd = g_slice_new0 (DigestData);
+	dd->folder = g_object_ref (folder);
+	dd->message_uid = g_strdup (message_uid);
+	dd->message = g_object_ref (message);
+
+	g_thread_pool_push (thread_pool, dd, NULL);
+}
+
+static void
+emfu_hash_message_thread (gpointer data,
+                          gpointer user_data)
+{
+	HashData *hd = user_data;
+	const gchar *uid = data;
+	CamelMimeMessage *message;
+	gchar *digest = NULL;
+	GError *local_error = NULL;
+	gboolean failed;
+
+	g_mutex_lock (&hd->lock);
+	failed = hd->failed;
+	g_mutex_unlock (&hd->lock);
+
+	/* This is an all or nothing operation, thus
+	 * there's no need to continue once any failed. */
+	if (failed)
+		return;
+
+	message = camel_folder_get_message_sync (
+		hd->folder, uid, hd->cancellable, &local_error);
+
+	if (message != NULL) {
+		if (mail_folder_compute_content_digest (message, &digest, hd->cancellable))
+			mail_folder_record_content_digest (hd->folder, uid, digest);
+
+		g_object_unref (message);
+	}
+
+	g_mutex_lock (&hd->lock);
+
+	if (message != NULL) {
+		g_hash_table_insert (hd->hash_table, g_strdup (uid), digest);
+		digest = NULL;
+	} else if (!hd->failed) {
+		hd->failed = TRUE;
+		hd->error = local_error;
+		local_error = NULL;
+	}
+
+	hd->n_done++;
+
+	camel_operation_progress (hd->cancellable, (hd->n_done * 100) / hd->n_total);
+
+	g_mutex_unlock (&hd->lock);
+
+	g_clear_error (&local_error);
+	g_free (digest);
+}
+
 static GHashTable *
 emfu_get_messages_hash_sync (CamelFolder *folder,
                              GPtrArray *message_uids,
@@ -663,90 +944,89 @@ emfu_get_messages_hash_sync (CamelFolder *folder,
                              GError **error)
 {
 	GHashTable *hash_table;
-	CamelMimeMessage *message;
+	GPtrArray *missing_uids;
 	guint ii;
 
 	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), NULL);
 	g_return_val_if_fail (message_uids != NULL, NULL);
 
-	camel_operation_push_message (
-		cancellable,
-		ngettext (
-			"Retrieving %d message",
-			"Retrieving %d messages",
-			message_uids->len),
-		message_uids->len);
-
 	hash_table = g_hash_table_new_full (
 		(GHashFunc) g_str_hash,
 		(GEqualFunc) g_str_equal,
 		(GDestroyNotify) g_free,
 		(GDestroyNotify) g_free);
 
-	/* This is an all or nothing operation.  Destroy the
-	 * hash table if we fail to retrieve any message. */
+	missing_uids = g_ptr_array_new ();
 
+	/* Use digests recorded in the summary, where known. */
 	for (ii = 0; ii < message_uids->len; ii++) {
+		CamelMessageInfo *info;
 		const gchar *uid;
-		gint percent;
+		gchar *digest = NULL;
 
 		uid = g_ptr_array_index (message_uids, ii);
-		percent = ((ii + 1) * 100) / message_uids->len;
-
-		message = camel_folder_get_message_sync (
-			folder, uid, cancellable, error);
-
-		camel_operation_progress (cancellable, percent);
+		info = camel_folder_get_message_info (folder, uid);
 
-		if (CAMEL_IS_MIME_MESSAGE (message)) {
-			CamelDataWrapper *content;
-			gchar *digest = NULL;
+		if (info != NULL) {
+			digest = camel_message_info_dup_user_tag (info, E_MAIL_CONTENT_DIGEST_TAG);
+			g_object_unref (info);
+		}
 
-			/* Generate a digest string from the message's content. */
-			content = camel_medium_get_content (CAMEL_MEDIUM (message));
+		if (digest == NULL) {
+			g_ptr_array_add (missing_uids, (gpointer) uid);
+		} else if (g_str_equal (digest, NO_CONTENT_DIGEST)) {
+			g_hash_table_insert (hash_table, g_strdup (uid), NULL);
+			g_free (digest);
+		} else {
+			g_hash_table_insert (hash_table, g_strdup (uid), digest);
+		}
+	}
 
-			if (content != NULL) {
-				CamelStream *stream;
-				GByteArray *buffer;
-				gssize n_bytes;
+	/* Retrieve the rest, a few messages at once. */
+	if (missing_uids->len > 0) {
+		GThreadPool *thread_pool;
+		HashData hd;
 
-				stream = camel_stream_mem_new ();
+		camel_operation_push_message (
+			cancellable,
+			ngettext (
+				"Retrieving %d message",
+				"Retrieving %d messages",
+				missing_uids->len),
+			missing_uids->len);
 
-				n_bytes = camel_data_wrapper_decode_to_stream_sync (
-					content, stream, cancellable, error);
+		memset (&hd, 0, sizeof (HashData));
+		g_mutex_init (&hd.lock);
+		hd.folder = folder;
+		hd.cancellable = cancellable;
+		hd.hash_table = hash_table;
+		hd.n_total = missing_uids->len;
 
-				if (n_bytes >= 0) {
-					guint data_len;
+		thread_pool = g_thread_pool_new (
+			emfu_hash_message_thread, &hd,
+			MIN (missing_uids->len, MAX_DIGEST_THREADS),
+			FALSE, NULL);
 
-					/* The CamelStreamMem owns the buffer. */
-					buffer = camel_stream_mem_get_byte_array (
-						CAMEL_STREAM_MEM (stream));
-					g_return_val_if_fail (buffer != NULL, NULL);
+		for (ii = 0; ii < missing_uids->len; ii++)
+			g_thread_pool_push (thread_pool, missing_uids->pdata[ii], NULL);
 
-					data_len = buffer->len;
+		/* Waits for all the queued messages to be processed. */
+		g_thread_pool_free (thread_pool, FALSE, TRUE);
 
-					/* Strip trailing white-spaces and empty lines */
-					while (data_len > 0 && g_ascii_isspace (buffer->data[data_len - 1]))
-						data_len--;
+		g_mutex_clear (&hd.lock);
 
-					if (data_len > 0)
-						digest = g_compute_checksum_for_data (G_CHECKSUM_SHA256, buffer->data, data_len);
-				}
+		camel_operation_pop_message (cancellable);
 
-				g_object_unref (stream);
-			}
+		if (hd.failed) {
+			if (hd.error != NULL)
+				g_propagate_error (error, hd.error);
 
-			g_hash_table_insert (
-				hash_table, g_strdup (uid), digest);
-			g_object_unref (message);
-		} else {
 			g_hash_table_destroy (hash_table);
 			hash_table = NULL;
-			break;
 		}
 	}
 
-	camel_operation_pop_message (cancellable);
+	g_ptr_array_free (missing_uids, TRUE);
 
 	return hash_table;
 }
@@ -1558,134 +1838,370 @@ mail_folder_save_prepare_part (CamelMimePart *mime_part)
 	}
 }
 
-gboolean
-e_mail_folder_save_messages_sync (CamelFolder *folder,
-                                  GPtrArray *message_uids,
-                                  GFile *destination,
-                                  GCancellable *cancellable,
-                                  GError **error)
+/* How many messages are retrieved ahead of the one being written. */
+#define MBOX_PREFETCH_WINDOW 16
+
+/* How many messages are retrieved at once. */
+#define MBOX_PREFETCH_THREADS 4
+
+#define MBOX_WRITE_BUFFER_SIZE (256 * 1024)
+
+typedef struct _MboxSlot MboxSlot;
+typedef struct _MboxExport MboxExport;
+
+struct _MboxSlot {
+	gboolean done;
+	GByteArray *bytes;
+	GError *error;
+};
+
+struct _MboxExport {
+	GMutex lock;
+	GCond cond;
+	CamelFolder *folder;
+	GPtrArray *message_uids;
+	gboolean prepare_parts;
+	GCancellable *cancellable;
+	MboxSlot *slots;
+	gboolean aborted;
+	gboolean in_main_thread;	/* the writer iterates the main context */
+};
+
+/* Returns the whole mbox entry for the message, including
+ * the From line and the trailing empty line. */
+static GByteArray *
+mail_folder_mbox_serialize (CamelMimeMessage *message,
+                            gboolean prepare_parts,
+                            GCancellable *cancellable,
+                            GError **error)
 {
-	GFileOutputStream *file_output_stream;
-	CamelStream *base_stream = NULL;
+	CamelMimeFilter *filter;
+	CamelStream *base_stream;
+	CamelStream *stream;
 	GByteArray *byte_array;
-	gboolean success = TRUE;
-	guint ii;
+	gchar *from_line;
+	gboolean success;
 
-	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), FALSE);
-	g_return_val_if_fail (message_uids != NULL, FALSE);
-	g_return_val_if_fail (G_IS_FILE (destination), FALSE);
+	if (prepare_parts)
+		mail_folder_save_prepare_part (CAMEL_MIME_PART (message));
 
-	/* Need at least one message UID to save. */
-	g_return_val_if_fail (message_uids->len > 0, FALSE);
+	byte_array = g_byte_array_new ();
 
-	camel_operation_push_message (
-		cancellable, ngettext (
-			"Saving %d message",
-			"Saving %d messages",
-			message_uids->len),
-		message_uids->len);
+	/* CamelStreamMem does NOT take ownership of the byte
+	 * array when set with camel_stream_mem_set_byte_array(). */
+	base_stream = camel_stream_mem_new ();
+	camel_stream_mem_set_byte_array (
+		CAMEL_STREAM_MEM (base_stream), byte_array);
 
-	file_output_stream = g_file_replace (
-		destination, NULL, FALSE,
-		G_FILE_CREATE_PRIVATE |
-		G_FILE_CREATE_REPLACE_DESTINATION,
-		cancellable, error);
+	from_line = camel_mime_message_build_mbox_from (message);
+	success = camel_stream_write_string (
+		base_stream, from_line, cancellable, error) != -1;
+	g_free (from_line);
 
-	if (file_output_stream == NULL) {
-		camel_operation_pop_message (cancellable);
-		return FALSE;
+	filter = camel_mime_filter_from_new ();
+	stream = camel_stream_filter_new (base_stream);
+	camel_stream_filter_add (CAMEL_STREAM_FILTER (stream), filter);
+
+	success = success && camel_data_wrapper_write_to_stream_sync (
+		CAMEL_DATA_WRAPPER (message),
+		stream, cancellable, error) != -1;
+	success = success && camel_stream_flush (
+		stream, cancellable, error) != -1;
+
+	g_object_unref (filter);
+	g_object_unref (stream);
+	g_object_unref (base_stream);
+
+	if (!success) {
+		g_byte_array_free (byte_array, TRUE);
+		return NULL;
 	}
 
-	byte_array = g_byte_array_new ();
+	g_byte_array_append (byte_array, (guint8 *) "\n", 1);
 
-	for (ii = 0; ii < message_uids->len; ii++) {
-		CamelMimeMessage *message;
-		CamelMimeFilter *filter;
-		CamelStream *stream;
-		const gchar *uid;
-		gchar *from_line;
-		gint percent;
-		gint retval;
+	return byte_array;
+}
 
-		if (base_stream != NULL)
-			g_object_unref (base_stream);
+static void
+mail_folder_mbox_fetch_thread (gpointer data,
+                               gpointer user_data)
+{
+	MboxExport *me = user_data;
+	CamelMimeMessage *message = NULL;
+	GByteArray *bytes = NULL;
+	GError *local_error = NULL;
+	gboolean aborted;
+	guint index;
 
-		/* CamelStreamMem does NOT take ownership of the byte
-		 * array when set with camel_stream_mem_set_byte_array().
-		 * This allows us to reuse the same memory slab for each
-		 * message, which is slightly more efficient. */
-		base_stream = camel_stream_mem_new ();
-		camel_stream_mem_set_byte_array (
-			CAMEL_STREAM_MEM (base_stream), byte_array);
+	index = GPOINTER_TO_UINT (data) - 1;
 
-		uid = g_ptr_array_index (message_uids, ii);
+	g_mutex_lock (&me->lock);
+	aborted = me->aborted;
+	g_mutex_unlock (&me->lock);
 
+	if (!aborted)
 		message = camel_folder_get_message_sync (
-			folder, uid, cancellable, error);
-		if (message == NULL) {
-			success = FALSE;
-			goto exit;
-		}
+			me->folder,
+			g_ptr_array_index (me->message_uids, index),
+			me->cancellable, &local_error);
+
+	if (message != NULL) {
+		bytes = mail_folder_mbox_serialize (
+			message, me->prepare_parts,
+			me->cancellable, &local_error);
+		g_object_unref (message);
+	}
 
-		mail_folder_save_prepare_part (CAMEL_MIME_PART (message));
+	g_mutex_lock (&me->lock);
+	me->slots[index].bytes = bytes;
+	me->slots[index].error = local_error;
+	me->slots[index].done = TRUE;
+	g_cond_broadcast (&me->cond);
+	g_mutex_unlock (&me->lock);
 
-		from_line = camel_mime_message_build_mbox_from (message);
-		g_return_val_if_fail (from_line != NULL, FALSE);
+	if (me->in_main_thread)
+		g_main_context_wakeup (NULL);
+}
 
-		success = g_output_stream_write_all (
-			G_OUTPUT_STREAM (file_output_stream),
-			from_line, strlen (from_line), NULL,
-			cancellable, error);
+/* Messages are retrieved and serialized by a few threads ahead of
+ * the one being written, while this thread writes them in order.
+ * The output stops only between messages when cancelled. */
+static gboolean
+mail_folder_write_mbox_sync (CamelFolder *folder,
+                             GPtrArray *message_uids,
+                             GOutputStream *output_stream,
+                             gboolean prepare_parts,
+                             GCancellable *cancellable,
+                             GError **error)
+{
+	MboxExport me;
+	GThreadPool *thread_pool;
+	GOutputStream *buffered_stream;
+	guint64 total_bytes = 0;
+	guint64 written_bytes = 0;
+	guint next_fetch = 0;
+	gboolean success = TRUE;
+	guint ii;
 
-		g_free (from_line);
+	/* The sizes in the summary are good enough for the progress. */
+	for (ii = 0; ii < message_uids->len; ii++) {
+		CamelMessageInfo *info;
 
-		if (!success) {
-			g_object_unref (message);
-			goto exit;
+		info = camel_folder_get_message_info (
+			folder, g_ptr_array_index (message_uids, ii));
+
+		if (info != NULL) {
+			total_bytes += camel_message_info_get_size (info);
+			g_object_unref (info);
 		}
+	}
 
-		filter = camel_mime_filter_from_new ();
-		stream = camel_stream_filter_new (base_stream);
-		camel_stream_filter_add (CAMEL_STREAM_FILTER (stream), filter);
+	memset (&me, 0, sizeof (MboxExport));
+	g_mutex_init (&me.lock);
+	g_cond_init (&me.cond);
+	me.folder = folder;
+	me.message_uids = message_uids;
+	me.prepare_parts = prepare_parts;
+	me.cancellable = cancellable;
+	me.slots = g_new0 (MboxSlot, message_uids->len);
+	me.in_main_thread = mail_in_main_thread ();
+
+	thread_pool = g_thread_pool_new (
+		mail_folder_mbox_fetch_thread, &me,
+		MBOX_PREFETCH_THREADS, FALSE, NULL);
+
+	buffered_stream = g_buffered_output_stream_new_sized (
+		output_stream, MBOX_WRITE_BUFFER_SIZE);
+	g_filter_output_stream_set_close_base_stream (
+		G_FILTER_OUTPUT_STREAM (buffered_stream), FALSE);
+
+	while (next_fetch < message_uids->len && next_fetch < MBOX_PREFETCH_WINDOW) {
+		next_fetch++;
+		g_thread_pool_push (
+			thread_pool, GUINT_TO_POINTER (next_fetch), NULL);
+	}
 
-		retval = camel_data_wrapper_write_to_stream_sync (
-			CAMEL_DATA_WRAPPER (message),
-			stream, cancellable, error);
+	for (ii = 0; ii < message_uids->len && success; ii++) {
+		MboxSlot *slot = &me.slots[ii];
+		GByteArray *bytes;
+		gint percent;
 
-		g_object_unref (filter);
-		g_object_unref (stream);
+		g_mutex_lock (&me.lock);
 
-		if (retval == -1) {
-			g_object_unref (message);
-			goto exit;
+		if (me.in_main_thread) {
+			/* Retrieving the messages can need the main loop,
+			 * like for the password prompts, thus keep it running
+			 * instead of blocking it until the message is ready. */
+			while (!slot->done) {
+				g_mutex_unlock (&me.lock);
+				g_main_context_iteration (NULL, TRUE);
+				g_mutex_lock (&me.lock);
+			}
+		} else {
+			while (!slot->done)
+				g_cond_wait (&me.cond, &me.lock);
 		}
 
-		g_byte_array_append (byte_array, (guint8 *) "\n", 1);
+		bytes = slot->bytes;
+		slot->bytes = NULL;
 
-		success = g_output_stream_write_all (
-			G_OUTPUT_STREAM (file_output_stream),
-			byte_array->data, byte_array->len,
-			NULL, cancellable, error);
+		if (bytes == NULL) {
+			if (slot->error != NULL)
+				g_propagate_error (error, slot->error);
+			else
+				g_set_error (
+					error, CAMEL_ERROR, CAMEL_ERROR_GENERIC,
+					_("Failed to retrieve message"));
+			slot->error = NULL;
+		}
 
-		if (!success) {
-			g_object_unref (message);
-			goto exit;
+		g_mutex_unlock (&me.lock);
+
+		/* Keep the prefetch window full. */
+		if (next_fetch < message_uids->len) {
+			next_fetch++;
+			g_thread_pool_push (
+				thread_pool, GUINT_TO_POINTER (next_fetch), NULL);
 		}
 
-		percent = ((ii + 1) * 100) / message_uids->len;
+		if (bytes == NULL) {
+			success = FALSE;
+			break;
+		}
+
+		/* Write either the whole message or nothing of it. */
+		if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+			g_byte_array_free (bytes, TRUE);
+			success = FALSE;
+			break;
+		}
+
+		success = g_output_stream_write_all (
+			buffered_stream, bytes->data, bytes->len,
+			NULL, NULL, error);
+
+		written_bytes += bytes->len;
+		g_byte_array_free (bytes, TRUE);
+
+		if (total_bytes > 0)
+			percent = MIN (written_bytes * 100 / total_bytes, 100);
+		else
+			percent = ((ii + 1) * 100) / message_uids->len;
+
 		camel_operation_progress (cancellable, percent);
+	}
+
+	/* Messages still queued are not needed anymore. */
+	g_mutex_lock (&me.lock);
+	me.aborted = TRUE;
+
+	/* Do not block the main loop on the running retrievals either;
+	 * the queued ones finish immediately, being aborted. */
+	for (ii = 0; me.in_main_thread && ii < next_fetch; ii++) {
+		while (!me.slots[ii].done) {
+			g_mutex_unlock (&me.lock);
+			g_main_context_iteration (NULL, TRUE);
+			g_mutex_lock (&me.lock);
+		}
+	}
 
-		/* Reset the byte array for the next message. */
-		g_byte_array_set_size (byte_array, 0);
+	g_mutex_unlock (&me.lock);
 
-		g_object_unref (message);
+	g_thread_pool_free (thread_pool, TRUE, TRUE);
+
+	/* This flushes the buffer, which ends at a message boundary. */
+	if (!g_output_stream_close (buffered_stream, NULL, success ? error : NULL))
+		success = FALSE;
+
+	g_object_unref (buffered_stream);
+
+	for (ii = 0; ii < message_uids->len; ii++) {
+		if (me.slots[ii].bytes != NULL)
+			g_byte_array_free (me.slots[ii].bytes, TRUE);
+		g_clear_error (&me.slots[ii].error);
 	}
 
-exit:
-	if (base_stream != NULL)
-		g_object_unref (base_stream);
+	g_free (me.slots);
+	g_cond_clear (&me.cond);
+	g_mutex_clear (&me.lock);
+
+	return success;
+}
+
+/**
+ * e_mail_folder_write_mbox_sync:
+ * @folder: a #CamelFolder
+ * @message_uids: array of message UIDs to write
+ * @output_stream: a #GOutputStream to write to
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Writes the messages identified by @message_uids in @folder to
+ * @output_stream in mbox format, in the given order.  The messages
+ * are retrieved a few at once ahead of the one being written.  When
+ * cancelled, the output ends after the last completely written message.
+ * The @output_stream is not closed.  When called in the main thread,
+ * the main context is iterated while waiting for the messages.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ *
+ * Since: 3.24
+ **/
+gboolean
+e_mail_folder_write_mbox_sync (CamelFolder *folder,
+                               GPtrArray *message_uids,
+                               GOutputStream *output_stream,
+                               GCancellable *cancellable,
+                               GError **error)
+{
+	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), FALSE);
+	g_return_val_if_fail (message_uids != NULL, FALSE);
+	g_return_val_if_fail (G_IS_OUTPUT_STREAM (output_stream), FALSE);
+
+	return mail_folder_write_mbox_sync (
+		folder, message_uids, output_stream,
+		FALSE, cancellable, error);
+}
+
+gboolean
+e_mail_folder_save_messages_sync (CamelFolder *folder,
+                                  GPtrArray *message_uids,
+                                  GFile *destination,
+                                  GCancellable *cancellable,
+                                  GError **error)
+{
+	GFileOutputStream *file_output_stream;
+	gboolean success;
+
+	g_return_val_if_fail (CAMEL_IS_FOLDER (folder), FALSE);
+	g_return_val_if_fail (message_uids != NULL, FALSE);
+	g_return_val_if_fail (G_IS_FILE (destination), FALSE);
+
+	/* Need at least one message UID to save. */
+	g_return_val_if_fail (message_uids->len > 0, FALSE);
+
+	camel_operation_push_message (
+		cancellable, ngettext (
+			"Saving %d message",
+			"Saving %d messages",
+			message_uids->len),
+		message_uids->len);
+
+	file_output_stream = g_file_replace (
+		destination, NULL, FALSE,
+		G_FILE_CREATE_PRIVATE |
+		G_FILE_CREATE_REPLACE_DESTINATION,
+		cancellable, error);
+
+	if (file_output_stream == NULL) {
+		camel_operation_pop_message (cancellable);
+		return FALSE;
+	}
 
-	g_byte_array_free (byte_array, TRUE);
+	success = mail_folder_write_mbox_sync (
+		folder, message_uids,
+		G_OUTPUT_STREAM (file_output_stream),
+		TRUE, cancellable, error);
 
 	g_object_unref (file_output_stream);
 
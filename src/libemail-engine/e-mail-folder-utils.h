@@ -26,6 +26,15 @@
 
 #include <camel/camel.h>
 
+/* User tags with the origin of messages fetched from POP3 accounts,
+ * thus the messages can be deleted from the server on expunge. */
+#define E_MAIL_POP3_UID_TAG "x-evolution-pop3-uid"
+#define E_MAIL_POP3_SOURCE_TAG "x-evolution-pop3-source"
+
+/* User tag with the SHA-256 digest of the message content,
+ * used to find duplicate messages without retrieving them. */
+#define E_MAIL_CONTENT_DIGEST_TAG "x-evolution-content-sha256"
+
 G_BEGIN_DECLS
 
 gboolean	e_mail_folder_append_message_sync
@@ -78,6 +87,10 @@ CamelMimePart *	e_mail_folder_build_attachment_finish
 						 gchar **fwd_subject,
 						 GError **error);
 
+void		e_mail_folder_remember_content_digest
+						(CamelFolder *folder,
+						 const gchar *message_uid,
+						 CamelMimeMessage *message);
 GHashTable *	e_mail_folder_find_duplicate_messages_sync
 						(CamelFolder *folder,
 						 GPtrArray *message_uids,
@@ -141,6 +154,11 @@ gboolean	e_mail_folder_remove_attachments_finish
 						 GAsyncResult *result,
 						 GError **error);
 
+gboolean	e_mail_folder_write_mbox_sync	(CamelFolder *folder,
+						 GPtrArray *message_uids,
+						 GOutputStream *output_stream,
+						 GCancellable *cancellable,
+						 GError **error);
 gboolean	e_mail_folder_save_messages_sync
 						(CamelFolder *folder,
 						 GPtrArray *message_uids,
@@ -30,6 +30,14 @@
 /*#define MALLOC_CHECK*/
 #define d(x)
 
+/* The unordered thread pool grows by one thread when a message waited
+ * longer than this before it started, up to the limit, which can be
+ * overridden with the EVOLUTION_MAIL_MAX_THREADS environment variable. */
+#define POOL_DEFAULT_LIMIT 10
+#define POOL_GROW_WAIT (200 * G_TIME_SPAN_MILLISECOND)
+#define POOL_GROW_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+#define POOL_SHRINK_INTERVAL (10 * G_TIME_SPAN_SECOND)
+
 static guint mail_msg_seq; /* sequence number of each message */
 
 /* Table of active messages.  Must hold mail_msg_lock to access. */
@@ -319,6 +327,332 @@ static GAsyncQueue *main_loop_queue = NULL;
 static GAsyncQueue *msg_reply_queue = NULL;
 static GThread *main_thread = NULL;
 
+typedef struct _MailMsgPool {
+	GThreadPool *thread_pool;
+	gint max_threads;	/* current size of the thread pool */
+	gint min_threads;
+	gint limit;		/* the pool does not grow beyond this */
+	gboolean fair;		/* whether to balance messages of stores */
+	gint64 last_resize;
+} MailMsgPool;
+
+typedef struct _StoreLoad {
+	guint n_pushed;		/* queued or running in the thread pool */
+	GQueue deferred;	/* sorted by mail_msg_compare() */
+} StoreLoad;
+
+/* Must hold pool_lock to access these. */
+static MailMsgPool unordered_pool = { NULL, 0, 0, 0, TRUE, 0 };
+static MailMsgPool fast_ordered_pool = { NULL, 1, 1, 1, FALSE, 0 };
+static MailMsgPool slow_ordered_pool = { NULL, 1, 1, 1, FALSE, 0 };
+static GHashTable *store_loads;	/* gconstpointer ~> StoreLoad */
+static GMutex pool_lock;
+
+/* Statistics per message type.  Must hold stats_lock to access. */
+static GHashTable *msg_stats;	/* MailMsgInfo ~> MailMsgStats */
+static GMutex stats_lock;
+
+static MailMsgStats *
+mail_msg_stats_lookup (const MailMsgInfo *info)
+{
+	MailMsgStats *stats;
+
+	stats = g_hash_table_lookup (msg_stats, info);
+	if (stats == NULL) {
+		stats = g_new0 (MailMsgStats, 1);
+		stats->info = info;
+		g_hash_table_insert (msg_stats, (gpointer) info, stats);
+	}
+
+	return stats;
+}
+
+static void
+mail_msg_stats_free (MailMsgStats *stats)
+{
+	g_free (stats->description);
+	g_free (stats);
+}
+
+static void
+mail_msg_stats_pushed (MailMsg *msg)
+{
+	g_mutex_lock (&stats_lock);
+
+	msg->push_time = g_get_monotonic_time ();
+	mail_msg_stats_lookup (msg->info)->queued++;
+
+	g_mutex_unlock (&stats_lock);
+}
+
+/* Returns the start time of the execution. */
+static gint64
+mail_msg_stats_started (MailMsg *msg,
+                        const gchar *description)
+{
+	MailMsgStats *stats;
+	gint64 start_time, wait_time;
+
+	start_time = g_get_monotonic_time ();
+	wait_time = start_time - msg->push_time;
+
+	g_mutex_lock (&stats_lock);
+
+	stats = mail_msg_stats_lookup (msg->info);
+	if (stats->queued > 0)
+		stats->queued--;
+	stats->running++;
+	stats->total_wait_time += wait_time;
+	stats->max_wait_time = MAX (stats->max_wait_time, wait_time);
+
+	if (description != NULL && g_strcmp0 (description, stats->description) != 0) {
+		g_free (stats->description);
+		stats->description = g_strdup (description);
+	}
+
+	g_mutex_unlock (&stats_lock);
+
+	return start_time;
+}
+
+static void
+mail_msg_stats_finished (MailMsg *msg,
+                         gint64 start_time)
+{
+	MailMsgStats *stats;
+	gint64 exec_time;
+
+	exec_time = g_get_monotonic_time () - start_time;
+
+	g_mutex_lock (&stats_lock);
+
+	stats = mail_msg_stats_lookup (msg->info);
+	if (stats->running > 0)
+		stats->running--;
+	stats->completed++;
+	stats->total_exec_time += exec_time;
+	stats->max_exec_time = MAX (stats->max_exec_time, exec_time);
+
+	g_mutex_unlock (&stats_lock);
+}
+
+/**
+ * mail_msg_dup_stats:
+ *
+ * Returns a snapshot of the statistics of all message types pushed so far,
+ * as a #GPtrArray of #MailMsgStats.  Free it with g_ptr_array_unref().
+ *
+ * Returns: (transfer full): a #GPtrArray of #MailMsgStats
+ **/
+GPtrArray *
+mail_msg_dup_stats (void)
+{
+	GPtrArray *array;
+	GHashTableIter iter;
+	gpointer value;
+
+	array = g_ptr_array_new_with_free_func (
+		(GDestroyNotify) mail_msg_stats_free);
+
+	g_mutex_lock (&stats_lock);
+
+	g_hash_table_iter_init (&iter, msg_stats);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		MailMsgStats *copy;
+
+		copy = g_memdup (value, sizeof (MailMsgStats));
+		copy->description = g_strdup (copy->description);
+
+		g_ptr_array_add (array, copy);
+	}
+
+	g_mutex_unlock (&stats_lock);
+
+	return array;
+}
+
+/**
+ * mail_msg_reset_stats:
+ *
+ * Resets the accumulated counters and times of all message types.
+ * The number of queued and running messages is left untouched.
+ **/
+void
+mail_msg_reset_stats (void)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_mutex_lock (&stats_lock);
+
+	g_hash_table_iter_init (&iter, msg_stats);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		MailMsgStats *stats = value;
+
+		stats->completed = 0;
+		stats->total_wait_time = 0;
+		stats->max_wait_time = 0;
+		stats->total_exec_time = 0;
+		stats->max_exec_time = 0;
+	}
+
+	g_mutex_unlock (&stats_lock);
+}
+
+/**
+ * mail_msg_get_unordered_max_threads:
+ *
+ * Returns the current number of threads the unordered messages
+ * can run in, or 0 when no unordered message was pushed yet.
+ *
+ * Returns: the size of the unordered thread pool
+ **/
+guint
+mail_msg_get_unordered_max_threads (void)
+{
+	guint max_threads;
+
+	g_mutex_lock (&pool_lock);
+	max_threads = unordered_pool.thread_pool ? unordered_pool.max_threads : 0;
+	g_mutex_unlock (&pool_lock);
+
+	return max_threads;
+}
+
+/**
+ * mail_msg_set_store:
+ * @msg: a #MailMsg
+ * @store: (nullable): a #CamelStore the message works with, or %NULL
+ *
+ * Tells which store the message works with, before it is pushed with
+ * mail_msg_unordered_push().  Messages of a single store can then occupy
+ * all but one of the unordered threads, the rest of them waits until one
+ * of the store's messages finishes, thus a slow account cannot starve the
+ * other accounts.  The ordered queues run one message at a time, thus
+ * they ignore the @store.  The @store is used only for comparison, it's
+ * not referenced.
+ **/
+void
+mail_msg_set_store (gpointer msg,
+                    CamelStore *store)
+{
+	MailMsg *mail_msg = msg;
+
+	g_return_if_fail (mail_msg != NULL);
+
+	mail_msg->store_key = store;
+}
+
+/* Grows the pool when messages wait in the queue for too long,
+ * and shrinks it back when the messages don't wait at all. */
+static void
+mail_msg_pool_adapt (MailMsgPool *pool,
+                     gint64 wait_time)
+{
+	gint64 now;
+
+	if (pool->min_threads == pool->limit)
+		return;
+
+	g_mutex_lock (&pool_lock);
+
+	now = g_get_monotonic_time ();
+
+	if (wait_time > POOL_GROW_WAIT &&
+	    pool->max_threads < pool->limit &&
+	    now - pool->last_resize > POOL_GROW_INTERVAL) {
+		pool->max_threads++;
+		pool->last_resize = now;
+		g_thread_pool_set_max_threads (
+			pool->thread_pool, pool->max_threads, NULL);
+	} else if (wait_time < POOL_GROW_WAIT / 10 &&
+		   pool->max_threads > pool->min_threads &&
+		   now - pool->last_resize > POOL_SHRINK_INTERVAL &&
+		   g_thread_pool_unprocessed (pool->thread_pool) == 0) {
+		pool->max_threads--;
+		pool->last_resize = now;
+		g_thread_pool_set_max_threads (
+			pool->thread_pool, pool->max_threads, NULL);
+	}
+
+	g_mutex_unlock (&pool_lock);
+}
+
+/* Must hold pool_lock to call this. */
+static gboolean
+mail_msg_pool_defer_locked (MailMsgPool *pool,
+                            MailMsg *msg)
+{
+	StoreLoad *load;
+	guint max_pushed;
+
+	if (!pool->fair || msg->store_key == NULL)
+		return FALSE;
+
+	load = g_hash_table_lookup (store_loads, msg->store_key);
+	if (load == NULL) {
+		load = g_slice_new0 (StoreLoad);
+		g_queue_init (&load->deferred);
+		g_hash_table_insert (
+			store_loads, (gpointer) msg->store_key, load);
+	}
+
+	max_pushed = MAX (1, pool->max_threads - 1);
+
+	if (load->n_pushed >= max_pushed) {
+		g_queue_insert_sorted (
+			&load->deferred, msg,
+			(GCompareDataFunc) mail_msg_compare, NULL);
+		return TRUE;
+	}
+
+	load->n_pushed++;
+
+	return FALSE;
+}
+
+/* Called when the @msg finished, to let the next message
+ * of the same store in. */
+static void
+mail_msg_pool_release (MailMsgPool *pool,
+                       MailMsg *msg)
+{
+	StoreLoad *load;
+	MailMsg *next = NULL;
+
+	if (!pool->fair || msg->store_key == NULL)
+		return;
+
+	g_mutex_lock (&pool_lock);
+
+	load = g_hash_table_lookup (store_loads, msg->store_key);
+	if (load != NULL) {
+		next = g_queue_pop_head (&load->deferred);
+		if (next == NULL && load->n_pushed <= 1) {
+			g_hash_table_remove (store_loads, msg->store_key);
+		} else if (next == NULL) {
+			load->n_pushed--;
+		}
+	}
+
+	/* The released slot goes to the next deferred message. */
+	if (next != NULL) {
+		next->pool_time = g_get_monotonic_time ();
+		g_thread_pool_push (pool->thread_pool, next, NULL);
+	}
+
+	g_mutex_unlock (&pool_lock);
+}
+
+static void
+store_load_free (StoreLoad *load)
+{
+	/* Deferred messages are pushed before the load is freed. */
+	g_warn_if_fail (g_queue_is_empty (&load->deferred));
+
+	g_slice_free (StoreLoad, load);
+}
+
 static gboolean
 mail_msg_idle_cb (void)
 {
@@ -333,6 +667,7 @@ mail_msg_idle_cb (void)
 	/* check the main loop queue */
 	while ((msg = g_async_queue_try_pop (main_loop_queue)) != NULL) {
 		GCancellable *cancellable;
+		gint64 start_time;
 
 		cancellable = msg->cancellable;
 
@@ -341,8 +676,10 @@ mail_msg_idle_cb (void)
 			(GSourceFunc) mail_msg_submit,
 			g_object_ref (msg->cancellable),
 			(GDestroyNotify) g_object_unref);
+		start_time = mail_msg_stats_started (msg, NULL);
 		if (msg->info->exec != NULL)
 			msg->info->exec (msg, cancellable, &msg->error);
+		mail_msg_stats_finished (msg, start_time);
 		if (msg->info->done != NULL)
 			msg->info->done (msg);
 		mail_msg_unref (msg);
@@ -359,18 +696,27 @@ mail_msg_idle_cb (void)
 }
 
 static void
-mail_msg_proxy (MailMsg *msg)
+mail_msg_proxy (MailMsg *msg,
+                MailMsgPool *pool)
 {
 	GCancellable *cancellable;
+	gchar *text = NULL;
+	gint64 start_time;
 
 	cancellable = msg->cancellable;
 
 	if (msg->info->desc != NULL) {
-		gchar *text = msg->info->desc (msg);
+		text = msg->info->desc (msg);
 		camel_operation_push_message (cancellable, "%s", text);
-		g_free (text);
 	}
 
+	start_time = mail_msg_stats_started (msg, text);
+
+	/* Only the wait for a free thread counts, not the time the message
+	 * was deliberately held back to let other stores in. */
+	mail_msg_pool_adapt (pool, start_time - msg->pool_time);
+	g_free (text);
+
 	g_idle_add_full (
 		G_PRIORITY_DEFAULT,
 		(GSourceFunc) mail_msg_submit,
@@ -380,6 +726,9 @@ mail_msg_proxy (MailMsg *msg)
 	if (msg->info->exec != NULL)
 		msg->info->exec (msg, cancellable, &msg->error);
 
+	mail_msg_stats_finished (msg, start_time);
+	mail_msg_pool_release (pool, msg);
+
 	if (msg->info->desc != NULL)
 		camel_operation_pop_message (cancellable);
 
@@ -405,6 +754,20 @@ mail_msg_init (void)
 
 	mail_msg_active_table = g_hash_table_new (NULL, NULL);
 	main_thread = g_thread_self ();
+
+	g_mutex_init (&pool_lock);
+	store_loads = g_hash_table_new_full (
+		(GHashFunc) g_direct_hash,
+		(GEqualFunc) g_direct_equal,
+		(GDestroyNotify) NULL,
+		(GDestroyNotify) store_load_free);
+
+	g_mutex_init (&stats_lock);
+	msg_stats = g_hash_table_new_full (
+		(GHashFunc) g_direct_hash,
+		(GEqualFunc) g_direct_equal,
+		(GDestroyNotify) NULL,
+		(GDestroyNotify) mail_msg_stats_free);
 }
 
 static gint
@@ -414,30 +777,84 @@ mail_msg_compare (const MailMsg *msg1,
 	gint priority1 = msg1->priority;
 	gint priority2 = msg2->priority;
 
-	if (priority1 == priority2)
-		return 0;
+	/* Keep the push order for messages of the same priority. */
+	if (priority1 == priority2) {
+		if (msg1->seq == msg2->seq)
+			return 0;
+
+		return (msg1->seq < msg2->seq) ? -1 : 1;
+	}
 
 	return (priority1 < priority2) ? 1 : -1;
 }
 
+static gint
+mail_msg_pool_get_limit (void)
+{
+	const gchar *env;
+	gint64 limit;
+
+	env = g_getenv ("EVOLUTION_MAIL_MAX_THREADS");
+	if (env == NULL || *env == '\0')
+		return POOL_DEFAULT_LIMIT;
+
+	limit = g_ascii_strtoll (env, NULL, 10);
+	if (limit <= 0)
+		return POOL_DEFAULT_LIMIT;
+
+	return (gint) MIN (limit, 64);
+}
+
 static gpointer
 create_thread_pool (gpointer data)
 {
-	GThreadPool *thread_pool;
-	gint max_threads = GPOINTER_TO_INT (data);
+	MailMsgPool *pool = data;
+
+	g_mutex_lock (&pool_lock);
+
+	/* The ordered pools stay with their single thread. */
+	if (pool->limit == 0) {
+		pool->limit = mail_msg_pool_get_limit ();
+		pool->min_threads = CLAMP (
+			(gint) g_get_num_processors (), 4, pool->limit);
+		pool->min_threads = MIN (pool->min_threads, pool->limit);
+		pool->max_threads = pool->min_threads;
+	}
+
+	pool->last_resize = g_get_monotonic_time ();
 
 	/* once created, run forever */
-	thread_pool = g_thread_pool_new (
-		(GFunc) mail_msg_proxy, NULL, max_threads, FALSE, NULL);
+	pool->thread_pool = g_thread_pool_new (
+		(GFunc) mail_msg_proxy, pool, pool->max_threads, FALSE, NULL);
 	g_thread_pool_set_sort_function (
-		thread_pool, (GCompareDataFunc) mail_msg_compare, NULL);
+		pool->thread_pool, (GCompareDataFunc) mail_msg_compare, NULL);
 
-	return thread_pool;
+	g_mutex_unlock (&pool_lock);
+
+	return pool->thread_pool;
+}
+
+static void
+mail_msg_pool_push (MailMsgPool *pool,
+                    MailMsg *msg)
+{
+	mail_msg_stats_pushed (msg);
+
+	g_mutex_lock (&pool_lock);
+
+	if (!mail_msg_pool_defer_locked (pool, msg)) {
+		msg->pool_time = g_get_monotonic_time ();
+		g_thread_pool_push (pool->thread_pool, msg, NULL);
+	}
+
+	g_mutex_unlock (&pool_lock);
 }
 
 void
 mail_msg_main_loop_push (gpointer msg)
 {
+	mail_msg_stats_pushed (msg);
+
 	g_async_queue_push_sorted (
 		main_loop_queue, msg,
 		(GCompareDataFunc) mail_msg_compare, NULL);
@@ -456,9 +873,9 @@ mail_msg_unordered_push (gpointer msg)
 {
 	static GOnce once = G_ONCE_INIT;
 
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (10));
+	g_once (&once, (GThreadFunc) create_thread_pool, &unordered_pool);
 
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+	mail_msg_pool_push (&unordered_pool, msg);
 }
 
 void
@@ -466,9 +883,9 @@ mail_msg_fast_ordered_push (gpointer msg)
 {
 	static GOnce once = G_ONCE_INIT;
 
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (1));
+	g_once (&once, (GThreadFunc) create_thread_pool, &fast_ordered_pool);
 
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+	mail_msg_pool_push (&fast_ordered_pool, msg);
 }
 
 void
@@ -476,9 +893,9 @@ mail_msg_slow_ordered_push (gpointer msg)
 {
 	static GOnce once = G_ONCE_INIT;
 
-	g_once (&once, (GThreadFunc) create_thread_pool, GINT_TO_POINTER (1));
+	g_once (&once, (GThreadFunc) create_thread_pool, &slow_ordered_pool);
 
-	g_thread_pool_push ((GThreadPool *) once.retval, msg, NULL);
+	mail_msg_pool_push (&slow_ordered_pool, msg);
 }
 
 gboolean
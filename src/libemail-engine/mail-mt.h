@@ -59,6 +59,9 @@ struct _MailMsg {
 	gint priority;			/* priority (default = 0) */
 	GCancellable *cancellable;
 	GError *error;			/* up to the caller to use this */
+	gconstpointer store_key;	/* for fair sharing of the threads, not referenced */
+	gint64 push_time;		/* monotonic time of the push into a queue */
+	gint64 pool_time;		/* monotonic time of the entry into a thread pool */
 };
 
 struct _MailMsgInfo {
@@ -100,6 +103,26 @@ void mail_msg_unordered_push (gpointer msg);
 void mail_msg_fast_ordered_push (gpointer msg);
 void mail_msg_slow_ordered_push (gpointer msg);
 
+/* messages of one store cannot occupy all the unordered threads */
+void mail_msg_set_store (gpointer msg, CamelStore *store);
+
+/* runtime statistics, per message type; times are in microseconds */
+typedef struct _MailMsgStats {
+	const MailMsgInfo *info;
+	gchar *description;	/* of the last message of the type, or NULL */
+	guint queued;		/* waiting in a queue now */
+	guint running;		/* being executed now */
+	guint64 completed;
+	gint64 total_wait_time;
+	gint64 max_wait_time;
+	gint64 total_exec_time;
+	gint64 max_exec_time;
+} MailMsgStats;
+
+GPtrArray *mail_msg_dup_stats (void);
+void mail_msg_reset_stats (void);
+guint mail_msg_get_unordered_max_threads (void);
+
 /* Call a function in the GUI thread, wait for it to return, type is
  * the marshaller to use.  FIXME This thing is horrible, please put
  * it out of its misery. */
@@ -88,6 +88,85 @@ em_filter_folder_element_desc (struct _filter_mail_msg *m)
 	return g_strdup (_("Filtering Selected Messages"));
 }
 
+static gboolean
+em_filter_folder_is_pop3 (CamelFolder *folder)
+{
+	CamelProvider *provider;
+
+	provider = camel_service_get_provider (
+		CAMEL_SERVICE (camel_folder_get_parent_store (folder)));
+
+	return provider && g_strcmp0 (provider->protocol, "pop") == 0;
+}
+
+/* Filters messages fetched from a POP3 account the same way as
+ * camel_filter_driver_filter_folder() does, only the POP3 origin is
+ * recorded in the user tags of each message, thus the message does not
+ * need to be read when it is expunged from the local folder later. */
+static gboolean
+em_filter_pop3_messages (struct _filter_mail_msg *m,
+                         GPtrArray *uids,
+                         GCancellable *cancellable,
+                         GError **error)
+{
+	CamelFolder *folder = m->source_folder;
+	const gchar *store_uid;
+	guint ii;
+
+	store_uid = camel_service_get_uid (
+		CAMEL_SERVICE (camel_folder_get_parent_store (folder)));
+
+	for (ii = 0; ii < uids->len; ii++) {
+		const gchar *uid = uids->pdata[ii];
+		CamelMimeMessage *message;
+		CamelMessageInfo *info;
+		gint status;
+
+		camel_operation_push_message (
+			cancellable, _("Getting message %d of %d"),
+			ii + 1, uids->len);
+		camel_operation_progress (cancellable, 100 * ii / uids->len);
+
+		message = camel_folder_get_message_sync (
+			folder, uid, cancellable, error);
+
+		camel_operation_pop_message (cancellable);
+
+		if (message == NULL)
+			return FALSE;
+
+		info = camel_message_info_new_from_headers (
+			NULL, camel_medium_get_headers (CAMEL_MEDIUM (message)));
+		camel_message_info_set_uid (info, uid);
+		camel_message_info_set_user_tag (info, E_MAIL_POP3_UID_TAG, uid);
+		camel_message_info_set_user_tag (info, E_MAIL_POP3_SOURCE_TAG, store_uid);
+
+		status = camel_filter_driver_filter_message (
+			m->driver, message, info, uid, folder,
+			store_uid, store_uid, cancellable, error);
+
+		g_object_unref (info);
+		g_object_unref (message);
+
+		if (status == -1)
+			return FALSE;
+
+		if (m->delete)
+			camel_folder_set_message_flags (
+				folder, uid, CAMEL_MESSAGE_DELETED |
+				CAMEL_MESSAGE_SEEN, ~0);
+
+		camel_uid_cache_save_uid (m->cache, uid);
+
+		if ((ii % 10) == 0)
+			camel_uid_cache_save (m->cache);
+	}
+
+	camel_operation_progress (cancellable, 100);
+
+	return TRUE;
+}
+
 /* filter a folder, or a subset thereof, uses source_folder/source_uids */
 /* this is shared with fetch_mail */
 static gboolean
@@ -117,9 +196,13 @@ em_filter_folder_element_exec (struct _filter_mail_msg *m,
 	else
 		folder_uids = uids = camel_folder_get_uids (folder);
 
-	success = camel_filter_driver_filter_folder (
-		m->driver, folder, m->cache, uids, m->delete,
-		cancellable, &local_error) == 0;
+	if (m->cache && em_filter_folder_is_pop3 (folder))
+		success = em_filter_pop3_messages (
+			m, uids, cancellable, &local_error);
+	else
+		success = camel_filter_driver_filter_folder (
+			m->driver, folder, m->cache, uids, m->delete,
+			cancellable, &local_error) == 0;
 	camel_filter_driver_flush (m->driver, &local_error);
 
 	if (folder_uids)
@@ -214,6 +297,7 @@ mail_filter_folder (EMailSession *session,
 			m->driver, "new-mail-notification");
 	}
 
+	mail_msg_set_store (m, camel_folder_get_parent_store (source_folder));
 	mail_msg_unordered_push (m);
 }
 
@@ -522,6 +606,7 @@ mail_fetch_mail (CamelStore *store,
 	if (status)
 		camel_filter_driver_set_status_func (fm->driver, status, status_data);
 
+	mail_msg_set_store (m, m->store);
 	mail_msg_unordered_push (m);
 
 	g_object_unref (session);
@@ -1263,6 +1348,7 @@ mail_transfer_messages (EMailSession *session,
 	m->done = done;
 	m->data = data;
 
+	mail_msg_set_store (m, camel_folder_get_parent_store (source));
 	mail_msg_slow_ordered_push (m);
 }
 
@@ -1383,6 +1469,7 @@ mail_sync_folder (CamelFolder *folder,
 	m->data = data;
 	m->done = done;
 
+	mail_msg_set_store (m, camel_folder_get_parent_store (folder));
 	mail_msg_slow_ordered_push (m);
 }
 
@@ -1464,6 +1551,7 @@ mail_sync_store (CamelStore *store,
 	m->data = data;
 	m->done = done;
 
+	mail_msg_set_store (m, store);
 	mail_msg_slow_ordered_push (m);
 }
 
@@ -1540,6 +1628,7 @@ mail_empty_trash (CamelStore *store)
 	m = mail_msg_new (&empty_trash_info);
 	m->store = g_object_ref (store);
 
+	mail_msg_set_store (m, store);
 	mail_msg_slow_ordered_push (m);
 }
 
@@ -1638,5 +1727,6 @@ mail_process_folder_changes (CamelFolder *folder,
 	m->done = done;
 	m->user_data = user_data;
 
+	mail_msg_set_store (m, camel_folder_get_parent_store (folder));
 	mail_msg_unordered_push (m);
 }
@@ -34,6 +34,11 @@
 
 #define w(x)
 
+/* Print web views are expensive to create, thus a few of them
+ * are kept for the next print operations for a short while. */
+#define MAX_IDLE_WEB_VIEWS 3
+#define IDLE_WEB_VIEWS_TIMEOUT_SECS 30
+
 #define E_MAIL_PRINTER_GET_PRIVATE(obj) \
 	(G_TYPE_INSTANCE_GET_PRIVATE \
 	((obj), E_TYPE_MAIL_PRINTER, EMailPrinterPrivate))
@@ -74,6 +79,12 @@ G_DEFINE_TYPE (
 	e_mail_printer,
 	G_TYPE_OBJECT);
 
+/* Accessed from the main thread only. */
+static GQueue idle_web_views = G_QUEUE_INIT;
+static guint idle_web_views_timeout_id;
+
+static void mail_printer_release_web_view (WebKitWebView *web_view);
+
 static void
 async_context_free (AsyncContext *async_context)
 {
@@ -82,6 +93,8 @@ async_context_free (AsyncContext *async_context)
 			async_context->web_view,
 			async_context->load_status_handler_id);
 
+	if (async_context->web_view != NULL)
+		mail_printer_release_web_view (async_context->web_view);
 	g_clear_object (&async_context->web_view);
 
 	g_slice_free (AsyncContext, async_context);
@@ -326,16 +339,87 @@ mail_printer_load_changed_cb (WebKitWebView *web_view,
 	}
 }
 
+static gboolean
+mail_printer_idle_web_views_timeout_cb (gpointer user_data)
+{
+	WebKitWebView *web_view;
+
+	while ((web_view = g_queue_pop_head (&idle_web_views)) != NULL)
+		g_object_unref (web_view);
+
+	idle_web_views_timeout_id = 0;
+
+	return G_SOURCE_REMOVE;
+}
+
+/* The charsets cannot be reset on the formatter of the web view,
+ * thus the idle web views are reused only for the same ones. */
+static gchar *
+mail_printer_build_charsets_key (const gchar *charset,
+                                 const gchar *default_charset)
+{
+	return g_strconcat (
+		charset ? charset : "", "\n",
+		default_charset ? default_charset : "", NULL);
+}
+
+static void
+mail_printer_release_web_view (WebKitWebView *web_view)
+{
+	if (g_object_get_data (G_OBJECT (web_view), "printer-charsets") == NULL)
+		return;
+
+	if (g_queue_get_length (&idle_web_views) >= MAX_IDLE_WEB_VIEWS)
+		g_object_unref (g_queue_pop_tail (&idle_web_views));
+
+	g_queue_push_head (&idle_web_views, g_object_ref (web_view));
+
+	if (idle_web_views_timeout_id > 0)
+		g_source_remove (idle_web_views_timeout_id);
+
+	idle_web_views_timeout_id = e_named_timeout_add_seconds (
+		IDLE_WEB_VIEWS_TIMEOUT_SECS,
+		mail_printer_idle_web_views_timeout_cb, NULL);
+}
+
 static WebKitWebView *
 mail_printer_new_web_view (const gchar *charset,
                            const gchar *default_charset)
 {
-	WebKitWebView *web_view;
+	WebKitWebView *web_view = NULL;
 	EMailFormatter *formatter;
+	gchar *charsets_key;
+	GList *link;
+
+	charsets_key = mail_printer_build_charsets_key (charset, default_charset);
+
+	for (link = g_queue_peek_head_link (&idle_web_views); link; link = g_list_next (link)) {
+		const gchar *key;
+
+		key = g_object_get_data (G_OBJECT (link->data), "printer-charsets");
+
+		if (g_strcmp0 (key, charsets_key) == 0) {
+			web_view = link->data;
+			g_queue_delete_link (&idle_web_views, link);
+			break;
+		}
+	}
+
+	if (web_view != NULL) {
+		g_free (charsets_key);
+
+		/* The reference of the idle queue is passed to the caller. */
+		return web_view;
+	}
 
 	web_view = g_object_new (
 		E_TYPE_MAIL_DISPLAY,
 		"mode", E_MAIL_FORMATTER_MODE_PRINTING, NULL);
+	g_object_ref_sink (web_view);
+
+	g_object_set_data_full (
+		G_OBJECT (web_view), "printer-charsets",
+		charsets_key, g_free);
 
 	/* Do not load remote images, print what user sees in the preview panel */
 	e_mail_display_set_force_load_images (E_MAIL_DISPLAY (web_view), FALSE);
@@ -552,7 +636,7 @@ e_mail_printer_print (EMailPrinter *printer,
 	web_view = mail_printer_new_web_view (charset, default_charset);
 	e_mail_display_set_part_list (E_MAIL_DISPLAY (web_view), part_list);
 
-	async_context->web_view = g_object_ref_sink (web_view);
+	async_context->web_view = web_view;
 
 	handler_id = g_signal_connect_data (
 		web_view, "load-changed",
@@ -25,6 +25,7 @@
 #include "e-mail-reader-utils.h"
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <libxml/tree.h>
 #include <camel/camel.h>
 
@@ -59,6 +60,7 @@ struct _AsyncContext {
 	EMailReader *reader;
 	CamelInternetAddress *address;
 	GPtrArray *uids;
+	GPtrArray *filenames;
 	gchar *folder_name;
 	gchar *message_uid;
 
@@ -85,6 +87,9 @@ async_context_free (AsyncContext *async_context)
 	if (async_context->uids != NULL)
 		g_ptr_array_unref (async_context->uids);
 
+	if (async_context->filenames != NULL)
+		g_ptr_array_unref (async_context->filenames);
+
 	g_free (async_context->folder_name);
 	g_free (async_context->message_uid);
 
@@ -2752,6 +2757,233 @@ exit:
 	g_ptr_array_unref (uids);
 }
 
+static void
+mail_reader_save_as_pdf_progress_cb (guint n_done,
+                                     guint n_total,
+                                     gpointer user_data)
+{
+	EActivity *activity = user_data;
+
+	if (n_total > 0)
+		e_activity_set_percent (activity, 100.0 * n_done / n_total);
+}
+
+static void
+mail_reader_save_as_pdf_cb (GObject *source_object,
+                            GAsyncResult *result,
+                            gpointer user_data)
+{
+	EActivity *activity;
+	EAlertSink *alert_sink;
+	AsyncContext *async_context;
+	GPtrArray *written;
+	GError *local_error = NULL;
+
+	async_context = (AsyncContext *) user_data;
+
+	activity = async_context->activity;
+	alert_sink = e_activity_get_alert_sink (activity);
+
+	written = em_utils_print_messages_to_files_finish (
+		CAMEL_FOLDER (source_object), result, &local_error);
+
+	if (e_activity_handle_cancellation (activity, local_error)) {
+		g_error_free (local_error);
+
+	} else if (local_error != NULL) {
+		e_alert_submit (
+			alert_sink,
+			"mail:save-messages",
+			local_error->message, NULL);
+		g_error_free (local_error);
+
+	} else {
+		e_activity_set_state (activity, E_ACTIVITY_COMPLETED);
+	}
+
+	/* Remove the files claimed for messages which were skipped */
+	if (async_context->filenames != NULL) {
+		guint ii;
+
+		for (ii = 0; ii < async_context->filenames->len; ii++) {
+			const gchar *filename = async_context->filenames->pdata[ii];
+			gboolean was_written = FALSE;
+			guint jj;
+
+			for (jj = 0; written != NULL && jj < written->len && !was_written; jj++)
+				was_written = g_strcmp0 (written->pdata[jj], filename) == 0;
+
+			if (!was_written)
+				g_unlink (filename);
+		}
+	}
+
+	if (written != NULL)
+		g_ptr_array_unref (written);
+
+	async_context_free (async_context);
+}
+
+/* Creates an empty file for the message in the @directory, under
+ * a name not used yet, thus no existing file is overwritten. */
+static gchar *
+mail_reader_claim_pdf_filename (GFile *directory,
+                                CamelFolder *folder,
+                                const gchar *message_uid,
+                                GCancellable *cancellable,
+                                GError **error)
+{
+	gchar *basename, *filename = NULL;
+	guint ii;
+
+	basename = em_utils_build_export_basename (folder, message_uid, NULL);
+	e_filename_make_safe (basename);
+
+	for (ii = 0; !filename; ii++) {
+		GFileOutputStream *stream;
+		GFile *file;
+		gchar *name;
+		GError *local_error = NULL;
+
+		if (ii == 0)
+			name = g_strconcat (basename, ".pdf", NULL);
+		else
+			name = g_strdup_printf ("%s (%u).pdf", basename, ii);
+
+		file = g_file_get_child (directory, name);
+		stream = g_file_create (file, G_FILE_CREATE_NONE, cancellable, &local_error);
+
+		if (stream) {
+			filename = g_file_get_path (file);
+			g_object_unref (stream);
+		}
+
+		g_object_unref (file);
+		g_free (name);
+
+		if (!stream && !g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_EXISTS)) {
+			g_propagate_error (error, local_error);
+			break;
+		}
+
+		g_clear_error (&local_error);
+	}
+
+	g_free (basename);
+
+	return filename;
+}
+
+/**
+ * e_mail_reader_save_messages_as_pdf:
+ * @reader: an #EMailReader
+ *
+ * Asks for a folder and saves each of the selected messages there
+ * as a PDF file, in the background, with the progress shown by
+ * an activity of the @reader.
+ *
+ * Since: 3.24
+ **/
+void
+e_mail_reader_save_messages_as_pdf (EMailReader *reader)
+{
+	EActivity *activity;
+	AsyncContext *async_context;
+	GCancellable *cancellable;
+	CamelFolder *folder;
+	GtkWidget *dialog;
+	GFile *directory = NULL;
+	GPtrArray *uids, *filenames;
+	GError *local_error = NULL;
+	guint ii;
+
+	g_return_if_fail (E_IS_MAIL_READER (reader));
+
+	folder = e_mail_reader_ref_folder (reader);
+	g_return_if_fail (folder != NULL);
+
+	uids = e_mail_reader_get_selected_uids (reader);
+	if (uids == NULL || uids->len == 0) {
+		if (uids != NULL)
+			g_ptr_array_unref (uids);
+		g_object_unref (folder);
+		return;
+	}
+
+	if (uids->len > 1) {
+		GtkWidget *message_list;
+
+		message_list = e_mail_reader_get_message_list (reader);
+		message_list_sort_uids (MESSAGE_LIST (message_list), uids);
+	}
+
+	dialog = gtk_file_chooser_dialog_new (
+		ngettext ("Save Message as PDF", "Save Messages as PDF", uids->len),
+		e_mail_reader_get_window (reader),
+		GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER,
+		_("_Cancel"), GTK_RESPONSE_CANCEL,
+		_("_Save"), GTK_RESPONSE_OK, NULL);
+
+	gtk_file_chooser_set_local_only (GTK_FILE_CHOOSER (dialog), TRUE);
+	gtk_dialog_set_default_response (GTK_DIALOG (dialog), GTK_RESPONSE_OK);
+
+	if (gtk_dialog_run (GTK_DIALOG (dialog)) == GTK_RESPONSE_OK)
+		directory = gtk_file_chooser_get_file (GTK_FILE_CHOOSER (dialog));
+
+	gtk_widget_destroy (dialog);
+
+	if (directory == NULL)
+		goto exit;
+
+	activity = e_mail_reader_new_activity (reader);
+	cancellable = e_activity_get_cancellable (activity);
+	e_activity_set_text (activity, _("Saving messages as PDF"));
+	e_activity_set_percent (activity, 0.0);
+
+	filenames = g_ptr_array_new_with_free_func (g_free);
+
+	for (ii = 0; ii < uids->len && !local_error; ii++) {
+		gchar *filename;
+
+		filename = mail_reader_claim_pdf_filename (
+			directory, folder, uids->pdata[ii], cancellable, &local_error);
+
+		if (filename != NULL)
+			g_ptr_array_add (filenames, filename);
+	}
+
+	if (local_error != NULL) {
+		for (ii = 0; ii < filenames->len; ii++)
+			g_unlink (filenames->pdata[ii]);
+
+		e_alert_submit (
+			e_activity_get_alert_sink (activity),
+			"mail:save-messages",
+			local_error->message, NULL);
+		e_activity_set_state (activity, E_ACTIVITY_COMPLETED);
+		g_error_free (local_error);
+	} else {
+		async_context = g_slice_new0 (AsyncContext);
+		async_context->activity = g_object_ref (activity);
+		async_context->reader = g_object_ref (reader);
+		async_context->filenames = g_ptr_array_ref (filenames);
+
+		em_utils_print_messages_to_files (
+			folder, uids, filenames,
+			mail_reader_save_as_pdf_progress_cb, activity,
+			cancellable, mail_reader_save_as_pdf_cb,
+			async_context);
+	}
+
+	g_ptr_array_unref (filenames);
+	g_object_unref (activity);
+	g_object_unref (directory);
+
+exit:
+	g_object_unref (folder);
+	g_ptr_array_unref (uids);
+}
+
 void
 e_mail_reader_select_next_message (EMailReader *reader,
                                    gboolean or_else_previous)
@@ -82,6 +82,8 @@ void		e_mail_reader_reply_to_message	(EMailReader *reader,
 						 CamelMimeMessage *message,
 						 EMailReplyType reply_type);
 void		e_mail_reader_save_messages	(EMailReader *reader);
+void		e_mail_reader_save_messages_as_pdf
+						(EMailReader *reader);
 void		e_mail_reader_select_next_message
 						(EMailReader *reader,
 						 gboolean or_else_previous);
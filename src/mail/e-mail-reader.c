@@ -1681,6 +1681,13 @@ action_mail_save_as_cb (GtkAction *action,
 	e_mail_reader_save_messages (reader);
 }
 
+static void
+action_mail_save_as_pdf_cb (GtkAction *action,
+                            EMailReader *reader)
+{
+	e_mail_reader_save_messages_as_pdf (reader);
+}
+
 static void
 action_mail_search_folder_from_mailing_list_cb (GtkAction *action,
                                                 EMailReader *reader)
@@ -2381,6 +2388,13 @@ static GtkActionEntry mail_reader_entries[] = {
 	  N_("Save selected messages as an mbox file"),
 	  G_CALLBACK (action_mail_save_as_cb) },
 
+	{ "mail-save-as-pdf",
+	  NULL,
+	  N_("Save as _PDF..."),
+	  NULL,
+	  N_("Save each of the selected messages as a PDF file"),
+	  G_CALLBACK (action_mail_save_as_pdf_cb) },
+
 	{ "mail-show-source",
 	  NULL,
 	  N_("_Message Source"),
@@ -2627,6 +2641,10 @@ static EPopupActionEntry mail_reader_popup_entries[] = {
 	  NULL,
 	  "mail-save-as" },
 
+	{ "mail-popup-save-as-pdf",
+	  NULL,
+	  "mail-save-as-pdf" },
+
 	{ "mail-popup-undelete",
 	  NULL,
 	  "mail-undelete" }
@@ -3091,6 +3109,7 @@ mail_reader_message_loaded_cb (CamelFolder *folder,
 
 	if (message != NULL) {
 		mail_reader_manage_followup_flag (reader, folder, message_uid);
+		e_mail_folder_remember_content_digest (folder, message_uid, message);
 
 		g_signal_emit (
 			reader, signals[MESSAGE_LOADED], 0,
@@ -4007,6 +4026,11 @@ mail_reader_update_actions (EMailReader *reader,
 	action = e_mail_reader_get_action (reader, action_name);
 	gtk_action_set_sensitive (action, sensitive);
 
+	action_name = "mail-save-as-pdf";
+	sensitive = any_messages_selected;
+	action = e_mail_reader_get_action (reader, action_name);
+	gtk_action_set_sensitive (action, sensitive);
+
 	action_name = "mail-show-source";
 	sensitive = single_message_selected;
 	action = e_mail_reader_get_action (reader, action_name);
@@ -4395,6 +4419,15 @@ e_mail_reader_init (EMailReader *reader,
 		G_SETTINGS_BIND_NO_SENSITIVITY |
 		G_SETTINGS_BIND_INVERT_BOOLEAN);
 
+	action_name = "mail-save-as-pdf";
+	action = e_mail_reader_get_action (reader, action_name);
+	g_settings_bind (
+		settings, "disable-save-to-disk",
+		action, "visible",
+		G_SETTINGS_BIND_GET |
+		G_SETTINGS_BIND_NO_SENSITIVITY |
+		G_SETTINGS_BIND_INVERT_BOOLEAN);
+
 	g_object_unref (settings);
 #endif
 
@@ -75,6 +75,10 @@ struct _EMailUISessionPrivate {
 
 	GSList *address_cache; /* data is AddressCacheData struct */
 	GMutex address_cache_mutex;
+
+	/* Used only from the main thread */
+	GHashTable *filter_rules; /* gchar *source ~> GPtrArray { FilterRuleCode * } */
+	gchar *filter_rules_stamp;
 };
 
 enum {
@@ -220,19 +224,149 @@ session_folder_can_filter_junk (CamelFolder *folder)
 	return (camel_folder_get_flags (folder) & CAMEL_FOLDER_FILTER_JUNK) != 0;
 }
 
+/* The filter rules, as compiled from the filter rule files; they are
+ * kept across filter driver requests, because parsing the files and
+ * building the code of all the rules is not cheap. */
+typedef struct _FilterRuleCode {
+	gchar *name;
+	gchar *search;
+	gchar *action;
+} FilterRuleCode;
+
+static void
+filter_rule_code_free (gpointer ptr)
+{
+	FilterRuleCode *frc = ptr;
+
+	if (frc) {
+		g_free (frc->name);
+		g_free (frc->search);
+		g_free (frc->action);
+		g_free (frc);
+	}
+}
+
+/* Describes the current state of the rule files; any change of it,
+ * by the filter editor or by anything else, invalidates the rules. */
+static gchar *
+mail_ui_session_dup_filter_files_stamp (const gchar *system,
+                                        const gchar *user)
+{
+	const gchar *filenames[2];
+	GString *stamp;
+	guint ii;
+
+	filenames[0] = system;
+	filenames[1] = user;
+
+	stamp = g_string_new ("");
+
+	for (ii = 0; ii < G_N_ELEMENTS (filenames); ii++) {
+		GFile *file;
+		GFileInfo *info;
+
+		file = g_file_new_for_path (filenames[ii]);
+		info = g_file_query_info (
+			file,
+			G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+			G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+			G_FILE_ATTRIBUTE_STANDARD_SIZE,
+			G_FILE_QUERY_INFO_NONE, NULL, NULL);
+
+		if (info) {
+			g_string_append_printf (
+				stamp, "%" G_GUINT64_FORMAT ".%u:%" G_GOFFSET_FORMAT ";",
+				g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+				g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC),
+				g_file_info_get_size (info));
+			g_object_unref (info);
+		} else {
+			g_string_append (stamp, "-;");
+		}
+
+		g_object_unref (file);
+	}
+
+	return g_string_free (stamp, FALSE);
+}
+
+static GPtrArray *
+mail_ui_session_get_filter_rules (EMailUISession *session,
+                                  const gchar *type)
+{
+	GPtrArray *rules;
+	gchar *user, *system, *stamp;
+
+	user = g_build_filename (mail_session_get_config_dir (), "filters.xml", NULL);
+	system = g_build_filename (EVOLUTION_PRIVDATADIR, "filtertypes.xml", NULL);
+	stamp = mail_ui_session_dup_filter_files_stamp (system, user);
+
+	if (g_strcmp0 (stamp, session->priv->filter_rules_stamp) != 0) {
+		g_hash_table_remove_all (session->priv->filter_rules);
+		g_free (session->priv->filter_rules_stamp);
+		session->priv->filter_rules_stamp = stamp;
+		stamp = NULL;
+	}
+
+	rules = g_hash_table_lookup (session->priv->filter_rules, type);
+
+	if (!rules) {
+		EFilterRule *rule = NULL;
+		ERuleContext *fc;
+		GString *fsearch, *faction;
+
+		fc = (ERuleContext *) em_filter_context_new (E_MAIL_SESSION (session));
+		e_rule_context_load (fc, system, user);
+
+		rules = g_ptr_array_new_with_free_func (filter_rule_code_free);
+
+		fsearch = g_string_new ("");
+		faction = g_string_new ("");
+
+		while ((rule = e_rule_context_next_rule (fc, rule, type))) {
+			FilterRuleCode *frc;
+
+			/* skip disabled rules */
+			if (!rule->enabled)
+				continue;
+
+			g_string_truncate (fsearch, 0);
+			g_string_truncate (faction, 0);
+
+			e_filter_rule_build_code (rule, fsearch);
+			em_filter_rule_build_action (
+				EM_FILTER_RULE (rule), faction);
+
+			frc = g_new0 (FilterRuleCode, 1);
+			frc->name = g_strdup (rule->name);
+			frc->search = g_strdup (fsearch->str);
+			frc->action = g_strdup (faction->str);
+
+			g_ptr_array_add (rules, frc);
+		}
+
+		g_string_free (fsearch, TRUE);
+		g_string_free (faction, TRUE);
+		g_object_unref (fc);
+
+		g_hash_table_insert (session->priv->filter_rules, g_strdup (type), rules);
+	}
+
+	g_free (system);
+	g_free (user);
+	g_free (stamp);
+
+	return rules;
+}
+
 static CamelFilterDriver *
 main_get_filter_driver (CamelSession *session,
 			const gchar *type,
 			CamelFolder *for_folder,
 			GError **error)
 {
-	EMailSession *ms = E_MAIL_SESSION (session);
 	CamelFilterDriver *driver;
-	EFilterRule *rule = NULL;
-	const gchar *config_dir;
-	gchar *user, *system;
 	GSettings *settings;
-	ERuleContext *fc;
 	EMailUISessionPrivate *priv;
 	gboolean add_junk_test;
 
@@ -240,14 +374,6 @@ main_get_filter_driver (CamelSession *session,
 
 	settings = e_util_ref_settings ("org.gnome.evolution.mail");
 
-	config_dir = mail_session_get_config_dir ();
-	user = g_build_filename (config_dir, "filters.xml", NULL);
-	system = g_build_filename (EVOLUTION_PRIVDATADIR, "filtertypes.xml", NULL);
-	fc = (ERuleContext *) em_filter_context_new (ms);
-	e_rule_context_load (fc, system, user);
-	g_free (system);
-	g_free (user);
-
 	driver = camel_filter_driver_new (session);
 	camel_filter_driver_set_folder_func (driver, get_folder, session);
 
@@ -284,37 +410,24 @@ main_get_filter_driver (CamelSession *session,
 	}
 
 	if (strcmp (type, E_FILTER_SOURCE_JUNKTEST) != 0) {
-		GString *fsearch, *faction;
-
-		fsearch = g_string_new ("");
-		faction = g_string_new ("");
+		GPtrArray *rules;
+		guint ii;
 
 		if (!strcmp (type, E_FILTER_SOURCE_DEMAND))
 			type = E_FILTER_SOURCE_INCOMING;
 
-		/* add the user-defined rules next */
-		while ((rule = e_rule_context_next_rule (fc, rule, type))) {
-			g_string_truncate (fsearch, 0);
-			g_string_truncate (faction, 0);
+		rules = mail_ui_session_get_filter_rules (E_MAIL_UI_SESSION (session), type);
 
-			/* skip disabled rules */
-			if (!rule->enabled)
-				continue;
+		/* add the user-defined rules next */
+		for (ii = 0; ii < rules->len; ii++) {
+			FilterRuleCode *frc = g_ptr_array_index (rules, ii);
 
-			e_filter_rule_build_code (rule, fsearch);
-			em_filter_rule_build_action (
-				EM_FILTER_RULE (rule), faction);
 			camel_filter_driver_add_rule (
-				driver, rule->name,
-				fsearch->str, faction->str);
+				driver, frc->name,
+				frc->search, frc->action);
 		}
-
-		g_string_free (fsearch, TRUE);
-		g_string_free (faction, TRUE);
 	}
 
-	g_object_unref (fc);
-
 	g_object_unref (settings);
 
 	return driver;
@@ -445,6 +558,8 @@ mail_ui_session_finalize (GObject *object)
 	priv = E_MAIL_UI_SESSION_GET_PRIVATE (object);
 
 	g_mutex_clear (&priv->address_cache_mutex);
+	g_hash_table_destroy (priv->filter_rules);
+	g_free (priv->filter_rules_stamp);
 
 	/* Chain up to parent's method. */
 	G_OBJECT_CLASS (e_mail_ui_session_parent_class)->finalize (object);
@@ -992,6 +1107,10 @@ e_mail_ui_session_init (EMailUISession *session)
 	session->priv = E_MAIL_UI_SESSION_GET_PRIVATE (session);
 	g_mutex_init (&session->priv->address_cache_mutex);
 	session->priv->label_store = e_mail_label_list_store_new ();
+	session->priv->filter_rules = g_hash_table_new_full (
+		g_str_hash, g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) g_ptr_array_unref);
 }
 
 EMailSession *
@@ -30,6 +30,7 @@
 #include <sys/stat.h>
 
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 
 #include <e-util/e-util.h>
 #include <shell/e-shell.h>
@@ -102,6 +103,11 @@ struct _StoreInfo {
 	/* Spinner renderers have to be animated manually. */
 	guint spinner_pulse_value;
 	guint spinner_pulse_timeout_id;
+
+	/* Reconciliation of the folders with the store's current
+	 * folder info, after the store claimed it's stale. */
+	GCancellable *reconcile_cancellable;
+	gboolean reconcile_again;
 };
 
 enum {
@@ -344,6 +350,11 @@ store_info_dispose (StoreInfo *si)
 		si->spinner_pulse_timeout_id = 0;
 	}
 
+	if (si->reconcile_cancellable) {
+		g_cancellable_cancel (si->reconcile_cancellable);
+		g_clear_object (&si->reconcile_cancellable);
+	}
+
 	store_info_unref (si);
 }
 
@@ -525,6 +536,10 @@ folder_tree_model_service_removed (EMailAccountStore *account_store,
 {
 	em_folder_tree_model_remove_store (
 		folder_tree_model, CAMEL_STORE (service));
+
+	/* The account is gone, thus also its folder tree snapshot. */
+	em_folder_tree_model_save_snapshot (
+		folder_tree_model, CAMEL_STORE (service), NULL);
 }
 
 static void
@@ -1449,20 +1464,415 @@ folder_tree_model_folder_renamed_cb (CamelStore *store,
 		EM_FOLDER_TREE_MODEL (model), &iter, store, info, TRUE);
 }
 
+static gchar *
+folder_tree_model_dup_snapshot_filename (CamelStore *store)
+{
+	return g_build_filename (
+		mail_session_get_cache_dir (), "folder-tree",
+		camel_service_get_uid (CAMEL_SERVICE (store)), NULL);
+}
+
+static void
+folder_tree_model_snapshot_append (GString *contents,
+                                   CamelFolderInfo *fi)
+{
+	while (fi) {
+		gchar *full_name, *display_name;
+
+		full_name = g_strescape (fi->full_name, NULL);
+		display_name = g_strescape (fi->display_name ? fi->display_name : "", NULL);
+
+		g_string_append_printf (
+			contents, "%u\t%d\t%s\t%s\n",
+			fi->flags, fi->unread, full_name, display_name);
+
+		g_free (full_name);
+		g_free (display_name);
+
+		folder_tree_model_snapshot_append (contents, fi->child);
+
+		fi = fi->next;
+	}
+}
+
+/* Reads the folder info tree saved by em_folder_tree_model_save_snapshot(),
+ * or returns NULL when there is none. */
+static CamelFolderInfo *
+folder_tree_model_load_snapshot (CamelStore *store)
+{
+	CamelFolderInfo *fi = NULL;
+	GPtrArray *folders;
+	gchar *filename, *contents = NULL;
+	gchar **lines;
+	guint ii;
+
+	filename = folder_tree_model_dup_snapshot_filename (store);
+
+	if (!g_file_get_contents (filename, &contents, NULL, NULL)) {
+		g_free (filename);
+		return NULL;
+	}
+
+	folders = g_ptr_array_new ();
+	lines = g_strsplit (contents, "\n", -1);
+
+	for (ii = 0; lines[ii]; ii++) {
+		CamelFolderInfo *info;
+		gchar **parts;
+
+		parts = g_strsplit (lines[ii], "\t", 4);
+
+		if (g_strv_length (parts) == 4 && *parts[2]) {
+			info = camel_folder_info_new ();
+			info->flags = (guint32) g_ascii_strtoull (parts[0], NULL, 10);
+			info->unread = (gint) g_ascii_strtoll (parts[1], NULL, 10);
+			info->total = -1;
+			info->full_name = g_strcompress (parts[2]);
+			info->display_name = g_strcompress (parts[3]);
+
+			g_ptr_array_add (folders, info);
+		}
+
+		g_strfreev (parts);
+	}
+
+	if (folders->len > 0)
+		fi = camel_folder_info_build (folders, "", '/', FALSE);
+
+	g_ptr_array_free (folders, TRUE);
+	g_strfreev (lines);
+	g_free (contents);
+	g_free (filename);
+
+	return fi;
+}
+
+static void
+folder_tree_model_reconcile_mark_seen (GHashTable *seen,
+                                       CamelFolderInfo *fi)
+{
+	while (fi) {
+		g_hash_table_add (seen, fi->full_name);
+		folder_tree_model_reconcile_mark_seen (seen, fi->child);
+		fi = fi->next;
+	}
+}
+
+/* Finds a row of a folder under @parent, which is gone from the folder
+ * info tree, but whose display name is the one of the new folder @fi,
+ * and gives it the full name of @fi, like when the folder has been
+ * renamed on the server.  The row, thus also its expanded state and
+ * its subfolders, is kept.  Returns the row reference, or NULL. */
+static GtkTreeRowReference *
+folder_tree_model_reconcile_rename (EMFolderTreeModel *model,
+                                    StoreInfo *si,
+                                    GtkTreeIter *parent,
+                                    CamelFolderInfo *fi,
+                                    GHashTable *seen)
+{
+	GtkTreeModel *tree_model = GTK_TREE_MODEL (model);
+	GtkTreeRowReference *reference = NULL;
+	GtkTreeIter child;
+	gboolean valid;
+
+	valid = gtk_tree_model_iter_children (tree_model, &child, parent);
+
+	while (valid && reference == NULL) {
+		gchar *full_name = NULL, *display_name = NULL;
+		gpointer old_key = NULL, value = NULL;
+
+		gtk_tree_model_get (
+			tree_model, &child,
+			COL_STRING_FULL_NAME, &full_name,
+			COL_STRING_DISPLAY_NAME, &display_name,
+			-1);
+
+		if (full_name && !g_hash_table_contains (seen, full_name) &&
+		    g_strcmp0 (display_name, fi->display_name) == 0 &&
+		    g_hash_table_lookup_extended (si->full_hash, full_name, &old_key, &value) &&
+		    gtk_tree_row_reference_valid (value)) {
+			reference = value;
+
+			/* The row reference moves to the new full name. */
+			g_hash_table_steal (si->full_hash, full_name);
+			g_hash_table_insert (si->full_hash, g_strdup (fi->full_name), reference);
+			g_hash_table_remove (si->full_hash_unread, full_name);
+			g_hash_table_remove (si->full_hash_unread, fi->full_name);
+			g_free (old_key);
+
+			gtk_tree_store_set (
+				GTK_TREE_STORE (model), &child,
+				COL_STRING_FULL_NAME, fi->full_name,
+				-1);
+		}
+
+		g_free (full_name);
+		g_free (display_name);
+
+		valid = gtk_tree_model_iter_next (tree_model, &child);
+	}
+
+	return reference;
+}
+
+static void
+folder_tree_model_reconcile_level (EMFolderTreeModel *model,
+                                   StoreInfo *si,
+                                   GtkTreeIter *parent,
+                                   CamelFolderInfo *fi,
+                                   GHashTable *seen)
+{
+	GtkTreeModel *tree_model = GTK_TREE_MODEL (model);
+	gboolean store_is_local;
+
+	store_is_local = g_strcmp0 (
+		camel_service_get_uid (CAMEL_SERVICE (si->store)),
+		E_MAIL_SESSION_LOCAL_UID) == 0;
+
+	for (; fi; fi = fi->next) {
+		GtkTreeRowReference *reference;
+		GtkTreePath *path;
+		GtkTreeIter iter;
+		gboolean load_subdirs = FALSE;
+		gboolean is_drafts = FALSE;
+		gchar *display_name = NULL;
+		gchar *icon_name = NULL;
+		guint32 flags = 0;
+		guint unread = 0, unread_last_sel = 0;
+
+		reference = g_hash_table_lookup (si->full_hash, fi->full_name);
+		if (!gtk_tree_row_reference_valid (reference))
+			reference = folder_tree_model_reconcile_rename (model, si, parent, fi, seen);
+
+		if (!gtk_tree_row_reference_valid (reference)) {
+			/* A new folder, added together with its subfolders. */
+			gtk_tree_store_append (GTK_TREE_STORE (model), &iter, parent);
+			em_folder_tree_model_set_folder_info (model, &iter, si->store, fi, TRUE);
+			continue;
+		}
+
+		path = gtk_tree_row_reference_get_path (reference);
+		gtk_tree_model_get_iter (tree_model, &iter, path);
+		gtk_tree_path_free (path);
+
+		gtk_tree_model_get (
+			tree_model, &iter,
+			COL_BOOL_LOAD_SUBDIRS, &load_subdirs,
+			COL_BOOL_IS_DRAFT, &is_drafts,
+			COL_STRING_DISPLAY_NAME, &display_name,
+			COL_STRING_ICON_NAME, &icon_name,
+			COL_UINT_FLAGS, &flags,
+			COL_UINT_UNREAD, &unread,
+			COL_UINT_UNREAD_LAST_SEL, &unread_last_sel,
+			-1);
+
+		/* Drafts and Outbox show the total count, which
+		 * the folder info does not provide. */
+		if (fi->unread >= 0 && (guint) fi->unread != unread && !is_drafts &&
+		    (flags & CAMEL_FOLDER_TYPE_MASK) != CAMEL_FOLDER_TYPE_OUTBOX) {
+			gtk_tree_store_set (
+				GTK_TREE_STORE (model), &iter,
+				COL_UINT_UNREAD, (guint) fi->unread,
+				COL_UINT_UNREAD_LAST_SEL, MIN (unread_last_sel, (guint) fi->unread),
+				-1);
+		}
+
+		/* The local store shows its special folders with their
+		 * own names and types, which the folder info does not
+		 * have, and it does not change behind our back. */
+		if (!store_is_local && fi->display_name &&
+		    g_strcmp0 (display_name, fi->display_name) != 0) {
+			gtk_tree_store_set (
+				GTK_TREE_STORE (model), &iter,
+				COL_STRING_DISPLAY_NAME, fi->display_name,
+				-1);
+		}
+
+		if (!store_is_local && flags != fi->flags) {
+			gtk_tree_store_set (
+				GTK_TREE_STORE (model), &iter,
+				COL_UINT_FLAGS, fi->flags,
+				-1);
+
+			/* Only the icon of the folder type changes; Drafts,
+			 * Templates and custom icons are left alone. */
+			if (g_strcmp0 (icon_name, em_folder_utils_get_icon_name (flags)) == 0) {
+				gtk_tree_store_set (
+					GTK_TREE_STORE (model), &iter,
+					COL_STRING_ICON_NAME, em_folder_utils_get_icon_name (fi->flags),
+					-1);
+			}
+		}
+
+		g_free (display_name);
+		g_free (icon_name);
+
+		/* Subfolders not loaded yet are loaded on expand, as usual. */
+		if (!load_subdirs)
+			folder_tree_model_reconcile_level (model, si, &iter, fi->child, seen);
+	}
+}
+
+/* Applies only the differences between the rows of the store and
+ * the @fi tree, thus the rows of the existing folders, with their
+ * expanded state, are preserved. */
+static void
+folder_tree_model_reconcile (EMFolderTreeModel *model,
+                             StoreInfo *si,
+                             CamelFolderInfo *fi)
+{
+	GtkTreeModel *tree_model = GTK_TREE_MODEL (model);
+	GtkTreePath *path;
+	GtkTreeIter root;
+	GHashTable *seen;
+	GHashTableIter iter;
+	GSList *removed = NULL, *link;
+	gpointer key;
+
+	if (!gtk_tree_row_reference_valid (si->row))
+		return;
+
+	path = gtk_tree_row_reference_get_path (si->row);
+	gtk_tree_model_get_iter (tree_model, &root, path);
+	gtk_tree_path_free (path);
+
+	/* All the full names are known upfront, thus the rows of
+	 * vanished folders can be told apart when matching renames. */
+	seen = g_hash_table_new (g_str_hash, g_str_equal);
+	folder_tree_model_reconcile_mark_seen (seen, fi);
+
+	folder_tree_model_reconcile_level (model, si, &root, fi, seen);
+
+	g_hash_table_iter_init (&iter, si->full_hash);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (!g_hash_table_contains (seen, key))
+			removed = g_slist_prepend (removed, g_strdup (key));
+	}
+
+	g_hash_table_destroy (seen);
+
+	for (link = removed; link; link = g_slist_next (link)) {
+		GtkTreeRowReference *reference;
+		GtkTreeIter row;
+
+		/* Could be gone with its parent already. */
+		reference = g_hash_table_lookup (si->full_hash, link->data);
+		if (!gtk_tree_row_reference_valid (reference))
+			continue;
+
+		path = gtk_tree_row_reference_get_path (reference);
+		gtk_tree_model_get_iter (tree_model, &row, path);
+		gtk_tree_path_free (path);
+
+		folder_tree_model_remove_folders (model, si, &row);
+	}
+
+	g_slist_free_full (removed, g_free);
+}
+
+typedef struct _ReconcileData {
+	EMFolderTreeModel *model;
+	StoreInfo *si;
+} ReconcileData;
+
+static void folder_tree_model_reconcile_store (EMFolderTreeModel *model,
+					       StoreInfo *si);
+
+static void
+folder_tree_model_reconcile_got_info_cb (GObject *source_object,
+                                         GAsyncResult *result,
+                                         gpointer user_data)
+{
+	ReconcileData *rd = user_data;
+	CamelFolderInfo *fi;
+	StoreInfo *current_si;
+	GError *error = NULL;
+
+	fi = camel_store_get_folder_info_finish (CAMEL_STORE (source_object), result, &error);
+
+	current_si = folder_tree_model_store_index_lookup (rd->model, rd->si->store);
+
+	/* Skip when cancelled, or when the store was removed or re-added meanwhile. */
+	if (current_si == rd->si && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_clear_object (&rd->si->reconcile_cancellable);
+
+		if (error) {
+			g_warning ("%s: Failed to get folder info for '%s': %s", G_STRFUNC,
+				camel_service_get_display_name (CAMEL_SERVICE (rd->si->store)), error->message);
+		} else {
+			folder_tree_model_reconcile (rd->model, rd->si, fi);
+			em_folder_tree_model_save_snapshot (rd->model, rd->si->store, fi);
+		}
+
+		if (rd->si->reconcile_again) {
+			rd->si->reconcile_again = FALSE;
+			folder_tree_model_reconcile_store (rd->model, rd->si);
+		}
+	}
+
+	if (current_si)
+		store_info_unref (current_si);
+
+	camel_folder_info_free (fi);
+	g_clear_error (&error);
+
+	store_info_unref (rd->si);
+	g_object_unref (rd->model);
+	g_slice_free (ReconcileData, rd);
+}
+
+static void
+folder_tree_model_reconcile_store (EMFolderTreeModel *model,
+                                   StoreInfo *si)
+{
+	ReconcileData *rd;
+
+	/* Coalesce the requests while one is in progress. */
+	if (si->reconcile_cancellable) {
+		si->reconcile_again = TRUE;
+		return;
+	}
+
+	si->reconcile_cancellable = g_cancellable_new ();
+
+	rd = g_slice_new0 (ReconcileData);
+	rd->model = g_object_ref (model);
+	rd->si = store_info_ref (si);
+
+	camel_store_get_folder_info (
+		si->store, NULL,
+		CAMEL_STORE_FOLDER_INFO_FAST |
+		CAMEL_STORE_FOLDER_INFO_RECURSIVE |
+		CAMEL_STORE_FOLDER_INFO_SUBSCRIBED,
+		G_PRIORITY_DEFAULT, si->reconcile_cancellable,
+		folder_tree_model_reconcile_got_info_cb, rd);
+}
+
 static void
 folder_tree_model_folder_info_stale_cb (CamelStore *store,
                                         StoreInfo *si)
 {
 	GtkTreeModel *model;
+	GtkTreePath *path;
+	GtkTreeIter root;
+	gboolean load_subdirs = TRUE;
 
 	if (!gtk_tree_row_reference_valid (si->row))
 		return;
 
 	model = gtk_tree_row_reference_get_model (si->row);
 
-	/* Re-add the store.  The StoreInfo instance will be
-	 * discarded and the folder tree will be reconstructed. */
-	em_folder_tree_model_add_store (EM_FOLDER_TREE_MODEL (model), store);
+	path = gtk_tree_row_reference_get_path (si->row);
+	gtk_tree_model_get_iter (model, &root, path);
+	gtk_tree_path_free (path);
+
+	gtk_tree_model_get (model, &root, COL_BOOL_LOAD_SUBDIRS, &load_subdirs, -1);
+
+	/* Nothing loaded yet, the folders will be read on expand. */
+	if (load_subdirs)
+		return;
+
+	folder_tree_model_reconcile_store (EM_FOLDER_TREE_MODEL (model), si);
 }
 
 static void
@@ -1644,6 +2054,7 @@ em_folder_tree_model_add_store (EMFolderTreeModel *model,
 	GtkTreePath *path;
 	CamelService *service;
 	CamelProvider *provider;
+	CamelFolderInfo *snapshot;
 	StoreInfo *si;
 	const gchar *display_name;
 
@@ -1709,15 +2120,85 @@ em_folder_tree_model_add_store (EMFolderTreeModel *model,
 		COL_BOOL_IS_DRAFT, FALSE,
 		-1);
 
+	snapshot = folder_tree_model_load_snapshot (store);
+	if (snapshot) {
+		CamelFolderInfo *fi;
+
+		/* Show the last known folders right away, instead of the
+		 * placeholder; the current ones are reconciled later. */
+		gtk_tree_store_remove (tree_store, &iter);
+
+		for (fi = snapshot; fi; fi = fi->next) {
+			gtk_tree_store_append (tree_store, &iter, &root);
+			em_folder_tree_model_set_folder_info (model, &iter, store, fi, TRUE);
+		}
+
+		gtk_tree_store_set (
+			tree_store, &root,
+			COL_BOOL_LOAD_SUBDIRS, FALSE, -1);
+
+		camel_folder_info_free (snapshot);
+	}
+
 	if (CAMEL_IS_NETWORK_SERVICE (store))
 		folder_tree_model_update_status_icon (si);
 
 	g_signal_emit (model, signals[LOADED_ROW], 0, path, &root);
 	gtk_tree_path_free (path);
 
+	if (snapshot)
+		folder_tree_model_reconcile_store (model, si);
+
 	store_info_unref (si);
 }
 
+/**
+ * em_folder_tree_model_save_snapshot:
+ * @model: an #EMFolderTreeModel
+ * @store: a #CamelStore
+ * @folder_info: (nullable): the complete folder info tree of the @store
+ *
+ * Remembers the @folder_info tree, to be shown when the @store is added
+ * next time, before its current folder info is received.
+ *
+ * Since: 3.24
+ **/
+void
+em_folder_tree_model_save_snapshot (EMFolderTreeModel *model,
+                                    CamelStore *store,
+                                    CamelFolderInfo *folder_info)
+{
+	GString *contents;
+	gchar *filename, *dirname;
+	GError *error = NULL;
+
+	g_return_if_fail (EM_IS_FOLDER_TREE_MODEL (model));
+	g_return_if_fail (CAMEL_IS_STORE (store));
+
+	filename = folder_tree_model_dup_snapshot_filename (store);
+
+	if (!folder_info) {
+		g_unlink (filename);
+		g_free (filename);
+		return;
+	}
+
+	contents = g_string_new ("");
+	folder_tree_model_snapshot_append (contents, folder_info);
+
+	dirname = g_path_get_dirname (filename);
+	g_mkdir_with_parents (dirname, 0700);
+
+	if (!g_file_set_contents (filename, contents->str, contents->len, &error)) {
+		g_warning ("%s: Failed to save '%s': %s", G_STRFUNC, filename, error ? error->message : "Unknown error");
+		g_clear_error (&error);
+	}
+
+	g_string_free (contents, TRUE);
+	g_free (dirname);
+	g_free (filename);
+}
+
 void
 em_folder_tree_model_remove_store (EMFolderTreeModel *model,
                                    CamelStore *store)
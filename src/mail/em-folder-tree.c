@@ -281,6 +281,11 @@ folder_tree_get_folder_info_cb (CamelStore *store,
 	 * subscribed to any folders yet, folder_info may legitimately be
 	 * NULL at this point.  We handle that case below.  Proceed. */
 
+	/* The whole store was read, remember it for the next start. */
+	if (is_store)
+		em_folder_tree_model_save_snapshot (
+			EM_FOLDER_TREE_MODEL (model), store, folder_info);
+
 	/* Make sure we still need to load the tree subfolders. */
 
 	iter_is_placeholder = FALSE;
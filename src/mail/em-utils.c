@@ -408,121 +408,357 @@ em_utils_flag_for_followup_completed (GtkWindow *parent,
 
 /* This kind of sucks, because for various reasons most callers need to run
  * synchronously in the gui thread, however this could take a long, blocking
- * time to run. */
+ * time to run.  The messages are at least retrieved a few at once. */
 static gint
 em_utils_write_messages_to_stream (CamelFolder *folder,
                                    GPtrArray *uids,
-                                   CamelStream *stream)
+                                   GOutputStream *stream)
 {
-	CamelStream *filtered_stream;
-	CamelMimeFilter *from_filter;
-	gint i, res = 0;
+	if (!e_mail_folder_write_mbox_sync (folder, uids, stream, NULL, NULL))
+		return -1;
 
-	from_filter = camel_mime_filter_from_new ();
-	filtered_stream = camel_stream_filter_new (stream);
-	camel_stream_filter_add (
-		CAMEL_STREAM_FILTER (filtered_stream), from_filter);
-	g_object_unref (from_filter);
+	return 0;
+}
 
-	for (i = 0; i < uids->len; i++) {
-		CamelMimeMessage *message;
-		gchar *from;
-
-		/* FIXME camel_folder_get_message_sync() may block. */
-		message = camel_folder_get_message_sync (
-			folder, uids->pdata[i], NULL, NULL);
-		if (message == NULL) {
-			res = -1;
-			break;
-		}
+/* How many messages can be fetched and parsed ahead
+ * of the one being printed by em_utils_print_messages_to_files(). */
+#define PRINT_PARSE_AHEAD 4
 
-		/* We need to flush after each stream write since we are
-		 * writing to the same stream. */
-		from = camel_mime_message_build_mbox_from (message);
+typedef struct _PrintBatch {
+	CamelFolder *folder;
+	EMailParser *parser;
+	EMailRemoteContent *remote_content;
+	GPtrArray *uids;
+	GPtrArray *filenames;
+	EMailPartList **part_lists;	/* NULL until parsed, or on failure */
+	gboolean *parsed;
+	guint next_parse;
+	guint next_print;
+	gboolean printing;
+	gboolean done;
+	GPtrArray *written;
+	EMUtilsPrintProgressFunc progress_func;
+	gpointer progress_data;
+} PrintBatch;
+
+typedef struct _PrintBatchParse {
+	PrintBatch *batch;	/* kept alive by the batch task */
+	guint index;
+} PrintBatchParse;
+
+static void print_batch_continue (GTask *task);
 
-		if (camel_stream_write_string (stream, from, NULL, NULL) == -1
-		    || camel_stream_flush (stream, NULL, NULL) == -1
-		    || camel_data_wrapper_write_to_stream_sync (
-			(CamelDataWrapper *) message, (CamelStream *)
-			filtered_stream, NULL, NULL) == -1
-		    || camel_stream_flush (
-			(CamelStream *) filtered_stream, NULL, NULL) == -1)
-			res = -1;
+static void
+print_batch_free (PrintBatch *batch)
+{
+	guint ii;
 
-		g_free (from);
-		g_object_unref (message);
+	for (ii = 0; ii < batch->uids->len; ii++)
+		g_clear_object (&batch->part_lists[ii]);
 
-		if (res == -1)
-			break;
-	}
+	g_clear_object (&batch->folder);
+	g_clear_object (&batch->parser);
+	g_clear_object (&batch->remote_content);
+	g_ptr_array_unref (batch->uids);
+	g_ptr_array_unref (batch->filenames);
+	g_ptr_array_unref (batch->written);
+	g_free (batch->part_lists);
+	g_free (batch->parsed);
 
-	g_object_unref (filtered_stream);
+	g_slice_free (PrintBatch, batch);
+}
 
-	return res;
+static void
+print_batch_parse_free (PrintBatchParse *parse)
+{
+	g_slice_free (PrintBatchParse, parse);
 }
 
-static gboolean
-em_utils_print_messages_to_file (CamelFolder *folder,
-                                 const gchar *uid,
-                                 const gchar *filename)
+static void
+print_batch_parse_thread (GTask *task,
+                          gpointer source_object,
+                          gpointer task_data,
+                          GCancellable *cancellable)
 {
-	EMailParser *parser;
-	EMailPartList *parts_list;
+	PrintBatchParse *parse = task_data;
+	PrintBatch *batch = parse->batch;
 	CamelMimeMessage *message;
-	CamelStore *parent_store;
-	CamelSession *session;
-	gboolean success = FALSE;
+	EMailPartList *part_list = NULL;
+	const gchar *uid;
 
-	message = camel_folder_get_message_sync (folder, uid, NULL, NULL);
-	if (message == NULL)
-		return FALSE;
+	uid = g_ptr_array_index (batch->uids, parse->index);
 
-	parent_store = camel_folder_get_parent_store (folder);
-	session = camel_service_ref_session (CAMEL_SERVICE (parent_store));
+	message = camel_folder_get_message_sync (
+		batch->folder, uid, cancellable, NULL);
 
-	parser = e_mail_parser_new (session);
+	if (message != NULL) {
+		part_list = e_mail_parser_parse_sync (
+			batch->parser, batch->folder, uid,
+			message, cancellable);
+		g_object_unref (message);
+	}
 
-	/* XXX em_utils_selection_set_urilist() is synchronous,
-	 *     so this function has to be synchronous as well.
-	 *     That means potentially blocking for awhile. */
-	parts_list = e_mail_parser_parse_sync (
-		parser, folder, uid, message, NULL);
-	if (parts_list != NULL) {
-		EMailBackend *mail_backend;
-		EAsyncClosure *closure;
-		GAsyncResult *result;
-		EMailPrinter *printer;
-		GtkPrintOperationResult print_result;
+	/* A message which failed is skipped, like before. */
+	g_task_return_pointer (task, part_list, g_object_unref);
+}
 
-		mail_backend = E_MAIL_BACKEND (e_shell_get_backend_by_name (e_shell_get_default (), "mail"));
-		g_return_val_if_fail (mail_backend != NULL, FALSE);
+static void
+print_batch_parsed_cb (GObject *source_object,
+                       GAsyncResult *result,
+                       gpointer user_data)
+{
+	GTask *task = user_data;
+	PrintBatch *batch;
+	PrintBatchParse *parse;
 
-		printer = e_mail_printer_new (parts_list, e_mail_backend_get_remote_content (mail_backend));
-		e_mail_printer_set_export_filename (printer, filename);
+	batch = g_task_get_task_data (task);
+	parse = g_task_get_task_data (G_TASK (result));
 
-		closure = e_async_closure_new ();
+	batch->part_lists[parse->index] =
+		g_task_propagate_pointer (G_TASK (result), NULL);
+	batch->parsed[parse->index] = TRUE;
 
-		e_mail_printer_print (
-			printer, GTK_PRINT_OPERATION_ACTION_EXPORT,
-			NULL, NULL, e_async_closure_callback, closure);
+	print_batch_continue (task);
 
-		result = e_async_closure_wait (closure);
+	g_object_unref (task);
+}
 
-		print_result = e_mail_printer_print_finish (
-			printer, result, NULL);
+static void
+print_batch_advance (GTask *task)
+{
+	PrintBatch *batch;
+	GCancellable *cancellable;
 
-		e_async_closure_free (closure);
+	batch = g_task_get_task_data (task);
+	cancellable = g_task_get_cancellable (task);
+
+	batch->next_print++;
+
+	if (CAMEL_IS_OPERATION (cancellable))
+		camel_operation_progress (
+			cancellable,
+			batch->next_print * 100 / batch->uids->len);
+
+	if (batch->progress_func != NULL)
+		batch->progress_func (
+			batch->next_print, batch->uids->len,
+			batch->progress_data);
+}
+
+static void
+print_batch_printed_cb (GObject *source_object,
+                        GAsyncResult *result,
+                        gpointer user_data)
+{
+	GTask *task = user_data;
+	PrintBatch *batch;
+	GtkPrintOperationResult print_result;
 
-		g_object_unref (printer);
-		g_object_unref (parts_list);
+	batch = g_task_get_task_data (task);
+
+	print_result = e_mail_printer_print_finish (
+		E_MAIL_PRINTER (source_object), result, NULL);
+
+	if (print_result != GTK_PRINT_OPERATION_RESULT_ERROR)
+		g_ptr_array_add (
+			batch->written,
+			g_strdup (g_ptr_array_index (
+			batch->filenames, batch->next_print)));
+
+	batch->printing = FALSE;
+
+	print_batch_advance (task);
+	print_batch_continue (task);
+
+	g_object_unref (task);
+}
+
+static void
+print_batch_print (GTask *task,
+                   EMailPartList *part_list)
+{
+	PrintBatch *batch;
+	EMailPrinter *printer;
 
-		success = (print_result != GTK_PRINT_OPERATION_RESULT_ERROR);
+	batch = g_task_get_task_data (task);
+
+	printer = e_mail_printer_new (part_list, batch->remote_content);
+	e_mail_printer_set_export_filename (
+		printer, g_ptr_array_index (batch->filenames, batch->next_print));
+
+	batch->printing = TRUE;
+
+	e_mail_printer_print (
+		printer, GTK_PRINT_OPERATION_ACTION_EXPORT, NULL,
+		g_task_get_cancellable (task),
+		print_batch_printed_cb, g_object_ref (task));
+
+	g_object_unref (printer);
+}
+
+/* Messages are printed one after another, in the order of the UIDs,
+ * while the next few of them are fetched and parsed in threads. */
+static void
+print_batch_continue (GTask *task)
+{
+	PrintBatch *batch;
+	GCancellable *cancellable;
+
+	batch = g_task_get_task_data (task);
+	cancellable = g_task_get_cancellable (task);
+
+	if (batch->done)
+		return;
+
+	if (g_cancellable_is_cancelled (cancellable)) {
+		/* Let the current print operation finish first. */
+		if (!batch->printing) {
+			batch->done = TRUE;
+			g_task_return_error_if_cancelled (task);
+		}
+		return;
 	}
 
-	g_object_unref (parser);
+	while (!batch->printing &&
+	       batch->next_print < batch->uids->len &&
+	       batch->parsed[batch->next_print]) {
+		EMailPartList *part_list;
+
+		part_list = batch->part_lists[batch->next_print];
+		batch->part_lists[batch->next_print] = NULL;
+
+		if (part_list != NULL) {
+			print_batch_print (task, part_list);
+			g_object_unref (part_list);
+		} else {
+			print_batch_advance (task);
+		}
+	}
+
+	while (batch->next_parse < batch->uids->len &&
+	       batch->next_parse - batch->next_print < PRINT_PARSE_AHEAD) {
+		PrintBatchParse *parse;
+		GTask *parse_task;
+
+		parse = g_slice_new0 (PrintBatchParse);
+		parse->batch = batch;
+		parse->index = batch->next_parse++;
+
+		parse_task = g_task_new (
+			batch->folder, cancellable,
+			print_batch_parsed_cb, g_object_ref (task));
+		g_task_set_task_data (
+			parse_task, parse,
+			(GDestroyNotify) print_batch_parse_free);
+		g_task_run_in_thread (parse_task, print_batch_parse_thread);
+		g_object_unref (parse_task);
+	}
+
+	if (!batch->printing && batch->next_print == batch->uids->len) {
+		batch->done = TRUE;
+		g_task_return_pointer (
+			task, g_ptr_array_ref (batch->written),
+			(GDestroyNotify) g_ptr_array_unref);
+	}
+}
+
+/**
+ * em_utils_print_messages_to_files:
+ * @folder: a #CamelFolder
+ * @uids: UIDs of the messages to print
+ * @filenames: PDF file names, one for each of the @uids
+ * @progress_func: (nullable): function to call after each message, or %NULL
+ * @progress_data: user data for @progress_func
+ * @cancellable: (nullable): optional #GCancellable object, or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: data to pass to the callback function
+ *
+ * Asynchronously prints the messages into PDF files.  The messages are
+ * fetched and parsed in dedicated threads, a few ahead of the one being
+ * printed, and the print renderers are reused between the messages.
+ * Messages which cannot be fetched or printed are skipped.
+ *
+ * When the operation is finished, @callback will be called.  You can
+ * then call em_utils_print_messages_to_files_finish() to get the result.
+ **/
+void
+em_utils_print_messages_to_files (CamelFolder *folder,
+                                  GPtrArray *uids,
+                                  GPtrArray *filenames,
+                                  EMUtilsPrintProgressFunc progress_func,
+                                  gpointer progress_data,
+                                  GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data)
+{
+	GTask *task;
+	PrintBatch *batch;
+	EMailBackend *mail_backend;
+	CamelStore *parent_store;
+	CamelSession *session;
+	guint ii;
+
+	g_return_if_fail (CAMEL_IS_FOLDER (folder));
+	g_return_if_fail (uids != NULL);
+	g_return_if_fail (filenames != NULL);
+	g_return_if_fail (uids->len == filenames->len);
+
+	mail_backend = E_MAIL_BACKEND (e_shell_get_backend_by_name (e_shell_get_default (), "mail"));
+	g_return_if_fail (mail_backend != NULL);
+
+	parent_store = camel_folder_get_parent_store (folder);
+	session = camel_service_ref_session (CAMEL_SERVICE (parent_store));
+
+	batch = g_slice_new0 (PrintBatch);
+	batch->folder = g_object_ref (folder);
+	batch->parser = e_mail_parser_new (session);
+	batch->remote_content = g_object_ref (e_mail_backend_get_remote_content (mail_backend));
+	batch->uids = g_ptr_array_new_with_free_func (g_free);
+	batch->filenames = g_ptr_array_new_with_free_func (g_free);
+	batch->written = g_ptr_array_new_with_free_func (g_free);
+	batch->part_lists = g_new0 (EMailPartList *, uids->len);
+	batch->parsed = g_new0 (gboolean, uids->len);
+	batch->progress_func = progress_func;
+	batch->progress_data = progress_data;
+
+	for (ii = 0; ii < uids->len; ii++) {
+		g_ptr_array_add (batch->uids, g_strdup (uids->pdata[ii]));
+		g_ptr_array_add (batch->filenames, g_strdup (filenames->pdata[ii]));
+	}
+
+	task = g_task_new (folder, cancellable, callback, user_data);
+	g_task_set_source_tag (task, em_utils_print_messages_to_files);
+	g_task_set_task_data (task, batch, (GDestroyNotify) print_batch_free);
+
+	print_batch_continue (task);
+
+	g_object_unref (task);
 	g_object_unref (session);
+}
 
-	return success;
+/**
+ * em_utils_print_messages_to_files_finish:
+ * @folder: a #CamelFolder
+ * @result: a #GAsyncResult
+ * @error: return location for a #GError, or %NULL
+ *
+ * Finishes the operation started with em_utils_print_messages_to_files().
+ *
+ * Returns: (transfer full): file names of the written PDF files, or %NULL
+ *    on error; free with g_ptr_array_unref() when no longer needed
+ **/
+GPtrArray *
+em_utils_print_messages_to_files_finish (CamelFolder *folder,
+                                         GAsyncResult *result,
+                                         GError **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, folder), NULL);
+
+	g_return_val_if_fail (
+		g_async_result_is_tagged (
+		result, em_utils_print_messages_to_files), NULL);
+
+	return g_task_propagate_pointer (G_TASK (result), error);
 }
 
 /* This kind of sucks, because for various reasons most callers need to run
@@ -599,19 +835,20 @@ em_utils_selection_set_mailbox (GtkSelectionData *data,
                                 CamelFolder *folder,
                                 GPtrArray *uids)
 {
-	GByteArray *byte_array;
-	CamelStream *stream;
+	GOutputStream *stream;
 	GdkAtom target;
 
 	target = gtk_selection_data_get_target (data);
 
-	byte_array = g_byte_array_new ();
-	stream = camel_stream_mem_new_with_byte_array (byte_array);
+	stream = g_memory_output_stream_new_resizable ();
 
 	if (em_utils_write_messages_to_stream (folder, uids, stream) == 0)
 		gtk_selection_data_set (
 			data, target, 8,
-			byte_array->data, byte_array->len);
+			g_memory_output_stream_get_data (
+				G_MEMORY_OUTPUT_STREAM (stream)),
+			g_memory_output_stream_get_data_size (
+				G_MEMORY_OUTPUT_STREAM (stream)));
 
 	g_object_unref (stream);
 }
@@ -941,9 +1178,11 @@ em_utils_selection_set_urilist (GtkSelectionData *data,
 	g_object_unref (settings);
 
 	if (save_as_mbox) {
-		CamelStream *fstream;
+		GFileOutputStream *fstream;
+		GFile *file;
 		gchar *basename;
 		gchar *filename;
+		gboolean written = FALSE;
 
 		if (uids->len > 1) {
 			basename = g_strdup_printf (
@@ -962,13 +1201,21 @@ em_utils_selection_set_urilist (GtkSelectionData *data,
 			O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0666);
 		if (fd == -1) {
 			g_free (filename);
+			g_rmdir (tmpdir);
 			goto exit;
 		}
 
+		/* The file is created above to claim the name. */
+		close (fd);
+
 		uri = g_filename_to_uri (filename, NULL, NULL);
-		fstream = camel_stream_fs_new_with_fd (fd);
+		file = g_file_new_for_path (filename);
+		fstream = g_file_append_to (file, G_FILE_CREATE_NONE, NULL, NULL);
+		g_object_unref (file);
 		if (fstream != NULL) {
-			if (em_utils_write_messages_to_stream (folder, uids, fstream) == 0) {
+			written = em_utils_write_messages_to_stream (
+				folder, uids, G_OUTPUT_STREAM (fstream)) == 0;
+			if (written) {
 				GdkAtom type;
 				gchar *uri_crlf;
 
@@ -983,22 +1230,30 @@ em_utils_selection_set_urilist (GtkSelectionData *data,
 				g_free (uri_crlf);
 			}
 			g_object_unref (fstream);
-		} else
-			close (fd);
+		}
+
+		/* Do not leave the claimed file behind on failure. */
+		if (!written) {
+			g_unlink (filename);
+			g_rmdir (tmpdir);
+		}
 
 		g_free (filename);
 		g_free (uri);
 
 	} else {  /* save as pdf */
+		EAsyncClosure *closure;
+		GAsyncResult *result;
+		GPtrArray *filenames;
+		GPtrArray *written;
 		gchar **uris;
-		guint n_uris = 0;
 		guint ii;
 
-		uris = g_new0 (gchar *, uids->len + 1);
+		filenames = g_ptr_array_new_with_free_func (g_free);
+
 		for (ii = 0; ii < uids->len; ii++) {
 			gchar *basename;
 			gchar *filename;
-			gboolean success;
 
 			basename = em_utils_build_export_basename (
 				folder, uids->pdata[ii], ".pdf");
@@ -1011,28 +1266,71 @@ em_utils_selection_set_urilist (GtkSelectionData *data,
 				filename,
 				O_WRONLY | O_CREAT | O_EXCL | O_BINARY, 0666);
 			if (fd == -1) {
-				g_strfreev (uris);
+				guint jj;
+
+				for (jj = 0; jj < filenames->len; jj++)
+					g_unlink (filenames->pdata[jj]);
+				g_ptr_array_unref (filenames);
 				g_free (filename);
+				g_rmdir (tmpdir);
 				goto exit;
 			}
 			close (fd);
 
-			/* export */
-			success = em_utils_print_messages_to_file (
-				folder, uids->pdata[ii], filename);
-			if (success) {
-				/* terminate with \r\n to be compliant with the spec */
-				uri = g_filename_to_uri (filename, NULL, NULL);
-				uris[n_uris++] = g_strconcat (uri, "\r\n", NULL);
-				g_free (uri);
-			}
+			g_ptr_array_add (filenames, filename);
+		}
 
-			g_free (filename);
+		/* XXX The selection data has to be set before returning,
+		 *     thus wait for the export here, even though it is
+		 *     asynchronous.  The wait runs a private main context,
+		 *     not to dispatch other events, like another drag,
+		 *     from within this drag-data-get handler. */
+		closure = e_async_closure_new ();
+
+		em_utils_print_messages_to_files (
+			folder, uids, filenames, NULL, NULL, NULL,
+			e_async_closure_callback, closure);
+
+		result = e_async_closure_wait (closure);
+
+		written = em_utils_print_messages_to_files_finish (
+			folder, result, NULL);
+
+		e_async_closure_free (closure);
+
+		uris = g_new0 (gchar *, (written ? written->len : 0) + 1);
+
+		for (ii = 0; written != NULL && ii < written->len; ii++) {
+			/* terminate with \r\n to be compliant with the spec */
+			uri = g_filename_to_uri (written->pdata[ii], NULL, NULL);
+			uris[ii] = g_strconcat (uri, "\r\n", NULL);
+			g_free (uri);
 		}
 
 		gtk_selection_data_set_uris (data, uris);
 
 		g_strfreev (uris);
+
+		/* Remove the files claimed for messages, which could
+		 * not be exported, thus no empty file is dropped. */
+		for (ii = 0; ii < filenames->len; ii++) {
+			const gchar *filename = filenames->pdata[ii];
+			gboolean was_written = FALSE;
+			guint jj;
+
+			for (jj = 0; written != NULL && jj < written->len && !was_written; jj++)
+				was_written = g_strcmp0 (written->pdata[jj], filename) == 0;
+
+			if (!was_written)
+				g_unlink (filename);
+		}
+
+		/* Fails unless it is empty. */
+		g_rmdir (tmpdir);
+
+		if (written != NULL)
+			g_ptr_array_unref (written);
+		g_ptr_array_unref (filenames);
 	}
 
 exit:
@@ -57,6 +57,24 @@ void em_utils_selection_get_uidlist (GtkSelectionData *data, EMailSession *sessi
 void em_utils_selection_set_urilist (GtkSelectionData *data, CamelFolder *folder, GPtrArray *uids);
 void em_utils_selection_get_urilist (GtkSelectionData *data, CamelFolder *folder);
 
+typedef void	(*EMUtilsPrintProgressFunc)	(guint n_done,
+						 guint n_total,
+						 gpointer user_data);
+
+void		em_utils_print_messages_to_files
+						(CamelFolder *folder,
+						 GPtrArray *uids,
+						 GPtrArray *filenames,
+						 EMUtilsPrintProgressFunc progress_func,
+						 gpointer progress_data,
+						 GCancellable *cancellable,
+						 GAsyncReadyCallback callback,
+						 gpointer user_data);
+GPtrArray *	em_utils_print_messages_to_files_finish
+						(CamelFolder *folder,
+						 GAsyncResult *result,
+						 GError **error);
+
 /* FIXME: should this have an override charset? */
 gchar *		em_utils_message_to_html	(CamelSession *session,
 						 CamelMimeMessage *msg,
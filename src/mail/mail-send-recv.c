@@ -1400,6 +1400,7 @@ receive_update_got_folderinfo (GObject *source_object,
 		m->info = send_info;
 		m->finfo = info;  /* takes ownership */
 
+		mail_msg_set_store (m, m->store);
 		mail_msg_unordered_push (m);
 
 	} else {
@@ -1511,6 +1512,7 @@ maybe_delete_junk_or_expunge_local_store (EMailSession *session)
 	m->delete_junk = delete_junk;
 	m->expunge_trash = expunge_trash;
 
+	mail_msg_set_store (m, m->store);
 	mail_msg_unordered_push (m);
 }
 
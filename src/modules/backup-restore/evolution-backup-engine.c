@@ -0,0 +1,1824 @@
+/*
+ * evolution-backup-engine.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Writes the back up as a tar archive, compressed with gzip or xz.
+ *
+ * The tar stream is split into chunks, which are compressed independently
+ * in a thread pool and written in order, each as a separate gzip member or
+ * xz stream.  Both formats decompress such concatenation as one stream,
+ * thus the result can be read by the usual tools.
+ *
+ * An index of the written chunks is saved beside the archive, thus the next
+ * back up copies compressed chunks of unchanged files from the previous
+ * archive instead of reading and compressing the files again. */
+
+#include "evolution-config.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+
+#include <sqlite3.h>
+
+#include "evolution-backup-engine.h"
+
+/* A chunk is closed when it grows over CHUNK_MAX_SIZE, or over
+ * CHUNK_MIN_SIZE after an entry whose name hash hits the boundary
+ * mask, thus an added or removed file changes only its own chunk
+ * and the following chunks can still be reused. */
+#define CHUNK_MIN_SIZE (256 * 1024)
+#define CHUNK_MAX_SIZE (4 * 1024 * 1024)
+#define CHUNK_BOUNDARY_MASK 0x7
+
+/* How many times a file, which changed while being read, is stored;
+ * the back up fails when it is still changing after that. */
+#define MAX_READ_ATTEMPTS 3
+
+/* How long to wait for a busy SQLite database, in milliseconds. */
+#define SQLITE_BUSY_TIMEOUT 5000
+
+#define TAR_BLOCK_SIZE 512
+#define TAR_TYPE_FILE '0'
+#define TAR_TYPE_DIRECTORY '5'
+#define TAR_TYPE_LONG_NAME 'L'
+
+#define INDEX_HEADER "evolution-backup-index 1"
+
+#define READ_BUFFER_SIZE 65536
+
+/* Returns the file name the archive member was restored to,
+ * or NULL when the member should not be verified. */
+typedef gchar *	(*BackupEngineMapFunc)		(const gchar *member_name,
+						 gpointer user_data);
+
+typedef struct _BackupEntry {
+	gchar *name;
+	gchar *filename;
+	gchar type;
+	guint32 mode;
+	guint32 uid;
+	guint32 gid;
+	guint64 size;
+	gint64 mtime;
+	guint attempt;
+
+	/* The file is a private snapshot of an SQLite database,
+	 * thus it cannot change while being read. */
+	gboolean snapshot;
+
+	/* Range of the file data stored in the chunk;
+	 * large files are split into more chunks. */
+	guint64 piece_start;
+	guint64 piece_end;
+} BackupEntry;
+
+typedef struct _BackupChunk {
+	gchar *key;
+	GPtrArray *entries;
+	gsize size;
+
+	GByteArray *data;
+	GBytes *compressed;
+	GError *error;
+	gboolean done;
+
+	gboolean reuse;
+	goffset reuse_offset;
+	gsize reuse_length;
+} BackupChunk;
+
+typedef struct _IndexChunk {
+	goffset offset;
+	gsize length;
+} IndexChunk;
+
+typedef struct _IndexFile {
+	guint64 size;
+	gint64 mtime;
+	gchar *checksum;
+} IndexFile;
+
+typedef struct _BackupEngine {
+	gboolean use_xz;
+	gint64 start_time;
+	GCancellable *cancellable;
+
+	/* The previous archive and its content. */
+	GInputStream *prev_stream;
+	GHashTable *prev_chunks; /* gchar *key ~> IndexChunk * */
+	GHashTable *prev_files; /* gchar *name ~> IndexFile * */
+
+	GOutputStream *output;
+	goffset output_offset;
+	GString *index_chunks;
+	GHashTable *index_files; /* gchar *name ~> IndexFile * */
+
+	GHashTable *manifest; /* gchar *name ~> gchar *checksum */
+	GHashTable *excludes;
+	GHashTable *visited_dirs;
+	GPtrArray *retry; /* BackupEntry * */
+
+	gchar *snapshot_dir;
+	guint n_snapshots;
+
+	BackupChunk *current;
+
+	/* The file being read, which can span more chunks. */
+	GInputStream *file_stream;
+	GChecksum *file_checksum;
+	gboolean file_changed;
+	gboolean file_unreadable;
+
+	GThreadPool *pool;
+	GMutex lock;
+	GCond cond;
+	GQueue pending; /* BackupChunk *, in the archive order */
+	guint max_pending;
+} BackupEngine;
+
+static BackupEntry *
+backup_entry_new (const gchar *name,
+                  const gchar *filename,
+                  gchar type,
+                  const GStatBuf *st,
+                  guint attempt)
+{
+	BackupEntry *entry;
+
+	entry = g_slice_new0 (BackupEntry);
+	entry->name = g_strdup (name);
+	entry->filename = g_strdup (filename);
+	entry->type = type;
+	entry->mode = st->st_mode & 07777;
+	entry->uid = st->st_uid;
+	entry->gid = st->st_gid;
+	entry->size = type == TAR_TYPE_FILE ? (guint64) st->st_size : 0;
+	entry->mtime = st->st_mtime;
+	entry->attempt = attempt;
+	entry->piece_start = 0;
+	entry->piece_end = entry->size;
+
+	return entry;
+}
+
+static BackupEntry *
+backup_entry_copy (const BackupEntry *src)
+{
+	BackupEntry *entry;
+
+	entry = g_slice_dup (BackupEntry, src);
+	entry->name = g_strdup (src->name);
+	entry->filename = g_strdup (src->filename);
+
+	return entry;
+}
+
+static void
+backup_entry_free (gpointer ptr)
+{
+	BackupEntry *entry = ptr;
+
+	if (entry) {
+		g_free (entry->name);
+		g_free (entry->filename);
+		g_slice_free (BackupEntry, entry);
+	}
+}
+
+static gsize
+backup_entry_get_archive_size (const BackupEntry *entry)
+{
+	gsize size = entry->piece_end - entry->piece_start;
+
+	if (entry->piece_start == 0) {
+		size += TAR_BLOCK_SIZE;
+
+		if (strlen (entry->name) >= 100)
+			size += 2 * TAR_BLOCK_SIZE + strlen (entry->name);
+	}
+
+	return size;
+}
+
+static BackupChunk *
+backup_chunk_new (void)
+{
+	BackupChunk *chunk;
+
+	chunk = g_slice_new0 (BackupChunk);
+	chunk->entries = g_ptr_array_new_with_free_func (backup_entry_free);
+
+	return chunk;
+}
+
+static void
+backup_chunk_free (gpointer ptr)
+{
+	BackupChunk *chunk = ptr;
+
+	if (chunk) {
+		g_free (chunk->key);
+		g_ptr_array_unref (chunk->entries);
+		if (chunk->data)
+			g_byte_array_unref (chunk->data);
+		if (chunk->compressed)
+			g_bytes_unref (chunk->compressed);
+		g_clear_error (&chunk->error);
+		g_slice_free (BackupChunk, chunk);
+	}
+}
+
+/* The key describes the chunk content; equal keys mean equal tar data. */
+static gchar *
+backup_chunk_compute_key (BackupChunk *chunk)
+{
+	GChecksum *checksum;
+	gchar *key;
+	guint ii;
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+	for (ii = 0; ii < chunk->entries->len; ii++) {
+		BackupEntry *entry = g_ptr_array_index (chunk->entries, ii);
+		gchar *str;
+
+		str = g_strdup_printf ("%c\t%o\t%u\t%u\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT
+			"\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT "\t",
+			entry->type, entry->mode, entry->uid, entry->gid, entry->size,
+			entry->mtime, entry->piece_start, entry->piece_end);
+
+		g_checksum_update (checksum, (const guchar *) entry->name, strlen (entry->name) + 1);
+		g_checksum_update (checksum, (const guchar *) str, -1);
+
+		g_free (str);
+	}
+
+	key = g_strdup (g_checksum_get_string (checksum));
+
+	g_checksum_free (checksum);
+
+	return key;
+}
+
+static void
+index_file_free (gpointer ptr)
+{
+	IndexFile *ifile = ptr;
+
+	if (ifile) {
+		g_free (ifile->checksum);
+		g_slice_free (IndexFile, ifile);
+	}
+}
+
+static void
+index_chunk_free (gpointer ptr)
+{
+	g_slice_free (IndexChunk, ptr);
+}
+
+static void
+tar_set_number (gchar *field,
+                gsize field_len,
+                guint64 value)
+{
+	/* Values not fitting into the octal digits use
+	 * the GNU base-256 encoding, as GNU tar does. */
+	if (value >> (3 * (field_len - 1))) {
+		gsize ii;
+
+		for (ii = field_len - 1; ii > 0; ii--) {
+			field[ii] = (gchar) (value & 0xFF);
+			value >>= 8;
+		}
+
+		field[0] = (gchar) 0x80;
+	} else {
+		g_snprintf (field, field_len, "%0*" G_GINT64_MODIFIER "o", (gint) field_len - 1, value);
+	}
+}
+
+static void
+tar_append_padding (GByteArray *data,
+                    guint64 size)
+{
+	static const guint8 zeros[TAR_BLOCK_SIZE] = { 0 };
+
+	if (size % TAR_BLOCK_SIZE)
+		g_byte_array_append (data, zeros, TAR_BLOCK_SIZE - (size % TAR_BLOCK_SIZE));
+}
+
+static void
+tar_append_header (GByteArray *data,
+                   const gchar *name,
+                   gchar type,
+                   guint32 mode,
+                   guint32 uid,
+                   guint32 gid,
+                   guint64 size,
+                   gint64 mtime)
+{
+	gchar header[TAR_BLOCK_SIZE];
+	gsize name_len;
+	guint checksum = 0;
+	gint ii;
+
+	name_len = strlen (name);
+
+	if (name_len >= 100) {
+		tar_append_header (data, "././@LongLink", TAR_TYPE_LONG_NAME, 0644, 0, 0, name_len + 1, 0);
+		g_byte_array_append (data, (const guint8 *) name, name_len + 1);
+		tar_append_padding (data, name_len + 1);
+	}
+
+	memset (header, 0, sizeof (header));
+	memcpy (header, name, MIN (name_len, 99));
+	tar_set_number (header + 100, 8, mode);
+	tar_set_number (header + 108, 8, uid);
+	tar_set_number (header + 116, 8, gid);
+	tar_set_number (header + 124, 12, size);
+	tar_set_number (header + 136, 12, mtime > 0 ? mtime : 0);
+	memset (header + 148, ' ', 8);
+	header[156] = type;
+	memcpy (header + 257, "ustar  ", 8);
+
+	for (ii = 0; ii < TAR_BLOCK_SIZE; ii++) {
+		checksum += (guchar) header[ii];
+	}
+
+	g_snprintf (header + 148, 7, "%06o", checksum);
+
+	g_byte_array_append (data, (const guint8 *) header, TAR_BLOCK_SIZE);
+}
+
+static GBytes *
+backup_compress (GByteArray *data,
+                 gboolean use_xz,
+                 GCancellable *cancellable,
+                 GError **error)
+{
+	GBytes *compressed = NULL;
+
+	if (use_xz) {
+		GSubprocess *subprocess;
+		GBytes *input;
+
+		subprocess = g_subprocess_new (
+			G_SUBPROCESS_FLAGS_STDIN_PIPE | G_SUBPROCESS_FLAGS_STDOUT_PIPE,
+			error, "xz", "-z", "-c", NULL);
+
+		if (!subprocess)
+			return NULL;
+
+		input = g_bytes_new_static (data->data, data->len);
+
+		if (g_subprocess_communicate (subprocess, input, cancellable, &compressed, NULL, error) &&
+		    !g_subprocess_get_successful (subprocess)) {
+			g_set_error_literal (
+				error, G_IO_ERROR, G_IO_ERROR_FAILED,
+				_("Failed to compress data with xz"));
+			g_clear_pointer (&compressed, g_bytes_unref);
+		}
+
+		g_bytes_unref (input);
+		g_object_unref (subprocess);
+	} else {
+		GZlibCompressor *compressor;
+		GOutputStream *memory_stream, *stream;
+
+		compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+		memory_stream = g_memory_output_stream_new_resizable ();
+		stream = g_converter_output_stream_new (memory_stream, G_CONVERTER (compressor));
+
+		if (g_output_stream_write_all (stream, data->data, data->len, NULL, cancellable, error) &&
+		    g_output_stream_close (stream, cancellable, error))
+			compressed = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (memory_stream));
+
+		g_object_unref (stream);
+		g_object_unref (memory_stream);
+		g_object_unref (compressor);
+	}
+
+	return compressed;
+}
+
+static void
+backup_engine_compress_thread (gpointer data,
+                               gpointer user_data)
+{
+	BackupChunk *chunk = data;
+	BackupEngine *engine = user_data;
+	GBytes *compressed;
+	GError *local_error = NULL;
+
+	compressed = backup_compress (chunk->data, engine->use_xz, engine->cancellable, &local_error);
+
+	g_mutex_lock (&engine->lock);
+	chunk->compressed = compressed;
+	chunk->error = local_error;
+	chunk->done = TRUE;
+	g_cond_broadcast (&engine->cond);
+	g_mutex_unlock (&engine->lock);
+}
+
+static void
+backup_engine_load_index (BackupEngine *engine,
+                          const gchar *index_filename)
+{
+	GStatBuf st;
+	GFile *file;
+	GFileInputStream *stream;
+	gchar *contents = NULL, *archive = NULL;
+	gchar **lines, **parts;
+	guint ii;
+
+	if (!g_file_get_contents (index_filename, &contents, NULL, NULL))
+		return;
+
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	if (g_strv_length (lines) < 2 || g_strcmp0 (lines[0], INDEX_HEADER) != 0) {
+		g_strfreev (lines);
+		return;
+	}
+
+	/* The archive the index describes, which should not be changed since */
+	parts = g_strsplit (lines[1], "\t", 4);
+	if (g_strv_length (parts) == 4 &&
+	    g_strcmp0 (parts[3], engine->use_xz ? "xz" : "gz") == 0) {
+		archive = g_strcompress (parts[0]);
+
+		if (g_stat (archive, &st) != 0 ||
+		    (guint64) st.st_size != g_ascii_strtoull (parts[1], NULL, 10) ||
+		    (gint64) st.st_mtime != g_ascii_strtoll (parts[2], NULL, 10))
+			g_clear_pointer (&archive, g_free);
+	}
+	g_strfreev (parts);
+
+	if (!archive) {
+		g_strfreev (lines);
+		return;
+	}
+
+	file = g_file_new_for_path (archive);
+	stream = g_file_read (file, NULL, NULL);
+	g_object_unref (file);
+	g_free (archive);
+
+	if (!stream) {
+		g_strfreev (lines);
+		return;
+	}
+
+	engine->prev_stream = G_INPUT_STREAM (stream);
+	engine->prev_chunks = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, index_chunk_free);
+	engine->prev_files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, index_file_free);
+
+	for (ii = 2; lines[ii]; ii++) {
+		if (g_str_has_prefix (lines[ii], "C\t")) {
+			parts = g_strsplit (lines[ii] + 2, "\t", 3);
+
+			if (g_strv_length (parts) == 3) {
+				IndexChunk *ichunk;
+
+				ichunk = g_slice_new0 (IndexChunk);
+				ichunk->offset = g_ascii_strtoll (parts[1], NULL, 10);
+				ichunk->length = g_ascii_strtoull (parts[2], NULL, 10);
+
+				g_hash_table_insert (engine->prev_chunks, g_strdup (parts[0]), ichunk);
+			}
+
+			g_strfreev (parts);
+		} else if (g_str_has_prefix (lines[ii], "F\t")) {
+			parts = g_strsplit (lines[ii] + 2, "\t", 4);
+
+			if (g_strv_length (parts) == 4) {
+				IndexFile *ifile;
+
+				ifile = g_slice_new0 (IndexFile);
+				ifile->size = g_ascii_strtoull (parts[0], NULL, 10);
+				ifile->mtime = g_ascii_strtoll (parts[1], NULL, 10);
+				ifile->checksum = g_strdup (parts[2]);
+
+				g_hash_table_insert (engine->prev_files, g_strcompress (parts[3]), ifile);
+			}
+
+			g_strfreev (parts);
+		}
+	}
+
+	g_strfreev (lines);
+}
+
+static gboolean
+backup_engine_save_index (BackupEngine *engine,
+                          const gchar *archive,
+                          const gchar *index_filename,
+                          GError **error)
+{
+	GHashTableIter iter;
+	GString *contents;
+	GStatBuf st;
+	gpointer key, value;
+	gchar *escaped, *dirname;
+	gboolean success;
+
+	if (g_stat (archive, &st) != 0) {
+		g_set_error (
+			error, G_IO_ERROR, g_io_error_from_errno (errno),
+			"%s", g_strerror (errno));
+		return FALSE;
+	}
+
+	contents = g_string_sized_new (engine->index_chunks->len + 1024);
+	escaped = g_strescape (archive, NULL);
+
+	g_string_append (contents, INDEX_HEADER "\n");
+	g_string_append_printf (
+		contents, "%s\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%s\n",
+		escaped, (guint64) st.st_size, (gint64) st.st_mtime, engine->use_xz ? "xz" : "gz");
+	g_string_append_len (contents, engine->index_chunks->str, engine->index_chunks->len);
+
+	g_free (escaped);
+
+	g_hash_table_iter_init (&iter, engine->index_files);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		IndexFile *ifile = value;
+
+		escaped = g_strescape (key, NULL);
+		g_string_append_printf (
+			contents, "F\t%" G_GUINT64_FORMAT "\t%" G_GINT64_FORMAT "\t%s\t%s\n",
+			ifile->size, ifile->mtime, ifile->checksum, escaped);
+		g_free (escaped);
+	}
+
+	dirname = g_path_get_dirname (index_filename);
+	g_mkdir_with_parents (dirname, 0700);
+	g_free (dirname);
+
+	success = g_file_set_contents (index_filename, contents->str, contents->len, error);
+
+	g_string_free (contents, TRUE);
+
+	return success;
+}
+
+static gboolean
+backup_engine_copy_previous (BackupEngine *engine,
+                             goffset offset,
+                             gsize length,
+                             GError **error)
+{
+	gchar *buffer;
+	gboolean success;
+
+	success = g_seekable_seek (G_SEEKABLE (engine->prev_stream), offset, G_SEEK_SET, engine->cancellable, error);
+
+	buffer = g_malloc (READ_BUFFER_SIZE);
+
+	while (success && length > 0) {
+		gsize bytes_read = 0;
+
+		success = g_input_stream_read_all (
+			engine->prev_stream, buffer, MIN (length, READ_BUFFER_SIZE),
+			&bytes_read, engine->cancellable, error);
+
+		if (success && !bytes_read) {
+			g_set_error_literal (
+				error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT,
+				_("The previous back up file is truncated"));
+			success = FALSE;
+		}
+
+		if (success)
+			success = g_output_stream_write_all (
+				engine->output, buffer, bytes_read,
+				NULL, engine->cancellable, error);
+
+		length -= bytes_read;
+	}
+
+	g_free (buffer);
+
+	return success;
+}
+
+static gboolean
+backup_engine_write_chunk (BackupEngine *engine,
+                           BackupChunk *chunk,
+                           GError **error)
+{
+	goffset offset = engine->output_offset;
+	gsize length;
+
+	if (chunk->error) {
+		g_propagate_error (error, chunk->error);
+		chunk->error = NULL;
+		return FALSE;
+	}
+
+	if (chunk->reuse) {
+		length = chunk->reuse_length;
+
+		if (!backup_engine_copy_previous (engine, chunk->reuse_offset, length, error))
+			return FALSE;
+	} else {
+		gconstpointer bytes;
+
+		bytes = g_bytes_get_data (chunk->compressed, &length);
+
+		if (!g_output_stream_write_all (engine->output, bytes, length, NULL, engine->cancellable, error))
+			return FALSE;
+	}
+
+	engine->output_offset += length;
+
+	if (chunk->key) {
+		g_string_append_printf (
+			engine->index_chunks, "C\t%s\t%" G_GINT64_FORMAT "\t%" G_GSIZE_FORMAT "\n",
+			chunk->key, (gint64) offset, length);
+	}
+
+	return TRUE;
+}
+
+/* Writes finished chunks from the head of the queue, waiting
+ * for them while more than @max_pending chunks are queued. */
+static gboolean
+backup_engine_write_pending (BackupEngine *engine,
+                             guint max_pending,
+                             GError **error)
+{
+	gboolean success = TRUE;
+
+	g_mutex_lock (&engine->lock);
+
+	while (success && !g_queue_is_empty (&engine->pending)) {
+		BackupChunk *chunk = g_queue_peek_head (&engine->pending);
+
+		if (!chunk->done) {
+			if (g_queue_get_length (&engine->pending) <= max_pending)
+				break;
+
+			g_cond_wait (&engine->cond, &engine->lock);
+			continue;
+		}
+
+		g_queue_pop_head (&engine->pending);
+		g_mutex_unlock (&engine->lock);
+
+		success = backup_engine_write_chunk (engine, chunk, error);
+		backup_chunk_free (chunk);
+
+		g_mutex_lock (&engine->lock);
+	}
+
+	g_mutex_unlock (&engine->lock);
+
+	return success;
+}
+
+static void
+backup_engine_queue_chunk (BackupEngine *engine,
+                           BackupChunk *chunk)
+{
+	g_mutex_lock (&engine->lock);
+	g_queue_push_tail (&engine->pending, chunk);
+	g_mutex_unlock (&engine->lock);
+
+	if (!chunk->done)
+		g_thread_pool_push (engine->pool, chunk, NULL);
+}
+
+static gboolean
+backup_engine_finish_file (BackupEngine *engine,
+                           const BackupEntry *entry,
+                           const gchar *checksum,
+                           GError **error)
+{
+	gboolean changed = engine->file_changed;
+
+	if (!changed && !engine->file_unreadable && !entry->snapshot) {
+		GStatBuf st;
+
+		changed = g_stat (entry->filename, &st) != 0 ||
+			(guint64) st.st_size != entry->size ||
+			(gint64) st.st_mtime != entry->mtime;
+	}
+
+	g_hash_table_insert (engine->manifest, g_strdup (entry->name), g_strdup (checksum));
+
+	if (changed) {
+		/* Store it once again; the later member overwrites
+		 * the earlier one when the archive is extracted. */
+		if (entry->attempt + 1 >= MAX_READ_ATTEMPTS) {
+			g_set_error (
+				error, G_IO_ERROR, G_IO_ERROR_FAILED,
+				_("File “%s” kept changing while being backed up"),
+				entry->filename);
+			return FALSE;
+		}
+
+		g_ptr_array_add (engine->retry, backup_entry_copy (entry));
+	}
+
+	/* Files modified in the same second as the back up started could
+	 * change again without changing the modification time, thus they
+	 * cannot be trusted to be the same next time. */
+	if (changed || engine->file_unreadable || entry->mtime >= engine->start_time - 1) {
+		g_hash_table_remove (engine->index_files, entry->name);
+	} else {
+		IndexFile *ifile;
+
+		ifile = g_slice_new0 (IndexFile);
+		ifile->size = entry->size;
+		ifile->mtime = entry->mtime;
+		ifile->checksum = g_strdup (checksum);
+
+		g_hash_table_insert (engine->index_files, g_strdup (entry->name), ifile);
+	}
+
+	return TRUE;
+}
+
+static IndexFile *
+backup_engine_lookup_unchanged (BackupEngine *engine,
+                                const BackupEntry *entry)
+{
+	IndexFile *ifile;
+
+	if (!engine->prev_files)
+		return NULL;
+
+	ifile = g_hash_table_lookup (engine->prev_files, entry->name);
+	if (ifile && ifile->size == entry->size && ifile->mtime == entry->mtime)
+		return ifile;
+
+	return NULL;
+}
+
+static gboolean
+backup_engine_read_entry (BackupEngine *engine,
+                          BackupChunk *chunk,
+                          const BackupEntry *entry,
+                          GError **error)
+{
+	gsize length, bytes_read = 0;
+	guint offset;
+
+	if (entry->piece_start == 0) {
+		tar_append_header (
+			chunk->data, entry->name, entry->type, entry->mode,
+			entry->uid, entry->gid, entry->size, entry->mtime);
+	}
+
+	if (entry->type != TAR_TYPE_FILE)
+		return TRUE;
+
+	if (!engine->file_stream && !engine->file_unreadable) {
+		GFileInputStream *stream;
+		GFile *file;
+		GError *local_error = NULL;
+
+		file = g_file_new_for_path (entry->filename);
+		stream = g_file_read (file, engine->cancellable, &local_error);
+		g_object_unref (file);
+
+		if (stream && entry->piece_start > 0 &&
+		    !g_seekable_seek (G_SEEKABLE (stream), entry->piece_start, G_SEEK_SET, engine->cancellable, &local_error))
+			g_clear_object (&stream);
+
+		if (!stream) {
+			if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+				g_propagate_error (error, local_error);
+				return FALSE;
+			}
+
+			/* Keep the archive consistent with the already declared size. */
+			g_warning ("Failed to read '%s': %s", entry->filename, local_error ? local_error->message : "Unknown error");
+			g_clear_error (&local_error);
+			engine->file_unreadable = TRUE;
+		}
+
+		engine->file_stream = G_INPUT_STREAM (stream);
+		engine->file_changed = FALSE;
+
+		/* The checksum of a file partly reused from the previous
+		 * back up is taken from the index, it cannot change. */
+		if (entry->piece_start == 0)
+			engine->file_checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	}
+
+	length = entry->piece_end - entry->piece_start;
+	offset = chunk->data->len;
+	g_byte_array_set_size (chunk->data, offset + length);
+
+	if (engine->file_stream && length > 0 &&
+	    !g_input_stream_read_all (engine->file_stream, chunk->data->data + offset, length, &bytes_read, engine->cancellable, error))
+		return FALSE;
+
+	if (bytes_read < length) {
+		/* Shrunk meanwhile, fill the rest with zeros. */
+		memset (chunk->data->data + offset + bytes_read, 0, length - bytes_read);
+
+		if (!engine->file_unreadable)
+			engine->file_changed = TRUE;
+	}
+
+	if (engine->file_checksum)
+		g_checksum_update (engine->file_checksum, chunk->data->data + offset, length);
+
+	if (entry->piece_end == entry->size) {
+		IndexFile *ifile;
+		const gchar *checksum = NULL;
+
+		tar_append_padding (chunk->data, entry->size);
+
+		if (engine->file_checksum) {
+			checksum = g_checksum_get_string (engine->file_checksum);
+		} else {
+			ifile = backup_engine_lookup_unchanged (engine, entry);
+			if (ifile)
+				checksum = ifile->checksum;
+		}
+
+		if (checksum && !backup_engine_finish_file (engine, entry, checksum, error))
+			return FALSE;
+
+		g_clear_object (&engine->file_stream);
+		g_clear_pointer (&engine->file_checksum, g_checksum_free);
+		engine->file_changed = FALSE;
+		engine->file_unreadable = FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+backup_engine_close_chunk (BackupEngine *engine,
+                           GError **error)
+{
+	BackupChunk *chunk = engine->current;
+	IndexChunk *ichunk = NULL;
+	gboolean reuse;
+	guint ii;
+
+	engine->current = NULL;
+
+	if (!chunk)
+		return TRUE;
+
+	chunk->key = backup_chunk_compute_key (chunk);
+
+	if (engine->prev_chunks)
+		ichunk = g_hash_table_lookup (engine->prev_chunks, chunk->key);
+
+	reuse = ichunk != NULL;
+
+	for (ii = 0; reuse && ii < chunk->entries->len; ii++) {
+		BackupEntry *entry = g_ptr_array_index (chunk->entries, ii);
+
+		reuse = entry->type != TAR_TYPE_FILE || backup_engine_lookup_unchanged (engine, entry);
+	}
+
+	if (reuse) {
+		chunk->reuse = TRUE;
+		chunk->reuse_offset = ichunk->offset;
+		chunk->reuse_length = ichunk->length;
+		chunk->done = TRUE;
+
+		for (ii = 0; ii < chunk->entries->len; ii++) {
+			BackupEntry *entry = g_ptr_array_index (chunk->entries, ii);
+
+			if (entry->type != TAR_TYPE_FILE)
+				continue;
+
+			/* A following piece of the file, if any, is read
+			 * from its own offset, with the indexed checksum. */
+			g_clear_object (&engine->file_stream);
+			g_clear_pointer (&engine->file_checksum, g_checksum_free);
+			engine->file_changed = FALSE;
+			engine->file_unreadable = FALSE;
+
+			if (entry->piece_end == entry->size) {
+				IndexFile *ifile = backup_engine_lookup_unchanged (engine, entry);
+
+				if (!backup_engine_finish_file (engine, entry, ifile->checksum, error)) {
+					backup_chunk_free (chunk);
+					return FALSE;
+				}
+			}
+		}
+	} else {
+		chunk->data = g_byte_array_sized_new (chunk->size);
+
+		for (ii = 0; ii < chunk->entries->len; ii++) {
+			BackupEntry *entry = g_ptr_array_index (chunk->entries, ii);
+
+			if (!backup_engine_read_entry (engine, chunk, entry, error)) {
+				backup_chunk_free (chunk);
+				return FALSE;
+			}
+		}
+	}
+
+	backup_engine_queue_chunk (engine, chunk);
+
+	return backup_engine_write_pending (engine, engine->max_pending, error);
+}
+
+static gboolean
+backup_engine_add_entry (BackupEngine *engine,
+                         BackupEntry *entry,
+                         GError **error)
+{
+	BackupChunk *chunk;
+
+	if (!engine->current)
+		engine->current = backup_chunk_new ();
+
+	chunk = engine->current;
+
+	g_ptr_array_add (chunk->entries, entry);
+	chunk->size += backup_entry_get_archive_size (entry);
+
+	if (chunk->size >= CHUNK_MAX_SIZE ||
+	    (chunk->size >= CHUNK_MIN_SIZE && (g_str_hash (entry->name) & CHUNK_BOUNDARY_MASK) == 0))
+		return backup_engine_close_chunk (engine, error);
+
+	return TRUE;
+}
+
+static gint
+backup_engine_compare_names (gconstpointer ptr1,
+                             gconstpointer ptr2)
+{
+	return g_strcmp0 (*((const gchar **) ptr1), *((const gchar **) ptr2));
+}
+
+static gboolean
+backup_engine_is_sqlite_file (const gchar *filename)
+{
+	static const gchar magic[16] = "SQLite format 3";
+	gchar header[16];
+	FILE *file;
+	gboolean is_sqlite;
+
+	file = g_fopen (filename, "rb");
+	if (!file)
+		return FALSE;
+
+	is_sqlite = fread (header, 1, sizeof (header), file) == sizeof (header) &&
+		memcmp (header, magic, sizeof (magic)) == 0;
+
+	fclose (file);
+
+	return is_sqlite;
+}
+
+/* The rollback journal and the write-ahead log are part
+ * of the database snapshot, they are not stored on their own. */
+static gboolean
+backup_engine_is_sqlite_companion (const gchar *filename)
+{
+	const gchar *suffixes[] = { "-journal", "-wal", "-shm" };
+	gsize len = strlen (filename);
+	guint ii;
+
+	for (ii = 0; ii < G_N_ELEMENTS (suffixes); ii++) {
+		gsize suffix_len = strlen (suffixes[ii]);
+
+		if (len > suffix_len && g_str_has_suffix (filename, suffixes[ii])) {
+			gchar *db_filename;
+			gboolean is_companion;
+
+			db_filename = g_strndup (filename, len - suffix_len);
+			is_companion = backup_engine_is_sqlite_file (db_filename);
+			g_free (db_filename);
+
+			return is_companion;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Copies a consistent state of the database into a private file,
+ * even when other processes keep writing into it. Returns %NULL
+ * when it fails, then the database file is read as any other file. */
+static gchar *
+backup_engine_snapshot_sqlite (BackupEngine *engine,
+                               const gchar *filename)
+{
+	sqlite3 *src = NULL, *dest = NULL;
+	sqlite3_backup *backup;
+	gchar *snapshot, *basename;
+	gint rc;
+
+	if (!engine->snapshot_dir) {
+		GError *local_error = NULL;
+
+		engine->snapshot_dir = g_dir_make_tmp ("evolution-backup-XXXXXX", &local_error);
+		if (!engine->snapshot_dir) {
+			g_warning ("Failed to create a directory for database snapshots: %s", local_error ? local_error->message : "Unknown error");
+			g_clear_error (&local_error);
+			return NULL;
+		}
+	}
+
+	basename = g_strdup_printf ("%u.db", ++engine->n_snapshots);
+	snapshot = g_build_filename (engine->snapshot_dir, basename, NULL);
+	g_free (basename);
+
+	rc = sqlite3_open_v2 (filename, &src, SQLITE_OPEN_READONLY, NULL);
+	if (rc == SQLITE_OK)
+		rc = sqlite3_open (snapshot, &dest);
+
+	if (rc == SQLITE_OK) {
+		sqlite3_busy_timeout (src, SQLITE_BUSY_TIMEOUT);
+
+		backup = sqlite3_backup_init (dest, "main", src, "main");
+		if (backup) {
+			/* Copy all pages in one step, thus the snapshot
+			 * cannot mix pages of different transactions. */
+			do {
+				rc = sqlite3_backup_step (backup, -1);
+				if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED)
+					sqlite3_sleep (100);
+			} while ((rc == SQLITE_BUSY || rc == SQLITE_LOCKED) &&
+				 !g_cancellable_is_cancelled (engine->cancellable));
+
+			sqlite3_backup_finish (backup);
+		}
+
+		if (rc == SQLITE_DONE)
+			rc = SQLITE_OK;
+		else if (rc == SQLITE_OK)
+			rc = sqlite3_errcode (dest);
+	}
+
+	if (rc != SQLITE_OK) {
+		g_warning ("Failed to make a snapshot of '%s': %s", filename, sqlite3_errstr (rc));
+		g_unlink (snapshot);
+		g_clear_pointer (&snapshot, g_free);
+	}
+
+	sqlite3_close (dest);
+	sqlite3_close (src);
+
+	return snapshot;
+}
+
+static void
+backup_engine_remove_snapshots (BackupEngine *engine)
+{
+	guint ii;
+
+	if (!engine->snapshot_dir)
+		return;
+
+	for (ii = 1; ii <= engine->n_snapshots; ii++) {
+		gchar *basename, *snapshot;
+
+		basename = g_strdup_printf ("%u.db", ii);
+		snapshot = g_build_filename (engine->snapshot_dir, basename, NULL);
+		g_unlink (snapshot);
+		g_free (snapshot);
+		g_free (basename);
+	}
+
+	g_rmdir (engine->snapshot_dir);
+	g_clear_pointer (&engine->snapshot_dir, g_free);
+}
+
+static gboolean
+backup_engine_add_path (BackupEngine *engine,
+                        const gchar *name,
+                        const gchar *filename,
+                        guint attempt,
+                        GError **error);
+
+static gboolean
+backup_engine_add_directory (BackupEngine *engine,
+                             const gchar *name,
+                             const gchar *filename,
+                             const GStatBuf *st,
+                             GError **error)
+{
+	GPtrArray *children;
+	GDir *dir;
+	gchar *dir_name, *dir_id;
+	const gchar *child;
+	gboolean success;
+	guint ii;
+
+	/* Symbolic links are followed, thus avoid loops. */
+	dir_id = g_strdup_printf ("%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT, (guint64) st->st_dev, (guint64) st->st_ino);
+	if (!g_hash_table_add (engine->visited_dirs, dir_id)) {
+		g_warning ("Skipping '%s', the directory was already backed up", filename);
+		return TRUE;
+	}
+
+	dir_name = g_strconcat (name, "/", NULL);
+	success = backup_engine_add_entry (engine, backup_entry_new (dir_name, filename, TAR_TYPE_DIRECTORY, st, 0), error);
+	g_free (dir_name);
+
+	if (!success)
+		return FALSE;
+
+	dir = g_dir_open (filename, 0, NULL);
+	if (!dir) {
+		g_warning ("Failed to open directory '%s'", filename);
+		return TRUE;
+	}
+
+	children = g_ptr_array_new_with_free_func (g_free);
+
+	while (child = g_dir_read_name (dir), child) {
+		g_ptr_array_add (children, g_strdup (child));
+	}
+
+	g_dir_close (dir);
+
+	/* Same order every time, to have the same chunks. */
+	g_ptr_array_sort (children, backup_engine_compare_names);
+
+	for (ii = 0; success && ii < children->len; ii++) {
+		gchar *child_name, *child_filename;
+
+		child = g_ptr_array_index (children, ii);
+		child_name = g_strconcat (name, "/", child, NULL);
+		child_filename = g_build_filename (filename, child, NULL);
+
+		success = backup_engine_add_path (engine, child_name, child_filename, 0, error);
+
+		g_free (child_filename);
+		g_free (child_name);
+	}
+
+	g_ptr_array_unref (children);
+
+	return success;
+}
+
+static gboolean
+backup_engine_add_path (BackupEngine *engine,
+                        const gchar *name,
+                        const gchar *filename,
+                        guint attempt,
+                        GError **error)
+{
+	BackupEntry *entry;
+	GStatBuf st;
+
+	if (g_hash_table_contains (engine->excludes, name))
+		return TRUE;
+
+	if (g_cancellable_set_error_if_cancelled (engine->cancellable, error))
+		return FALSE;
+
+	if (g_stat (filename, &st) != 0) {
+		/* Removed meanwhile */
+		if (errno != ENOENT)
+			g_warning ("Failed to stat '%s': %s", filename, g_strerror (errno));
+		return TRUE;
+	}
+
+	if (S_ISDIR (st.st_mode))
+		return backup_engine_add_directory (engine, name, filename, &st, error);
+
+	if (!S_ISREG (st.st_mode))
+		return TRUE;
+
+	if (backup_engine_is_sqlite_companion (filename))
+		return TRUE;
+
+	if (backup_engine_is_sqlite_file (filename)) {
+		gchar *snapshot;
+
+		snapshot = backup_engine_snapshot_sqlite (engine, filename);
+		if (snapshot) {
+			GStatBuf snapshot_st;
+			gchar *wal_filename;
+			gint64 mtime = st.st_mtime;
+
+			/* Writes into the write-ahead log do not change
+			 * the modification time of the database file. */
+			wal_filename = g_strconcat (filename, "-wal", NULL);
+			if (g_stat (wal_filename, &snapshot_st) == 0)
+				mtime = MAX (mtime, (gint64) snapshot_st.st_mtime);
+			g_free (wal_filename);
+
+			if (g_stat (snapshot, &snapshot_st) == 0) {
+				entry = backup_entry_new (name, snapshot, TAR_TYPE_FILE, &snapshot_st, attempt);
+				entry->mode = st.st_mode & 07777;
+				entry->mtime = mtime;
+				entry->snapshot = TRUE;
+			} else {
+				entry = backup_entry_new (name, filename, TAR_TYPE_FILE, &st, attempt);
+			}
+
+			g_free (snapshot);
+		} else {
+			entry = backup_entry_new (name, filename, TAR_TYPE_FILE, &st, attempt);
+		}
+	} else {
+		entry = backup_entry_new (name, filename, TAR_TYPE_FILE, &st, attempt);
+	}
+
+	if (entry->size > CHUNK_MAX_SIZE) {
+		guint64 piece_start;
+
+		/* Large files go into their own chunks, piece by piece. */
+		if (!backup_engine_close_chunk (engine, error)) {
+			backup_entry_free (entry);
+			return FALSE;
+		}
+
+		for (piece_start = 0; piece_start < entry->size; piece_start += CHUNK_MAX_SIZE) {
+			BackupEntry *piece;
+
+			piece = backup_entry_copy (entry);
+			piece->piece_start = piece_start;
+			piece->piece_end = MIN (piece_start + CHUNK_MAX_SIZE, entry->size);
+
+			if (!backup_engine_add_entry (engine, piece, error) ||
+			    !backup_engine_close_chunk (engine, error)) {
+				backup_entry_free (entry);
+				return FALSE;
+			}
+		}
+
+		backup_entry_free (entry);
+
+		return TRUE;
+	}
+
+	return backup_engine_add_entry (engine, entry, error);
+}
+
+static gboolean
+backup_engine_add_manifest (BackupEngine *engine,
+                            const gchar *manifest_name,
+                            GError **error)
+{
+	static const guint8 zeros[2 * TAR_BLOCK_SIZE] = { 0 };
+	BackupChunk *chunk;
+	GString *contents;
+	GList *names, *link;
+
+	contents = g_string_new ("");
+	names = g_list_sort (g_hash_table_get_keys (engine->manifest), (GCompareFunc) g_strcmp0);
+
+	for (link = names; link; link = g_list_next (link)) {
+		gchar *escaped;
+
+		escaped = g_strescape (link->data, NULL);
+		g_string_append_printf (contents, "%s  %s\n", (const gchar *) g_hash_table_lookup (engine->manifest, link->data), escaped);
+		g_free (escaped);
+	}
+
+	g_list_free (names);
+
+	/* The manifest and the end of archive marker; never reused. */
+	chunk = backup_chunk_new ();
+	chunk->data = g_byte_array_sized_new (contents->len + 4 * TAR_BLOCK_SIZE);
+
+	tar_append_header (
+		chunk->data, manifest_name, TAR_TYPE_FILE, 0600, 0, 0,
+		contents->len, g_get_real_time () / G_USEC_PER_SEC);
+	g_byte_array_append (chunk->data, (const guint8 *) contents->str, contents->len);
+	tar_append_padding (chunk->data, contents->len);
+	g_byte_array_append (chunk->data, zeros, sizeof (zeros));
+
+	g_string_free (contents, TRUE);
+
+	backup_engine_queue_chunk (engine, chunk);
+
+	return backup_engine_write_pending (engine, 0, error);
+}
+
+/**
+ * backup_engine_write:
+ * @filename: the archive file name to write
+ * @base_dir: the directory the @members are relative to
+ * @members: (array zero-terminated=1): paths to store, relative to @base_dir
+ * @excludes: (array zero-terminated=1) (nullable): member names to skip
+ * @manifest_name: member name of the checksum manifest
+ * @use_xz: whether to compress with xz, instead of gzip
+ * @index_filename: where to keep the index of the last written archive
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Writes the @members, recursively, into a compressed tar archive @filename.
+ * Unchanged files are copied in the compressed form from the archive described
+ * by @index_filename, when it still exists. SQLite databases are stored
+ * from a snapshot taken with the SQLite online back up, their journals
+ * are skipped. Other files changed while being read are stored again;
+ * when a file keeps changing, the back up fails. Files, which belong
+ * together, like a folder summary and its mailbox, are consistent with
+ * each other only when the application using them is not running.
+ *
+ * Returns: whether succeeded
+ **/
+gboolean
+backup_engine_write (const gchar *filename,
+                     const gchar *base_dir,
+                     const gchar * const *members,
+                     const gchar * const *excludes,
+                     const gchar *manifest_name,
+                     gboolean use_xz,
+                     const gchar *index_filename,
+                     GCancellable *cancellable,
+                     GError **error)
+{
+	BackupEngine engine;
+	GFileOutputStream *output;
+	GFile *partial_file, *file;
+	gchar *partial;
+	gboolean success;
+	guint ii;
+
+	g_return_val_if_fail (filename != NULL, FALSE);
+	g_return_val_if_fail (base_dir != NULL, FALSE);
+	g_return_val_if_fail (members != NULL, FALSE);
+	g_return_val_if_fail (manifest_name != NULL, FALSE);
+	g_return_val_if_fail (index_filename != NULL, FALSE);
+
+	memset (&engine, 0, sizeof (BackupEngine));
+
+	engine.use_xz = use_xz;
+	engine.start_time = g_get_real_time () / G_USEC_PER_SEC;
+	engine.cancellable = cancellable;
+	engine.index_chunks = g_string_new ("");
+	engine.index_files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, index_file_free);
+	engine.manifest = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	engine.excludes = g_hash_table_new (g_str_hash, g_str_equal);
+	engine.visited_dirs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	engine.retry = g_ptr_array_new_with_free_func (backup_entry_free);
+	engine.max_pending = 2 * g_get_num_processors ();
+	g_mutex_init (&engine.lock);
+	g_cond_init (&engine.cond);
+	g_queue_init (&engine.pending);
+
+	for (ii = 0; excludes && excludes[ii]; ii++) {
+		g_hash_table_add (engine.excludes, (gpointer) excludes[ii]);
+	}
+
+	backup_engine_load_index (&engine, index_filename);
+
+	partial = g_strconcat (filename, BACKUP_ENGINE_PARTIAL_SUFFIX, NULL);
+	partial_file = g_file_new_for_path (partial);
+
+	output = g_file_replace (
+		partial_file, NULL, FALSE,
+		G_FILE_CREATE_PRIVATE | G_FILE_CREATE_REPLACE_DESTINATION,
+		cancellable, error);
+
+	success = output != NULL;
+
+	if (success) {
+		engine.output = G_OUTPUT_STREAM (output);
+		engine.pool = g_thread_pool_new (
+			backup_engine_compress_thread, &engine,
+			g_get_num_processors (), FALSE, error);
+
+		success = engine.pool != NULL;
+	}
+
+	for (ii = 0; success && members[ii]; ii++) {
+		gchar *member_filename;
+
+		member_filename = g_build_filename (base_dir, members[ii], NULL);
+		success = backup_engine_add_path (&engine, members[ii], member_filename, 0, error);
+		g_free (member_filename);
+	}
+
+	while (success && engine.retry->len > 0) {
+		GPtrArray *retry = engine.retry;
+
+		engine.retry = g_ptr_array_new_with_free_func (backup_entry_free);
+
+		for (ii = 0; success && ii < retry->len; ii++) {
+			BackupEntry *entry = g_ptr_array_index (retry, ii);
+
+			success = backup_engine_add_path (&engine, entry->name, entry->filename, entry->attempt + 1, error);
+		}
+
+		g_ptr_array_unref (retry);
+	}
+
+	if (success)
+		success = backup_engine_close_chunk (&engine, error);
+
+	if (success)
+		success = backup_engine_add_manifest (&engine, manifest_name, error);
+
+	if (engine.pool)
+		g_thread_pool_free (engine.pool, TRUE, TRUE);
+
+	g_queue_foreach (&engine.pending, (GFunc) backup_chunk_free, NULL);
+	g_queue_clear (&engine.pending);
+
+	if (engine.output) {
+		if (success)
+			success = g_output_stream_close (engine.output, cancellable, error);
+		else
+			g_output_stream_close (engine.output, NULL, NULL);
+	}
+
+	if (success) {
+		file = g_file_new_for_path (filename);
+		success = g_file_move (partial_file, file, G_FILE_COPY_OVERWRITE, cancellable, NULL, NULL, error);
+		g_object_unref (file);
+	}
+
+	if (success) {
+		GError *local_error = NULL;
+
+		/* Not fatal, the next back up will be a full one. */
+		if (!backup_engine_save_index (&engine, filename, index_filename, &local_error)) {
+			g_warning ("Failed to save back up index '%s': %s", index_filename, local_error ? local_error->message : "Unknown error");
+			g_clear_error (&local_error);
+		}
+	} else {
+		g_unlink (partial);
+	}
+
+	backup_chunk_free (engine.current);
+	g_clear_object (&engine.output);
+	g_clear_object (&engine.prev_stream);
+	g_clear_object (&engine.file_stream);
+	g_clear_pointer (&engine.file_checksum, g_checksum_free);
+	g_clear_pointer (&engine.prev_chunks, g_hash_table_destroy);
+	g_clear_pointer (&engine.prev_files, g_hash_table_destroy);
+	g_string_free (engine.index_chunks, TRUE);
+	g_hash_table_destroy (engine.index_files);
+	g_hash_table_destroy (engine.manifest);
+	g_hash_table_destroy (engine.excludes);
+	g_hash_table_destroy (engine.visited_dirs);
+	g_ptr_array_unref (engine.retry);
+	backup_engine_remove_snapshots (&engine);
+	g_mutex_clear (&engine.lock);
+	g_cond_clear (&engine.cond);
+	g_object_unref (partial_file);
+	g_free (partial);
+
+	return success;
+}
+
+static gchar *
+backup_engine_compute_file_checksum (const gchar *filename,
+                                     GCancellable *cancellable,
+                                     GError **error)
+{
+	GFileInputStream *stream;
+	GChecksum *checksum;
+	GFile *file;
+	gchar *buffer, *result = NULL;
+	gssize bytes_read;
+
+	file = g_file_new_for_path (filename);
+	stream = g_file_read (file, cancellable, error);
+	g_object_unref (file);
+
+	if (!stream)
+		return NULL;
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	buffer = g_malloc (READ_BUFFER_SIZE);
+
+	while (bytes_read = g_input_stream_read (G_INPUT_STREAM (stream), buffer, READ_BUFFER_SIZE, cancellable, error), bytes_read > 0) {
+		g_checksum_update (checksum, (const guchar *) buffer, bytes_read);
+	}
+
+	if (bytes_read == 0)
+		result = g_strdup (g_checksum_get_string (checksum));
+
+	g_checksum_free (checksum);
+	g_object_unref (stream);
+	g_free (buffer);
+
+	return result;
+}
+
+/* Verifies that the restored files match the checksums
+ * stored in the archive by backup_engine_write(). */
+static gboolean
+backup_engine_verify (const gchar *manifest_filename,
+                      BackupEngineMapFunc map_func,
+                      gpointer user_data,
+                      GCancellable *cancellable,
+                      GError **error)
+{
+	gchar *contents = NULL;
+	gchar **lines;
+	gboolean success = TRUE;
+	guint ii;
+
+	g_return_val_if_fail (manifest_filename != NULL, FALSE);
+	g_return_val_if_fail (map_func != NULL, FALSE);
+
+	if (!g_file_get_contents (manifest_filename, &contents, NULL, error))
+		return FALSE;
+
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	for (ii = 0; success && lines[ii]; ii++) {
+		gchar *name, *filename, *checksum;
+		const gchar *separator;
+
+		separator = strstr (lines[ii], "  ");
+		if (!separator)
+			continue;
+
+		name = g_strcompress (separator + 2);
+		filename = map_func (name, user_data);
+		g_free (name);
+
+		if (!filename)
+			continue;
+
+		*((gchar *) separator) = '\0';
+
+		checksum = backup_engine_compute_file_checksum (filename, cancellable, error);
+
+		if (!checksum) {
+			success = FALSE;
+		} else if (g_strcmp0 (checksum, lines[ii]) != 0) {
+			g_set_error (
+				error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+				_("Restored file “%s” does not match the back up"), filename);
+			success = FALSE;
+		}
+
+		g_free (checksum);
+		g_free (filename);
+	}
+
+	g_strfreev (lines);
+
+	return success;
+}
+
+typedef struct _RestoreMapData {
+	const gchar * const *members;
+	const gchar * const *dirs;
+} RestoreMapData;
+
+static gchar *
+backup_engine_restore_map_cb (const gchar *member_name,
+                              gpointer user_data)
+{
+	RestoreMapData *rmd = user_data;
+	guint ii;
+
+	for (ii = 0; rmd->members[ii]; ii++) {
+		gsize len = strlen (rmd->members[ii]);
+
+		if (strncmp (member_name, rmd->members[ii], len) == 0 && member_name[len] == '/')
+			return g_build_filename (rmd->dirs[ii], member_name + len + 1, NULL);
+	}
+
+	return NULL;
+}
+
+static void
+backup_engine_remove_tree (const gchar *path)
+{
+	GDir *dir;
+
+	if (!g_file_test (path, G_FILE_TEST_IS_SYMLINK)) {
+		dir = g_dir_open (path, 0, NULL);
+
+		if (dir) {
+			const gchar *name;
+
+			while (name = g_dir_read_name (dir), name) {
+				gchar *child;
+
+				child = g_build_filename (path, name, NULL);
+				backup_engine_remove_tree (child);
+				g_free (child);
+			}
+
+			g_dir_close (dir);
+		}
+	}
+
+	g_remove (path);
+}
+
+static guint
+backup_engine_count_components (const gchar *member)
+{
+	guint count = 0;
+	const gchar *ptr;
+
+	for (ptr = member; *ptr; ptr++) {
+		if (*ptr == '/' && ptr[1] && ptr[1] != '/')
+			count++;
+	}
+
+	return *member && *member != '/' ? count + 1 : count;
+}
+
+static gboolean
+backup_engine_extract (const gchar *filename,
+                       gboolean use_xz,
+                       const gchar *member,
+                       guint strip_components,
+                       const gchar *dest_dir,
+                       GSubprocessFlags flags,
+                       GCancellable *cancellable,
+                       GError **error)
+{
+	GSubprocessLauncher *launcher;
+	GSubprocess *subprocess;
+	const gchar *argv[6];
+	gchar *strip;
+	gboolean success;
+
+	strip = g_strdup_printf ("--strip-components=%u", strip_components);
+
+	argv[0] = "tar";
+	argv[1] = strip;
+	argv[2] = use_xz ? "-xJf" : "-xzf";
+	argv[3] = filename;
+	argv[4] = member;
+	argv[5] = NULL;
+
+	launcher = g_subprocess_launcher_new (flags);
+	g_subprocess_launcher_set_cwd (launcher, dest_dir);
+
+	subprocess = g_subprocess_launcher_spawnv (launcher, argv, error);
+	success = subprocess && g_subprocess_wait_check (subprocess, cancellable, error);
+
+	if (subprocess && !success)
+		g_subprocess_force_exit (subprocess);
+
+	g_clear_object (&subprocess);
+	g_object_unref (launcher);
+	g_free (strip);
+
+	return success;
+}
+
+/**
+ * backup_engine_restore:
+ * @filename: the archive file name to restore from
+ * @members: (array zero-terminated=1): directory members to restore
+ * @dirs: (array zero-terminated=1): where to restore the respective @members
+ * @manifest_name: member name of the checksum manifest
+ * @use_xz: whether the archive is compressed with xz, instead of gzip
+ * @cancellable: optional #GCancellable object, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Moves the @dirs aside, with the %BACKUP_ENGINE_OLD_SUFFIX, and extracts
+ * the content of the @members into them. When the archive contains
+ * the checksum manifest, the restored files are verified against it;
+ * archives without it, written by older versions, are not verified.
+ * When anything fails, the @dirs are put back as they were. On success
+ * the caller removes the moved directories, once it does not need them.
+ *
+ * Returns: whether succeeded
+ **/
+gboolean
+backup_engine_restore (const gchar *filename,
+                       const gchar * const *members,
+                       const gchar * const *dirs,
+                       const gchar *manifest_name,
+                       gboolean use_xz,
+                       GCancellable *cancellable,
+                       GError **error)
+{
+	RestoreMapData rmd;
+	gchar *archive, *tmp_dir, *manifest_filename;
+	guint ii, n_dirs, n_moved = 0;
+	gboolean success = TRUE;
+
+	g_return_val_if_fail (filename != NULL, FALSE);
+	g_return_val_if_fail (members != NULL, FALSE);
+	g_return_val_if_fail (dirs != NULL, FALSE);
+	g_return_val_if_fail (manifest_name != NULL, FALSE);
+
+	n_dirs = g_strv_length ((gchar **) dirs);
+	g_return_val_if_fail (g_strv_length ((gchar **) members) == n_dirs, FALSE);
+
+	/* tar runs in the restored directories */
+	if (g_path_is_absolute (filename)) {
+		archive = g_strdup (filename);
+	} else {
+		gchar *current_dir;
+
+		current_dir = g_get_current_dir ();
+		archive = g_build_filename (current_dir, filename, NULL);
+		g_free (current_dir);
+	}
+
+	tmp_dir = g_dir_make_tmp ("evolution-restore-XXXXXX", error);
+	if (!tmp_dir) {
+		g_free (archive);
+		return FALSE;
+	}
+
+	manifest_filename = g_build_filename (tmp_dir, manifest_name, NULL);
+
+	/* Not in back ups made by older versions */
+	backup_engine_extract (
+		archive, use_xz, manifest_name, 0, tmp_dir,
+		G_SUBPROCESS_FLAGS_STDERR_SILENCE, cancellable, NULL);
+
+	if (g_cancellable_set_error_if_cancelled (cancellable, error))
+		success = FALSE;
+
+	for (ii = 0; success && ii < n_dirs; ii++) {
+		gchar *old_dir;
+
+		old_dir = g_strconcat (dirs[ii], BACKUP_ENGINE_OLD_SUFFIX, NULL);
+
+		/* Left behind by an interrupted restore */
+		backup_engine_remove_tree (old_dir);
+
+		if (g_rename (dirs[ii], old_dir) != 0 && errno != ENOENT) {
+			gint errn = errno;
+
+			g_set_error (
+				error, G_IO_ERROR, g_io_error_from_errno (errn),
+				_("Failed to move “%s” aside: %s"), dirs[ii], g_strerror (errn));
+			success = FALSE;
+		} else {
+			n_moved++;
+		}
+
+		g_free (old_dir);
+	}
+
+	for (ii = 0; success && ii < n_dirs; ii++) {
+		if (g_mkdir_with_parents (dirs[ii], 0700) != 0) {
+			gint errn = errno;
+
+			g_set_error (
+				error, G_IO_ERROR, g_io_error_from_errno (errn),
+				_("Failed to create “%s”: %s"), dirs[ii], g_strerror (errn));
+			success = FALSE;
+		} else {
+			success = backup_engine_extract (
+				archive, use_xz, members[ii],
+				backup_engine_count_components (members[ii]), dirs[ii],
+				G_SUBPROCESS_FLAGS_NONE, cancellable, error);
+		}
+	}
+
+	if (success && g_file_test (manifest_filename, G_FILE_TEST_EXISTS)) {
+		rmd.members = members;
+		rmd.dirs = dirs;
+
+		success = backup_engine_verify (
+			manifest_filename, backup_engine_restore_map_cb,
+			&rmd, cancellable, error);
+	}
+
+	if (!success) {
+		/* Put back the previous data */
+		for (ii = 0; ii < n_moved; ii++) {
+			gchar *old_dir;
+
+			old_dir = g_strconcat (dirs[ii], BACKUP_ENGINE_OLD_SUFFIX, NULL);
+
+			backup_engine_remove_tree (dirs[ii]);
+
+			if (g_file_test (old_dir, G_FILE_TEST_EXISTS) &&
+			    g_rename (old_dir, dirs[ii]) != 0)
+				g_warning ("Failed to put back '%s': %s", old_dir, g_strerror (errno));
+
+			g_free (old_dir);
+		}
+	}
+
+	g_unlink (manifest_filename);
+	g_rmdir (tmp_dir);
+	g_free (manifest_filename);
+	g_free (tmp_dir);
+	g_free (archive);
+
+	return success;
+}
@@ -0,0 +1,52 @@
+/*
+ * evolution-backup-engine.h
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef EVOLUTION_BACKUP_ENGINE_H
+#define EVOLUTION_BACKUP_ENGINE_H
+
+#include <gio/gio.h>
+
+/* The archive is written into a file with this suffix
+ * and renamed to the requested name once complete. */
+#define BACKUP_ENGINE_PARTIAL_SUFFIX ".part"
+
+/* Restored directories are moved aside with this suffix,
+ * thus they can be put back when the restore fails. */
+#define BACKUP_ENGINE_OLD_SUFFIX "_old"
+
+G_BEGIN_DECLS
+
+gboolean	backup_engine_write		(const gchar *filename,
+						 const gchar *base_dir,
+						 const gchar * const *members,
+						 const gchar * const *excludes,
+						 const gchar *manifest_name,
+						 gboolean use_xz,
+						 const gchar *index_filename,
+						 GCancellable *cancellable,
+						 GError **error);
+gboolean	backup_engine_restore		(const gchar *filename,
+						 const gchar * const *members,
+						 const gchar * const *dirs,
+						 const gchar *manifest_name,
+						 gboolean use_xz,
+						 GCancellable *cancellable,
+						 GError **error);
+
+G_END_DECLS
+
+#endif /* EVOLUTION_BACKUP_ENGINE_H */
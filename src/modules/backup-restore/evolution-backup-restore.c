@@ -93,26 +93,22 @@ enum {
 };
 
 static void
-backup (const gchar *filename,
-        gboolean restart)
+backup (const gchar *filename)
 {
-	if (restart)
-		execl (
-			EVOLUTION_TOOLSDIR "/evolution-backup",
-			"evolution-backup",
-			"--gui",
-			"--backup",
-			"--restart",
-			filename,
-			NULL);
-	else
-		execl (
-			EVOLUTION_TOOLSDIR "/evolution-backup",
-			"evolution-backup",
-			"--gui",
-			"--backup",
-			filename,
-			NULL);
+	gchar *argv[] = {
+		(gchar *) EVOLUTION_TOOLSDIR "/evolution-backup",
+		(gchar *) "--gui",
+		(gchar *) "--backup",
+		(gchar *) filename,
+		NULL
+	};
+	GError *error = NULL;
+
+	/* The back up tool does not need Evolution to be closed. */
+	if (!g_spawn_async (NULL, argv, NULL, G_SPAWN_DEFAULT, NULL, NULL, NULL, &error)) {
+		g_warning ("%s: Failed to run back up tool: %s", G_STRFUNC, error ? error->message : "Unknown error");
+		g_clear_error (&error);
+	}
 }
 
 static void
@@ -258,16 +254,15 @@ action_settings_backup_cb (GtkAction *action,
 	}
 
 	if (g_file_info_get_attribute_boolean (file_info, attribute)) {
-		guint32 mask;
+		gint response;
 		gchar *path;
 
-		mask = dialog_prompt_user (
+		response = e_alert_run_dialog_for_args (
 			GTK_WINDOW (shell_window),
-			_("_Restart Evolution after backup"),
 			"org.gnome.backup-restore:backup-confirm", NULL);
-		if (mask & BR_OK) {
+		if (response == GTK_RESPONSE_YES) {
 			path = g_file_get_path (file);
-			backup (path, (mask & BR_START) ? TRUE: FALSE);
+			backup (path);
 			g_free (path);
 		}
 	} else {
@@ -37,11 +37,14 @@
 #include "e-util/e-util-private.h"
 #include "e-util/e-util.h"
 
+#include "evolution-backup-engine.h"
+
 #define EVOUSERDATADIR_MAGIC "#EVO_USERDATADIR#"
 
 #define EVOLUTION "evolution"
 #define EVOLUTION_DIR "$DATADIR/"
 #define EVOLUTION_DIR_FILE EVOLUTION ".dir"
+#define EVOLUTION_MANIFEST_FILE EVOLUTION ".sha256"
 #define DBUS_SOURCE_REGISTRY_SERVICE_FILE "$DBUSDATADIR/org.gnome.evolution.dataserver.Sources.service"
 
 #define ANCIENT_GCONF_DUMP_FILE "backup-restore-gconf.xml"
@@ -282,23 +285,19 @@ static void
 backup (const gchar *filename,
         GCancellable *cancellable)
 {
-	gchar *command;
-	gchar *quotedfname;
-	gboolean use_xz;
+	const gchar *members[4];
+	const gchar *excludes[2];
+	gchar *running_name, *index_filename;
+	GError *error = NULL;
 
 	g_return_if_fail (filename && *filename);
 
 	if (g_cancellable_is_cancelled (cancellable))
 		return;
 
-	txt = _("Shutting down Evolution");
-	/* FIXME Will the versioned setting always work? */
-	run_cmd (EVOLUTION " --quit");
-
-	run_cmd ("rm $DATADIR/.running");
-
-	if (g_cancellable_is_cancelled (cancellable))
-		return;
+	/* Evolution keeps running. The engine stores SQLite databases
+	 * from their snapshots and stores again files changed while
+	 * being read, thus no file is stored torn. */
 
 	txt = _("Backing Evolution accounts and settings");
 	run_cmd ("dconf dump " DCONF_PATH_EDS " >" EVOLUTION_DIR DCONF_DUMP_FILE_EDS);
@@ -319,31 +318,33 @@ backup (const gchar *filename,
 
 	txt = _("Backing Evolution data (Mails, Contacts, Calendar, Tasks, Memos)");
 
-	quotedfname = g_shell_quote (filename);
-	use_xz = get_filename_is_xz (filename);
+	members[0] = strip_home_dir (e_get_user_data_dir ());
+	members[1] = strip_home_dir (e_get_user_config_dir ());
+	members[2] = EVOLUTION_DIR_FILE;
+	members[3] = NULL;
 
-	command = g_strdup_printf (
-		"cd $HOME && tar chf - $STRIPDATADIR "
-		"$STRIPCONFIGDIR " EVOLUTION_DIR_FILE " | "
-		"%s > %s", use_xz ? "xz -z" : "gzip", quotedfname);
-	run_cmd (command);
+	running_name = g_strconcat (members[0], "/.running", NULL);
+	excludes[0] = running_name;
+	excludes[1] = NULL;
 
-	g_free (command);
-	g_free (quotedfname);
-
-	run_cmd ("rm $HOME/" EVOLUTION_DIR_FILE);
+	index_filename = g_build_filename (e_get_user_cache_dir (), "backup", "index", NULL);
 
-	txt = _("Back up complete");
-
-	if (restart_arg) {
+	if (!backup_engine_write (filename, g_get_home_dir (), members, excludes,
+		EVOLUTION_MANIFEST_FILE, get_filename_is_xz (filename), index_filename,
+		cancellable, &error)) {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("Failed to back up to '%s': %s", filename, error ? error->message : "Unknown error");
+		g_clear_error (&error);
+		result = 1;
+	}
 
-		if (g_cancellable_is_cancelled (cancellable))
-			return;
+	g_free (index_filename);
+	g_free (running_name);
 
-		txt = _("Restarting Evolution");
-		run_evolution_no_wait ();
-	}
+	run_cmd ("rm $HOME/" EVOLUTION_DIR_FILE);
 
+	if (!result)
+		txt = _("Back up complete");
 }
 
 static void
@@ -406,24 +407,6 @@ extract_backup_data (const gchar *filename,
 	g_key_file_free (key_file);
 }
 
-static gint
-get_dir_level (const gchar *dir)
-{
-	gint res = 0, i;
-
-	g_return_val_if_fail (dir != NULL, -1);
-
-	for (i = 0; dir[i]; i++) {
-		if (dir[i] == '/' || dir[i] == '\\')
-			res++;
-	}
-
-	if (i > 0)
-		res++;
-
-	return res;
-}
-
 static gchar *
 get_source_manager_reload_command (void)
 {
@@ -498,13 +481,6 @@ restore (const gchar *filename,
 	txt = _("Shutting down Evolution");
 	run_cmd (EVOLUTION " --quit");
 
-	if (g_cancellable_is_cancelled (cancellable))
-		return;
-
-	txt = _("Back up current Evolution data");
-	run_cmd ("mv $DATADIR $DATADIR_old");
-	run_cmd ("mv $CONFIGDIR $CONFIGDIR_old");
-
 	if (g_cancellable_is_cancelled (cancellable))
 		return;
 
@@ -516,6 +492,11 @@ restore (const gchar *filename,
 		gchar *config_dir = NULL;
 		gchar *restored_version = NULL;
 		const gchar *tar_opts;
+		const gchar *members[3];
+		const gchar *dirs[3];
+		gchar *unquoted_data_dir, *unquoted_config_dir;
+		gboolean success;
+		GError *error = NULL;
 
 		if (get_filename_is_xz (filename))
 			tar_opts = "-xJf";
@@ -553,20 +534,39 @@ restore (const gchar *filename,
 			goto end;
 		}
 
-		g_mkdir_with_parents (e_get_user_data_dir (), 0700);
-		g_mkdir_with_parents (e_get_user_config_dir (), 0700);
+		unquoted_data_dir = g_shell_unquote (data_dir, NULL);
+		unquoted_config_dir = g_shell_unquote (config_dir, NULL);
 
-		command = g_strdup_printf (
-			"cd $DATADIR && tar --strip-components %d %s %s %s",
-			 get_dir_level (data_dir), tar_opts, quotedfname, data_dir);
-		run_cmd (command);
-		g_free (command);
+		members[0] = unquoted_data_dir;
+		members[1] = unquoted_config_dir;
+		members[2] = NULL;
 
-		command = g_strdup_printf (
-			"cd $CONFIGDIR && tar --strip-components %d %s %s %s",
-			get_dir_level (config_dir), tar_opts, quotedfname, config_dir);
-		run_cmd (command);
-		g_free (command);
+		dirs[0] = e_get_user_data_dir ();
+		dirs[1] = e_get_user_config_dir ();
+		dirs[2] = NULL;
+
+		/* Moves the current data aside, to $DATADIR_old and
+		 * $CONFIGDIR_old, and puts it back when the restored
+		 * files do not match the back up. */
+		success = members[0] && members[1] && backup_engine_restore (
+			filename, members, dirs, EVOLUTION_MANIFEST_FILE,
+			get_filename_is_xz (filename), cancellable, &error);
+
+		g_free (unquoted_data_dir);
+		g_free (unquoted_config_dir);
+
+		if (!success) {
+			if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+				g_warning ("Failed to restore from '%s': %s", filename, error ? error->message : "Unknown error");
+			g_clear_error (&error);
+
+			g_free (data_dir);
+			g_free (config_dir);
+			g_free (restored_version);
+			g_free (quotedfname);
+			result = 1;
+			goto end;
+		}
 
 		/* If the back file had version information, set the last
 		 * used version in GSettings before restarting Evolution. */
@@ -590,6 +590,8 @@ restore (const gchar *filename,
 		else
 			decr_opts = "gzip -cd";
 
+		run_cmd ("mv $DATADIR $DATADIR_old");
+		run_cmd ("mv $CONFIGDIR $CONFIGDIR_old");
 		run_cmd ("mv $HOME/.evolution $HOME/.evolution_old");
 
 		command = g_strdup_printf (
@@ -844,21 +846,18 @@ dlg_response (GtkWidget *dlg,
 
 	/* We will kill just the tar operation. Rest of
 	 * them will be just a second of microseconds.*/
-	run_cmd ("pkill tar");
+	if (restore_op)
+		run_cmd ("pkill tar");
 
 	if (bk_file && backup_op && response == GTK_RESPONSE_REJECT) {
-		/* Backup was cancelled, delete the
+		/* Backup was cancelled, delete the partial
 		 * backup file as it is not needed now. */
-		gchar *cmd, *filename;
+		gchar *filename;
 
 		g_message ("Back up cancelled, removing partial back up file.");
 
-		filename = g_shell_quote (bk_file);
-		cmd = g_strconcat ("rm ", filename, NULL);
-
-		run_cmd (cmd);
-
-		g_free (cmd);
+		filename = g_strconcat (bk_file, BACKUP_ENGINE_PARTIAL_SUFFIX, NULL);
+		g_unlink (filename);
 		g_free (filename);
 	}
 
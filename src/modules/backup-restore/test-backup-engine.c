@@ -0,0 +1,537 @@
+/*
+ * test-backup-engine.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Writes archives with the back up engine and reads them with GNU tar,
+ * and restores from archives written by the engine and by plain tar. */
+
+#include "evolution-backup-engine.c"
+
+#define MANIFEST_NAME	"test.sha256"
+#define DATA_MEMBER	"share/evolution"
+#define CONFIG_MEMBER	"config/evolution"
+
+/* Does not fit into the 11 octal digits of the header field. */
+#define FUTURE_MTIME	G_GINT64_CONSTANT (10000000000)
+
+typedef struct _Fixture Fixture;
+
+struct _Fixture {
+	gchar *tmp_dir;
+	gchar *home_dir;
+	gchar *archive;
+	gchar *index;
+};
+
+static gchar *
+fixture_path (Fixture *fixture,
+              const gchar *relative)
+{
+	return g_build_filename (fixture->tmp_dir, relative, NULL);
+}
+
+static void
+fixture_set_mtime (Fixture *fixture,
+                   const gchar *relative,
+                   gint64 mtime)
+{
+	GFile *file;
+	gchar *filename;
+	GError *error = NULL;
+
+	filename = fixture_path (fixture, relative);
+	file = g_file_new_for_path (filename);
+
+	g_file_set_attribute_uint64 (
+		file, G_FILE_ATTRIBUTE_TIME_MODIFIED, mtime,
+		G_FILE_QUERY_INFO_NONE, NULL, &error);
+	g_assert_no_error (error);
+
+	g_object_unref (file);
+	g_free (filename);
+}
+
+static gint64
+fixture_get_mtime (Fixture *fixture,
+                   const gchar *relative)
+{
+	GStatBuf st;
+	gchar *filename;
+
+	filename = fixture_path (fixture, relative);
+	g_assert_cmpint (g_stat (filename, &st), ==, 0);
+	g_free (filename);
+
+	return st.st_mtime;
+}
+
+static void
+fixture_write_file (Fixture *fixture,
+                    const gchar *relative,
+                    const gchar *content,
+                    gint64 mtime)
+{
+	gchar *filename, *dirname;
+	GError *error = NULL;
+
+	filename = fixture_path (fixture, relative);
+	dirname = g_path_get_dirname (filename);
+
+	g_assert_cmpint (g_mkdir_with_parents (dirname, 0700), ==, 0);
+	g_file_set_contents (filename, content, -1, &error);
+	g_assert_no_error (error);
+
+	if (mtime > 0)
+		fixture_set_mtime (fixture, relative, mtime);
+
+	g_free (dirname);
+	g_free (filename);
+}
+
+static void
+fixture_assert_file (Fixture *fixture,
+                     const gchar *relative,
+                     const gchar *expected)
+{
+	gchar *filename, *content = NULL;
+	GError *error = NULL;
+
+	filename = fixture_path (fixture, relative);
+
+	if (expected) {
+		g_file_get_contents (filename, &content, NULL, &error);
+		g_assert_no_error (error);
+		g_assert_cmpstr (content, ==, expected);
+	} else {
+		g_assert (!g_file_test (filename, G_FILE_TEST_EXISTS));
+	}
+
+	g_free (content);
+	g_free (filename);
+}
+
+/* Runs tar in the temporary directory and returns its standard output;
+ * the exit status is checked only when @check is set. */
+static gchar *
+fixture_run_tar (Fixture *fixture,
+                 gboolean check,
+                 const gchar *arg1,
+                 ...)
+{
+	GSubprocessLauncher *launcher;
+	GSubprocess *subprocess;
+	GPtrArray *argv;
+	const gchar *arg;
+	gchar *stdout_buf = NULL;
+	GError *error = NULL;
+	va_list va;
+
+	argv = g_ptr_array_new ();
+	g_ptr_array_add (argv, (gpointer) "tar");
+
+	va_start (va, arg1);
+	for (arg = arg1; arg; arg = va_arg (va, const gchar *)) {
+		g_ptr_array_add (argv, (gpointer) arg);
+	}
+	va_end (va);
+
+	g_ptr_array_add (argv, NULL);
+
+	launcher = g_subprocess_launcher_new (
+		G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+		G_SUBPROCESS_FLAGS_STDERR_SILENCE);
+	g_subprocess_launcher_set_cwd (launcher, fixture->tmp_dir);
+
+	subprocess = g_subprocess_launcher_spawnv (launcher, (const gchar * const *) argv->pdata, &error);
+	g_assert_no_error (error);
+
+	g_subprocess_communicate_utf8 (subprocess, NULL, NULL, &stdout_buf, NULL, &error);
+	g_assert_no_error (error);
+
+	if (check)
+		g_assert (g_subprocess_get_successful (subprocess));
+
+	g_object_unref (subprocess);
+	g_object_unref (launcher);
+	g_ptr_array_unref (argv);
+
+	return stdout_buf;
+}
+
+static gboolean
+fixture_backup (Fixture *fixture,
+                GError **error)
+{
+	const gchar *members[] = { DATA_MEMBER, CONFIG_MEMBER, NULL };
+	const gchar *excludes[] = { DATA_MEMBER "/.running", NULL };
+
+	return backup_engine_write (
+		fixture->archive, fixture->home_dir, members, excludes,
+		MANIFEST_NAME, FALSE, fixture->index, NULL, error);
+}
+
+static gboolean
+fixture_restore (Fixture *fixture,
+                 const gchar *archive,
+                 GError **error)
+{
+	const gchar *members[] = { DATA_MEMBER, CONFIG_MEMBER, NULL };
+	const gchar *dirs[3];
+	gboolean success;
+
+	dirs[0] = g_build_filename (fixture->tmp_dir, "data", NULL);
+	dirs[1] = g_build_filename (fixture->tmp_dir, "config", NULL);
+	dirs[2] = NULL;
+
+	success = backup_engine_restore (archive, members, dirs, MANIFEST_NAME, FALSE, NULL, error);
+
+	g_free ((gchar *) dirs[0]);
+	g_free ((gchar *) dirs[1]);
+
+	return success;
+}
+
+static void
+fixture_set_up (Fixture *fixture,
+                gconstpointer user_data)
+{
+	GError *error = NULL;
+	gint64 old_mtime;
+
+	fixture->tmp_dir = g_dir_make_tmp ("test-backup-XXXXXX", &error);
+	g_assert_no_error (error);
+
+	fixture->home_dir = fixture_path (fixture, "home");
+	fixture->archive = fixture_path (fixture, "backup.tar.gz");
+	fixture->index = fixture_path (fixture, "index");
+
+	/* Older than the back up start, thus the files are indexed. */
+	old_mtime = g_get_real_time () / G_USEC_PER_SEC - 3600;
+
+	fixture_write_file (fixture, "home/" DATA_MEMBER "/mail/inbox", "inbox content", old_mtime);
+	fixture_write_file (fixture, "home/" DATA_MEMBER "/mail/empty", "", old_mtime);
+	fixture_write_file (fixture, "home/" DATA_MEMBER "/.running", "", 0);
+	fixture_write_file (fixture, "home/" CONFIG_MEMBER "/sources/account.source", "[Data Source]\n", old_mtime);
+
+	/* The current data, which is replaced by the restore. */
+	fixture_write_file (fixture, "data/mail/inbox", "current inbox", 0);
+	fixture_write_file (fixture, "config/sources/account.source", "current source", 0);
+}
+
+static void
+fixture_tear_down (Fixture *fixture,
+                   gconstpointer user_data)
+{
+	backup_engine_remove_tree (fixture->tmp_dir);
+
+	g_free (fixture->tmp_dir);
+	g_free (fixture->home_dir);
+	g_free (fixture->archive);
+	g_free (fixture->index);
+}
+
+static void
+test_tar_number (void)
+{
+	gchar field[12];
+	guint64 value = 0;
+	guint64 large = G_GUINT64_CONSTANT (10) << 30;
+	guint ii;
+
+	tar_set_number (field, sizeof (field), 01234);
+	g_assert_cmpstr (field, ==, "00000001234");
+
+	/* The largest value written as octal digits */
+	tar_set_number (field, sizeof (field), G_GUINT64_CONSTANT (077777777777));
+	g_assert_cmpstr (field, ==, "77777777777");
+
+	/* Sizes over 8 GiB use the GNU base-256 encoding */
+	tar_set_number (field, sizeof (field), large);
+	g_assert_cmpint ((guchar) field[0], ==, 0x80);
+
+	for (ii = 1; ii < G_N_ELEMENTS (field); ii++) {
+		value = (value << 8) | (guchar) field[ii];
+	}
+
+	g_assert_cmpuint (value, ==, large);
+}
+
+static void
+test_tar_large_size (Fixture *fixture,
+                     gconstpointer user_data)
+{
+	static const guint8 zeros[2 * TAR_BLOCK_SIZE] = { 0 };
+	GByteArray *data;
+	gchar *filename, *listing;
+	GError *error = NULL;
+
+	/* Only the header; tar lists it before it finds the data missing. */
+	data = g_byte_array_new ();
+	tar_append_header (data, "large", TAR_TYPE_FILE, 0600, 0, 0, G_GUINT64_CONSTANT (10) << 30, 1000);
+	g_byte_array_append (data, zeros, sizeof (zeros));
+
+	filename = fixture_path (fixture, "large.tar");
+	g_file_set_contents (filename, (const gchar *) data->data, data->len, &error);
+	g_assert_no_error (error);
+
+	listing = fixture_run_tar (fixture, FALSE, "-tvf", filename, NULL);
+	g_assert (strstr (listing, " 10737418240 ") != NULL);
+
+	g_byte_array_unref (data);
+	g_free (listing);
+	g_free (filename);
+}
+
+static void
+test_round_trip (Fixture *fixture,
+                 gconstpointer user_data)
+{
+	GString *long_name;
+	GStatBuf st;
+	gchar *extract_dir, *filename, *manifest = NULL;
+	GError *error = NULL;
+
+	/* Stored with a GNU LongLink entry */
+	long_name = g_string_new ("home/" DATA_MEMBER "/");
+	while (long_name->len < 150) {
+		g_string_append (long_name, "a-rather-long-directory-name/");
+	}
+	g_string_append (long_name, "message-with-a-long-name.eml");
+
+	fixture_write_file (fixture, long_name->str, "long name content", 0);
+	fixture_write_file (fixture, "home/" DATA_MEMBER "/future", "future content", FUTURE_MTIME);
+
+	g_assert (fixture_backup (fixture, &error));
+	g_assert_no_error (error);
+
+	extract_dir = fixture_path (fixture, "extract");
+	g_assert_cmpint (g_mkdir (extract_dir, 0700), ==, 0);
+	g_free (fixture_run_tar (fixture, TRUE, "-xzf", fixture->archive, "-C", extract_dir, NULL));
+
+	fixture_assert_file (fixture, "extract/" DATA_MEMBER "/mail/inbox", "inbox content");
+	fixture_assert_file (fixture, "extract/" DATA_MEMBER "/mail/empty", "");
+	fixture_assert_file (fixture, "extract/" DATA_MEMBER "/future", "future content");
+	fixture_assert_file (fixture, "extract/" DATA_MEMBER "/.running", NULL);
+	fixture_assert_file (fixture, "extract/" CONFIG_MEMBER "/sources/account.source", "[Data Source]\n");
+
+	/* Strip the "home/" prefix */
+	filename = g_build_filename (extract_dir, long_name->str + 5, NULL);
+	g_assert (g_file_test (filename, G_FILE_TEST_IS_REGULAR));
+	g_free (filename);
+
+	/* The modification time is stored in base-256 */
+	filename = g_build_filename (extract_dir, DATA_MEMBER, "future", NULL);
+	g_assert_cmpint (g_stat (filename, &st), ==, 0);
+	g_assert_cmpint ((gint64) st.st_mtime, ==, FUTURE_MTIME);
+	g_free (filename);
+
+	filename = g_build_filename (extract_dir, MANIFEST_NAME, NULL);
+	g_file_get_contents (filename, &manifest, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (strstr (manifest, "  " DATA_MEMBER "/mail/inbox\n") != NULL);
+	g_assert (strstr (manifest, "message-with-a-long-name.eml\n") != NULL);
+	g_free (filename);
+
+	g_assert (g_file_test (fixture->index, G_FILE_TEST_IS_REGULAR));
+
+	g_string_free (long_name, TRUE);
+	g_free (manifest);
+	g_free (extract_dir);
+}
+
+static void
+test_chunk_reuse (Fixture *fixture,
+                  gconstpointer user_data)
+{
+	gchar *previous;
+	gint64 old_mtime, dir_mtime;
+	GError *error = NULL;
+
+	g_assert (fixture_backup (fixture, &error));
+	g_assert_no_error (error);
+
+	/* The next archive is written beside the previous one,
+	 * which has to stay where the index says it is. */
+	previous = fixture->archive;
+	fixture->archive = fixture_path (fixture, "second.tar.gz");
+
+	/* Same size and times; the engine trusts the index, thus
+	 * the previous content is copied from the previous archive. */
+	old_mtime = fixture_get_mtime (fixture, "home/" DATA_MEMBER "/mail/inbox");
+	dir_mtime = fixture_get_mtime (fixture, "home/" DATA_MEMBER "/mail");
+	fixture_write_file (fixture, "home/" DATA_MEMBER "/mail/inbox", "INBOX CONTENT", old_mtime);
+	fixture_set_mtime (fixture, "home/" DATA_MEMBER "/mail", dir_mtime);
+
+	g_assert (fixture_backup (fixture, &error));
+	g_assert_no_error (error);
+
+	g_assert (fixture_restore (fixture, fixture->archive, &error));
+	g_assert_no_error (error);
+	fixture_assert_file (fixture, "data/mail/inbox", "inbox content");
+
+	/* A changed modification time means the file is read again. */
+	g_free (previous);
+	previous = fixture->archive;
+	fixture->archive = fixture_path (fixture, "third.tar.gz");
+	fixture_write_file (fixture, "home/" DATA_MEMBER "/mail/inbox", "INBOX CONTENT", old_mtime - 60);
+
+	g_assert (fixture_backup (fixture, &error));
+	g_assert_no_error (error);
+
+	g_assert (fixture_restore (fixture, fixture->archive, &error));
+	g_assert_no_error (error);
+	fixture_assert_file (fixture, "data/mail/inbox", "INBOX CONTENT");
+
+	g_free (previous);
+}
+
+static void
+test_restore (Fixture *fixture,
+              gconstpointer user_data)
+{
+	GError *error = NULL;
+
+	g_assert (fixture_backup (fixture, &error));
+	g_assert_no_error (error);
+
+	g_assert (fixture_restore (fixture, fixture->archive, &error));
+	g_assert_no_error (error);
+
+	fixture_assert_file (fixture, "data/mail/inbox", "inbox content");
+	fixture_assert_file (fixture, "data/.running", NULL);
+	fixture_assert_file (fixture, "config/sources/account.source", "[Data Source]\n");
+
+	/* The previous data is kept for the caller to remove. */
+	fixture_assert_file (fixture, "data_old/mail/inbox", "current inbox");
+	fixture_assert_file (fixture, "config_old/sources/account.source", "current source");
+}
+
+static void
+test_restore_mismatch (Fixture *fixture,
+                       gconstpointer user_data)
+{
+	gchar *extract_dir, *archive;
+	GError *error = NULL;
+
+	g_assert (fixture_backup (fixture, &error));
+	g_assert_no_error (error);
+
+	/* Change a file, but keep the manifest of the original. */
+	extract_dir = fixture_path (fixture, "extract");
+	g_assert_cmpint (g_mkdir (extract_dir, 0700), ==, 0);
+	g_free (fixture_run_tar (fixture, TRUE, "-xzf", fixture->archive, "-C", extract_dir, NULL));
+
+	fixture_write_file (fixture, "extract/" DATA_MEMBER "/mail/inbox", "damaged", 0);
+
+	archive = fixture_path (fixture, "damaged.tar.gz");
+	g_free (fixture_run_tar (
+		fixture, TRUE, "-czf", archive, "-C", extract_dir,
+		DATA_MEMBER, CONFIG_MEMBER, MANIFEST_NAME, NULL));
+
+	g_assert (!fixture_restore (fixture, archive, &error));
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+	g_clear_error (&error);
+
+	/* The current data is put back from the _old directories. */
+	fixture_assert_file (fixture, "data/mail/inbox", "current inbox");
+	fixture_assert_file (fixture, "config/sources/account.source", "current source");
+	fixture_assert_file (fixture, "data_old", NULL);
+	fixture_assert_file (fixture, "config_old", NULL);
+
+	g_free (archive);
+	g_free (extract_dir);
+}
+
+static void
+test_restore_missing_member (Fixture *fixture,
+                             gconstpointer user_data)
+{
+	gchar *archive;
+	GError *error = NULL;
+
+	/* No config member at all */
+	archive = fixture_path (fixture, "partial.tar.gz");
+	g_free (fixture_run_tar (
+		fixture, TRUE, "-czf", archive, "-C",
+		fixture->home_dir, DATA_MEMBER, NULL));
+
+	g_assert (!fixture_restore (fixture, archive, &error));
+	g_assert (error != NULL);
+	g_clear_error (&error);
+
+	fixture_assert_file (fixture, "data/mail/inbox", "current inbox");
+	fixture_assert_file (fixture, "config/sources/account.source", "current source");
+	fixture_assert_file (fixture, "data_old", NULL);
+
+	g_free (archive);
+}
+
+static void
+test_restore_legacy (Fixture *fixture,
+                     gconstpointer user_data)
+{
+	gchar *archive;
+	GError *error = NULL;
+
+	/* Written by the tar command, as older versions did;
+	 * it has no manifest, thus it is not verified. */
+	archive = fixture_path (fixture, "legacy.tar.gz");
+	g_free (fixture_run_tar (
+		fixture, TRUE, "-czf", archive, "-C", fixture->home_dir,
+		DATA_MEMBER, CONFIG_MEMBER, NULL));
+
+	g_assert (fixture_restore (fixture, archive, &error));
+	g_assert_no_error (error);
+
+	fixture_assert_file (fixture, "data/mail/inbox", "inbox content");
+	fixture_assert_file (fixture, "data/mail/empty", "");
+	fixture_assert_file (fixture, "config/sources/account.source", "[Data Source]\n");
+	fixture_assert_file (fixture, "data_old/mail/inbox", "current inbox");
+
+	g_free (archive);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/BackupEngine/TarNumber", test_tar_number);
+	g_test_add (
+		"/BackupEngine/TarLargeSize", Fixture, NULL,
+		fixture_set_up, test_tar_large_size, fixture_tear_down);
+	g_test_add (
+		"/BackupEngine/RoundTrip", Fixture, NULL,
+		fixture_set_up, test_round_trip, fixture_tear_down);
+	g_test_add (
+		"/BackupEngine/ChunkReuse", Fixture, NULL,
+		fixture_set_up, test_chunk_reuse, fixture_tear_down);
+	g_test_add (
+		"/BackupEngine/Restore", Fixture, NULL,
+		fixture_set_up, test_restore, fixture_tear_down);
+	g_test_add (
+		"/BackupEngine/RestoreMismatch", Fixture, NULL,
+		fixture_set_up, test_restore_mismatch, fixture_tear_down);
+	g_test_add (
+		"/BackupEngine/RestoreMissingMember", Fixture, NULL,
+		fixture_set_up, test_restore_missing_member, fixture_tear_down);
+	g_test_add (
+		"/BackupEngine/RestoreLegacy", Fixture, NULL,
+		fixture_set_up, test_restore_legacy, fixture_tear_down);
+
+	return g_test_run ();
+}
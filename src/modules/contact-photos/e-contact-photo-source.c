@@ -26,11 +26,23 @@ typedef struct _AsyncContext AsyncContext;
 struct _EContactPhotoSourcePrivate {
 	EClientCache *client_cache;
 	ESource *source;
+
+	/* Email addresses of the book's contacts, kept current through
+	 * a client view, so that addresses the book does not know about
+	 * are answered without querying the book.  Guarded by index_lock,
+	 * because the view can be created on a different thread. */
+	GMutex index_lock;
+	EBookClientView *index_view;
+	GHashTable *index_uids;		/* uid ~> GSList of email keys */
+	GHashTable *index_emails;	/* email key ~> contact count */
+	gboolean index_requested;
+	gboolean index_complete;
 };
 
 struct _AsyncContext {
 	EBookClient *client;
 	gchar *query_string;
+	gchar *email_key;
 	GInputStream *stream;
 	GCancellable *cancellable;
 	gint priority;
@@ -60,12 +72,301 @@ async_context_free (AsyncContext *async_context)
 {
 	g_clear_object (&async_context->client);
 	g_free (async_context->query_string);
+	g_free (async_context->email_key);
 	g_clear_object (&async_context->stream);
 	g_clear_object (&async_context->cancellable);
 
 	g_slice_free (AsyncContext, async_context);
 }
 
+static void
+contact_photo_source_free_keys (gpointer keys)
+{
+	g_slist_free_full (keys, (GDestroyNotify) g_free);
+}
+
+static gchar *
+contact_photo_source_email_key (const gchar *email_address)
+{
+	gchar *stripped, *key;
+
+	if (email_address == NULL)
+		return NULL;
+
+	stripped = g_strstrip (g_strdup (email_address));
+	key = g_utf8_casefold (stripped, -1);
+	g_free (stripped);
+
+	return key;
+}
+
+static void
+contact_photo_source_index_remove_locked (EContactPhotoSource *photo_source,
+                                          const gchar *uid)
+{
+	GSList *keys, *link;
+
+	keys = g_hash_table_lookup (photo_source->priv->index_uids, uid);
+
+	for (link = keys; link != NULL; link = g_slist_next (link)) {
+		GHashTable *emails = photo_source->priv->index_emails;
+		guint count;
+
+		count = GPOINTER_TO_UINT (g_hash_table_lookup (emails, link->data));
+		if (count > 1)
+			g_hash_table_insert (emails, g_strdup (link->data), GUINT_TO_POINTER (count - 1));
+		else
+			g_hash_table_remove (emails, link->data);
+	}
+
+	g_hash_table_remove (photo_source->priv->index_uids, uid);
+}
+
+static void
+contact_photo_source_index_add_locked (EContactPhotoSource *photo_source,
+                                       EContact *contact)
+{
+	GList *emails, *link;
+	GSList *keys = NULL;
+	const gchar *uid;
+
+	uid = e_contact_get_const (contact, E_CONTACT_UID);
+	if (uid == NULL)
+		return;
+
+	contact_photo_source_index_remove_locked (photo_source, uid);
+
+	emails = e_contact_get (contact, E_CONTACT_EMAIL);
+
+	for (link = emails; link != NULL; link = g_list_next (link)) {
+		GHashTable *index_emails = photo_source->priv->index_emails;
+		gchar *key;
+		guint count;
+
+		key = contact_photo_source_email_key (link->data);
+		if (key == NULL || *key == '\0') {
+			g_free (key);
+			continue;
+		}
+
+		count = GPOINTER_TO_UINT (g_hash_table_lookup (index_emails, key));
+		g_hash_table_insert (index_emails, g_strdup (key), GUINT_TO_POINTER (count + 1));
+
+		keys = g_slist_prepend (keys, key);
+	}
+
+	g_list_free_full (emails, (GDestroyNotify) g_free);
+
+	if (keys != NULL)
+		g_hash_table_insert (photo_source->priv->index_uids, g_strdup (uid), keys);
+}
+
+static void
+contact_photo_source_index_clear_locked (EContactPhotoSource *photo_source)
+{
+	EContactPhotoSourcePrivate *priv = photo_source->priv;
+
+	if (priv->index_view != NULL) {
+		g_signal_handlers_disconnect_matched (
+			priv->index_view, G_SIGNAL_MATCH_DATA,
+			0, 0, NULL, NULL, photo_source);
+		e_book_client_view_stop (priv->index_view, NULL);
+		g_clear_object (&priv->index_view);
+	}
+
+	g_hash_table_remove_all (priv->index_uids);
+	g_hash_table_remove_all (priv->index_emails);
+	priv->index_complete = FALSE;
+}
+
+static void
+contact_photo_source_view_objects_added_cb (EBookClientView *client_view,
+                                            const GSList *contacts,
+                                            EContactPhotoSource *photo_source)
+{
+	const GSList *link;
+
+	g_mutex_lock (&photo_source->priv->index_lock);
+
+	for (link = contacts; link != NULL; link = g_slist_next (link))
+		contact_photo_source_index_add_locked (photo_source, link->data);
+
+	g_mutex_unlock (&photo_source->priv->index_lock);
+}
+
+static void
+contact_photo_source_view_objects_removed_cb (EBookClientView *client_view,
+                                              const GSList *uids,
+                                              EContactPhotoSource *photo_source)
+{
+	const GSList *link;
+
+	g_mutex_lock (&photo_source->priv->index_lock);
+
+	for (link = uids; link != NULL; link = g_slist_next (link))
+		contact_photo_source_index_remove_locked (photo_source, link->data);
+
+	g_mutex_unlock (&photo_source->priv->index_lock);
+}
+
+static void
+contact_photo_source_view_complete_cb (EBookClientView *client_view,
+                                       const GError *error,
+                                       EContactPhotoSource *photo_source)
+{
+	g_mutex_lock (&photo_source->priv->index_lock);
+
+	/* Without a complete index every address is looked up. */
+	if (error == NULL)
+		photo_source->priv->index_complete = TRUE;
+
+	g_mutex_unlock (&photo_source->priv->index_lock);
+}
+
+static void
+contact_photo_source_get_view_cb (GObject *source_object,
+                                  GAsyncResult *result,
+                                  gpointer user_data)
+{
+	EContactPhotoSource *photo_source;
+	EBookClientView *client_view = NULL;
+	GWeakRef *weak_ref = user_data;
+	GSList *fields = NULL;
+	GError *error = NULL;
+
+	e_book_client_get_view_finish (
+		E_BOOK_CLIENT (source_object), result, &client_view, &error);
+
+	photo_source = g_weak_ref_get (weak_ref);
+	e_weak_ref_free (weak_ref);
+
+	if (error != NULL) {
+		g_warn_if_fail (client_view == NULL);
+		g_debug ("%s: Failed to create view: %s", G_STRFUNC, error->message);
+		g_error_free (error);
+
+		if (photo_source != NULL) {
+			g_mutex_lock (&photo_source->priv->index_lock);
+			photo_source->priv->index_requested = FALSE;
+			g_mutex_unlock (&photo_source->priv->index_lock);
+			g_object_unref (photo_source);
+		}
+		return;
+	}
+
+	if (photo_source == NULL) {
+		g_object_unref (client_view);
+		return;
+	}
+
+	/* Only the addresses are needed, not the photos. */
+	fields = g_slist_prepend (fields, (gpointer) e_contact_field_name (E_CONTACT_EMAIL));
+	fields = g_slist_prepend (fields, (gpointer) e_contact_field_name (E_CONTACT_UID));
+	e_book_client_view_set_fields_of_interest (client_view, fields, NULL);
+	g_slist_free (fields);
+
+	g_mutex_lock (&photo_source->priv->index_lock);
+
+	photo_source->priv->index_view = client_view;
+
+	g_signal_connect (
+		client_view, "objects-added",
+		G_CALLBACK (contact_photo_source_view_objects_added_cb),
+		photo_source);
+	g_signal_connect (
+		client_view, "objects-modified",
+		G_CALLBACK (contact_photo_source_view_objects_added_cb),
+		photo_source);
+	g_signal_connect (
+		client_view, "objects-removed",
+		G_CALLBACK (contact_photo_source_view_objects_removed_cb),
+		photo_source);
+	g_signal_connect (
+		client_view, "complete",
+		G_CALLBACK (contact_photo_source_view_complete_cb),
+		photo_source);
+
+	g_mutex_unlock (&photo_source->priv->index_lock);
+
+	e_book_client_view_start (client_view, &error);
+
+	if (error != NULL) {
+		g_debug ("%s: Failed to start view: %s", G_STRFUNC, error->message);
+		g_error_free (error);
+
+		g_mutex_lock (&photo_source->priv->index_lock);
+		contact_photo_source_index_clear_locked (photo_source);
+		photo_source->priv->index_requested = FALSE;
+		g_mutex_unlock (&photo_source->priv->index_lock);
+	}
+
+	g_object_unref (photo_source);
+}
+
+/* Returns whether the book has to be asked for the email address.
+ * Until the index is complete every address is looked up, and the
+ * first caller is told to request the view which builds the index. */
+static gboolean
+contact_photo_source_index_lookup (EContactPhotoSource *photo_source,
+                                   const gchar *email_key,
+                                   gboolean *out_request_view)
+{
+	gboolean need_lookup = TRUE;
+
+	*out_request_view = FALSE;
+
+	g_mutex_lock (&photo_source->priv->index_lock);
+
+	if (photo_source->priv->index_complete) {
+		need_lookup = email_key != NULL && g_hash_table_contains (
+			photo_source->priv->index_emails, email_key);
+	} else if (!photo_source->priv->index_requested) {
+		photo_source->priv->index_requested = TRUE;
+		*out_request_view = TRUE;
+	}
+
+	g_mutex_unlock (&photo_source->priv->index_lock);
+
+	return need_lookup;
+}
+
+/* Like contact_photo_source_index_lookup(), but only books, which
+ * can list all their contacts, are indexed; a view of an online book,
+ * like LDAP, would download it whole or be truncated by the server,
+ * thus those are always asked. */
+static gboolean
+contact_photo_source_index_check (EContactPhotoSource *photo_source,
+                                  EBookClient *client,
+                                  const gchar *email_key)
+{
+	gboolean need_lookup;
+	gboolean request_view = FALSE;
+
+	if (!e_client_check_capability (E_CLIENT (client), "do-initial-query"))
+		return TRUE;
+
+	need_lookup = contact_photo_source_index_lookup (
+		photo_source, email_key, &request_view);
+
+	if (request_view) {
+		EBookQuery *book_query;
+		gchar *sexp;
+
+		book_query = e_book_query_field_exists (E_CONTACT_EMAIL);
+		sexp = e_book_query_to_string (book_query);
+		e_book_query_unref (book_query);
+
+		e_book_client_get_view (
+			client, sexp, NULL,
+			contact_photo_source_get_view_cb,
+			e_weak_ref_new (photo_source));
+
+		g_free (sexp);
+	}
+
+	return need_lookup;
+}
+
 static EContactPhoto *
 contact_photo_source_extract_photo (EContact *contact,
                                     gint *out_priority)
@@ -179,14 +480,28 @@ contact_photo_source_get_client_cb (GObject *source_object,
 		((client == NULL) && (error != NULL)));
 
 	if (client != NULL) {
+		GObject *photo_source;
+
 		async_context->client = g_object_ref (client);
 
-		/* The rest of the operation we can run from a
-		 * worker thread to keep the logic flow simple. */
-		g_simple_async_result_run_in_thread (
-			simple, contact_photo_source_get_photo_thread,
-			G_PRIORITY_DEFAULT, async_context->cancellable);
+		photo_source = g_async_result_get_source_object (
+			G_ASYNC_RESULT (simple));
+
+		if (contact_photo_source_index_check (
+			E_CONTACT_PHOTO_SOURCE (photo_source),
+			E_BOOK_CLIENT (client),
+			async_context->email_key)) {
+			/* The rest of the operation we can run from a
+			 * worker thread to keep the logic flow simple. */
+			g_simple_async_result_run_in_thread (
+				simple, contact_photo_source_get_photo_thread,
+				G_PRIORITY_DEFAULT, async_context->cancellable);
+		} else {
+			/* No contact in this book has the address. */
+			g_simple_async_result_complete_in_idle (simple);
+		}
 
+		g_object_unref (photo_source);
 		g_object_unref (client);
 
 	} else {
@@ -272,6 +587,10 @@ contact_photo_source_dispose (GObject *object)
 
 	priv = E_CONTACT_PHOTO_SOURCE_GET_PRIVATE (object);
 
+	g_mutex_lock (&priv->index_lock);
+	contact_photo_source_index_clear_locked (E_CONTACT_PHOTO_SOURCE (object));
+	g_mutex_unlock (&priv->index_lock);
+
 	g_clear_object (&priv->client_cache);
 	g_clear_object (&priv->source);
 
@@ -279,6 +598,21 @@ contact_photo_source_dispose (GObject *object)
 	G_OBJECT_CLASS (e_contact_photo_source_parent_class)->dispose (object);
 }
 
+static void
+contact_photo_source_finalize (GObject *object)
+{
+	EContactPhotoSourcePrivate *priv;
+
+	priv = E_CONTACT_PHOTO_SOURCE_GET_PRIVATE (object);
+
+	g_hash_table_destroy (priv->index_uids);
+	g_hash_table_destroy (priv->index_emails);
+	g_mutex_clear (&priv->index_lock);
+
+	/* Chain up to parent's finalize() method. */
+	G_OBJECT_CLASS (e_contact_photo_source_parent_class)->finalize (object);
+}
+
 static void
 contact_photo_source_get_photo (EPhotoSource *photo_source,
                                 const gchar *email_address,
@@ -298,6 +632,7 @@ contact_photo_source_get_photo (EPhotoSource *photo_source,
 
 	async_context = g_slice_new0 (AsyncContext);
 	async_context->query_string = e_book_query_to_string (book_query);
+	async_context->email_key = contact_photo_source_email_key (email_address);
 
 	if (G_IS_CANCELLABLE (cancellable))
 		async_context->cancellable = g_object_ref (cancellable);
@@ -385,6 +720,7 @@ e_contact_photo_source_class_init (EContactPhotoSourceClass *class)
 	object_class->set_property = contact_photo_source_set_property;
 	object_class->get_property = contact_photo_source_get_property;
 	object_class->dispose = contact_photo_source_dispose;
+	object_class->finalize = contact_photo_source_finalize;
 
 	g_object_class_install_property (
 		object_class,
@@ -425,6 +761,18 @@ static void
 e_contact_photo_source_init (EContactPhotoSource *photo_source)
 {
 	photo_source->priv = E_CONTACT_PHOTO_SOURCE_GET_PRIVATE (photo_source);
+
+	g_mutex_init (&photo_source->priv->index_lock);
+	photo_source->priv->index_uids = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) contact_photo_source_free_keys);
+	photo_source->priv->index_emails = g_hash_table_new_full (
+		(GHashFunc) g_str_hash,
+		(GEqualFunc) g_str_equal,
+		(GDestroyNotify) g_free,
+		(GDestroyNotify) NULL);
 }
 
 void
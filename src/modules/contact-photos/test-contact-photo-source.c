@@ -0,0 +1,269 @@
+/*
+ * test-contact-photo-source.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Feeds the email index of a local address book, the way its client
+ * view does, and checks which addresses the book is asked for.  The
+ * source file is included to reach the static index functions. */
+
+#include "evolution-config.h"
+
+#include "e-contact-photo-source.c"
+
+typedef struct _TestModule TestModule;
+typedef struct _TestModuleClass TestModuleClass;
+
+struct _TestModule {
+	GTypeModule parent;
+};
+
+struct _TestModuleClass {
+	GTypeModuleClass parent_class;
+};
+
+typedef struct _Fixture Fixture;
+
+struct _Fixture {
+	EContactPhotoSource *photo_source;
+};
+
+GType test_module_get_type (void);
+
+G_DEFINE_TYPE (TestModule, test_module, G_TYPE_TYPE_MODULE)
+
+static gboolean
+test_module_load (GTypeModule *type_module)
+{
+	return TRUE;
+}
+
+static void
+test_module_unload (GTypeModule *type_module)
+{
+}
+
+static void
+test_module_class_init (TestModuleClass *class)
+{
+	GTypeModuleClass *type_module_class;
+
+	type_module_class = G_TYPE_MODULE_CLASS (class);
+	type_module_class->load = test_module_load;
+	type_module_class->unload = test_module_unload;
+}
+
+static void
+test_module_init (TestModule *module)
+{
+}
+
+static void
+fixture_set_up (Fixture *fixture,
+                gconstpointer user_data)
+{
+	/* Neither the client cache nor the source
+	 * is needed by the index, thus not set. */
+	fixture->photo_source = g_object_new (E_TYPE_CONTACT_PHOTO_SOURCE, NULL);
+}
+
+static void
+fixture_tear_down (Fixture *fixture,
+                   gconstpointer user_data)
+{
+	g_object_unref (fixture->photo_source);
+}
+
+static EContact *
+fixture_new_contact (const gchar *uid,
+                     const gchar *email1,
+                     const gchar *email2)
+{
+	EContact *contact;
+	GList *emails = NULL;
+
+	contact = e_contact_new ();
+	e_contact_set (contact, E_CONTACT_UID, uid);
+
+	if (email2 != NULL)
+		emails = g_list_prepend (emails, (gpointer) email2);
+	if (email1 != NULL)
+		emails = g_list_prepend (emails, (gpointer) email1);
+
+	e_contact_set (contact, E_CONTACT_EMAIL, emails);
+	g_list_free (emails);
+
+	return contact;
+}
+
+static void
+fixture_add_contact (Fixture *fixture,
+                     const gchar *uid,
+                     const gchar *email1,
+                     const gchar *email2)
+{
+	EContact *contact;
+	GSList *contacts;
+
+	contact = fixture_new_contact (uid, email1, email2);
+	contacts = g_slist_prepend (NULL, contact);
+
+	contact_photo_source_view_objects_added_cb (
+		NULL, contacts, fixture->photo_source);
+
+	g_slist_free_full (contacts, (GDestroyNotify) g_object_unref);
+}
+
+static void
+fixture_remove_contact (Fixture *fixture,
+                        const gchar *uid)
+{
+	GSList *uids;
+
+	uids = g_slist_prepend (NULL, (gpointer) uid);
+
+	contact_photo_source_view_objects_removed_cb (
+		NULL, uids, fixture->photo_source);
+
+	g_slist_free (uids);
+}
+
+static gboolean
+fixture_need_lookup (Fixture *fixture,
+                     const gchar *email_address)
+{
+	gboolean need_lookup;
+	gboolean request_view = TRUE;
+	gchar *email_key;
+
+	email_key = contact_photo_source_email_key (email_address);
+
+	need_lookup = contact_photo_source_index_lookup (
+		fixture->photo_source, email_key, &request_view);
+
+	/* The view is requested only once. */
+	g_assert (!request_view);
+
+	g_free (email_key);
+
+	return need_lookup;
+}
+
+static void
+test_index_incomplete (Fixture *fixture,
+                       gconstpointer user_data)
+{
+	gboolean request_view = FALSE;
+	GError *error;
+
+	/* The first lookup asks for the view. */
+	g_assert (contact_photo_source_index_lookup (
+		fixture->photo_source, "nobody@example.com", &request_view));
+	g_assert (request_view);
+
+	/* Until the view completes every address is looked up. */
+	fixture_add_contact (fixture, "1", "someone@example.com", NULL);
+	g_assert (fixture_need_lookup (fixture, "someone@example.com"));
+	g_assert (fixture_need_lookup (fixture, "nobody@example.com"));
+
+	/* A failed view keeps it that way. */
+	error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_FAILED, "failed");
+	contact_photo_source_view_complete_cb (NULL, error, fixture->photo_source);
+	g_error_free (error);
+	g_assert (fixture_need_lookup (fixture, "nobody@example.com"));
+}
+
+static void
+test_index_complete (Fixture *fixture,
+                     gconstpointer user_data)
+{
+	gboolean request_view = FALSE;
+
+	contact_photo_source_index_lookup (
+		fixture->photo_source, NULL, &request_view);
+	g_assert (request_view);
+
+	fixture_add_contact (fixture, "1", "someone@example.com", "Other@Example.com");
+	contact_photo_source_view_complete_cb (NULL, NULL, fixture->photo_source);
+
+	/* Case and surrounding white space do not matter. */
+	g_assert (fixture_need_lookup (fixture, "someone@example.com"));
+	g_assert (fixture_need_lookup (fixture, " other@example.COM "));
+
+	/* The book is not asked for addresses it does not know. */
+	g_assert (!fixture_need_lookup (fixture, "nobody@example.com"));
+	g_assert (!fixture_need_lookup (fixture, NULL));
+
+	/* Contacts added after the initial notification count too. */
+	fixture_add_contact (fixture, "2", "nobody@example.com", NULL);
+	g_assert (fixture_need_lookup (fixture, "nobody@example.com"));
+}
+
+static void
+test_index_modify_remove (Fixture *fixture,
+                          gconstpointer user_data)
+{
+	gboolean request_view = FALSE;
+
+	contact_photo_source_index_lookup (
+		fixture->photo_source, NULL, &request_view);
+
+	fixture_add_contact (fixture, "1", "shared@example.com", "first@example.com");
+	fixture_add_contact (fixture, "2", "shared@example.com", NULL);
+	contact_photo_source_view_complete_cb (NULL, NULL, fixture->photo_source);
+
+	/* A modified contact replaces its previous addresses. */
+	fixture_add_contact (fixture, "1", "shared@example.com", "changed@example.com");
+	g_assert (!fixture_need_lookup (fixture, "first@example.com"));
+	g_assert (fixture_need_lookup (fixture, "changed@example.com"));
+
+	/* An address stays known while any contact has it. */
+	fixture_remove_contact (fixture, "1");
+	g_assert (!fixture_need_lookup (fixture, "changed@example.com"));
+	g_assert (fixture_need_lookup (fixture, "shared@example.com"));
+
+	fixture_remove_contact (fixture, "2");
+	g_assert (!fixture_need_lookup (fixture, "shared@example.com"));
+
+	/* Removing an unknown contact is harmless. */
+	fixture_remove_contact (fixture, "3");
+	g_assert_cmpuint (g_hash_table_size (fixture->photo_source->priv->index_uids), ==, 0);
+	g_assert_cmpuint (g_hash_table_size (fixture->photo_source->priv->index_emails), ==, 0);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	GTypeModule *type_module;
+
+	g_test_init (&argc, &argv, NULL);
+
+	type_module = g_object_new (test_module_get_type (), NULL);
+	g_type_module_use (type_module);
+	e_contact_photo_source_type_register (type_module);
+
+	g_test_add (
+		"/ContactPhotoSource/IndexIncomplete", Fixture, NULL,
+		fixture_set_up, test_index_incomplete, fixture_tear_down);
+	g_test_add (
+		"/ContactPhotoSource/IndexComplete", Fixture, NULL,
+		fixture_set_up, test_index_complete, fixture_tear_down);
+	g_test_add (
+		"/ContactPhotoSource/IndexModifyRemove", Fixture, NULL,
+		fixture_set_up, test_index_modify_remove, fixture_tear_down);
+
+	return g_test_run ();
+}
@@ -26,13 +26,22 @@
 
 #define AVATAR_BASE_URI "https://secure.gravatar.com/avatar/"
 
+/* Overrides the default base URI, mainly for testing. */
+#define AVATAR_BASE_URI_ENV "EVOLUTION_GRAVATAR_BASE_URI"
+
 struct _EGravatarPhotoSourcePrivate
 {
 	gboolean enabled;
+	gchar *base_uri;
+
+	/* Shared by all the requests, thus the connection
+	 * to the server can be reused. */
+	SoupSession *session;
 };
 
 enum {
 	PROP_0,
+	PROP_BASE_URI,
 	PROP_ENABLED
 };
 
@@ -70,9 +79,9 @@ gravatar_photo_source_get_photo_thread (GSimpleAsyncResult *simple,
                                         GObject *source_object,
                                         GCancellable *cancellable)
 {
+	EGravatarPhotoSource *photo_source;
 	AsyncContext *async_context;
 	SoupRequest *request;
-	SoupSession *session;
 	GInputStream *stream = NULL;
 	gchar *hash;
 	gchar *uri;
@@ -80,21 +89,22 @@ gravatar_photo_source_get_photo_thread (GSimpleAsyncResult *simple,
 
 	g_return_if_fail (E_IS_GRAVATAR_PHOTO_SOURCE (source_object));
 
-	if (!e_gravatar_photo_source_get_enabled (E_GRAVATAR_PHOTO_SOURCE (source_object)))
+	photo_source = E_GRAVATAR_PHOTO_SOURCE (source_object);
+
+	if (!e_gravatar_photo_source_get_enabled (photo_source))
 		return;
 
 	async_context = g_simple_async_result_get_op_res_gpointer (simple);
 
 	hash = e_gravatar_get_hash (async_context->email_address);
-	uri = g_strdup_printf ("%s%s?d=404", AVATAR_BASE_URI, hash);
+	uri = g_strdup_printf (
+		"%s%s?d=404", photo_source->priv->base_uri, hash);
 
 	g_debug ("Requesting avatar for %s", async_context->email_address);
 	g_debug ("%s", uri);
 
-	session = soup_session_new ();
-
 	/* We control the URI so there should be no error. */
-	request = soup_session_request (session, uri, NULL);
+	request = soup_session_request (photo_source->priv->session, uri, NULL);
 	g_return_if_fail (request != NULL);
 
 	stream = soup_request_send (request, cancellable, &local_error);
@@ -138,7 +148,6 @@ gravatar_photo_source_get_photo_thread (GSimpleAsyncResult *simple,
 	g_debug ("Request complete");
 
 	g_clear_object (&request);
-	g_clear_object (&session);
 
 	g_free (hash);
 	g_free (uri);
@@ -205,6 +214,21 @@ gravatar_photo_source_get_photo_finish (EPhotoSource *photo_source,
 	return TRUE;
 }
 
+static void
+gravatar_photo_source_set_base_uri (EGravatarPhotoSource *photo_source,
+                                    const gchar *base_uri)
+{
+	g_return_if_fail (photo_source->priv->base_uri == NULL);
+
+	if (base_uri == NULL || *base_uri == '\0')
+		base_uri = g_getenv (AVATAR_BASE_URI_ENV);
+
+	if (base_uri == NULL || *base_uri == '\0')
+		base_uri = AVATAR_BASE_URI;
+
+	photo_source->priv->base_uri = g_strdup (base_uri);
+}
+
 static void
 gravatar_photo_source_set_property (GObject *object,
 				    guint property_id,
@@ -212,6 +236,12 @@ gravatar_photo_source_set_property (GObject *object,
 				    GParamSpec *pspec)
 {
 	switch (property_id) {
+		case PROP_BASE_URI:
+			gravatar_photo_source_set_base_uri (
+				E_GRAVATAR_PHOTO_SOURCE (object),
+				g_value_get_string (value));
+			return;
+
 		case PROP_ENABLED:
 			e_gravatar_photo_source_set_enabled (
 				E_GRAVATAR_PHOTO_SOURCE (object),
@@ -229,6 +259,13 @@ gravatar_photo_source_get_property (GObject *object,
 				    GParamSpec *pspec)
 {
 	switch (property_id) {
+		case PROP_BASE_URI:
+			g_value_set_string (
+				value,
+				e_gravatar_photo_source_get_base_uri (
+				E_GRAVATAR_PHOTO_SOURCE (object)));
+			return;
+
 		case PROP_ENABLED:
 			g_value_set_boolean (
 				value,
@@ -240,6 +277,20 @@ gravatar_photo_source_get_property (GObject *object,
 	G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
 }
 
+static void
+gravatar_photo_source_finalize (GObject *object)
+{
+	EGravatarPhotoSourcePrivate *priv;
+
+	priv = E_GRAVATAR_PHOTO_SOURCE_GET_PRIVATE (object);
+
+	g_clear_object (&priv->session);
+	g_free (priv->base_uri);
+
+	/* Chain up to parent's finalize() method. */
+	G_OBJECT_CLASS (e_gravatar_photo_source_parent_class)->finalize (object);
+}
+
 static void
 e_gravatar_photo_source_class_init (EGravatarPhotoSourceClass *class)
 {
@@ -250,6 +301,28 @@ e_gravatar_photo_source_class_init (EGravatarPhotoSourceClass *class)
 	object_class = G_OBJECT_CLASS (class);
 	object_class->set_property = gravatar_photo_source_set_property;
 	object_class->get_property = gravatar_photo_source_get_property;
+	object_class->finalize = gravatar_photo_source_finalize;
+
+	/**
+	 * EGravatarPhotoSource:base-uri:
+	 *
+	 * The URI the MD5 hashes of the email addresses are appended to.
+	 * When not set, the EVOLUTION_GRAVATAR_BASE_URI environment variable
+	 * is used, or the Gravatar service itself when that is not set either.
+	 *
+	 * Since: 3.24
+	 **/
+	g_object_class_install_property (
+		object_class,
+		PROP_BASE_URI,
+		g_param_spec_string (
+			"base-uri",
+			"Base URI",
+			"The URI the email address hashes are appended to",
+			NULL,
+			G_PARAM_READWRITE |
+			G_PARAM_CONSTRUCT_ONLY |
+			G_PARAM_STATIC_STRINGS));
 
 	g_object_class_install_property (
 		object_class,
@@ -281,6 +354,7 @@ e_gravatar_photo_source_init (EGravatarPhotoSource *photo_source)
 	GSettings *settings;
 
 	photo_source->priv = E_GRAVATAR_PHOTO_SOURCE_GET_PRIVATE (photo_source);
+	photo_source->priv->session = soup_session_new ();
 
 	settings = e_util_ref_settings ("org.gnome.evolution.mail");
 
@@ -322,6 +396,24 @@ e_gravatar_get_hash (const gchar *email_address)
 	return hash;
 }
 
+/**
+ * e_gravatar_photo_source_get_base_uri:
+ * @photo_source: an #EGravatarPhotoSource
+ *
+ * Returns the URI the MD5 hashes of the email addresses are appended to.
+ *
+ * Returns: the #EGravatarPhotoSource:base-uri
+ *
+ * Since: 3.24
+ **/
+const gchar *
+e_gravatar_photo_source_get_base_uri (EGravatarPhotoSource *photo_source)
+{
+	g_return_val_if_fail (E_IS_GRAVATAR_PHOTO_SOURCE (photo_source), NULL);
+
+	return photo_source->priv->base_uri;
+}
+
 gboolean
 e_gravatar_photo_source_get_enabled (EGravatarPhotoSource *photo_source)
 {
@@ -0,0 +1,361 @@
+/*
+ * test-gravatar-photo-source.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Runs EGravatarPhotoSource against a local HTTP stub, which serves
+ * a photo for a single address, fails for another and answers
+ * 404 Not Found for everything else. */
+
+#include "evolution-config.h"
+
+#include <string.h>
+#include <libsoup/soup.h>
+
+#include "e-gravatar-photo-source.h"
+
+#define PHOTO_ADDRESS	"Someone@Example.com "
+#define BROKEN_ADDRESS	"broken@example.com"
+#define MISSING_ADDRESS	"nobody@example.com"
+#define PHOTO_DATA	"not really a PNG"
+
+typedef struct _TestModule TestModule;
+typedef struct _TestModuleClass TestModuleClass;
+
+struct _TestModule {
+	GTypeModule parent;
+};
+
+struct _TestModuleClass {
+	GTypeModuleClass parent_class;
+};
+
+typedef struct _Fixture Fixture;
+
+struct _Fixture {
+	SoupServer *server;
+	EPhotoSource *photo_source;
+	GMainLoop *main_loop;
+	guint n_requests;
+
+	/* Results of the last lookup. */
+	GInputStream *stream;
+	gboolean success;
+	GError *error;
+};
+
+GType test_module_get_type (void);
+
+G_DEFINE_TYPE (TestModule, test_module, G_TYPE_TYPE_MODULE)
+
+static gboolean
+test_module_load (GTypeModule *type_module)
+{
+	return TRUE;
+}
+
+static void
+test_module_unload (GTypeModule *type_module)
+{
+}
+
+static void
+test_module_class_init (TestModuleClass *class)
+{
+	GTypeModuleClass *type_module_class;
+
+	type_module_class = G_TYPE_MODULE_CLASS (class);
+	type_module_class->load = test_module_load;
+	type_module_class->unload = test_module_unload;
+}
+
+static void
+test_module_init (TestModule *module)
+{
+}
+
+static void
+server_callback (SoupServer *server,
+                 SoupMessage *msg,
+                 const gchar *path,
+                 GHashTable *query,
+                 SoupClientContext *client,
+                 gpointer user_data)
+{
+	Fixture *fixture = user_data;
+	gchar *photo_hash, *broken_hash;
+	gchar *photo_path, *broken_path;
+
+	fixture->n_requests++;
+
+	photo_hash = e_gravatar_get_hash (PHOTO_ADDRESS);
+	broken_hash = e_gravatar_get_hash (BROKEN_ADDRESS);
+	photo_path = g_strconcat ("/avatar/", photo_hash, NULL);
+	broken_path = g_strconcat ("/avatar/", broken_hash, NULL);
+
+	/* The default image has to be turned off. */
+	g_assert_cmpstr (query ? g_hash_table_lookup (query, "d") : NULL, ==, "404");
+
+	if (g_strcmp0 (path, photo_path) == 0) {
+		soup_message_set_status (msg, SOUP_STATUS_OK);
+		soup_message_set_response (
+			msg, "image/png", SOUP_MEMORY_STATIC,
+			PHOTO_DATA, strlen (PHOTO_DATA));
+	} else if (g_strcmp0 (path, broken_path) == 0) {
+		soup_message_set_status (msg, SOUP_STATUS_INTERNAL_SERVER_ERROR);
+	} else {
+		soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);
+	}
+
+	g_free (photo_hash);
+	g_free (broken_hash);
+	g_free (photo_path);
+	g_free (broken_path);
+}
+
+static void
+fixture_set_up (Fixture *fixture,
+                gconstpointer user_data)
+{
+	SoupAddress *address;
+	gchar *base_uri;
+
+	address = soup_address_new ("127.0.0.1", SOUP_ADDRESS_ANY_PORT);
+	soup_address_resolve_sync (address, NULL);
+
+	fixture->server = soup_server_new (SOUP_SERVER_INTERFACE, address, NULL);
+	g_assert (fixture->server != NULL);
+
+	g_object_unref (address);
+
+	soup_server_add_handler (
+		fixture->server, "/avatar",
+		server_callback, fixture, NULL);
+	soup_server_run_async (fixture->server);
+
+	base_uri = g_strdup_printf (
+		"http://127.0.0.1:%u/avatar/",
+		soup_server_get_port (fixture->server));
+
+	fixture->photo_source = g_object_new (
+		E_TYPE_GRAVATAR_PHOTO_SOURCE,
+		"base-uri", base_uri, NULL);
+	e_gravatar_photo_source_set_enabled (
+		E_GRAVATAR_PHOTO_SOURCE (fixture->photo_source), TRUE);
+
+	g_free (base_uri);
+
+	fixture->main_loop = g_main_loop_new (NULL, FALSE);
+}
+
+static void
+fixture_tear_down (Fixture *fixture,
+                   gconstpointer user_data)
+{
+	g_clear_object (&fixture->stream);
+	g_clear_error (&fixture->error);
+	g_main_loop_unref (fixture->main_loop);
+	g_object_unref (fixture->photo_source);
+
+	soup_server_disconnect (fixture->server);
+	g_object_unref (fixture->server);
+}
+
+static void
+get_photo_cb (GObject *source_object,
+              GAsyncResult *result,
+              gpointer user_data)
+{
+	Fixture *fixture = user_data;
+
+	fixture->success = e_photo_source_get_photo_finish (
+		E_PHOTO_SOURCE (source_object), result,
+		&fixture->stream, NULL, &fixture->error);
+
+	g_main_loop_quit (fixture->main_loop);
+}
+
+static void
+fixture_get_photo (Fixture *fixture,
+                   const gchar *email_address)
+{
+	g_clear_object (&fixture->stream);
+	g_clear_error (&fixture->error);
+	fixture->success = FALSE;
+
+	e_photo_source_get_photo (
+		fixture->photo_source, email_address, NULL,
+		get_photo_cb, fixture);
+
+	g_main_loop_run (fixture->main_loop);
+}
+
+static void
+test_photo_found (Fixture *fixture,
+                  gconstpointer user_data)
+{
+	gchar buffer[64];
+	gsize bytes_read = 0;
+	gboolean success;
+	GError *error = NULL;
+
+	fixture_get_photo (fixture, PHOTO_ADDRESS);
+
+	g_assert_no_error (fixture->error);
+	g_assert (fixture->success);
+	g_assert (G_IS_INPUT_STREAM (fixture->stream));
+
+	success = g_input_stream_read_all (
+		fixture->stream, buffer, sizeof (buffer) - 1,
+		&bytes_read, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (success);
+
+	buffer[bytes_read] = '\0';
+	g_assert_cmpstr (buffer, ==, PHOTO_DATA);
+	g_assert_cmpuint (fixture->n_requests, ==, 1);
+}
+
+static void
+test_photo_missing (Fixture *fixture,
+                    gconstpointer user_data)
+{
+	fixture_get_photo (fixture, MISSING_ADDRESS);
+
+	/* Not Found is not an error, just no photo. */
+	g_assert_no_error (fixture->error);
+	g_assert (fixture->success);
+	g_assert (fixture->stream == NULL);
+	g_assert_cmpuint (fixture->n_requests, ==, 1);
+}
+
+static void
+test_photo_error (Fixture *fixture,
+                  gconstpointer user_data)
+{
+	fixture_get_photo (fixture, BROKEN_ADDRESS);
+
+	g_assert_error (
+		fixture->error, SOUP_HTTP_ERROR,
+		SOUP_STATUS_INTERNAL_SERVER_ERROR);
+	g_assert (!fixture->success);
+	g_assert (fixture->stream == NULL);
+}
+
+static void
+test_photo_disabled (Fixture *fixture,
+                     gconstpointer user_data)
+{
+	e_gravatar_photo_source_set_enabled (
+		E_GRAVATAR_PHOTO_SOURCE (fixture->photo_source), FALSE);
+
+	fixture_get_photo (fixture, PHOTO_ADDRESS);
+
+	g_assert_no_error (fixture->error);
+	g_assert (fixture->success);
+	g_assert (fixture->stream == NULL);
+	g_assert_cmpuint (fixture->n_requests, ==, 0);
+}
+
+static void
+test_repeated_requests (Fixture *fixture,
+                        gconstpointer user_data)
+{
+	gint ii;
+
+	for (ii = 0; ii < 3; ii++) {
+		fixture_get_photo (fixture, PHOTO_ADDRESS);
+		g_assert_no_error (fixture->error);
+		g_assert (fixture->stream != NULL);
+	}
+
+	g_assert_cmpuint (fixture->n_requests, ==, 3);
+}
+
+static void
+test_base_uri_env (void)
+{
+	EPhotoSource *photo_source;
+	const gchar *base_uri;
+
+	g_setenv ("EVOLUTION_GRAVATAR_BASE_URI", "http://localhost/env/", TRUE);
+
+	photo_source = e_gravatar_photo_source_new ();
+	base_uri = e_gravatar_photo_source_get_base_uri (
+		E_GRAVATAR_PHOTO_SOURCE (photo_source));
+	g_assert_cmpstr (base_uri, ==, "http://localhost/env/");
+	g_object_unref (photo_source);
+
+	g_unsetenv ("EVOLUTION_GRAVATAR_BASE_URI");
+
+	photo_source = e_gravatar_photo_source_new ();
+	base_uri = e_gravatar_photo_source_get_base_uri (
+		E_GRAVATAR_PHOTO_SOURCE (photo_source));
+	g_assert_cmpstr (base_uri, ==, "https://secure.gravatar.com/avatar/");
+	g_object_unref (photo_source);
+}
+
+static void
+test_hash (void)
+{
+	gchar *hash1, *hash2;
+
+	hash1 = e_gravatar_get_hash ("someone@example.com");
+	hash2 = e_gravatar_get_hash (PHOTO_ADDRESS);
+
+	/* Case and surrounding white space do not matter. */
+	g_assert_cmpstr (hash1, ==, hash2);
+	g_assert_cmpstr (hash1, ==, "16d113840f999444259f73bac9ab8b10");
+
+	g_free (hash1);
+	g_free (hash2);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	GTypeModule *type_module;
+
+	/* Do not touch the user's settings. */
+	g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+	g_unsetenv ("EVOLUTION_GRAVATAR_BASE_URI");
+
+	g_test_init (&argc, &argv, NULL);
+
+	type_module = g_object_new (test_module_get_type (), NULL);
+	g_type_module_use (type_module);
+	e_gravatar_photo_source_type_register (type_module);
+
+	g_test_add_func ("/Gravatar/Hash", test_hash);
+	g_test_add_func ("/Gravatar/BaseUriEnv", test_base_uri_env);
+	g_test_add (
+		"/Gravatar/PhotoFound", Fixture, NULL,
+		fixture_set_up, test_photo_found, fixture_tear_down);
+	g_test_add (
+		"/Gravatar/PhotoMissing", Fixture, NULL,
+		fixture_set_up, test_photo_missing, fixture_tear_down);
+	g_test_add (
+		"/Gravatar/PhotoError", Fixture, NULL,
+		fixture_set_up, test_photo_error, fixture_tear_down);
+	g_test_add (
+		"/Gravatar/PhotoDisabled", Fixture, NULL,
+		fixture_set_up, test_photo_disabled, fixture_tear_down);
+	g_test_add (
+		"/Gravatar/RepeatedRequests", Fixture, NULL,
+		fixture_set_up, test_repeated_requests, fixture_tear_down);
+
+	return g_test_run ();
+}
@@ -3671,6 +3671,371 @@ itip_comp_older_than_stored (ItipView *view,
 	return is_older;
 }
 
+/* Busy times and UIDs of the conflict-search calendars, shared by all
+ * the views and kept current through client views, thus showing an
+ * invitation does not need to query each of the backends again. */
+typedef struct {
+	ECalComponent *comp;
+	gboolean span_known;
+	time_t occur_start;
+	time_t occur_end;
+} BusyObject;
+
+typedef struct {
+	ECalClient *client;
+	ECalClientView *view;
+	gulong backend_died_id;
+	gboolean complete;
+	GHashTable *objects;	/* "uid\nrid" ~> BusyObject */
+	GHashTable *uids;	/* uid ~> number of its objects */
+} BusyCalendar;
+
+static GHashTable *busy_calendars = NULL; /* ESource UID ~> BusyCalendar */
+
+static gchar *
+busy_object_key (const gchar *uid,
+                 const gchar *rid)
+{
+	return g_strconcat (uid, "\n", rid ? rid : "", NULL);
+}
+
+static void
+busy_object_free (gpointer ptr)
+{
+	BusyObject *bo = ptr;
+
+	if (bo) {
+		g_clear_object (&bo->comp);
+		g_free (bo);
+	}
+}
+
+static void
+busy_calendar_free (gpointer ptr)
+{
+	BusyCalendar *bc = ptr;
+
+	if (!bc)
+		return;
+
+	if (bc->view) {
+		g_signal_handlers_disconnect_matched (bc->view, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, bc);
+		e_cal_client_view_stop (bc->view, NULL);
+		g_clear_object (&bc->view);
+	}
+
+	if (bc->backend_died_id)
+		g_signal_handler_disconnect (bc->client, bc->backend_died_id);
+
+	g_clear_object (&bc->client);
+	g_hash_table_destroy (bc->objects);
+	g_hash_table_destroy (bc->uids);
+	g_free (bc);
+}
+
+static void
+busy_calendar_remove (BusyCalendar *bc,
+                      const gchar *uid,
+                      const gchar *rid)
+{
+	gchar *key;
+
+	if (!uid)
+		return;
+
+	key = busy_object_key (uid, rid && *rid ? rid : NULL);
+
+	if (g_hash_table_remove (bc->objects, key)) {
+		guint count;
+
+		count = GPOINTER_TO_UINT (g_hash_table_lookup (bc->uids, uid));
+		if (count > 1)
+			g_hash_table_insert (bc->uids, g_strdup (uid), GUINT_TO_POINTER (count - 1));
+		else
+			g_hash_table_remove (bc->uids, uid);
+	}
+
+	g_free (key);
+}
+
+static void
+busy_calendar_add (BusyCalendar *bc,
+                   icalcomponent *icalcomp)
+{
+	ECalComponent *comp;
+	BusyObject *bo;
+	const gchar *uid;
+	gchar *rid;
+	guint count;
+
+	comp = e_cal_component_new_from_icalcomponent (icalcomponent_new_clone (icalcomp));
+	if (!comp)
+		return;
+
+	e_cal_component_get_uid (comp, &uid);
+	if (!uid) {
+		g_object_unref (comp);
+		return;
+	}
+
+	rid = e_cal_component_get_recurid_as_string (comp);
+
+	busy_calendar_remove (bc, uid, rid);
+
+	bo = g_new0 (BusyObject, 1);
+	bo->comp = comp;
+
+	g_hash_table_insert (bc->objects, busy_object_key (uid, rid), bo);
+
+	count = GPOINTER_TO_UINT (g_hash_table_lookup (bc->uids, uid));
+	g_hash_table_insert (bc->uids, g_strdup (uid), GUINT_TO_POINTER (count + 1));
+
+	g_free (rid);
+}
+
+static void
+busy_view_objects_added_cb (ECalClientView *view,
+                            const GSList *objects,
+                            gpointer user_data)
+{
+	BusyCalendar *bc = user_data;
+	const GSList *link;
+
+	for (link = objects; link; link = g_slist_next (link))
+		busy_calendar_add (bc, link->data);
+}
+
+static void
+busy_view_objects_removed_cb (ECalClientView *view,
+                              const GSList *ids,
+                              gpointer user_data)
+{
+	BusyCalendar *bc = user_data;
+	const GSList *link;
+
+	for (link = ids; link; link = g_slist_next (link)) {
+		ECalComponentId *id = link->data;
+
+		busy_calendar_remove (bc, id->uid, id->rid);
+	}
+}
+
+static void
+busy_view_complete_cb (ECalClientView *view,
+                       const GError *error,
+                       gpointer user_data)
+{
+	BusyCalendar *bc = user_data;
+
+	if (error)
+		g_warning ("%s: Failed to read calendar: %s", G_STRFUNC, error->message);
+	else
+		bc->complete = TRUE;
+}
+
+static void
+busy_client_backend_died_cb (EClient *client,
+                             gpointer user_data)
+{
+	BusyCalendar *bc = user_data;
+
+	if (busy_calendars)
+		g_hash_table_remove (busy_calendars, e_source_get_uid (e_client_get_source (E_CLIENT (bc->client))));
+}
+
+static void
+busy_view_created_cb (GObject *source_object,
+                      GAsyncResult *result,
+                      gpointer user_data)
+{
+	ECalClient *client = E_CAL_CLIENT (source_object);
+	ECalClientView *view = NULL;
+	BusyCalendar *bc;
+	gchar *source_uid = user_data;
+	GError *error = NULL;
+
+	if (!e_cal_client_get_view_finish (client, result, &view, &error)) {
+		g_warning ("%s: Failed to watch calendar: %s", G_STRFUNC, error ? error->message : "Unknown error");
+		g_clear_error (&error);
+
+		if (busy_calendars)
+			g_hash_table_remove (busy_calendars, source_uid);
+		g_free (source_uid);
+		return;
+	}
+
+	bc = busy_calendars ? g_hash_table_lookup (busy_calendars, source_uid) : NULL;
+	g_free (source_uid);
+
+	/* The calendar was removed or reopened meanwhile */
+	if (!bc || bc->client != client || bc->view) {
+		g_object_unref (view);
+		return;
+	}
+
+	bc->view = view;
+
+	g_signal_connect (view, "objects-added", G_CALLBACK (busy_view_objects_added_cb), bc);
+	g_signal_connect (view, "objects-modified", G_CALLBACK (busy_view_objects_added_cb), bc);
+	g_signal_connect (view, "objects-removed", G_CALLBACK (busy_view_objects_removed_cb), bc);
+	g_signal_connect (view, "complete", G_CALLBACK (busy_view_complete_cb), bc);
+
+	e_cal_client_view_start (view, &error);
+
+	if (error) {
+		g_warning ("%s: Failed to watch calendar: %s", G_STRFUNC, error->message);
+		g_clear_error (&error);
+		g_hash_table_remove (busy_calendars, e_source_get_uid (e_client_get_source (E_CLIENT (client))));
+	}
+}
+
+/* Returns the index of the 'client', or NULL when it is not read yet,
+ * in which case the backend should be asked instead. */
+static BusyCalendar *
+busy_index_get_calendar (ECalClient *client)
+{
+	BusyCalendar *bc;
+	const gchar *source_uid;
+
+	source_uid = e_source_get_uid (e_client_get_source (E_CLIENT (client)));
+
+	if (!busy_calendars)
+		busy_calendars = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, busy_calendar_free);
+
+	bc = g_hash_table_lookup (busy_calendars, source_uid);
+	if (bc && bc->client == client)
+		return bc->complete ? bc : NULL;
+
+	bc = g_new0 (BusyCalendar, 1);
+	bc->client = g_object_ref (client);
+	bc->objects = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, busy_object_free);
+	bc->uids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	bc->backend_died_id = g_signal_connect (
+		client, "backend-died",
+		G_CALLBACK (busy_client_backend_died_cb), bc);
+
+	g_hash_table_insert (busy_calendars, g_strdup (source_uid), bc);
+
+	e_cal_client_get_view (client, "#t", NULL, busy_view_created_cb, g_strdup (source_uid));
+
+	return NULL;
+}
+
+static gboolean
+busy_instance_found_cb (ECalComponent *comp,
+                        time_t instance_start,
+                        time_t instance_end,
+                        gpointer user_data)
+{
+	gboolean *found = user_data;
+
+	*found = TRUE;
+
+	/* One is enough */
+	return FALSE;
+}
+
+/* Returns components of the calendar which occur in the given time range,
+ * except of those with 'exclude_uid', the same as the time range query
+ * would; free the list with e_cal_client_free_icalcomp_slist(). */
+static GSList *
+busy_index_find_conflicts (BusyCalendar *bc,
+                           const gchar *exclude_uid,
+                           time_t start,
+                           time_t end)
+{
+	icaltimezone *default_zone;
+	GHashTableIter iter;
+	gpointer value;
+	GSList *conflicts = NULL;
+
+	default_zone = e_cal_client_get_default_timezone (bc->client);
+
+	g_hash_table_iter_init (&iter, bc->objects);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		BusyObject *bo = value;
+		const gchar *uid = NULL;
+		gboolean found;
+
+		e_cal_component_get_uid (bo->comp, &uid);
+		if (g_strcmp0 (uid, exclude_uid) == 0)
+			continue;
+
+		if (!bo->span_known) {
+			e_cal_util_get_component_occur_times (
+				bo->comp, &bo->occur_start, &bo->occur_end,
+				e_cal_client_resolve_tzid_cb, bc->client,
+				default_zone, ICAL_VEVENT_COMPONENT);
+			bo->span_known = TRUE;
+		}
+
+		if (bo->occur_start > end || bo->occur_end < start)
+			continue;
+
+		/* The span covers all the occurrences, check them one by one,
+		 * with the same bounds as the backend's time range query. */
+		found = FALSE;
+
+		e_cal_recur_generate_instances (
+			bo->comp, start, end,
+			busy_instance_found_cb, &found,
+			e_cal_client_resolve_tzid_cb, bc->client,
+			default_zone);
+
+		if (found)
+			conflicts = g_slist_prepend (conflicts,
+				icalcomponent_new_clone (e_cal_component_get_icalcomponent (bo->comp)));
+	}
+
+	return conflicts;
+}
+
+/* Returns a copy of the stored component with the 'uid' and 'rid', or
+ * of its master object when there is no such detached instance. */
+static icalcomponent *
+busy_index_dup_object (BusyCalendar *bc,
+                       const gchar *uid,
+                       const gchar *rid)
+{
+	BusyObject *bo = NULL;
+	gchar *key;
+
+	if (!uid || !g_hash_table_contains (bc->uids, uid))
+		return NULL;
+
+	if (rid && *rid) {
+		key = busy_object_key (uid, rid);
+		bo = g_hash_table_lookup (bc->objects, key);
+		g_free (key);
+	}
+
+	if (!bo) {
+		key = busy_object_key (uid, NULL);
+		bo = g_hash_table_lookup (bc->objects, key);
+		g_free (key);
+	}
+
+	if (!bo) {
+		GHashTableIter iter;
+		gpointer value;
+
+		/* Only detached instances are stored, pick any of them */
+		g_hash_table_iter_init (&iter, bc->objects);
+		while (!bo && g_hash_table_iter_next (&iter, NULL, &value)) {
+			const gchar *comp_uid = NULL;
+
+			e_cal_component_get_uid (((BusyObject *) value)->comp, &comp_uid);
+			if (g_strcmp0 (comp_uid, uid) == 0)
+				bo = value;
+		}
+	}
+
+	if (!bo)
+		return NULL;
+
+	return icalcomponent_new_clone (e_cal_component_get_icalcomponent (bo->comp));
+}
+
 static void
 find_cal_update_ui (FormatItipFindData *fd,
                     ECalClient *cal_client)
@@ -3929,6 +4294,30 @@ decrease_find_data (FormatItipFindData *fd)
 	}
 }
 
+/* Takes ownership of the 'icalcomp' */
+static void
+find_cal_found_object (FormatItipFindData *fd,
+                       ECalClient *cal_client,
+                       icalcomponent *icalcomp)
+{
+	ECalComponent *comp;
+
+	fd->view->priv->current_client = cal_client;
+	fd->keep_alarm_check = (fd->view->priv->method == ICAL_METHOD_PUBLISH || fd->view->priv->method == ICAL_METHOD_REQUEST) &&
+		(icalcomponent_get_first_component (icalcomp, ICAL_VALARM_COMPONENT) ||
+		icalcomponent_get_first_component (icalcomp, ICAL_XAUDIOALARM_COMPONENT) ||
+		icalcomponent_get_first_component (icalcomp, ICAL_XDISPLAYALARM_COMPONENT) ||
+		icalcomponent_get_first_component (icalcomp, ICAL_XPROCEDUREALARM_COMPONENT) ||
+		icalcomponent_get_first_component (icalcomp, ICAL_XEMAILALARM_COMPONENT));
+
+	comp = e_cal_component_new_from_icalcomponent (icalcomp);
+	if (comp) {
+		ESource *source = e_client_get_source (E_CLIENT (cal_client));
+
+		g_hash_table_insert (fd->view->priv->real_comps, g_strdup (e_source_get_uid (source)), comp);
+	}
+}
+
 static void
 get_object_without_rid_ready_cb (GObject *source_object,
                                  GAsyncResult *result,
@@ -3952,23 +4341,7 @@ get_object_without_rid_ready_cb (GObject *source_object,
 	g_clear_error (&error);
 
 	if (icalcomp) {
-		ECalComponent *comp;
-
-		fd->view->priv->current_client = cal_client;
-		fd->keep_alarm_check = (fd->view->priv->method == ICAL_METHOD_PUBLISH || fd->view->priv->method == ICAL_METHOD_REQUEST) &&
-			(icalcomponent_get_first_component (icalcomp, ICAL_VALARM_COMPONENT) ||
-			icalcomponent_get_first_component (icalcomp, ICAL_XAUDIOALARM_COMPONENT) ||
-			icalcomponent_get_first_component (icalcomp, ICAL_XDISPLAYALARM_COMPONENT) ||
-			icalcomponent_get_first_component (icalcomp, ICAL_XPROCEDUREALARM_COMPONENT) ||
-			icalcomponent_get_first_component (icalcomp, ICAL_XEMAILALARM_COMPONENT));
-
-		comp = e_cal_component_new_from_icalcomponent (icalcomp);
-		if (comp) {
-			ESource *source = e_client_get_source (E_CLIENT (cal_client));
-
-			g_hash_table_insert (fd->view->priv->real_comps, g_strdup (e_source_get_uid (source)), comp);
-		}
-
+		find_cal_found_object (fd, cal_client, icalcomp);
 		find_cal_update_ui (fd, cal_client);
 		decrease_find_data (fd);
 		return;
@@ -4001,23 +4374,7 @@ get_object_with_rid_ready_cb (GObject *source_object,
 	g_clear_error (&error);
 
 	if (icalcomp) {
-		ECalComponent *comp;
-
-		fd->view->priv->current_client = cal_client;
-		fd->keep_alarm_check = (fd->view->priv->method == ICAL_METHOD_PUBLISH || fd->view->priv->method == ICAL_METHOD_REQUEST) &&
-			(icalcomponent_get_first_component (icalcomp, ICAL_VALARM_COMPONENT) ||
-			icalcomponent_get_first_component (icalcomp, ICAL_XAUDIOALARM_COMPONENT) ||
-			icalcomponent_get_first_component (icalcomp, ICAL_XDISPLAYALARM_COMPONENT) ||
-			icalcomponent_get_first_component (icalcomp, ICAL_XPROCEDUREALARM_COMPONENT) ||
-			icalcomponent_get_first_component (icalcomp, ICAL_XEMAILALARM_COMPONENT));
-
-		comp = e_cal_component_new_from_icalcomponent (icalcomp);
-		if (comp) {
-			ESource *source = e_client_get_source (E_CLIENT (cal_client));
-
-			g_hash_table_insert (fd->view->priv->real_comps, g_strdup (e_source_get_uid (source)), comp);
-		}
-
+		find_cal_found_object (fd, cal_client, icalcomp);
 		find_cal_update_ui (fd, cal_client);
 		decrease_find_data (fd);
 		return;
@@ -4134,9 +4491,37 @@ find_cal_opened_cb (GObject *source_object,
 		return;
 	}
 
+	/* Answer from the shared index when it's ready, including
+	 * the recurring conflicts, without asking the backend. */
+	if (search_for_conflicts) {
+		BusyCalendar *bc;
+
+		bc = busy_index_get_calendar (cal_client);
+		if (bc) {
+			icalcomponent *icalcomp;
+
+			if (view->priv->start_time && view->priv->end_time) {
+				GSList *conflicts;
+
+				conflicts = busy_index_find_conflicts (
+					bc, icalcomponent_get_uid (view->priv->ical_comp),
+					view->priv->start_time, view->priv->end_time);
+				if (conflicts)
+					g_hash_table_insert (fd->conflicts, cal_client, conflicts);
+			}
+
+			icalcomp = busy_index_dup_object (bc, fd->uid, fd->rid);
+			if (icalcomp)
+				find_cal_found_object (fd, cal_client, icalcomp);
+
+			find_cal_update_ui (fd, cal_client);
+			decrease_find_data (fd);
+			return;
+		}
+	}
+
  	/* Check for conflicts */
  	/* If the query fails, we'll just ignore it */
- 	/* FIXME What happens for recurring conflicts? */
 	if (search_for_conflicts) {
 		e_cal_client_get_object_list (
 			cal_client, fd->sexp,
@@ -8026,6 +8026,194 @@ process_content_to_plain_text_changing_composer_mode (EEditorPage *editor_page)
 	e_editor_dom_force_spell_check_in_viewport (editor_page);
 }
 
+/* The export of the content is done block by block (top-level children of
+ * the BODY) and the result for each block is remembered in a cache on the
+ * EEditorPage, keyed by a digest of the block's serialized content. The next
+ * export then converts only the blocks which changed since the last export,
+ * which is what matters when the autosave is exporting a long reply over and
+ * over, while the user is typing only at its top. */
+static gchar *
+export_cache_dup_node_key (WebKitDOMNode *node,
+                           gint word_wrap_length)
+{
+	GChecksum *checksum;
+	gchar *content, *key;
+	gushort node_type;
+
+	if (WEBKIT_DOM_IS_ELEMENT (node))
+		content = webkit_dom_element_get_outer_html (WEBKIT_DOM_ELEMENT (node));
+	else
+		content = webkit_dom_node_get_text_content (node);
+
+	node_type = webkit_dom_node_get_node_type (node);
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA1);
+	g_checksum_update (checksum, (const guchar *) &node_type, sizeof (node_type));
+	g_checksum_update (checksum, (const guchar *) &word_wrap_length, sizeof (word_wrap_length));
+	if (content)
+		g_checksum_update (checksum, (const guchar *) content, -1);
+
+	key = g_strdup (g_checksum_get_string (checksum));
+
+	g_checksum_free (checksum);
+	g_free (content);
+
+	return key;
+}
+
+/* Looks for the @key in the @new_cache first, then in the @old_cache, from
+ * which it is moved into the @new_cache, thus the @old_cache contains only
+ * unused blocks at the end of the export. */
+static const gchar *
+export_cache_lookup (GHashTable *old_cache,
+                     GHashTable *new_cache,
+                     const gchar *key)
+{
+	gpointer orig_key = NULL, orig_value = NULL;
+	const gchar *value;
+
+	value = g_hash_table_lookup (new_cache, key);
+
+	if (!value && old_cache &&
+	    g_hash_table_lookup_extended (old_cache, key, &orig_key, &orig_value)) {
+		g_hash_table_steal (old_cache, key);
+		g_hash_table_insert (new_cache, orig_key, orig_value);
+		value = orig_value;
+	}
+
+	return value;
+}
+
+static WebKitDOMElement *
+export_cache_clone_block (WebKitDOMDocument *document,
+                          WebKitDOMNode *block,
+                          const gchar *wrapper_tag)
+{
+	WebKitDOMElement *wrapper;
+
+	wrapper = webkit_dom_document_create_element (document, wrapper_tag, NULL);
+	webkit_dom_node_append_child (
+		WEBKIT_DOM_NODE (wrapper),
+		webkit_dom_node_clone_node_with_error (block, TRUE, NULL),
+		NULL);
+
+	return wrapper;
+}
+
+static gchar *
+export_block_to_plain_text (EEditorPage *editor_page,
+                            WebKitDOMDocument *document,
+                            WebKitDOMNode *block)
+{
+	WebKitDOMElement *wrapper;
+	WebKitDOMNodeList *list = NULL;
+	GString *plain_text;
+	gint ii;
+
+	/* SPAN is used as the wrapper, because the DIV would add
+	 * an extra new line after the block content. */
+	wrapper = export_cache_clone_block (document, block, "span");
+
+	list = webkit_dom_element_query_selector_all (
+		wrapper, "[data-evo-paragraph]", NULL);
+	for (ii = webkit_dom_node_list_get_length (list); ii--;) {
+		WebKitDOMNode *paragraph;
+
+		paragraph = webkit_dom_node_list_item (list, ii);
+
+		if (node_is_list (paragraph)) {
+			WebKitDOMNode *item = webkit_dom_node_get_first_child (paragraph);
+
+			while (item) {
+				WebKitDOMNode *next_item =
+					webkit_dom_node_get_next_sibling (item);
+
+				if (WEBKIT_DOM_IS_HTML_LI_ELEMENT (item))
+					e_editor_dom_wrap_paragraph (editor_page, WEBKIT_DOM_ELEMENT (item));
+
+				item = next_item;
+			}
+		} else if (!webkit_dom_element_query_selector (WEBKIT_DOM_ELEMENT (paragraph), ".-x-evo-wrap-br,.-x-evo-quoted", NULL)) {
+			/* Don't try to wrap the already wrapped content. */
+			e_editor_dom_wrap_paragraph (editor_page, WEBKIT_DOM_ELEMENT (paragraph));
+		}
+	}
+	g_clear_object (&list);
+
+	webkit_dom_node_normalize (WEBKIT_DOM_NODE (wrapper));
+
+	/* Pretend the previous block ended with a new line, which is
+	 * what the processing of the whole BODY would see there. */
+	plain_text = g_string_new ("\n");
+	process_node_to_plain_text_for_exporting (editor_page, WEBKIT_DOM_NODE (wrapper), plain_text);
+	g_string_erase (plain_text, 0, 1);
+
+	return g_string_free (plain_text, FALSE);
+}
+
+/* Returns %NULL when the content cannot be exported block by block
+ * and the caller should fall back to processing the whole BODY. */
+static gchar *
+process_content_to_plain_text_for_exporting_cached (EEditorPage *editor_page)
+{
+	WebKitDOMDocument *document;
+	WebKitDOMNode *body, *block;
+	GHashTable *old_cache, *new_cache;
+	GString *plain_text;
+	gint word_wrap_length;
+	gboolean can_use = TRUE;
+
+	document = e_editor_page_get_document (editor_page);
+	body = WEBKIT_DOM_NODE (webkit_dom_document_get_body (document));
+	word_wrap_length = e_editor_page_get_word_wrap_length (editor_page);
+
+	old_cache = e_editor_page_get_export_cache (editor_page, FALSE);
+	new_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	plain_text = g_string_sized_new (1024);
+
+	for (block = webkit_dom_node_get_first_child (body);
+	     block && can_use;
+	     block = webkit_dom_node_get_next_sibling (block)) {
+		const gchar *block_text;
+		gchar *key;
+
+		key = export_cache_dup_node_key (block, word_wrap_length);
+		block_text = export_cache_lookup (old_cache, new_cache, key);
+
+		if (!block_text) {
+			gchar *text;
+
+			text = export_block_to_plain_text (editor_page, document, block);
+			g_hash_table_insert (new_cache, g_strdup (key), text);
+			block_text = text;
+		}
+
+		g_free (key);
+
+		/* The block processing relies on the previous block being
+		 * finished with a new line, which is not true for the first
+		 * block and possibly for text nodes between the blocks. */
+		if ((!plain_text->len && !*block_text) ||
+		    (plain_text->len && plain_text->str[plain_text->len - 1] != '\n'))
+			can_use = FALSE;
+		else
+			g_string_append (plain_text, block_text);
+	}
+
+	e_editor_page_set_export_cache (editor_page, FALSE, new_cache);
+
+	if (!can_use) {
+		g_string_free (plain_text, TRUE);
+		return NULL;
+	}
+
+	/* The same as done for the BODY in process_node_to_plain_text_for_exporting() */
+	if (plain_text->len > 1 && plain_text->str[plain_text->len - 1] == '\n')
+		g_string_truncate (plain_text, plain_text->len - 1);
+
+	return g_string_free (plain_text, FALSE);
+}
+
 gchar *
 e_editor_dom_process_content_to_plain_text_for_exporting (EEditorPage *editor_page)
 {
@@ -8041,6 +8229,16 @@ e_editor_dom_process_content_to_plain_text_for_exporting (EEditorPage *editor_pa
 
 	g_return_val_if_fail (E_IS_EDITOR_PAGE (editor_page), NULL);
 
+	/* In the HTML mode the content can need a conversion that has to see
+	 * the whole document, thus only the plain text mode uses the cache. */
+	if (!e_editor_page_get_html_mode (editor_page)) {
+		gchar *content;
+
+		content = process_content_to_plain_text_for_exporting_cached (editor_page);
+		if (content)
+			return content;
+	}
+
 	document = e_editor_page_get_document (editor_page);
 	plain_text = g_string_sized_new (1024);
 
@@ -8252,24 +8450,90 @@ e_editor_dom_restore_images (EEditorPage *editor_page,
 	g_variant_iter_free (iter);
 }
 
+static gchar *
+export_block_to_html (EEditorPage *editor_page,
+                      WebKitDOMDocument *document,
+                      WebKitDOMNode *block)
+{
+	WebKitDOMElement *wrapper, *element;
+	WebKitDOMNodeList *list = NULL;
+	gchar *html;
+	gint ii;
+
+	wrapper = export_cache_clone_block (document, block, "div");
+
+	element = webkit_dom_element_query_selector (
+		wrapper, "#-x-evo-selection-start-marker", NULL);
+	if (element)
+		remove_node (WEBKIT_DOM_NODE (element));
+	element = webkit_dom_element_query_selector (
+		wrapper, "#-x-evo-selection-end-marker", NULL);
+	if (element)
+		remove_node (WEBKIT_DOM_NODE (element));
+
+	list = webkit_dom_element_query_selector_all (
+		wrapper, "span[data-hidden-space]", NULL);
+	for (ii = webkit_dom_node_list_get_length (list); ii--;)
+		remove_node (webkit_dom_node_list_item (list, ii));
+	g_clear_object (&list);
+
+	list = webkit_dom_element_query_selector_all (
+		wrapper, "[data-style]", NULL);
+	for (ii = webkit_dom_node_list_get_length (list); ii--;) {
+		WebKitDOMNode *data_style_node;
+
+		data_style_node = webkit_dom_node_list_item (list, ii);
+
+		element_rename_attribute (WEBKIT_DOM_ELEMENT (data_style_node), "data-style", "style");
+	}
+	g_clear_object (&list);
+
+	process_node_to_html_for_exporting (editor_page, WEBKIT_DOM_NODE (wrapper));
+
+	html = webkit_dom_element_get_inner_html (wrapper);
+
+	if (html && strstr (html, UNICODE_ZERO_WIDTH_SPACE)) {
+		GString *processed;
+
+		processed = e_str_replace_string (html, UNICODE_ZERO_WIDTH_SPACE, "");
+		g_free (html);
+		html = g_string_free (processed, FALSE);
+	}
+
+	return html ? html : g_strdup ("");
+}
+
 gchar *
 e_editor_dom_process_content_to_html_for_exporting (EEditorPage *editor_page)
 {
 	WebKitDOMDocument *document;
-	WebKitDOMElement *element;
-	WebKitDOMNode *node, *document_clone;
-	WebKitDOMNodeList *list = NULL;
+	WebKitDOMElement *element, *document_element;
+	WebKitDOMNode *node, *document_clone, *child;
+	GHashTable *old_cache, *new_cache;
 	GSettings *settings;
-	gint ii;
-	gchar *html_content;
+	GString *html_content;
+	gchar *document_html, *body_end;
 	gboolean send_editor_colors = FALSE;
 
 	g_return_val_if_fail (E_IS_EDITOR_PAGE (editor_page), NULL);
 
 	document = e_editor_page_get_document (editor_page);
+	document_element = webkit_dom_document_get_document_element (document);
 
+	/* Clone everything except of the BODY content, which
+	 * is exported block by block below. */
 	document_clone = webkit_dom_node_clone_node_with_error (
-		WEBKIT_DOM_NODE (webkit_dom_document_get_document_element (document)), TRUE, NULL);
+		WEBKIT_DOM_NODE (document_element), FALSE, NULL);
+	for (child = webkit_dom_node_get_first_child (WEBKIT_DOM_NODE (document_element));
+	     child;
+	     child = webkit_dom_node_get_next_sibling (child)) {
+		webkit_dom_node_append_child (
+			document_clone,
+			webkit_dom_node_clone_node_with_error (
+				child, !WEBKIT_DOM_IS_HTML_BODY_ELEMENT (child), NULL),
+			NULL);
+	}
+
 	element = webkit_dom_element_query_selector (
 		WEBKIT_DOM_ELEMENT (document_clone), "style#-x-evo-quote-style", NULL);
 	if (element)
@@ -8289,14 +8553,6 @@ e_editor_dom_process_content_to_html_for_exporting (EEditorPage *editor_page)
 		remove_node (WEBKIT_DOM_NODE (element));
 	node = WEBKIT_DOM_NODE (webkit_dom_element_query_selector (
 		WEBKIT_DOM_ELEMENT (document_clone), "body", NULL));
-	element = webkit_dom_element_query_selector (
-		WEBKIT_DOM_ELEMENT (node), "#-x-evo-selection-start-marker", NULL);
-	if (element)
-		remove_node (WEBKIT_DOM_NODE (element));
-	element = webkit_dom_element_query_selector (
-		WEBKIT_DOM_ELEMENT (node), "#-x-evo-selection-end-marker", NULL);
-	if (element)
-		remove_node (WEBKIT_DOM_NODE (element));
 
 	settings = e_util_ref_settings ("org.gnome.evolution.mail");
 	send_editor_colors = g_settings_get_boolean (settings, "composer-inherit-theme-colors");
@@ -8311,37 +8567,60 @@ e_editor_dom_process_content_to_html_for_exporting (EEditorPage *editor_page)
 		webkit_dom_element_remove_attribute (WEBKIT_DOM_ELEMENT (node), "vlink");
 	}
 
-	list = webkit_dom_element_query_selector_all (
-		WEBKIT_DOM_ELEMENT (node), "span[data-hidden-space]", NULL);
-	for (ii = webkit_dom_node_list_get_length (list); ii--;)
-		remove_node (webkit_dom_node_list_item (list, ii));
-	g_clear_object (&list);
+	/* The BODY is empty now, thus this processes only its attributes. */
+	process_node_to_html_for_exporting (editor_page, node);
 
-	list = webkit_dom_element_query_selector_all (
-		WEBKIT_DOM_ELEMENT (node), "[data-style]", NULL);
-	for (ii = webkit_dom_node_list_get_length (list); ii--;) {
-		WebKitDOMNode *data_style_node;
+	old_cache = e_editor_page_get_export_cache (editor_page, TRUE);
+	new_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	html_content = g_string_sized_new (1024);
 
-		data_style_node = webkit_dom_node_list_item (list, ii);
+	for (child = webkit_dom_node_get_first_child (WEBKIT_DOM_NODE (webkit_dom_document_get_body (document)));
+	     child;
+	     child = webkit_dom_node_get_next_sibling (child)) {
+		const gchar *block_html;
+		gchar *key;
 
-		element_rename_attribute (WEBKIT_DOM_ELEMENT (data_style_node), "data-style", "style");
+		key = export_cache_dup_node_key (child, 0);
+		block_html = export_cache_lookup (old_cache, new_cache, key);
+
+		if (!block_html) {
+			gchar *html;
+
+			html = export_block_to_html (editor_page, document, child);
+			g_hash_table_insert (new_cache, g_strdup (key), html);
+			block_html = html;
+		}
+
+		g_string_append (html_content, block_html);
+
+		g_free (key);
 	}
-	g_clear_object (&list);
 
-	process_node_to_html_for_exporting (editor_page, node);
+	e_editor_page_set_export_cache (editor_page, TRUE, new_cache);
 
-	html_content = webkit_dom_element_get_outer_html (
+	document_html = webkit_dom_element_get_outer_html (
 		WEBKIT_DOM_ELEMENT (document_clone));
 
-	if (strstr (html_content, UNICODE_ZERO_WIDTH_SPACE)) {
+	if (strstr (document_html, UNICODE_ZERO_WIDTH_SPACE)) {
 		GString *processed;
 
-		processed = e_str_replace_string (html_content, UNICODE_ZERO_WIDTH_SPACE, "");
-		g_free (html_content);
-		html_content = g_string_free (processed, FALSE);
+		processed = e_str_replace_string (document_html, UNICODE_ZERO_WIDTH_SPACE, "");
+		g_free (document_html);
+		document_html = g_string_free (processed, FALSE);
 	}
 
-	return html_content;
+	/* Put the exported blocks into the (empty) BODY */
+	body_end = g_strrstr (document_html, "</body>");
+	if (body_end) {
+		g_string_prepend_len (html_content, document_html, body_end - document_html);
+		g_string_append (html_content, body_end);
+	} else {
+		g_string_prepend (html_content, document_html);
+	}
+
+	g_free (document_html);
+
+	return g_string_free (html_content, FALSE);
 }
 
 void
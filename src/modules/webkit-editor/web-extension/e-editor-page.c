@@ -65,6 +65,11 @@ struct _EEditorPagePrivate {
 
 	GHashTable *inline_images;
 
+	/* Serialized top-level blocks from the last export, keyed by
+	 * a digest of the block; see e-editor-dom-functions.c */
+	GHashTable *plain_text_export_cache;
+	GHashTable *html_export_cache;
+
 	WebKitDOMNode *node_under_mouse_click;
 
 	GSettings *mail_settings;
@@ -82,6 +87,9 @@ web_page_document_loaded_cb (WebKitWebPage *web_page,
 
 	editor_page->priv->body_input_event_removed = TRUE;
 
+	e_editor_page_set_export_cache (editor_page, FALSE, NULL);
+	e_editor_page_set_export_cache (editor_page, TRUE, NULL);
+
 	e_editor_undo_redo_manager_clean_history (editor_page->priv->undo_redo_manager);
 	e_editor_dom_process_content_after_load (editor_page);
 }
@@ -203,6 +211,9 @@ e_editor_page_dispose (GObject *object)
 
 	g_hash_table_remove_all (editor_page->priv->inline_images);
 
+	g_clear_pointer (&editor_page->priv->plain_text_export_cache, g_hash_table_destroy);
+	g_clear_pointer (&editor_page->priv->html_export_cache, g_hash_table_destroy);
+
 	/* Chain up to parent's method. */
 	G_OBJECT_CLASS (e_editor_page_parent_class)->dispose (object);
 }
@@ -687,6 +698,39 @@ e_editor_page_get_inline_images (EEditorPage *editor_page)
 	return editor_page->priv->inline_images;
 }
 
+/* Returns the export cache of @editor_page or %NULL, when there is none yet.
+ * The caller doesn't own the returned hash table. */
+GHashTable *
+e_editor_page_get_export_cache (EEditorPage *editor_page,
+				gboolean html)
+{
+	g_return_val_if_fail (E_IS_EDITOR_PAGE (editor_page), NULL);
+
+	return html ? editor_page->priv->html_export_cache : editor_page->priv->plain_text_export_cache;
+}
+
+/* Replaces the export cache of @editor_page with @cache, which can be %NULL.
+ * The function assumes ownership of the @cache. */
+void
+e_editor_page_set_export_cache (EEditorPage *editor_page,
+				gboolean html,
+				GHashTable *cache)
+{
+	GHashTable **pcache;
+
+	g_return_if_fail (E_IS_EDITOR_PAGE (editor_page));
+
+	pcache = html ? &editor_page->priv->html_export_cache : &editor_page->priv->plain_text_export_cache;
+
+	if (*pcache == cache)
+		return;
+
+	if (*pcache)
+		g_hash_table_destroy (*pcache);
+
+	*pcache = cache;
+}
+
 void
 e_editor_page_add_new_inline_image_into_list (EEditorPage *editor_page,
                                               const gchar *cid_src,
@@ -149,6 +149,11 @@ void		e_editor_page_set_convert_in_situ
 						 gboolean value);
 GHashTable *	e_editor_page_get_inline_images
 						(EEditorPage *editor_page);
+GHashTable *	e_editor_page_get_export_cache	(EEditorPage *editor_page,
+						 gboolean html);
+void		e_editor_page_set_export_cache	(EEditorPage *editor_page,
+						 gboolean html,
+						 GHashTable *cache);
 void		e_editor_page_add_new_inline_image_into_list
 						(EEditorPage *editor_page,
 						 const gchar *cid_src,
@@ -48,7 +48,8 @@ struct bbdb_stuff {
 
 /* Static forward declarations */
 static gboolean bbdb_timeout (gpointer data);
-static void bbdb_do_it (EBookClient *client, const gchar *name, const gchar *email);
+static void bbdb_do_it (EBookClient *client, const gchar *name, const gchar *email, GSList **new_contacts);
+static void known_index_drop (void);
 static void add_email_to_contact (EContact *contact, const gchar *email);
 static void enable_toggled_cb (GtkWidget *widget, gpointer data);
 static void source_changed_cb (ESourceComboBox *source_combo_box, struct bbdb_stuff *stuff);
@@ -80,6 +81,8 @@ e_plugin_lib_enable (EPlugin *ep,
 		update_source = 0;
 	}
 
+	known_index_drop ();
+
 	/* Start up the plugin. */
 	if (enable) {
 		gint interval;
@@ -114,6 +117,416 @@ bbdb_timeout (gpointer data)
 	return data == NULL;
 }
 
+/* Known e-mail addresses and full names of the automatic contacts book,
+ * kept current through a client view.  Recipients which are already known
+ * need no address book queries.  The view signals are delivered in the main
+ * thread, while the lookups are done in the todo queue thread. */
+typedef enum {
+	KNOWN_INCOMPLETE,
+	KNOWN_NONE,
+	KNOWN_EMAIL,
+	KNOWN_NAME,
+	KNOWN_NAME_AMBIGUOUS
+} KnownState;
+
+typedef struct {
+	gchar *name_key;
+	GSList *email_keys;
+} KnownContact;
+
+static struct {
+	EBookClient *client;	/* the view's client, kept alive with it */
+	EBookClientView *view;
+	gchar *source_uid;
+	gboolean complete;
+	GHashTable *contacts;	/* contact UID ~> KnownContact */
+	GHashTable *emails;	/* casefolded e-mail ~> count of contacts */
+	GHashTable *names;	/* casefolded full name ~> GSList of contact UIDs, not freed by the table */
+} known;
+G_LOCK_DEFINE_STATIC (known);
+
+static gchar *
+known_key (const gchar *str)
+{
+	if (!str || !*str)
+		return NULL;
+
+	return g_utf8_casefold (str, -1);
+}
+
+static void
+known_contact_free (gpointer ptr)
+{
+	KnownContact *kc = ptr;
+
+	if (kc) {
+		g_free (kc->name_key);
+		g_slist_free_full (kc->email_keys, g_free);
+		g_free (kc);
+	}
+}
+
+static void
+known_remove_contact_locked (const gchar *uid)
+{
+	KnownContact *kc;
+	GSList *link;
+
+	kc = g_hash_table_lookup (known.contacts, uid);
+	if (!kc)
+		return;
+
+	for (link = kc->email_keys; link; link = g_slist_next (link)) {
+		guint count;
+
+		count = GPOINTER_TO_UINT (g_hash_table_lookup (known.emails, link->data));
+		if (count > 1)
+			g_hash_table_insert (known.emails, g_strdup (link->data), GUINT_TO_POINTER (count - 1));
+		else
+			g_hash_table_remove (known.emails, link->data);
+	}
+
+	if (kc->name_key) {
+		GSList *uids;
+
+		uids = g_hash_table_lookup (known.names, kc->name_key);
+		link = g_slist_find_custom (uids, uid, (GCompareFunc) g_strcmp0);
+		if (link) {
+			g_free (link->data);
+			uids = g_slist_delete_link (uids, link);
+		}
+
+		if (uids)
+			g_hash_table_insert (known.names, g_strdup (kc->name_key), uids);
+		else
+			g_hash_table_remove (known.names, kc->name_key);
+	}
+
+	g_hash_table_remove (known.contacts, uid);
+}
+
+static void
+known_add_contact_locked (EContact *contact)
+{
+	KnownContact *kc;
+	GList *emails, *link;
+	const gchar *uid;
+
+	uid = e_contact_get_const (contact, E_CONTACT_UID);
+	if (!uid)
+		return;
+
+	known_remove_contact_locked (uid);
+
+	kc = g_new0 (KnownContact, 1);
+	kc->name_key = known_key (e_contact_get_const (contact, E_CONTACT_FULL_NAME));
+
+	emails = e_contact_get (contact, E_CONTACT_EMAIL);
+	for (link = emails; link; link = g_list_next (link)) {
+		gchar *key;
+		guint count;
+
+		key = known_key (link->data);
+		if (!key)
+			continue;
+
+		count = GPOINTER_TO_UINT (g_hash_table_lookup (known.emails, key));
+		g_hash_table_insert (known.emails, g_strdup (key), GUINT_TO_POINTER (count + 1));
+
+		kc->email_keys = g_slist_prepend (kc->email_keys, key);
+	}
+	g_list_free_full (emails, g_free);
+
+	if (kc->name_key) {
+		GSList *uids;
+
+		uids = g_hash_table_lookup (known.names, kc->name_key);
+		uids = g_slist_prepend (uids, g_strdup (uid));
+		g_hash_table_insert (known.names, g_strdup (kc->name_key), uids);
+	}
+
+	g_hash_table_insert (known.contacts, g_strdup (uid), kc);
+}
+
+static void
+known_clear_locked (void)
+{
+	if (known.names) {
+		GHashTableIter iter;
+		gpointer value;
+
+		g_hash_table_iter_init (&iter, known.names);
+		while (g_hash_table_iter_next (&iter, NULL, &value))
+			g_slist_free_full (value, g_free);
+	}
+
+	if (known.view) {
+		g_signal_handlers_disconnect_matched (known.view, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, &known);
+		e_book_client_view_stop (known.view, NULL);
+		g_clear_object (&known.view);
+	}
+
+	g_clear_object (&known.client);
+
+	g_clear_pointer (&known.source_uid, g_free);
+	g_clear_pointer (&known.contacts, g_hash_table_destroy);
+	g_clear_pointer (&known.emails, g_hash_table_destroy);
+	g_clear_pointer (&known.names, g_hash_table_destroy);
+	known.complete = FALSE;
+}
+
+static void
+known_index_drop (void)
+{
+	G_LOCK (known);
+	known_clear_locked ();
+	G_UNLOCK (known);
+}
+
+static void
+known_view_objects_added_cb (EBookClientView *view,
+                             const GSList *contacts,
+                             gpointer user_data)
+{
+	const GSList *link;
+
+	G_LOCK (known);
+
+	if (view == known.view) {
+		for (link = contacts; link; link = g_slist_next (link))
+			known_add_contact_locked (link->data);
+	}
+
+	G_UNLOCK (known);
+}
+
+static void
+known_view_objects_removed_cb (EBookClientView *view,
+                               const GSList *uids,
+                               gpointer user_data)
+{
+	const GSList *link;
+
+	G_LOCK (known);
+
+	if (view == known.view) {
+		for (link = uids; link; link = g_slist_next (link))
+			known_remove_contact_locked (link->data);
+	}
+
+	G_UNLOCK (known);
+}
+
+static void
+known_view_complete_cb (EBookClientView *view,
+                        const GError *error,
+                        gpointer user_data)
+{
+	G_LOCK (known);
+
+	if (view == known.view) {
+		if (error)
+			g_warning ("bbdb: Failed to read automatic contacts: %s", error->message);
+		else
+			known.complete = TRUE;
+	}
+
+	G_UNLOCK (known);
+}
+
+/* Makes sure the index follows the book of the 'client'.  The index is
+ * filled asynchronously, the lookups return KNOWN_INCOMPLETE until then. */
+static void
+known_index_ensure (EBookClient *client)
+{
+	EBookClientView *view = NULL;
+	EBookQuery *query;
+	GSList *fields = NULL;
+	const gchar *source_uid;
+	gchar *sexp;
+	GError *error = NULL;
+
+	source_uid = e_source_get_uid (e_client_get_source (E_CLIENT (client)));
+
+	G_LOCK (known);
+	if (known.view && g_strcmp0 (known.source_uid, source_uid) == 0) {
+		G_UNLOCK (known);
+		return;
+	}
+	known_clear_locked ();
+	G_UNLOCK (known);
+
+	query = e_book_query_any_field_contains ("");
+	sexp = e_book_query_to_string (query);
+	e_book_query_unref (query);
+
+	if (!e_book_client_get_view_sync (client, sexp, &view, NULL, &error)) {
+		g_warning ("bbdb: Failed to watch automatic contacts: %s", error ? error->message : "Unknown error");
+		g_clear_error (&error);
+		g_free (sexp);
+		return;
+	}
+
+	g_free (sexp);
+
+	fields = g_slist_prepend (fields, (gpointer) e_contact_field_name (E_CONTACT_EMAIL));
+	fields = g_slist_prepend (fields, (gpointer) e_contact_field_name (E_CONTACT_FULL_NAME));
+	fields = g_slist_prepend (fields, (gpointer) e_contact_field_name (E_CONTACT_UID));
+	e_book_client_view_set_fields_of_interest (view, fields, NULL);
+	g_slist_free (fields);
+
+	G_LOCK (known);
+
+	/* Another thread could have been quicker */
+	if (known.view) {
+		G_UNLOCK (known);
+		g_object_unref (view);
+		return;
+	}
+
+	known.client = g_object_ref (client);
+	known.view = view;
+	known.source_uid = g_strdup (source_uid);
+	known.contacts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, known_contact_free);
+	known.emails = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	known.names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	g_signal_connect (view, "objects-added", G_CALLBACK (known_view_objects_added_cb), &known);
+	g_signal_connect (view, "objects-modified", G_CALLBACK (known_view_objects_added_cb), &known);
+	g_signal_connect (view, "objects-removed", G_CALLBACK (known_view_objects_removed_cb), &known);
+	g_signal_connect (view, "complete", G_CALLBACK (known_view_complete_cb), &known);
+
+	e_book_client_view_start (view, &error);
+
+	if (error) {
+		g_warning ("bbdb: Failed to watch automatic contacts: %s", error->message);
+		g_clear_error (&error);
+		known_clear_locked ();
+	}
+
+	G_UNLOCK (known);
+}
+
+/* Records a contact just saved to the book, before the view notices it. */
+static void
+known_index_add (EContact *contact)
+{
+	G_LOCK (known);
+
+	if (known.contacts)
+		known_add_contact_locked (contact);
+
+	G_UNLOCK (known);
+}
+
+static KnownState
+known_index_lookup (const gchar *email,
+                    const gchar *name,
+                    gchar **out_uid)
+{
+	KnownState state = KNOWN_NONE;
+	gchar *key;
+
+	*out_uid = NULL;
+
+	G_LOCK (known);
+
+	if (!known.complete) {
+		G_UNLOCK (known);
+		return KNOWN_INCOMPLETE;
+	}
+
+	key = known_key (email);
+	if (key && g_hash_table_contains (known.emails, key))
+		state = KNOWN_EMAIL;
+	g_free (key);
+
+	if (state == KNOWN_NONE) {
+		GSList *uids;
+
+		key = known_key (name);
+		uids = key ? g_hash_table_lookup (known.names, key) : NULL;
+		g_free (key);
+
+		if (uids && uids->next) {
+			state = KNOWN_NAME_AMBIGUOUS;
+		} else if (uids) {
+			state = KNOWN_NAME;
+			*out_uid = g_strdup (uids->data);
+		}
+	}
+
+	G_UNLOCK (known);
+
+	return state;
+}
+
+/* Returns the contact of the 'new_contacts' batch which has the 'name',
+ * or NULL; sets 'out_email_found' when the 'email' is already in it. */
+static EContact *
+pending_find (GSList *new_contacts,
+              const gchar *email,
+              const gchar *name,
+              gboolean *out_email_found,
+              gboolean *out_name_ambiguous)
+{
+	EContact *found = NULL;
+	GSList *link;
+
+	*out_email_found = FALSE;
+	*out_name_ambiguous = FALSE;
+
+	for (link = new_contacts; link; link = g_slist_next (link)) {
+		EContact *contact = link->data;
+		GList *emails, *elink;
+
+		emails = e_contact_get (contact, E_CONTACT_EMAIL);
+		for (elink = emails; elink && !*out_email_found; elink = g_list_next (elink)) {
+			*out_email_found = elink->data && g_ascii_strcasecmp (elink->data, email) == 0;
+		}
+		g_list_free_full (emails, g_free);
+
+		if (*out_email_found)
+			return NULL;
+
+		if (g_strcmp0 (e_contact_get_const (contact, E_CONTACT_FULL_NAME), name) == 0) {
+			if (found)
+				*out_name_ambiguous = TRUE;
+			found = contact;
+		}
+	}
+
+	return found;
+}
+
+static void
+bbdb_add_new_contacts (EBookClient *client,
+                       GSList *new_contacts)
+{
+	GSList *added_uids = NULL, *link, *ulink;
+	GError *error = NULL;
+
+	if (!new_contacts)
+		return;
+
+	e_book_client_add_contacts_sync (client, new_contacts, &added_uids, NULL, &error);
+
+	if (error != NULL) {
+		g_warning ("bbdb: Failed to add new contacts: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	for (link = new_contacts, ulink = added_uids;
+	     link && ulink;
+	     link = g_slist_next (link), ulink = g_slist_next (ulink)) {
+		e_contact_set (link->data, E_CONTACT_UID, ulink->data);
+		known_index_add (link->data);
+	}
+
+	g_slist_free_full (added_uids, g_free);
+}
+
 typedef struct {
 	gchar *name;
 	gchar *email;
@@ -163,13 +576,21 @@ todo_queue_process_thread (gpointer data)
 		AUTOMATIC_CONTACTS_ADDRESSBOOK, NULL, &error);
 
 	if (client != NULL) {
+		GSList *new_contacts = NULL;
 		todo_struct *td;
 
+		known_index_ensure (client);
+
 		while ((td = todo_queue_pop ()) != NULL) {
-			bbdb_do_it (client, td->name, td->email);
+			bbdb_do_it (client, td->name, td->email, &new_contacts);
 			free_todo_struct (td);
 		}
 
+		/* New contacts are added at once, not one by one */
+		new_contacts = g_slist_reverse (new_contacts);
+		bbdb_add_new_contacts (client, new_contacts);
+		g_slist_free_full (new_contacts, g_object_unref);
+
 		g_object_unref (client);
 	}
 
@@ -290,10 +711,79 @@ bbdb_handle_send (EPlugin *ep,
 	}
 }
 
+/* Returns TRUE when the automatic contacts book needs no queries,
+ * because the index or the batch of 'new_contacts' already know
+ * the recipient; 'out_done' is set when nothing else is to be done. */
+static gboolean
+bbdb_handle_known (EBookClient *client,
+                   const gchar *name,
+                   const gchar *email,
+                   GSList *new_contacts,
+                   gboolean *out_done)
+{
+	EContact *contact = NULL;
+	KnownState state;
+	gboolean email_found, name_ambiguous;
+	gchar *uid = NULL;
+	GError *error = NULL;
+
+	*out_done = TRUE;
+
+	state = known_index_lookup (email, name, &uid);
+	if (state == KNOWN_EMAIL || state == KNOWN_NAME_AMBIGUOUS)
+		return TRUE;
+
+	contact = pending_find (new_contacts, email, name, &email_found, &name_ambiguous);
+	if (email_found || name_ambiguous || (contact && uid)) {
+		g_free (uid);
+		return TRUE;
+	}
+
+	/* A contact with this name waits to be added, add the email address to it. */
+	if (contact) {
+		add_email_to_contact (contact, email);
+		return TRUE;
+	}
+
+	if (state == KNOWN_INCOMPLETE) {
+		*out_done = FALSE;
+		return FALSE;
+	}
+
+	if (state == KNOWN_NONE) {
+		*out_done = FALSE;
+		return TRUE;
+	}
+
+	/* A contact with this name exists, add the email address to it. */
+	if (!e_book_client_get_contact_sync (client, uid, &contact, NULL, &error)) {
+		g_warning ("bbdb: Could not get contact: %s\n", error ? error->message : "Unknown error");
+		g_clear_error (&error);
+		g_free (uid);
+		return TRUE;
+	}
+
+	add_email_to_contact (contact, email);
+
+	if (e_book_client_modify_contact_sync (client, contact, NULL, &error))
+		known_index_add (contact);
+
+	if (error != NULL) {
+		g_warning ("bbdb: Could not modify contact: %s\n", error->message);
+		g_error_free (error);
+	}
+
+	g_object_unref (contact);
+	g_free (uid);
+
+	return TRUE;
+}
+
 static void
 bbdb_do_it (EBookClient *client,
             const gchar *name,
-            const gchar *email)
+            const gchar *email,
+            GSList **new_contacts)
 {
 	gchar *query_string, *delim, *temp_name = NULL;
 	GSList *contacts = NULL;
@@ -309,6 +799,7 @@ bbdb_do_it (EBookClient *client,
 	EBookClient *client_addressbook;
 	ESourceAutocomplete *autocomplete_extension;
 	gboolean on_autocomplete, has_autocomplete;
+	gboolean done = FALSE;
 
 	g_return_if_fail (client != NULL);
 
@@ -324,6 +815,18 @@ bbdb_do_it (EBookClient *client,
 		name = temp_name;
 	}
 
+	if (g_utf8_strchr (name, -1, '\"')) {
+		GString *tmp = g_string_new (name);
+		gchar *p;
+
+		while (p = g_utf8_strchr (tmp->str, tmp->len, '\"'), p)
+			tmp = g_string_erase (tmp, p - tmp->str, 1);
+
+		g_free (temp_name);
+		temp_name = g_string_free (tmp, FALSE);
+		name = temp_name;
+	}
+
 	/* Search through all addressbooks */
 	shell = e_shell_get_default ();
 	registry = e_shell_get_registry (shell);
@@ -343,6 +846,17 @@ bbdb_do_it (EBookClient *client,
 	while (aux_addressbooks != NULL) {
 
 		if (g_strcmp0 (e_source_get_uid (dest_source), e_source_get_uid (aux_addressbooks->data)) == 0) {
+			if (bbdb_handle_known (client, name, email, *new_contacts, &done)) {
+				if (done) {
+					g_free (temp_name);
+					g_list_free_full (addressbooks, g_object_unref);
+					return;
+				}
+
+				aux_addressbooks = aux_addressbooks->next;
+				continue;
+			}
+
 			client_addressbook = g_object_ref (client);
 		} else {
 			/* Check only addressbooks with autocompletion enabled */
@@ -391,18 +905,6 @@ bbdb_do_it (EBookClient *client,
 			return;
 		}
 
-		if (g_utf8_strchr (name, -1, '\"')) {
-			GString *tmp = g_string_new (name);
-			gchar *p;
-
-			while (p = g_utf8_strchr (tmp->str, tmp->len, '\"'), p)
-				tmp = g_string_erase (tmp, p - tmp->str, 1);
-
-			g_free (temp_name);
-			temp_name = g_string_free (tmp, FALSE);
-			name = temp_name;
-		}
-
 		contacts = NULL;
 		/* If a contact exists with this name, add the email address to it. */
 		query_string = g_strdup_printf ("(is \"full_name\" \"%s\")", name);
@@ -429,8 +931,9 @@ bbdb_do_it (EBookClient *client,
 			contact = (EContact *) contacts->data;
 			add_email_to_contact (contact, email);
 
-			e_book_client_modify_contact_sync (
-					client_addressbook, contact, NULL, &error);
+			if (e_book_client_modify_contact_sync (client_addressbook, contact, NULL, &error) &&
+			    client_addressbook == client)
+				known_index_add (contact);
 
 			if (error != NULL) {
 				g_warning ("bbdb: Could not modify contact: %s\n", error->message);
@@ -450,20 +953,13 @@ bbdb_do_it (EBookClient *client,
 
 	g_list_free_full (addressbooks, (GDestroyNotify) g_object_unref);
 
-	/* Otherwise, create a new contact. */
+	/* Otherwise, create a new contact; it is added with the rest of the batch. */
 	contact = e_contact_new ();
 	e_contact_set (contact, E_CONTACT_FULL_NAME, (gpointer) name);
 	add_email_to_contact (contact, email);
 	g_free (temp_name);
 
-	e_book_client_add_contact_sync (client, contact, NULL, NULL, &error);
-
-	if (error != NULL) {
-		g_warning ("bbdb: Failed to add new contact: %s", error->message);
-		g_error_free (error);
-	}
-
-	g_object_unref (contact);
+	*new_contacts = g_slist_prepend (*new_contacts, contact);
 }
 
 EBookClient *
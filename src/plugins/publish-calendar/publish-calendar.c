@@ -45,6 +45,10 @@ static GSList *publish_uris = NULL;
 static GSList *queued_publishes = NULL;
 static gint online = 0;
 
+/* Source UID ~> PublishSourceTracker */
+static GHashTable *source_trackers = NULL;
+static GMutex source_trackers_lock;
+
 static GSList *error_queue = NULL;
 static GMutex error_queue_lock;
 static guint error_queue_show_idle_id = 0;
@@ -189,6 +193,203 @@ publish_uri_async (EPublishUri *uri)
 	}
 }
 
+/* Counts the changes in a published calendar, as seen by a client view
+ * opened on it, so that a location can be skipped when none of its
+ * calendars changed since it was uploaded the last time. */
+typedef struct _PublishSourceTracker {
+	gchar *uid;
+	ECalClientView *view;
+	guint64 changes;
+} PublishSourceTracker;
+
+static void
+publish_source_tracker_free (gpointer ptr)
+{
+	PublishSourceTracker *tracker = ptr;
+
+	if (tracker) {
+		if (tracker->view) {
+			g_signal_handlers_disconnect_matched (
+				tracker->view, G_SIGNAL_MATCH_DATA,
+				0, 0, NULL, NULL, tracker);
+			e_cal_client_view_stop (tracker->view, NULL);
+			g_object_unref (tracker->view);
+		}
+
+		g_free (tracker->uid);
+		g_free (tracker);
+	}
+}
+
+static void
+publish_source_tracker_changed_cb (ECalClientView *view,
+                                   gpointer objects,
+                                   PublishSourceTracker *tracker)
+{
+	g_mutex_lock (&source_trackers_lock);
+	tracker->changes++;
+	g_mutex_unlock (&source_trackers_lock);
+}
+
+static void
+publish_source_tracker_forget (const gchar *uid)
+{
+	g_mutex_lock (&source_trackers_lock);
+	g_hash_table_remove (source_trackers, uid);
+	g_mutex_unlock (&source_trackers_lock);
+}
+
+static void
+publish_source_tracker_view_cb (GObject *source_object,
+                                GAsyncResult *result,
+                                gpointer user_data)
+{
+	gchar *uid = user_data;
+	PublishSourceTracker *tracker;
+	ECalClientView *view = NULL;
+	ECalClientView *started = NULL;
+	GError *error = NULL;
+
+	if (!e_cal_client_get_view_finish (E_CAL_CLIENT (source_object), result, &view, &error)) {
+		g_warning ("%s: Failed to open view on '%s': %s", G_STRFUNC, uid, error ? error->message : "Unknown error");
+		g_clear_error (&error);
+		publish_source_tracker_forget (uid);
+		g_free (uid);
+		return;
+	}
+
+	g_mutex_lock (&source_trackers_lock);
+
+	tracker = g_hash_table_lookup (source_trackers, uid);
+	if (tracker && !tracker->view) {
+		tracker->view = view;
+		started = g_object_ref (view);
+
+		g_signal_connect (
+			tracker->view, "objects-added",
+			G_CALLBACK (publish_source_tracker_changed_cb), tracker);
+		g_signal_connect (
+			tracker->view, "objects-modified",
+			G_CALLBACK (publish_source_tracker_changed_cb), tracker);
+		g_signal_connect (
+			tracker->view, "objects-removed",
+			G_CALLBACK (publish_source_tracker_changed_cb), tracker);
+
+		/* Anything published before the view started is stale */
+		tracker->changes++;
+	}
+
+	g_mutex_unlock (&source_trackers_lock);
+
+	if (started) {
+		e_cal_client_view_start (started, &error);
+
+		if (error) {
+			g_warning ("%s: Failed to start view on '%s': %s", G_STRFUNC, uid, error->message);
+			g_clear_error (&error);
+			publish_source_tracker_forget (uid);
+		}
+
+		g_object_unref (started);
+	} else {
+		g_object_unref (view);
+	}
+
+	g_free (uid);
+}
+
+static void
+publish_source_tracker_client_cb (GObject *source_object,
+                                  GAsyncResult *result,
+                                  gpointer user_data)
+{
+	gchar *uid = user_data;
+	EClient *client;
+	GError *error = NULL;
+
+	client = e_client_cache_get_client_finish (E_CLIENT_CACHE (source_object), result, &error);
+
+	if (!client) {
+		g_warning ("%s: Failed to open '%s': %s", G_STRFUNC, uid, error ? error->message : "Unknown error");
+		g_clear_error (&error);
+		publish_source_tracker_forget (uid);
+		g_free (uid);
+		return;
+	}
+
+	e_cal_client_get_view (
+		E_CAL_CLIENT (client), "#t", NULL,
+		publish_source_tracker_view_cb, uid);
+
+	g_object_unref (client);
+}
+
+static gboolean
+publish_source_tracker_open_idle_cb (gpointer user_data)
+{
+	gchar *uid = user_data;
+	EShell *shell;
+	ESource *source;
+
+	shell = e_shell_get_default ();
+	source = shell ? e_source_registry_ref_source (e_shell_get_registry (shell), uid) : NULL;
+
+	if (!source) {
+		publish_source_tracker_forget (uid);
+		g_free (uid);
+		return FALSE;
+	}
+
+	e_client_cache_get_client (
+		e_shell_get_client_cache (shell), source,
+		E_SOURCE_EXTENSION_CALENDAR, 30, NULL,
+		publish_source_tracker_client_cb, uid);
+
+	g_object_unref (source);
+
+	return FALSE;
+}
+
+/* Returns the sum of the change counters of the given calendars, or zero
+ * when any of them is not tracked yet; in that case the tracking is started.
+ * Can be called from any thread, the views are opened in the main thread. */
+static guint64
+publish_sources_get_changes (GSList *uids)
+{
+	GSList *link;
+	guint64 changes = 0;
+	gboolean all_tracked = TRUE;
+
+	g_mutex_lock (&source_trackers_lock);
+
+	if (!source_trackers)
+		source_trackers = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, publish_source_tracker_free);
+
+	for (link = uids; link; link = g_slist_next (link)) {
+		const gchar *uid = link->data;
+		PublishSourceTracker *tracker;
+
+		tracker = g_hash_table_lookup (source_trackers, uid);
+		if (!tracker) {
+			tracker = g_new0 (PublishSourceTracker, 1);
+			tracker->uid = g_strdup (uid);
+
+			g_hash_table_insert (source_trackers, tracker->uid, tracker);
+
+			g_idle_add (publish_source_tracker_open_idle_cb, g_strdup (uid));
+		}
+
+		if (!tracker->view)
+			all_tracked = FALSE;
+		else
+			changes += tracker->changes;
+	}
+
+	g_mutex_unlock (&source_trackers_lock);
+
+	return all_tracked ? changes : 0;
+}
+
 static void
 publish_online (EPublishUri *uri,
                 GFile *file,
@@ -196,55 +397,96 @@ publish_online (EPublishUri *uri,
                 gboolean can_report_success)
 {
 	GOutputStream *stream;
+	GFileIOStream *tmp_stream = NULL;
+	GFile *tmp_file;
+	GChecksum *checksum;
+	gchar *last_digest;
+	guint64 changes, last_changes = 0;
 	GError *error = NULL;
 
-	stream = G_OUTPUT_STREAM (g_file_replace (
-		file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error));
-
-	/* Sanity check. */
-	g_return_if_fail (
-		((stream != NULL) && (error == NULL)) ||
-		((stream == NULL) && (error != NULL)));
+	changes = publish_sources_get_changes (uri->events);
+	last_digest = e_publish_uri_dup_last_digest (uri, &last_changes, NULL);
 
-	if (error != NULL) {
-		if (perror != NULL) {
-			*perror = error;
-		} else {
+	/* Nothing changed in the free/busy case does not mean the same
+	 * content, the published time range moves with the current day. */
+	if (uri->publish_format == URI_PUBLISH_AS_ICAL &&
+	    last_digest && changes != 0 &&
+	    changes == last_changes) {
+		if (can_report_success)
 			error_queue_add (
 				g_strdup_printf (
-					_("Could not open %s:"),
+					_("Publishing to %s finished successfully"),
 					uri->location),
-				error);
-		}
+				NULL);
+
+		update_timestamp (uri);
+		g_free (last_digest);
+		return;
+	}
+
+	g_free (last_digest);
+
+	/* The content is generated into a temporary file first, thus
+	 * the upload can be skipped when it did not change. */
+	tmp_file = g_file_new_tmp ("evolution-publish-XXXXXX", &tmp_stream, &error);
+
+	if (error != NULL) {
+		error_queue_add (
+			g_strdup_printf (
+				_("There was an error while publishing to %s:"),
+				uri->location),
+			error);
 		return;
 	}
 
+	checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	stream = g_io_stream_get_output_stream (G_IO_STREAM (tmp_stream));
+
 	switch (uri->publish_format) {
 		case URI_PUBLISH_AS_ICAL:
-			publish_calendar_as_ical (stream, uri, &error);
+			publish_calendar_as_ical (stream, checksum, uri, &error);
 			break;
 		case URI_PUBLISH_AS_FB:
-			publish_calendar_as_fb (stream, uri, &error);
+			publish_calendar_as_fb (stream, checksum, uri, &error);
 			break;
 	}
 
-	if (error != NULL)
-		error_queue_add (
-			g_strdup_printf (
-				_("There was an error while publishing to %s:"),
-				uri->location),
-			error);
-	else if (can_report_success)
-		error_queue_add (
-			g_strdup_printf (
-				_("Publishing to %s finished successfully"),
-				uri->location),
-			NULL);
+	if (error == NULL)
+		g_seekable_seek (G_SEEKABLE (tmp_stream), 0, G_SEEK_SET, NULL, &error);
+
+	if (error == NULL)
+		e_publish_uri_upload_sync (
+			uri, file,
+			g_io_stream_get_input_stream (G_IO_STREAM (tmp_stream)),
+			g_checksum_get_string (checksum), changes,
+			NULL, NULL, &error);
+
+	/* The caller mounts the location and tries again. */
+	if (perror != NULL && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_MOUNTED)) {
+		*perror = error;
+		error = NULL;
+	} else {
+		if (error != NULL)
+			error_queue_add (
+				g_strdup_printf (
+					_("There was an error while publishing to %s:"),
+					uri->location),
+				error);
+		else if (can_report_success)
+			error_queue_add (
+				g_strdup_printf (
+					_("Publishing to %s finished successfully"),
+					uri->location),
+				NULL);
 
-	update_timestamp (uri);
+		update_timestamp (uri);
+	}
 
-	g_output_stream_close (stream, NULL, NULL);
-	g_object_unref (stream);
+	g_checksum_free (checksum);
+	g_io_stream_close (G_IO_STREAM (tmp_stream), NULL, NULL);
+	g_object_unref (tmp_stream);
+	g_file_delete (tmp_file, NULL, NULL);
+	g_object_unref (tmp_file);
 }
 
 static void
@@ -743,6 +985,9 @@ url_edit_clicked (GtkButton *button,
 				URL_LIST_LOCATION_COLUMN, uri->location,
 				URL_LIST_URL_COLUMN, uri, -1);
 
+			/* The location or the calendars could change */
+			e_publish_uri_forget_last_digest (uri);
+
 			id = GPOINTER_TO_UINT (g_hash_table_lookup (uri_timeouts, uri));
 			if (id)
 				g_source_remove (id);
@@ -810,6 +1055,7 @@ url_remove_clicked (GtkButton *button,
 		if (id)
 			g_source_remove (id);
 
+		e_publish_uri_forget_last_digest (url);
 		g_free (url);
 		url_list_changed (ui);
 	}
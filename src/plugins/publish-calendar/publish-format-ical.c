@@ -33,14 +33,13 @@ typedef struct {
 	ECalClient *client;
 } CompTzData;
 
- static void
+static void
 insert_tz_comps (icalparameter *param,
                  gpointer cb_data)
 {
 	const gchar *tzid;
 	CompTzData *tdata = cb_data;
 	icaltimezone *zone = NULL;
-	icalcomponent *tzcomp;
 	GError *error = NULL;
 
 	tzid = icalparameter_get_tzid (param);
@@ -59,21 +58,81 @@ insert_tz_comps (icalparameter *param,
 		return;
 	}
 
-	tzcomp = icalcomponent_new_clone (icaltimezone_get_component (zone));
-	g_hash_table_insert (tdata->zones, (gpointer) tzid, (gpointer) tzcomp);
+	g_hash_table_insert (tdata->zones, (gpointer) tzid, zone);
 }
 
-static void
-append_tz_to_comp (gpointer key,
-                   gpointer value,
-                   icalcomponent *toplevel)
+static gboolean
+publish_write_string (GOutputStream *stream,
+                      GChecksum *checksum,
+                      const gchar *str,
+                      GError **error)
 {
-	icalcomponent_add_component (toplevel, (icalcomponent *) value);
+	gsize len = strlen (str);
+
+	if (checksum)
+		g_checksum_update (checksum, (const guchar *) str, len);
+
+	return g_output_stream_write_all (stream, str, len, NULL, NULL, error);
+}
+
+/* The top-level VCALENDAR is written piece by piece, so that
+ * the whole calendar is never serialized into a single string. */
+gboolean
+publish_ical_write_begin (GOutputStream *stream,
+                          GChecksum *checksum,
+                          GError **error)
+{
+	icalcomponent *top_level;
+	icalproperty *prop;
+	gboolean success;
+
+	success = publish_write_string (stream, checksum, "BEGIN:VCALENDAR\r\n", error);
+
+	top_level = e_cal_util_new_top_level ();
+
+	for (prop = icalcomponent_get_first_property (top_level, ICAL_ANY_PROPERTY);
+	     prop && success;
+	     prop = icalcomponent_get_next_property (top_level, ICAL_ANY_PROPERTY)) {
+		gchar *str;
+
+		str = icalproperty_as_ical_string_r (prop);
+		success = publish_write_string (stream, checksum, str, error);
+		g_free (str);
+	}
+
+	icalcomponent_free (top_level);
+
+	return success;
+}
+
+gboolean
+publish_ical_write_component (GOutputStream *stream,
+                              GChecksum *checksum,
+                              icalcomponent *icalcomp,
+                              GError **error)
+{
+	gchar *str;
+	gboolean success;
+
+	str = icalcomponent_as_ical_string_r (icalcomp);
+	success = publish_write_string (stream, checksum, str, error);
+	g_free (str);
+
+	return success;
+}
+
+gboolean
+publish_ical_write_end (GOutputStream *stream,
+                        GChecksum *checksum,
+                        GError **error)
+{
+	return publish_write_string (stream, checksum, "END:VCALENDAR\r\n", error);
 }
 
 static gboolean
 write_calendar (const gchar *uid,
                 GOutputStream *stream,
+                GChecksum *checksum,
                 GError **error)
 {
 	EShell *shell;
@@ -81,7 +140,6 @@ write_calendar (const gchar *uid,
 	ESourceRegistry *registry;
 	EClient *client = NULL;
 	GSList *objects = NULL;
-	icalcomponent *top_level;
 	gboolean res = FALSE;
 
 	shell = e_shell_get_default ();
@@ -105,44 +163,51 @@ write_calendar (const gchar *uid,
 	if (client == NULL)
 		return FALSE;
 
-	top_level = e_cal_util_new_top_level ();
-
 	e_cal_client_get_object_list_sync (
 		E_CAL_CLIENT (client), "#t", &objects, NULL, error);
 
 	if (objects != NULL) {
 		GSList *iter;
-		gchar *ical_string;
+		GHashTableIter zones_iter;
+		gpointer value;
 		CompTzData tdata;
 
 		tdata.zones = g_hash_table_new (g_str_hash, g_str_equal);
 		tdata.client = E_CAL_CLIENT (client);
 
-		for (iter = objects; iter; iter = iter->next) {
-			icalcomponent *icalcomp = icalcomponent_new_clone (iter->data);
+		res = publish_ical_write_begin (stream, checksum, error);
+
+		for (iter = objects; iter && res; iter = iter->next) {
+			icalcomponent *icalcomp = iter->data;
+
 			icalcomponent_foreach_tzid (icalcomp, insert_tz_comps, &tdata);
-			icalcomponent_add_component (top_level, icalcomp);
+			res = publish_ical_write_component (stream, checksum, icalcomp, error);
+		}
+
+		g_hash_table_iter_init (&zones_iter, tdata.zones);
+		while (res && g_hash_table_iter_next (&zones_iter, NULL, &value)) {
+			res = publish_ical_write_component (
+				stream, checksum,
+				icaltimezone_get_component (value), error);
 		}
 
-		g_hash_table_foreach (tdata.zones, (GHFunc) append_tz_to_comp, top_level);
+		if (res)
+			res = publish_ical_write_end (stream, checksum, error);
 
 		g_hash_table_destroy (tdata.zones);
 		tdata.zones = NULL;
 
-		ical_string = icalcomponent_as_ical_string_r (top_level);
-		res = g_output_stream_write_all (stream, ical_string, strlen (ical_string), NULL, NULL, error);
-		g_free (ical_string);
 		e_cal_client_free_icalcomp_slist (objects);
 	}
 
 	g_object_unref (client);
-	icalcomponent_free (top_level);
 
 	return res;
 }
 
 void
 publish_calendar_as_ical (GOutputStream *stream,
+                          GChecksum *checksum,
                           EPublishUri *uri,
                           GError **error)
 {
@@ -152,7 +217,7 @@ publish_calendar_as_ical (GOutputStream *stream,
 	l = uri->events;
 	while (l) {
 		gchar *uid = l->data;
-		if (!write_calendar (uid, stream, error))
+		if (!write_calendar (uid, stream, checksum, error))
 			break;
 		l = g_slist_next (l);
 	}
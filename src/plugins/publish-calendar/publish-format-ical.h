@@ -27,6 +27,10 @@
 #ifndef PUBLISH_FORMAT_ICAL_H
 #define PUBLISH_FORMAT_ICAL_H
 
-void publish_calendar_as_ical (GOutputStream *stream, EPublishUri *uri, GError **error);
+void publish_calendar_as_ical (GOutputStream *stream, GChecksum *checksum, EPublishUri *uri, GError **error);
+
+gboolean publish_ical_write_begin (GOutputStream *stream, GChecksum *checksum, GError **error);
+gboolean publish_ical_write_component (GOutputStream *stream, GChecksum *checksum, icalcomponent *icalcomp, GError **error);
+gboolean publish_ical_write_end (GOutputStream *stream, GChecksum *checksum, GError **error);
 
 #endif
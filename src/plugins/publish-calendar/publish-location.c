@@ -29,6 +29,9 @@
 
 #include "e-util/e-util.h"
 
+/* Guards the last upload information of all the EPublishUri-s */
+G_LOCK_DEFINE_STATIC (last_upload);
+
 static EPublishUri *
 migrateURI (const gchar *xml,
             xmlDocPtr doc)
@@ -270,3 +273,127 @@ e_publish_uri_to_xml (EPublishUri *uri)
 
 	return returned_buffer;
 }
+
+/* Returns a copy of the digest of the last upload to the @uri, together with
+ * the change count of its calendars at that time and a generation, which
+ * e_publish_uri_set_last_digest() checks to not store a stale result. */
+gchar *
+e_publish_uri_dup_last_digest (EPublishUri *uri,
+                               guint64 *out_last_changes,
+                               guint *out_generation)
+{
+	gchar *digest;
+
+	g_return_val_if_fail (uri != NULL, NULL);
+
+	G_LOCK (last_upload);
+
+	digest = g_strdup (uri->last_digest);
+
+	if (out_last_changes)
+		*out_last_changes = uri->last_changes;
+	if (out_generation)
+		*out_generation = uri->last_generation;
+
+	G_UNLOCK (last_upload);
+
+	return digest;
+}
+
+/* Remembers the @digest of an upload, unless the last upload information
+ * was forgotten since the @generation had been read.  Returns whether
+ * it was stored. */
+gboolean
+e_publish_uri_set_last_digest (EPublishUri *uri,
+                               guint generation,
+                               const gchar *digest,
+                               guint64 last_changes)
+{
+	gboolean stored = FALSE;
+
+	g_return_val_if_fail (uri != NULL, FALSE);
+
+	G_LOCK (last_upload);
+
+	if (uri->last_generation == generation) {
+		if (g_strcmp0 (uri->last_digest, digest) != 0) {
+			g_free (uri->last_digest);
+			uri->last_digest = g_strdup (digest);
+		}
+
+		uri->last_changes = last_changes;
+		stored = TRUE;
+	}
+
+	G_UNLOCK (last_upload);
+
+	return stored;
+}
+
+/* Makes the next publish upload the content, even when it did not change,
+ * like after the location or the calendars of the @uri had been changed. */
+void
+e_publish_uri_forget_last_digest (EPublishUri *uri)
+{
+	g_return_if_fail (uri != NULL);
+
+	G_LOCK (last_upload);
+
+	g_free (uri->last_digest);
+	uri->last_digest = NULL;
+	uri->last_changes = 0;
+	uri->last_generation++;
+
+	G_UNLOCK (last_upload);
+}
+
+/* Writes the @content into the @file, unless the @digest of the content
+ * matches the last upload to the @uri.  The @digest and the @changes are
+ * remembered on success.  Can be called from any thread. */
+gboolean
+e_publish_uri_upload_sync (EPublishUri *uri,
+                           GFile *file,
+                           GInputStream *content,
+                           const gchar *digest,
+                           guint64 changes,
+                           gboolean *out_uploaded,
+                           GCancellable *cancellable,
+                           GError **error)
+{
+	GOutputStream *stream;
+	gchar *last_digest;
+	guint generation = 0;
+	gboolean uploaded = FALSE;
+	gboolean success = TRUE;
+
+	g_return_val_if_fail (uri != NULL, FALSE);
+	g_return_val_if_fail (G_IS_FILE (file), FALSE);
+	g_return_val_if_fail (G_IS_INPUT_STREAM (content), FALSE);
+	g_return_val_if_fail (digest != NULL, FALSE);
+
+	last_digest = e_publish_uri_dup_last_digest (uri, NULL, &generation);
+
+	if (g_strcmp0 (digest, last_digest) != 0) {
+		stream = G_OUTPUT_STREAM (g_file_replace (
+			file, NULL, FALSE, G_FILE_CREATE_NONE, cancellable, error));
+
+		success = stream != NULL && g_output_stream_splice (
+			stream, content,
+			G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+			cancellable, error) != -1;
+
+		g_clear_object (&stream);
+
+		uploaded = success;
+	}
+
+	if (success)
+		e_publish_uri_set_last_digest (uri, generation, digest, changes);
+
+	if (out_uploaded)
+		*out_uploaded = uploaded;
+
+	g_free (last_digest);
+
+	return success;
+}
@@ -23,7 +23,7 @@
 #ifndef PUBLISH_LOCATION_H
 #define PUBLISH_LOCATION_H
 
-#include <glib.h>
+#include <gio/gio.h>
 
 #define PC_SETTINGS_ID "org.gnome.evolution.plugin.publish-calendar"
 #define PC_SETTINGS_URIS "uris"
@@ -60,10 +60,32 @@ struct _EPublishUri {
 	gint fb_duration_type;
 
 	gint service_type;
+
+	/* Not saved; what was uploaded during this session.  Accessed
+	 * from the publishing threads, thus use the functions below. */
+	gchar *last_digest;
+	guint64 last_changes;
+	guint last_generation;
 };
 
 EPublishUri *e_publish_uri_from_xml (const gchar *xml);
 gchar       *e_publish_uri_to_xml (EPublishUri *uri);
+gchar       *e_publish_uri_dup_last_digest (EPublishUri *uri,
+                                            guint64 *out_last_changes,
+                                            guint *out_generation);
+gboolean     e_publish_uri_set_last_digest (EPublishUri *uri,
+                                            guint generation,
+                                            const gchar *digest,
+                                            guint64 last_changes);
+void         e_publish_uri_forget_last_digest (EPublishUri *uri);
+gboolean     e_publish_uri_upload_sync (EPublishUri *uri,
+                                        GFile *file,
+                                        GInputStream *content,
+                                        const gchar *digest,
+                                        guint64 changes,
+                                        gboolean *out_uploaded,
+                                        GCancellable *cancellable,
+                                        GError **error);
 
 G_END_DECLS
 
@@ -0,0 +1,271 @@
+/*
+ * test-publish-location.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* Publishes to a file:// location in a temporary directory and checks
+ * that unchanged content is not uploaded again. */
+
+#include "evolution-config.h"
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "publish-location.h"
+
+typedef struct _Fixture Fixture;
+
+struct _Fixture {
+	gchar *tmp_dir;
+	gchar *filename;
+	GFile *file;
+	EPublishUri *uri;
+};
+
+static void
+fixture_set_up (Fixture *fixture,
+                gconstpointer user_data)
+{
+	GError *error = NULL;
+
+	fixture->tmp_dir = g_dir_make_tmp ("test-publish-XXXXXX", &error);
+	g_assert_no_error (error);
+
+	fixture->filename = g_build_filename (fixture->tmp_dir, "calendar.ics", NULL);
+	fixture->file = g_file_new_for_path (fixture->filename);
+
+	fixture->uri = g_new0 (EPublishUri, 1);
+	fixture->uri->location = g_file_get_uri (fixture->file);
+}
+
+static void
+fixture_tear_down (Fixture *fixture,
+                   gconstpointer user_data)
+{
+	e_publish_uri_forget_last_digest (fixture->uri);
+	g_free (fixture->uri->location);
+	g_free (fixture->uri);
+
+	g_object_unref (fixture->file);
+	g_unlink (fixture->filename);
+	g_rmdir (fixture->tmp_dir);
+	g_free (fixture->filename);
+	g_free (fixture->tmp_dir);
+}
+
+static gboolean
+fixture_upload (Fixture *fixture,
+                const gchar *content,
+                guint64 changes,
+                GError **error)
+{
+	GInputStream *stream;
+	gchar *digest;
+	gboolean uploaded = FALSE;
+	gboolean success;
+
+	digest = g_compute_checksum_for_string (G_CHECKSUM_SHA256, content, -1);
+	stream = g_memory_input_stream_new_from_data (content, strlen (content), NULL);
+
+	success = e_publish_uri_upload_sync (
+		fixture->uri, fixture->file, stream, digest,
+		changes, &uploaded, NULL, error);
+	g_assert (success || !uploaded);
+
+	g_object_unref (stream);
+	g_free (digest);
+
+	return uploaded;
+}
+
+static void
+fixture_assert_content (Fixture *fixture,
+                        const gchar *expected)
+{
+	gchar *content = NULL;
+	GError *error = NULL;
+
+	g_file_get_contents (fixture->filename, &content, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_cmpstr (content, ==, expected);
+
+	g_free (content);
+}
+
+static void
+test_upload_once (Fixture *fixture,
+                  gconstpointer user_data)
+{
+	GError *error = NULL;
+	guint64 last_changes = 0;
+	gchar *digest;
+
+	g_assert (fixture_upload (fixture, "first", 1, &error));
+	g_assert_no_error (error);
+	fixture_assert_content (fixture, "first");
+
+	/* Whatever is at the location is not overwritten with
+	 * the same content as had been uploaded before. */
+	g_file_set_contents (fixture->filename, "changed by others", -1, &error);
+	g_assert_no_error (error);
+
+	g_assert (!fixture_upload (fixture, "first", 2, &error));
+	g_assert_no_error (error);
+	fixture_assert_content (fixture, "changed by others");
+
+	/* The change count is remembered also when not uploaded. */
+	digest = e_publish_uri_dup_last_digest (fixture->uri, &last_changes, NULL);
+	g_assert (digest != NULL);
+	g_assert_cmpuint (last_changes, ==, 2);
+	g_free (digest);
+
+	g_assert (fixture_upload (fixture, "second", 3, &error));
+	g_assert_no_error (error);
+	fixture_assert_content (fixture, "second");
+}
+
+static void
+test_upload_forget (Fixture *fixture,
+                    gconstpointer user_data)
+{
+	GError *error = NULL;
+	guint64 last_changes = 1;
+	gchar *digest;
+
+	g_assert (fixture_upload (fixture, "content", 1, &error));
+	g_assert_no_error (error);
+
+	e_publish_uri_forget_last_digest (fixture->uri);
+
+	digest = e_publish_uri_dup_last_digest (fixture->uri, &last_changes, NULL);
+	g_assert (digest == NULL);
+	g_assert_cmpuint (last_changes, ==, 0);
+
+	g_file_set_contents (fixture->filename, "changed by others", -1, &error);
+	g_assert_no_error (error);
+
+	g_assert (fixture_upload (fixture, "content", 1, &error));
+	g_assert_no_error (error);
+	fixture_assert_content (fixture, "content");
+}
+
+static void
+test_upload_error (Fixture *fixture,
+                   gconstpointer user_data)
+{
+	GFile *file;
+	gchar *digest;
+	GError *error = NULL;
+
+	/* The location cannot be written into a missing directory. */
+	file = g_file_get_child (fixture->file, "missing");
+	g_object_unref (fixture->file);
+	fixture->file = file;
+
+	g_assert (!fixture_upload (fixture, "content", 1, &error));
+	g_assert (error != NULL);
+	g_clear_error (&error);
+
+	/* Nothing is remembered, thus it is tried again next time. */
+	digest = e_publish_uri_dup_last_digest (fixture->uri, NULL, NULL);
+	g_assert (digest == NULL);
+}
+
+static void
+test_stale_generation (Fixture *fixture,
+                       gconstpointer user_data)
+{
+	guint generation = 0;
+	gchar *digest;
+
+	/* A publish started before the location was edited
+	 * does not store the digest of the old content. */
+	digest = e_publish_uri_dup_last_digest (fixture->uri, NULL, &generation);
+	g_assert (digest == NULL);
+
+	e_publish_uri_forget_last_digest (fixture->uri);
+
+	g_assert (!e_publish_uri_set_last_digest (fixture->uri, generation, "stale", 1));
+	digest = e_publish_uri_dup_last_digest (fixture->uri, NULL, &generation);
+	g_assert (digest == NULL);
+
+	g_assert (e_publish_uri_set_last_digest (fixture->uri, generation, "current", 1));
+	digest = e_publish_uri_dup_last_digest (fixture->uri, NULL, NULL);
+	g_assert_cmpstr (digest, ==, "current");
+	g_free (digest);
+}
+
+static gpointer
+upload_thread (gpointer user_data)
+{
+	Fixture *fixture = user_data;
+	gint ii;
+
+	for (ii = 0; ii < 200; ii++) {
+		GError *error = NULL;
+
+		fixture_upload (fixture, (ii & 1) ? "odd" : "even", ii, &error);
+		g_assert_no_error (error);
+	}
+
+	return NULL;
+}
+
+static void
+test_upload_concurrent (Fixture *fixture,
+                        gconstpointer user_data)
+{
+	GThread *thread;
+	gint ii;
+
+	/* The main thread forgets the digest, like when the location
+	 * is edited, while a publishing thread uploads to it. */
+	thread = g_thread_new ("upload", upload_thread, fixture);
+
+	for (ii = 0; ii < 200; ii++) {
+		gchar *digest;
+
+		e_publish_uri_forget_last_digest (fixture->uri);
+		digest = e_publish_uri_dup_last_digest (fixture->uri, NULL, NULL);
+		g_free (digest);
+	}
+
+	g_thread_join (thread);
+}
+
+gint
+main (gint argc,
+      gchar **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add (
+		"/PublishLocation/UploadOnce", Fixture, NULL,
+		fixture_set_up, test_upload_once, fixture_tear_down);
+	g_test_add (
+		"/PublishLocation/UploadForget", Fixture, NULL,
+		fixture_set_up, test_upload_forget, fixture_tear_down);
+	g_test_add (
+		"/PublishLocation/UploadError", Fixture, NULL,
+		fixture_set_up, test_upload_error, fixture_tear_down);
+	g_test_add (
+		"/PublishLocation/StaleGeneration", Fixture, NULL,
+		fixture_set_up, test_stale_generation, fixture_tear_down);
+	g_test_add (
+		"/PublishLocation/UploadConcurrent", Fixture, NULL,
+		fixture_set_up, test_upload_concurrent, fixture_tear_down);
+
+	return g_test_run ();
+}
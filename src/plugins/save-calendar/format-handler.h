@@ -46,3 +46,25 @@ FormatHandler *ical_format_handler_new (void);
 FormatHandler *rdf_format_handler_new (void);
 
 GOutputStream *open_for_writing (GtkWindow *parent, const gchar *uri, GError **error);
+
+typedef gboolean (* FormatHandlerStreamFunc)	(GOutputStream *stream,
+						 ECalClient *client,
+						 gpointer user_data,
+						 GCancellable *cancellable,
+						 GError **error);
+typedef gboolean (* FormatHandlerWriteFunc)	(GOutputStream *stream,
+						 ECalClient *client,
+						 icalcomponent *icalcomp,
+						 gpointer user_data,
+						 GCancellable *cancellable,
+						 GError **error);
+
+void export_calendar_in_thread (ESourceSelector *selector,
+				EClient *client,
+				GOutputStream *stream,
+				const gchar *dest_uri,
+				FormatHandlerStreamFunc begin_func,
+				FormatHandlerWriteFunc write_func,
+				FormatHandlerStreamFunc end_func,
+				gpointer user_data,
+				GDestroyNotify free_user_data);
@@ -42,10 +42,21 @@ display_error_message (GtkWidget *parent,
 }
 
 typedef struct {
-	GHashTable *zones;
+	GHashTable *zones; /* gchar *tzid ~> icaltimezone * */
 	ECalClient *client;
 } CompTzData;
 
+static void
+comp_tz_data_free (gpointer ptr)
+{
+	CompTzData *tdata = ptr;
+
+	if (tdata) {
+		g_hash_table_destroy (tdata->zones);
+		g_free (tdata);
+	}
+}
+
 static void
 insert_tz_comps (icalparameter *param,
                  gpointer cb_data)
@@ -53,12 +64,11 @@ insert_tz_comps (icalparameter *param,
 	const gchar *tzid;
 	CompTzData *tdata = cb_data;
 	icaltimezone *zone = NULL;
-	icalcomponent *tzcomp;
 	GError *error = NULL;
 
 	tzid = icalparameter_get_tzid (param);
 
-	if (g_hash_table_lookup (tdata->zones, tzid))
+	if (g_hash_table_contains (tdata->zones, tzid))
 		return;
 
 	e_cal_client_get_timezone_sync (
@@ -72,16 +82,91 @@ insert_tz_comps (icalparameter *param,
 		return;
 	}
 
-	tzcomp = icalcomponent_new_clone (icaltimezone_get_component (zone));
-	g_hash_table_insert (tdata->zones, (gpointer) tzid, (gpointer) tzcomp);
+	/* The zone is owned by the client, which outlives the export */
+	g_hash_table_insert (tdata->zones, g_strdup (tzid), zone);
 }
 
-static void
-append_tz_to_comp (gpointer key,
-                   gpointer value,
-                   icalcomponent *toplevel)
+static gboolean
+write_ical_string (GOutputStream *stream,
+                   gchar *str,
+                   GCancellable *cancellable,
+                   GError **error)
+{
+	gboolean success;
+
+	success = g_output_stream_write_all (stream, str, strlen (str), NULL, cancellable, error);
+	g_free (str);
+
+	return success;
+}
+
+static gboolean
+ical_begin (GOutputStream *stream,
+            ECalClient *client,
+            gpointer user_data,
+            GCancellable *cancellable,
+            GError **error)
+{
+	icalcomponent *top_level;
+	icalproperty *prop;
+	gboolean success;
+
+	success = write_ical_string (stream, g_strdup ("BEGIN:VCALENDAR\r\n"), cancellable, error);
+
+	top_level = e_cal_util_new_top_level ();
+
+	for (prop = icalcomponent_get_first_property (top_level, ICAL_ANY_PROPERTY);
+	     prop && success;
+	     prop = icalcomponent_get_next_property (top_level, ICAL_ANY_PROPERTY)) {
+		success = write_ical_string (stream, icalproperty_as_ical_string_r (prop), cancellable, error);
+	}
+
+	icalcomponent_free (top_level);
+
+	return success;
+}
+
+static gboolean
+ical_write (GOutputStream *stream,
+            ECalClient *client,
+            icalcomponent *icalcomp,
+            gpointer user_data,
+            GCancellable *cancellable,
+            GError **error)
+{
+	CompTzData *tdata = user_data;
+
+	icalcomponent_foreach_tzid (icalcomp, insert_tz_comps, tdata);
+
+	return write_ical_string (stream, icalcomponent_as_ical_string_r (icalcomp), cancellable, error);
+}
+
+static gboolean
+ical_end (GOutputStream *stream,
+          ECalClient *client,
+          gpointer user_data,
+          GCancellable *cancellable,
+          GError **error)
 {
-	icalcomponent_add_component (toplevel, (icalcomponent *) value);
+	CompTzData *tdata = user_data;
+	GHashTableIter iter;
+	gpointer value;
+	gboolean success = TRUE;
+
+	/* The time zones follow the components, as they are known
+	 * only after all the components were written. */
+	g_hash_table_iter_init (&iter, tdata->zones);
+	while (success && g_hash_table_iter_next (&iter, NULL, &value)) {
+		success = write_ical_string (
+			stream, icalcomponent_as_ical_string_r (
+			icaltimezone_get_component (value)),
+			cancellable, error);
+	}
+
+	if (success)
+		success = write_ical_string (stream, g_strdup ("END:VCALENDAR\r\n"), cancellable, error);
+
+	return success;
 }
 
 static void
@@ -92,9 +177,9 @@ do_save_calendar_ical (FormatHandler *handler,
 {
 	ESource *primary_source;
 	EClient *source_client;
+	GOutputStream *stream;
+	CompTzData *tdata;
 	GError *error = NULL;
-	GSList *objects = NULL;
-	icalcomponent *top_level = NULL;
 
 	if (!dest_uri)
 		return;
@@ -119,57 +204,29 @@ do_save_calendar_ical (FormatHandler *handler,
 	}
 
 	/* create destination file */
-	top_level = e_cal_util_new_top_level ();
-
-	e_cal_client_get_object_list_sync (
-		E_CAL_CLIENT (source_client), "#t", &objects, NULL, &error);
-
-	if (objects != NULL) {
-		CompTzData tdata;
-		GOutputStream *stream;
-		GSList *iter;
-
-		tdata.zones = g_hash_table_new (g_str_hash, g_str_equal);
-		tdata.client = E_CAL_CLIENT (source_client);
-
-		for (iter = objects; iter; iter = iter->next) {
-			icalcomponent *icalcomp = icalcomponent_new_clone (iter->data);
-
-			icalcomponent_foreach_tzid (icalcomp, insert_tz_comps, &tdata);
-			icalcomponent_add_component (top_level, icalcomp);
-		}
-
-		g_hash_table_foreach (tdata.zones, (GHFunc) append_tz_to_comp, top_level);
-
-		g_hash_table_destroy (tdata.zones);
-		tdata.zones = NULL;
-
-		/* save the file */
-		stream = open_for_writing (GTK_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (selector))), dest_uri, &error);
-
-		if (stream) {
-			gchar *ical_str = icalcomponent_as_ical_string_r (top_level);
-
-			g_output_stream_write_all (stream, ical_str, strlen (ical_str), NULL, NULL, &error);
-			g_output_stream_close (stream, NULL, NULL);
-
-			g_object_unref (stream);
-			g_free (ical_str);
+	stream = open_for_writing (GTK_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (selector))), dest_uri, &error);
+
+	if (!stream) {
+		if (error != NULL) {
+			display_error_message (
+				gtk_widget_get_toplevel (GTK_WIDGET (selector)),
+				error->message);
+			g_error_free (error);
 		}
 
-		e_cal_client_free_icalcomp_slist (objects);
+		g_object_unref (source_client);
+		return;
 	}
 
-	if (error != NULL) {
-		display_error_message (
-			gtk_widget_get_toplevel (GTK_WIDGET (selector)),
-			error->message);
-		g_error_free (error);
-	}
+	tdata = g_new0 (CompTzData, 1);
+	tdata->zones = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	tdata->client = E_CAL_CLIENT (source_client);
 
-	/* terminate */
-	g_object_unref (source_client);
-	icalcomponent_free (top_level);
+	/* save the file */
+	export_calendar_in_thread (
+		selector, source_client, stream, dest_uri,
+		ical_begin, ical_write, ical_end,
+		tdata, comp_tz_data_free);
 }
 
 FormatHandler *
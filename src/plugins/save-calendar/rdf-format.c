@@ -168,210 +168,300 @@ add_string_to_rdf (xmlNodePtr node,
 	}
 }
 
+typedef struct _RdfData {
+	xmlDocPtr doc;
+	xmlNodePtr fnode;
+	xmlBufferPtr buffer;
+	gchar *source_uid;
+	gchar *source_display_name;
+} RdfData;
+
 static void
-do_save_calendar_rdf (FormatHandler *handler,
-                      ESourceSelector *selector,
-		      EClientCache *client_cache,
-                      gchar *dest_uri)
+rdf_data_free (gpointer ptr)
 {
+	RdfData *rdata = ptr;
+
+	if (rdata) {
+		xmlBufferFree (rdata->buffer);
+		xmlFreeDoc (rdata->doc);
+		g_free (rdata->source_uid);
+		g_free (rdata->source_display_name);
+		g_free (rdata);
+	}
+}
 
-	/*
-	 * According to some documentation about CSV, newlines 'are' allowed
-	 * in CSV-files. But you 'do' have to put the value between quotes.
-	 * The helper 'string_needsquotes' will check for that
-	 *
-	 * http://www.creativyst.com/Doc/Articles/CSV/CSV01.htm
-	 * http://www.creativyst.com/cgi-bin/Prod/15/eg/csv2xml.pl
-	 */
-
-	ESource *primary_source;
-	EClient *source_client;
-	GError *error = NULL;
-	GSList *objects = NULL;
-	gchar *temp = NULL;
-	GOutputStream *stream;
+/* Writes the node as if it was dumped as a child of the Vcalendar node
+ * of the whole document, which is never built; only the header and the
+ * currently written component are in the memory at any time. */
+static gboolean
+rdf_write_node (GOutputStream *stream,
+                RdfData *rdata,
+                xmlNodePtr node,
+                GCancellable *cancellable,
+                GError **error)
+{
+	gboolean success;
 
-	if (!dest_uri)
-		return;
+	xmlBufferEmpty (rdata->buffer);
+	xmlNodeDump (rdata->buffer, rdata->doc, node, 2, 1);
 
-	/* open source client */
-	primary_source = e_source_selector_ref_primary_selection (selector);
-	source_client = e_client_cache_get_client_sync (client_cache,
-		primary_source, e_source_selector_get_extension_name (selector), 30, NULL, &error);
-	g_object_unref (primary_source);
+	success = g_output_stream_write_all (stream, "\n    ", 5, NULL, cancellable, error) &&
+		g_output_stream_write_all (
+			stream, xmlBufferContent (rdata->buffer),
+			xmlBufferLength (rdata->buffer), NULL, cancellable, error);
 
-	/* Sanity check. */
-	g_return_if_fail (
-		((source_client != NULL) && (error == NULL)) ||
-		((source_client == NULL) && (error != NULL)));
+	return success;
+}
 
-	if (source_client == NULL) {
-		display_error_message (
-			gtk_widget_get_toplevel (GTK_WIDGET (selector)),
-			error->message);
-		g_error_free (error);
-		return;
-	}
+static gboolean
+rdf_begin (GOutputStream *stream,
+           ECalClient *client,
+           gpointer user_data,
+           GCancellable *cancellable,
+           GError **error)
+{
+	RdfData *rdata = user_data;
+	xmlNodePtr node;
+	gchar *temp = NULL;
+	const gchar *header =
+		"<rdf:RDF xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\" xmlns=\"http://www.w3.org/2002/12/cal/ical#\">\n"
+		"  <Vcalendar xmlns:x-wr=\"http://www.w3.org/2002/12/cal/prod/Apple_Comp_628d9d8459c556fa#\" xmlns:x-lic=\"http://www.w3.org/2002/12/cal/prod/Apple_Comp_628d9d8459c556fa#\">";
 
-	stream = open_for_writing (GTK_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (selector))), dest_uri, &error);
+	rdata->doc = xmlNewDoc ((xmlChar *) "1.0");
+	rdata->buffer = xmlBufferCreate ();
 
-	if (stream && e_cal_client_get_object_list_as_comps_sync (E_CAL_CLIENT (source_client), "#t", &objects, NULL, NULL)) {
-		GSList *iter;
+	rdata->doc->children = xmlNewDocNode (rdata->doc, NULL, (const guchar *)"rdf:RDF", NULL);
+	xmlSetProp (rdata->doc->children, (const guchar *)"xmlns:rdf", (const guchar *)"http://www.w3.org/1999/02/22-rdf-syntax-ns#");
+	xmlSetProp (rdata->doc->children, (const guchar *)"xmlns", (const guchar *)"http://www.w3.org/2002/12/cal/ical#");
 
-		xmlBufferPtr buffer = xmlBufferCreate ();
-		xmlDocPtr doc = xmlNewDoc ((xmlChar *) "1.0");
-		xmlNodePtr fnode;
+	rdata->fnode = xmlNewChild (rdata->doc->children, NULL, (const guchar *)"Vcalendar", NULL);
 
-		doc->children = xmlNewDocNode (doc, NULL, (const guchar *)"rdf:RDF", NULL);
-		xmlSetProp (doc->children, (const guchar *)"xmlns:rdf", (const guchar *)"http://www.w3.org/1999/02/22-rdf-syntax-ns#");
-		xmlSetProp (doc->children, (const guchar *)"xmlns", (const guchar *)"http://www.w3.org/2002/12/cal/ical#");
+	/* Should Evolution publicise these? */
+	xmlSetProp (rdata->fnode, (const guchar *)"xmlns:x-wr", (const guchar *)"http://www.w3.org/2002/12/cal/prod/Apple_Comp_628d9d8459c556fa#");
+	xmlSetProp (rdata->fnode, (const guchar *)"xmlns:x-lic", (const guchar *)"http://www.w3.org/2002/12/cal/prod/Apple_Comp_628d9d8459c556fa#");
 
-		fnode = xmlNewChild (doc->children, NULL, (const guchar *)"Vcalendar", NULL);
+	/* Not sure if it's correct like this */
+	xmlNewChild (rdata->fnode, NULL, (const guchar *)"prodid", (const guchar *)"-//" PACKAGE " " VERSION VERSION_SUBSTRING " " VERSION_COMMENT "//iCal 1.0//EN");
 
-		/* Should Evolution publicise these? */
-		xmlSetProp (fnode, (const guchar *)"xmlns:x-wr", (const guchar *)"http://www.w3.org/2002/12/cal/prod/Apple_Comp_628d9d8459c556fa#");
-		xmlSetProp (fnode, (const guchar *)"xmlns:x-lic", (const guchar *)"http://www.w3.org/2002/12/cal/prod/Apple_Comp_628d9d8459c556fa#");
+	/* Assuming GREGORIAN is the only supported calendar scale */
+	xmlNewChild (rdata->fnode, NULL, (const guchar *)"calscale", (const guchar *)"GREGORIAN");
 
-		/* Not sure if it's correct like this */
-		xmlNewChild (fnode, NULL, (const guchar *)"prodid", (const guchar *)"-//" PACKAGE " " VERSION VERSION_SUBSTRING " " VERSION_COMMENT "//iCal 1.0//EN");
+	temp = calendar_config_get_timezone ();
+	xmlNewChild (rdata->fnode, NULL, (const guchar *)"x-wr:timezone", (guchar *) temp);
+	g_free (temp);
 
-		/* Assuming GREGORIAN is the only supported calendar scale */
-		xmlNewChild (fnode, NULL, (const guchar *)"calscale", (const guchar *)"GREGORIAN");
+	xmlNewChild (rdata->fnode, NULL, (const guchar *)"method", (const guchar *)"PUBLISH");
 
-		temp = calendar_config_get_timezone ();
-		xmlNewChild (fnode, NULL, (const guchar *)"x-wr:timezone", (guchar *) temp);
-		g_free (temp);
+	xmlNewChild (rdata->fnode, NULL, (const guchar *)"x-wr:relcalid", (guchar *) rdata->source_uid);
 
-		xmlNewChild (fnode, NULL, (const guchar *)"method", (const guchar *)"PUBLISH");
+	xmlNewChild (rdata->fnode, NULL, (const guchar *)"x-wr:calname", (guchar *) rdata->source_display_name);
 
-		xmlNewChild (fnode, NULL, (const guchar *)"x-wr:relcalid", (guchar *) e_source_get_uid (primary_source));
+	/* Version of this RDF-format */
+	xmlNewChild (rdata->fnode, NULL, (const guchar *)"version", (const guchar *)"2.0");
 
-		xmlNewChild (fnode, NULL, (const guchar *)"x-wr:calname", (guchar *) e_source_get_display_name (primary_source));
+	if (!g_output_stream_write_all (stream, header, strlen (header), NULL, cancellable, error))
+		return FALSE;
 
-		/* Version of this RDF-format */
-		xmlNewChild (fnode, NULL, (const guchar *)"version", (const guchar *)"2.0");
+	for (node = rdata->fnode->children; node; node = node->next) {
+		if (!rdf_write_node (stream, rdata, node, cancellable, error))
+			return FALSE;
+	}
 
-		for (iter = objects; iter; iter = iter->next) {
-			ECalComponent *comp = iter->data;
-			const gchar *temp_constchar;
-			gchar *tmp_str = NULL;
-			GSList *temp_list;
-			ECalComponentDateTime temp_dt;
-			struct icaltimetype *temp_time;
-			gint *temp_int;
-			ECalComponentText temp_comptext;
-			xmlNodePtr c_node = xmlNewChild (fnode, NULL, (const guchar *)"component", NULL);
-			xmlNodePtr node = xmlNewChild (c_node, NULL, (const guchar *)"Vevent", NULL);
+	return TRUE;
+}
 
-			/* Getting the stuff */
-			e_cal_component_get_uid (comp, &temp_constchar);
-			tmp_str = g_strdup_printf ("#%s", temp_constchar);
-			xmlSetProp (node, (const guchar *)"about", (guchar *) tmp_str);
-			g_free (tmp_str);
-			add_string_to_rdf (node, "uid",temp_constchar);
+static gboolean
+rdf_write (GOutputStream *stream,
+           ECalClient *client,
+           icalcomponent *icalcomp,
+           gpointer user_data,
+           GCancellable *cancellable,
+           GError **error)
+{
+	RdfData *rdata = user_data;
+	ECalComponent *comp;
+	const gchar *temp_constchar;
+	gchar *tmp_str = NULL;
+	GSList *temp_list;
+	ECalComponentDateTime temp_dt;
+	struct icaltimetype *temp_time;
+	gint *temp_int;
+	ECalComponentText temp_comptext;
+	xmlNodePtr c_node, node;
+	gboolean success;
+
+	comp = e_cal_component_new_from_icalcomponent (icalcomponent_new_clone (icalcomp));
+	if (!comp)
+		return TRUE;
+
+	c_node = xmlNewChild (rdata->fnode, NULL, (const guchar *)"component", NULL);
+	node = xmlNewChild (c_node, NULL, (const guchar *)"Vevent", NULL);
+
+	/* Getting the stuff */
+	e_cal_component_get_uid (comp, &temp_constchar);
+	tmp_str = g_strdup_printf ("#%s", temp_constchar);
+	xmlSetProp (node, (const guchar *)"about", (guchar *) tmp_str);
+	g_free (tmp_str);
+	add_string_to_rdf (node, "uid",temp_constchar);
+
+	e_cal_component_get_summary (comp, &temp_comptext);
+	add_string_to_rdf (node, "summary", temp_comptext.value);
+
+	e_cal_component_get_description_list (comp, &temp_list);
+	add_list_to_rdf (node, "description", temp_list, ECALCOMPONENTTEXT);
+	if (temp_list)
+		e_cal_component_free_text_list (temp_list);
+
+	e_cal_component_get_categories_list (comp, &temp_list);
+	add_list_to_rdf (node, "categories", temp_list, CONSTCHAR);
+	if (temp_list)
+		e_cal_component_free_categories_list (temp_list);
+
+	e_cal_component_get_comment_list (comp, &temp_list);
+	add_list_to_rdf (node, "comment", temp_list, ECALCOMPONENTTEXT);
+
+	if (temp_list)
+		e_cal_component_free_text_list (temp_list);
+
+	e_cal_component_get_completed (comp, &temp_time);
+	add_time_to_rdf (node, "completed", temp_time);
+	if (temp_time)
+		e_cal_component_free_icaltimetype (temp_time);
+
+	e_cal_component_get_created (comp, &temp_time);
+	add_time_to_rdf (node, "created", temp_time);
+	if (temp_time)
+		e_cal_component_free_icaltimetype (temp_time);
+
+	e_cal_component_get_contact_list (comp, &temp_list);
+	add_list_to_rdf (node, "contact", temp_list, ECALCOMPONENTTEXT);
+	if (temp_list)
+		e_cal_component_free_text_list (temp_list);
+
+	e_cal_component_get_dtstart (comp, &temp_dt);
+	add_time_to_rdf (node, "dtstart", temp_dt.value ? temp_dt.value : NULL);
+	e_cal_component_free_datetime (&temp_dt);
+
+	e_cal_component_get_dtend (comp, &temp_dt);
+	add_time_to_rdf (node, "dtend", temp_dt.value ? temp_dt.value : NULL);
+	e_cal_component_free_datetime (&temp_dt);
+
+	e_cal_component_get_due (comp, &temp_dt);
+	add_time_to_rdf (node, "due", temp_dt.value ? temp_dt.value : NULL);
+	e_cal_component_free_datetime (&temp_dt);
+
+	e_cal_component_get_percent (comp, &temp_int);
+	add_nummeric_to_rdf (node, "percentComplete", temp_int);
+
+	e_cal_component_get_priority (comp, &temp_int);
+	add_nummeric_to_rdf (node, "priority", temp_int);
+
+	e_cal_component_get_url (comp, &temp_constchar);
+	add_string_to_rdf (node, "URL", temp_constchar);
+
+	if (e_cal_component_has_attendees (comp)) {
+		e_cal_component_get_attendee_list (comp, &temp_list);
+		add_list_to_rdf (node, "attendee", temp_list, ECALCOMPONENTATTENDEE);
+		if (temp_list)
+			e_cal_component_free_attendee_list (temp_list);
+	}
 
-			e_cal_component_get_summary (comp, &temp_comptext);
-			add_string_to_rdf (node, "summary", temp_comptext.value);
+	e_cal_component_get_location (comp, &temp_constchar);
+	add_string_to_rdf (node, "location", temp_constchar);
 
-			e_cal_component_get_description_list (comp, &temp_list);
-			add_list_to_rdf (node, "description", temp_list, ECALCOMPONENTTEXT);
-			if (temp_list)
-				e_cal_component_free_text_list (temp_list);
+	e_cal_component_get_last_modified (comp, &temp_time);
+	add_time_to_rdf (node, "lastModified",temp_time);
 
-			e_cal_component_get_categories_list (comp, &temp_list);
-			add_list_to_rdf (node, "categories", temp_list, CONSTCHAR);
-			if (temp_list)
-				e_cal_component_free_categories_list (temp_list);
+	/* Important note!
+	 * The documentation is not requiring this!
+	 *
+	 * if (temp_time) e_cal_component_free_icaltimetype (temp_time);
+	 *
+	 * Please uncomment and fix documentation if untrue
+	 * http://www.gnome.org/projects/evolution/developer-doc/libecal/ECalComponent.html
+	 *	#e-cal-component-get-last-modified
+	 */
 
-			e_cal_component_get_comment_list (comp, &temp_list);
-			add_list_to_rdf (node, "comment", temp_list, ECALCOMPONENTTEXT);
+	success = rdf_write_node (stream, rdata, c_node, cancellable, error);
 
-			if (temp_list)
-				e_cal_component_free_text_list (temp_list);
+	xmlUnlinkNode (c_node);
+	xmlFreeNode (c_node);
+	g_object_unref (comp);
 
-			e_cal_component_get_completed (comp, &temp_time);
-			add_time_to_rdf (node, "completed", temp_time);
-			if (temp_time)
-				e_cal_component_free_icaltimetype (temp_time);
+	return success;
+}
 
-			e_cal_component_get_created (comp, &temp_time);
-			add_time_to_rdf (node, "created", temp_time);
-			if (temp_time)
-				e_cal_component_free_icaltimetype (temp_time);
+static gboolean
+rdf_end (GOutputStream *stream,
+         ECalClient *client,
+         gpointer user_data,
+         GCancellable *cancellable,
+         GError **error)
+{
+	const gchar *footer = "\n  </Vcalendar>\n</rdf:RDF>";
 
-			e_cal_component_get_contact_list (comp, &temp_list);
-			add_list_to_rdf (node, "contact", temp_list, ECALCOMPONENTTEXT);
-			if (temp_list)
-				e_cal_component_free_text_list (temp_list);
+	return g_output_stream_write_all (stream, footer, strlen (footer), NULL, cancellable, error);
+}
 
-			e_cal_component_get_dtstart (comp, &temp_dt);
-			add_time_to_rdf (node, "dtstart", temp_dt.value ? temp_dt.value : NULL);
-			e_cal_component_free_datetime (&temp_dt);
+static void
+do_save_calendar_rdf (FormatHandler *handler,
+                      ESourceSelector *selector,
+		      EClientCache *client_cache,
+                      gchar *dest_uri)
+{
+	ESource *primary_source;
+	EClient *source_client;
+	GError *error = NULL;
+	GOutputStream *stream;
+	RdfData *rdata;
 
-			e_cal_component_get_dtend (comp, &temp_dt);
-			add_time_to_rdf (node, "dtend", temp_dt.value ? temp_dt.value : NULL);
-			e_cal_component_free_datetime (&temp_dt);
+	if (!dest_uri)
+		return;
 
-			e_cal_component_get_due (comp, &temp_dt);
-			add_time_to_rdf (node, "due", temp_dt.value ? temp_dt.value : NULL);
-			e_cal_component_free_datetime (&temp_dt);
+	/* open source client */
+	primary_source = e_source_selector_ref_primary_selection (selector);
+	source_client = e_client_cache_get_client_sync (client_cache,
+		primary_source, e_source_selector_get_extension_name (selector), 30, NULL, &error);
 
-			e_cal_component_get_percent (comp, &temp_int);
-			add_nummeric_to_rdf (node, "percentComplete", temp_int);
-
-			e_cal_component_get_priority (comp, &temp_int);
-			add_nummeric_to_rdf (node, "priority", temp_int);
+	/* Sanity check. */
+	g_return_if_fail (
+		((source_client != NULL) && (error == NULL)) ||
+		((source_client == NULL) && (error != NULL)));
 
-			e_cal_component_get_url (comp, &temp_constchar);
-			add_string_to_rdf (node, "URL", temp_constchar);
+	if (source_client == NULL) {
+		display_error_message (
+			gtk_widget_get_toplevel (GTK_WIDGET (selector)),
+			error->message);
+		g_error_free (error);
+		g_object_unref (primary_source);
+		return;
+	}
 
-			if (e_cal_component_has_attendees (comp)) {
-				e_cal_component_get_attendee_list (comp, &temp_list);
-				add_list_to_rdf (node, "attendee", temp_list, ECALCOMPONENTATTENDEE);
-				if (temp_list)
-					e_cal_component_free_attendee_list (temp_list);
-			}
+	stream = open_for_writing (GTK_WINDOW (gtk_widget_get_toplevel (GTK_WIDGET (selector))), dest_uri, &error);
 
-			e_cal_component_get_location (comp, &temp_constchar);
-			add_string_to_rdf (node, "location", temp_constchar);
-
-			e_cal_component_get_last_modified (comp, &temp_time);
-			add_time_to_rdf (node, "lastModified",temp_time);
-
-			/* Important note!
-			 * The documentation is not requiring this!
-			 *
-			 * if (temp_time) e_cal_component_free_icaltimetype (temp_time);
-			 *
-			 * Please uncomment and fix documentation if untrue
-			 * http://www.gnome.org/projects/evolution/developer-doc/libecal/ECalComponent.html
-			 *	#e-cal-component-get-last-modified
-			 */
+	if (!stream) {
+		if (error != NULL) {
+			display_error_message (
+				gtk_widget_get_toplevel (GTK_WIDGET (selector)),
+				error->message);
+			g_error_free (error);
 		}
 
-		/* I used a buffer rather than xmlDocDump: I want gio support */
-		xmlNodeDump (buffer, doc, doc->children, 2, 1);
-
-		g_output_stream_write_all (stream, xmlBufferContent (buffer), xmlBufferLength (buffer), NULL, NULL, &error);
-		g_output_stream_close (stream, NULL, NULL);
-
-		e_cal_client_free_ecalcomp_slist (objects);
-
-		xmlBufferFree (buffer);
-		xmlFreeDoc (doc);
+		g_object_unref (source_client);
+		g_object_unref (primary_source);
+		return;
 	}
 
-	if (stream)
-		g_object_unref (stream);
+	rdata = g_new0 (RdfData, 1);
+	rdata->source_uid = g_strdup (e_source_get_uid (primary_source));
+	rdata->source_display_name = e_source_dup_display_name (primary_source);
 
-	g_object_unref (source_client);
+	g_object_unref (primary_source);
 
-	if (error != NULL) {
-		display_error_message (
-			gtk_widget_get_toplevel (GTK_WIDGET (selector)),
-			error->message);
-		g_error_free (error);
-	}
+	export_calendar_in_thread (
+		selector, source_client, stream, dest_uri,
+		rdf_begin, rdf_write, rdf_end,
+		rdata, rdf_data_free);
 }
 
 FormatHandler *
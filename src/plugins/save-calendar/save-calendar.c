@@ -292,6 +292,245 @@ open_for_writing (GtkWindow *parent,
 	return NULL;
 }
 
+/* How often, in components, the progress message is updated */
+#define EXPORT_PROGRESS_STEP 100
+
+typedef struct _ExportData {
+	ECalClient *client;
+	GOutputStream *stream;
+	gchar *dest_uri;
+
+	FormatHandlerStreamFunc begin_func;
+	FormatHandlerWriteFunc write_func;
+	FormatHandlerStreamFunc end_func;
+	gpointer user_data;
+	GDestroyNotify free_user_data;
+
+	GCancellable *cancellable;
+	guint n_written;
+	gboolean message_pushed;
+	gboolean done;
+	GError *error;
+} ExportData;
+
+static void
+export_data_free (gpointer ptr)
+{
+	ExportData *ed = ptr;
+
+	if (ed) {
+		if (ed->free_user_data)
+			ed->free_user_data (ed->user_data);
+
+		g_clear_object (&ed->client);
+		g_clear_object (&ed->stream);
+		g_clear_error (&ed->error);
+		g_free (ed->dest_uri);
+		g_free (ed);
+	}
+}
+
+static void
+export_objects_added_cb (ECalClientView *view,
+                         const GSList *objects,
+                         ExportData *ed)
+{
+	const GSList *link;
+
+	if (ed->done)
+		return;
+
+	for (link = objects; link; link = g_slist_next (link)) {
+		if (!ed->write_func (ed->stream, ed->client, link->data, ed->user_data, ed->cancellable, &ed->error)) {
+			ed->done = TRUE;
+			return;
+		}
+
+		ed->n_written++;
+
+		if ((ed->n_written % EXPORT_PROGRESS_STEP) == 0) {
+			if (ed->message_pushed)
+				camel_operation_pop_message (ed->cancellable);
+
+			camel_operation_push_message (
+				ed->cancellable,
+				ngettext ("Saved %d item", "Saved %d items", ed->n_written),
+				ed->n_written);
+
+			ed->message_pushed = TRUE;
+		}
+	}
+}
+
+static void
+export_complete_cb (ECalClientView *view,
+                    const GError *error,
+                    ExportData *ed)
+{
+	if (error && !ed->error)
+		ed->error = g_error_copy (error);
+
+	ed->done = TRUE;
+}
+
+static void
+export_cancelled_cb (GCancellable *cancellable,
+                     GMainContext *main_context)
+{
+	g_main_context_wakeup (main_context);
+}
+
+/* The components are received from a view in batches and each is written
+ * as it arrives, thus the whole calendar is never held in memory. */
+static void
+export_calendar_thread (EAlertSinkThreadJobData *job_data,
+                        gpointer user_data,
+                        GCancellable *cancellable,
+                        GError **error)
+{
+	ExportData *ed = user_data;
+	ECalClientView *view = NULL;
+	GMainContext *main_context;
+	gulong cancelled_id = 0;
+	gboolean success = FALSE;
+
+	ed->cancellable = cancellable;
+
+	/* The view emits its signals in the thread-default main context */
+	main_context = g_main_context_new ();
+	g_main_context_push_thread_default (main_context);
+
+	if (ed->begin_func && !ed->begin_func (ed->stream, ed->client, ed->user_data, cancellable, error))
+		goto exit;
+
+	if (!e_cal_client_get_view_sync (ed->client, "#t", &view, cancellable, error))
+		goto exit;
+
+	g_signal_connect (
+		view, "objects-added",
+		G_CALLBACK (export_objects_added_cb), ed);
+	g_signal_connect (
+		view, "complete",
+		G_CALLBACK (export_complete_cb), ed);
+
+	if (cancellable)
+		cancelled_id = g_cancellable_connect (
+			cancellable, G_CALLBACK (export_cancelled_cb),
+			main_context, NULL);
+
+	e_cal_client_view_start (view, &ed->error);
+	if (ed->error)
+		ed->done = TRUE;
+
+	while (!ed->done && !g_cancellable_is_cancelled (cancellable))
+		g_main_context_iteration (main_context, TRUE);
+
+	if (cancelled_id)
+		g_cancellable_disconnect (cancellable, cancelled_id);
+
+	g_signal_handlers_disconnect_matched (view, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, ed);
+	e_cal_client_view_stop (view, NULL);
+
+	if (ed->message_pushed) {
+		camel_operation_pop_message (cancellable);
+		ed->message_pushed = FALSE;
+	}
+
+	if (ed->error) {
+		g_propagate_error (error, ed->error);
+		ed->error = NULL;
+		goto exit;
+	}
+
+	if (g_cancellable_set_error_if_cancelled (cancellable, error))
+		goto exit;
+
+	if (ed->end_func && !ed->end_func (ed->stream, ed->client, ed->user_data, cancellable, error))
+		goto exit;
+
+	success = g_output_stream_close (ed->stream, cancellable, error);
+
+ exit:
+	if (!success) {
+		GFile *file;
+
+		/* Do not leave a truncated file behind */
+		g_output_stream_close (ed->stream, NULL, NULL);
+
+		file = g_file_new_for_uri (ed->dest_uri);
+		g_file_delete (file, NULL, NULL);
+		g_object_unref (file);
+	}
+
+	g_clear_object (&view);
+
+	g_main_context_pop_thread_default (main_context);
+	g_main_context_unref (main_context);
+
+	ed->cancellable = NULL;
+}
+
+/* Takes ownership of the @client, the @stream and the @user_data.
+ * The export runs in a dedicated thread, with its progress shown
+ * in the shell view and with a possibility to cancel it. */
+void
+export_calendar_in_thread (ESourceSelector *selector,
+                           EClient *client,
+                           GOutputStream *stream,
+                           const gchar *dest_uri,
+                           FormatHandlerStreamFunc begin_func,
+                           FormatHandlerWriteFunc write_func,
+                           FormatHandlerStreamFunc end_func,
+                           gpointer user_data,
+                           GDestroyNotify free_user_data)
+{
+	GtkWidget *shell_sidebar;
+	EActivity *activity;
+	ExportData *ed;
+	gchar *display_name;
+
+	g_return_if_fail (E_IS_SOURCE_SELECTOR (selector));
+	g_return_if_fail (E_IS_CAL_CLIENT (client));
+	g_return_if_fail (G_IS_OUTPUT_STREAM (stream));
+	g_return_if_fail (dest_uri != NULL);
+	g_return_if_fail (write_func != NULL);
+
+	ed = g_new0 (ExportData, 1);
+	ed->client = E_CAL_CLIENT (client);
+	ed->stream = stream;
+	ed->dest_uri = g_strdup (dest_uri);
+	ed->begin_func = begin_func;
+	ed->write_func = write_func;
+	ed->end_func = end_func;
+	ed->user_data = user_data;
+	ed->free_user_data = free_user_data;
+
+	shell_sidebar = gtk_widget_get_ancestor (GTK_WIDGET (selector), E_TYPE_SHELL_SIDEBAR);
+	if (!shell_sidebar) {
+		g_warn_if_reached ();
+		export_data_free (ed);
+		return;
+	}
+
+	display_name = g_filename_display_basename (dest_uri);
+
+	activity = e_alert_sink_submit_thread_job (
+		E_ALERT_SINK (shell_sidebar),
+		_("Saving calendar data..."),
+		"system:no-save-file", display_name,
+		export_calendar_thread, ed, export_data_free);
+
+	if (activity) {
+		EShellView *shell_view;
+
+		shell_view = e_shell_sidebar_get_shell_view (E_SHELL_SIDEBAR (shell_sidebar));
+		e_shell_backend_add_activity (e_shell_view_get_shell_backend (shell_view), activity);
+		g_object_unref (activity);
+	}
+
+	g_free (display_name);
+}
+
 static void
 save_general (EShellView *shell_view)
 {